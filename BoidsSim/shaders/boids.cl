@@ -1,78 +1,146 @@
-__kernel void simulate(__global float2* positions,
-                       __global float2* velocities,
-                       __global float2* accelerations,
-                       const float dt,
-                       const float separation_radius,
-                       const float alignment_radius,
-                       const float cohesion_radius,
-                       const float max_speed,
-                       const float max_force,
-                       const float bounceFactor,
-                       float4 bounds) 
+// State layout of the boid positions and velocities, selected at build
+// time. The buffers have the same size in every layout:
+//   LAYOUT_AOS    interleaved float2 per boid
+//   LAYOUT_SOA    one plane of x and one plane of y components
+//   LAYOUT_AOSOA  blocks of AOSOA_WIDTH boids holding one vector per component
+// Every work-item accesses its own element, a single vector load or store
+// only in AoS. In SoA and AoSoA the components are scalar accesses,
+// contiguous with the same component of the neighbouring work-items, and
+// the all-pairs loop reads 4 boids per component with load_lanes4.
+// The step kernels run one work-item per boid, so their element count is
+// get_global_size(0). The accelerations are only read and written by the
+// boid's own work-item and always stay float2.
+#if !defined(LAYOUT_SOA) && !defined(LAYOUT_AOSOA) && !defined(LAYOUT_AOS)
+#define LAYOUT_AOS
+#endif
+
+#ifndef AOSOA_WIDTH
+#define AOSOA_WIDTH 4
+#endif
+
+// Float index of component c of element i among n elements of the given width
+inline int element_index(int i, int c, int n, int components)
 {
-    int i = get_global_id(0);
-    int NumBoids = get_global_size(0);
+#if defined(LAYOUT_SOA)
+    return c * n + i;
+#elif defined(LAYOUT_AOSOA)
+    return (i / AOSOA_WIDTH) * components * AOSOA_WIDTH + c * AOSOA_WIDTH + i % AOSOA_WIDTH;
+#else
+    return i * components + c;
+#endif
+}
 
-    // Read current position and velocity
-    float2 pos = positions[i];
-    float2 vel = velocities[i];
-    float2 acc = accelerations[i];
+inline float2 load_float2(__global const float* data, int i, int n)
+{
+#if defined(LAYOUT_AOS)
+    return vload2(i, data);
+#else
+    return (float2)(data[element_index(i, 0, n, 2)], data[element_index(i, 1, n, 2)]);
+#endif
+}
 
-    // Behavior calculations
-    float2 separation   = (float2)(0.0f, 0.0f);
-    float2 alignment    = (float2)(0.0f, 0.0f);
-    float2 cohesion     = (float2)(0.0f, 0.0f);
+inline void store_float2(__global float* data, int i, int n, float2 value)
+{
+#if defined(LAYOUT_AOS)
+    vstore2(value, i, data);
+#else
+    data[element_index(i, 0, n, 2)] = value.x;
+    data[element_index(i, 1, n, 2)] = value.y;
+#endif
+}
 
-    int separation_count = 0;
-    int alignment_count = 0;
-    int cohesion_count = 0;
+#if !defined(LAYOUT_AOS)
+#if AOSOA_WIDTH % 4 != 0
+#error AOSOA_WIDTH must be a multiple of 4 for the lane loads
+#endif
 
-    // Iterate through all other boids for behaviors
-    for (int j = 0; j < get_global_size(0); j++) 
-    {
-        if (i == j) 
-            continue;  // Skip self
+// Component c of the 4 elements j .. j + 3, j a multiple of 4, as a single
+// vector load: the lanes are contiguous within an SoA plane or AoSoA block.
+// Lanes past n hold padding or the next plane and must be masked by the caller.
+inline float4 load_lanes4(__global const float* data, int j, int c, int n, int components)
+{
+    return vload4(0, data + element_index(j, c, n, components));
+}
+#endif
 
-        // Get position of other boid
-        float2 other_pos = positions[j];
-        float2 diff = other_pos - pos;
-        float distance = length(diff);
+// Running sums of the three flocking rules over the neighbours of a boid
+typedef struct
+{
+    float2 separation;
+    float2 alignment;
+    float2 cohesion;
 
-        // Separation: Avoid other boids within separation radius
-        if (distance < separation_radius)
-        {
-            float forceStrength = 1.0f / (distance * distance);
-            separation += normalize(diff) * forceStrength;
-            separation_count++;
-        }
+    int separation_count;
+    int alignment_count;
+    int cohesion_count;
+} Flock;
 
-        // Alignment: Align with nearby boids within alignment radius
-        if (distance < alignment_radius)
-        {
-            alignment += velocities[j];
-            alignment_count++;
-        }
+inline Flock empty_flock()
+{
+    Flock flock;
+    flock.separation = (float2)(0.0f, 0.0f);
+    flock.alignment = (float2)(0.0f, 0.0f);
+    flock.cohesion = (float2)(0.0f, 0.0f);
+    flock.separation_count = 0;
+    flock.alignment_count = 0;
+    flock.cohesion_count = 0;
+    return flock;
+}
 
-        // Cohesion: Move towards the average position of nearby boids
-        if (distance < cohesion_radius)
-        {
-            cohesion += other_pos;
-            cohesion_count++;
-        }
+// Adds one other boid to the rules whose radius it falls within
+inline void add_neighbor(Flock* flock,
+                         float2 pos,
+                         float2 other_pos,
+                         float2 other_vel,
+                         const float separation_radius,
+                         const float alignment_radius,
+                         const float cohesion_radius)
+{
+    float2 diff = other_pos - pos;
+    float distance = length(diff);
+
+    // Separation: Avoid other boids within separation radius
+    if (distance < separation_radius)
+    {
+        float forceStrength = 1.0f / (distance * distance);
+        flock->separation += normalize(diff) * forceStrength;
+        flock->separation_count++;
     }
 
+    // Alignment: Align with nearby boids within alignment radius
+    if (distance < alignment_radius)
+    {
+        flock->alignment += other_vel;
+        flock->alignment_count++;
+    }
+
+    // Cohesion: Move towards the average position of nearby boids
+    if (distance < cohesion_radius)
+    {
+        flock->cohesion += other_pos;
+        flock->cohesion_count++;
+    }
+}
+
+// Averages the rules, adds them to the previous acceleration and limits it to max_force
+inline float2 flock_acceleration(Flock* flock, float2 pos, float2 acc, const float max_force)
+{
+    float2 separation = flock->separation;
+    float2 alignment = flock->alignment;
+    float2 cohesion = flock->cohesion;
+
     // Compute average behaviors (avoid division by zero)
-    if (separation_count > 0)
+    if (flock->separation_count > 0)
     {
-        separation /= separation_count;
+        separation /= flock->separation_count;
     }
-    if (alignment_count > 0)
+    if (flock->alignment_count > 0)
     {
-        alignment /= alignment_count;
+        alignment /= flock->alignment_count;
     }
-    if (cohesion_count > 0)
+    if (flock->cohesion_count > 0)
     {
-        cohesion /= cohesion_count;
+        cohesion /= flock->cohesion_count;
     }
 
     // Apply behaviors
@@ -84,21 +152,170 @@ __kernel void simulate(__global float2* positions,
     acc += separation + alignment + cohesion;
 
     // Limit the acceleration
-    acc = normalize(acc) * max_force;
+    return normalize(acc) * max_force;
+}
 
-    // Update velocity based on acceleration
-    vel += acc * dt;
+// Separation, alignment and cohesion steering of boid i against every other
+// boid, added to its previous acceleration and limited to max_force.
+inline float2 steer(__global const float* positions,
+                    __global const float* velocities,
+                    int i,
+                    float2 acc,
+                    const float separation_radius,
+                    const float alignment_radius,
+                    const float cohesion_radius,
+                    const float max_force)
+{
+    int n = get_global_size(0);
+    float2 pos = load_float2(positions, i, n);
+    Flock flock = empty_flock();
 
-    // Limit velocity to max speed
+    // Iterate through all other boids for behaviors
+#if defined(LAYOUT_AOS)
+    for (int j = 0; j < n; j++) 
+    {
+        if (i == j) 
+            continue;  // Skip self
+
+        add_neighbor(&flock, pos, load_float2(positions, j, n), load_float2(velocities, j, n), separation_radius, alignment_radius, cohesion_radius);
+    }
+#else
+    // 4 boids at a time, one vector load per component, the buffers are padded to whole blocks of 4
+    for (int j = 0; j < n; j += 4)
+    {
+        float4 px = load_lanes4(positions, j, 0, n, 2);
+        float4 py = load_lanes4(positions, j, 1, n, 2);
+        float4 vx = load_lanes4(velocities, j, 0, n, 2);
+        float4 vy = load_lanes4(velocities, j, 1, n, 2);
+
+        // Skip self and the lanes past the last boid
+        if (j != i)
+            add_neighbor(&flock, pos, (float2)(px.s0, py.s0), (float2)(vx.s0, vy.s0), separation_radius, alignment_radius, cohesion_radius);
+        if (j + 1 != i && j + 1 < n)
+            add_neighbor(&flock, pos, (float2)(px.s1, py.s1), (float2)(vx.s1, vy.s1), separation_radius, alignment_radius, cohesion_radius);
+        if (j + 2 != i && j + 2 < n)
+            add_neighbor(&flock, pos, (float2)(px.s2, py.s2), (float2)(vx.s2, vy.s2), separation_radius, alignment_radius, cohesion_radius);
+        if (j + 3 != i && j + 3 < n)
+            add_neighbor(&flock, pos, (float2)(px.s3, py.s3), (float2)(vx.s3, vy.s3), separation_radius, alignment_radius, cohesion_radius);
+    }
+#endif
+
+    return flock_acceleration(&flock, pos, acc, max_force);
+}
+
+// ---------------------------------------------------------------------------
+// Uniform grid
+//
+// Boids are hashed to square cells at least as large as the largest rule
+// radius and sorted by cell, so the boids of a cell are contiguous and
+// every neighbour within reach lies in the 3x3 block of cells around a boid.
+// cellStart and cellEnd, built by UniformGrid (uniform_grid.cl), hold the
+// sorted range of every cell, empty cells have a start of EMPTY_CELL.
+// ---------------------------------------------------------------------------
+
+#define EMPTY_CELL 0xffffffffu
+
+inline int2 cell_of(float2 pos, float2 gridOrigin, int2 gridSize, float cellSize)
+{
+    int2 cell = convert_int2_rtn((pos - gridOrigin) / cellSize);
+    return clamp(cell, (int2)(0, 0), gridSize - 1);
+}
+
+// Cell key of every boid, along with the index of the boid so the keys can
+// be sorted as key/value pairs.
+__kernel void hash_boids(__global const float* positions,
+                         int numBoids,
+                         float2 gridOrigin,
+                         int2 gridSize,
+                         float cellSize,
+                         __global uint* cellKeys,
+                         __global uint* indices)
+{
+    int i = get_global_id(0);
+    if (i >= numBoids)
+        return;
+
+    indices[i] = i;
+
+    int2 cell = cell_of(load_float2(positions, i, numBoids), gridOrigin, gridSize, cellSize);
+    cellKeys[i] = cell.y * gridSize.x + cell.x;
+}
+
+// Gathers the boid state into cell order
+__kernel void reorder_boids(__global const uint* indices,
+                            int numBoids,
+                            __global const float* positions,
+                            __global const float* velocities,
+                            __global const float2* accelerations,
+                            __global float* sortedPositions,
+                            __global float* sortedVelocities,
+                            __global float2* sortedAccelerations)
+{
+    int i = get_global_id(0);
+    if (i >= numBoids)
+        return;
+
+    uint j = indices[i];
+    store_float2(sortedPositions, i, numBoids, load_float2(positions, j, numBoids));
+    store_float2(sortedVelocities, i, numBoids, load_float2(velocities, j, numBoids));
+    sortedAccelerations[i] = accelerations[j];
+}
+
+// steer over the 3x3 cells around boid i of the cell-sorted state
+inline float2 steer_grid(__global const float* positions,
+                         __global const float* velocities,
+                         int i,
+                         float2 acc,
+                         const float separation_radius,
+                         const float alignment_radius,
+                         const float cohesion_radius,
+                         const float max_force,
+                         __global const uint* cellStart,
+                         __global const uint* cellEnd,
+                         float2 gridOrigin,
+                         int2 gridSize,
+                         float cellSize)
+{
+    int n = get_global_size(0);
+    float2 pos = load_float2(positions, i, n);
+    Flock flock = empty_flock();
+
+    int2 cell = cell_of(pos, gridOrigin, gridSize, cellSize);
+    for (int y = max(cell.y - 1, 0); y <= min(cell.y + 1, gridSize.y - 1); ++y)
+    {
+        for (int x = max(cell.x - 1, 0); x <= min(cell.x + 1, gridSize.x - 1); ++x)
+        {
+            int key = y * gridSize.x + x;
+            uint start = cellStart[key];
+            if (start == EMPTY_CELL)
+                continue;
+
+            uint end = cellEnd[key];
+            for (uint j = start; j < end; ++j)
+            {
+                if ((int)j == i)
+                    continue;
+
+                add_neighbor(&flock, pos, load_float2(positions, j, n), load_float2(velocities, j, n), separation_radius, alignment_radius, cohesion_radius);
+            }
+        }
+    }
+
+    return flock_acceleration(&flock, pos, acc, max_force);
+}
+
+inline float2 limit_speed(float2 vel, const float max_speed)
+{
     if (length(vel) > max_speed) 
     {
         vel = normalize(vel) * max_speed;
     }
+    return vel;
+}
 
-    // Update position based on velocity
-    pos += vel * dt;
-
-    // Handle boundary collisions
+// Boids leaving the area reappear on the opposite side
+inline float2 wrap_bounds(float2 pos, float4 bounds)
+{
     float minX = bounds.x;
     float maxX = bounds.y;
     float minY = bounds.z;
@@ -120,9 +337,159 @@ __kernel void simulate(__global float2* positions,
     {
         pos.y = minY;
     }
+    return pos;
+}
+
+// Reads the current state from positions and velocities and writes the next
+// one to positionsOut and velocitiesOut, so no work-item can observe a
+// neighbour that has already moved. The host swaps the buffers every step.
+__kernel void simulate(__global const float* positions,
+                       __global const float* velocities,
+                       __global float2* accelerations,
+                       const float dt,
+                       const float separation_radius,
+                       const float alignment_radius,
+                       const float cohesion_radius,
+                       const float max_speed,
+                       const float max_force,
+                       const float bounceFactor,
+                       float4 bounds,
+                       __global float* positionsOut,
+                       __global float* velocitiesOut) 
+{
+    int i = get_global_id(0);
+    int n = get_global_size(0);
+
+    // Read current position and velocity
+    float2 pos = load_float2(positions, i, n);
+    float2 vel = load_float2(velocities, i, n);
+    float2 acc = steer(positions, velocities, i, accelerations[i], separation_radius, alignment_radius, cohesion_radius, max_force);
+
+    // Update velocity based on acceleration
+    vel = limit_speed(vel + acc * dt, max_speed);
+
+    // Update position based on velocity
+    pos = wrap_bounds(pos + vel * dt, bounds);
     
-    // Write updated position, velocity, and acceleration back to buffers
-    positions[i] = pos;
-    velocities[i] = vel;
+    // Write updated position, velocity, and acceleration to buffers
+    store_float2(positionsOut, i, n, pos);
+    store_float2(velocitiesOut, i, n, vel);
     accelerations[i] = acc;
 }
+
+// Steering only, for the leapfrog integrator which evaluates it between its
+// two half kicks. Every work-item only touches its own acceleration.
+__kernel void compute_steering(__global const float* positions,
+                               __global const float* velocities,
+                               __global float2* accelerations,
+                               const float separation_radius,
+                               const float alignment_radius,
+                               const float cohesion_radius,
+                               const float max_force)
+{
+    int i = get_global_id(0);
+    accelerations[i] = steer(positions, velocities, i, accelerations[i], separation_radius, alignment_radius, cohesion_radius, max_force);
+}
+
+// Kick-drift-kick leapfrog, see nbody.cl. The first half kick and the drift
+// read one buffer set and write the other, leapfrog_kick completes the step
+// in place once the steering at the new positions is known.
+__kernel void leapfrog_kick_drift(__global const float* positions,
+                                  __global const float* velocities,
+                                  __global const float2* accelerations,
+                                  const float dt,
+                                  const float max_speed,
+                                  float4 bounds,
+                                  __global float* positionsOut,
+                                  __global float* velocitiesOut)
+{
+    int i = get_global_id(0);
+    int n = get_global_size(0);
+
+    float2 vel = limit_speed(load_float2(velocities, i, n) + accelerations[i] * (0.5f * dt), max_speed);
+    store_float2(positionsOut, i, n, wrap_bounds(load_float2(positions, i, n) + vel * dt, bounds));
+    store_float2(velocitiesOut, i, n, vel);
+}
+
+__kernel void leapfrog_kick(__global float* velocities,
+                            __global const float2* accelerations,
+                            const float dt,
+                            const float max_speed)
+{
+    int i = get_global_id(0);
+    int n = get_global_size(0);
+    store_float2(velocities, i, n, limit_speed(load_float2(velocities, i, n) + accelerations[i] * (0.5f * dt), max_speed));
+}
+
+
+// simulate with the neighbours taken from the grid. Takes the arguments of
+// simulate followed by the grid, the state must be sorted by cell.
+__kernel void simulate_grid(__global const float* positions,
+                            __global const float* velocities,
+                            __global float2* accelerations,
+                            const float dt,
+                            const float separation_radius,
+                            const float alignment_radius,
+                            const float cohesion_radius,
+                            const float max_speed,
+                            const float max_force,
+                            const float bounceFactor,
+                            float4 bounds,
+                            __global float* positionsOut,
+                            __global float* velocitiesOut,
+                            __global const uint* cellStart,
+                            __global const uint* cellEnd,
+                            float2 gridOrigin,
+                            int2 gridSize,
+                            float cellSize)
+{
+    int i = get_global_id(0);
+    int n = get_global_size(0);
+
+    float2 pos = load_float2(positions, i, n);
+    float2 vel = load_float2(velocities, i, n);
+    float2 acc = steer_grid(positions, velocities, i, accelerations[i], separation_radius, alignment_radius, cohesion_radius, max_force,
+                            cellStart, cellEnd, gridOrigin, gridSize, cellSize);
+
+    vel = limit_speed(vel + acc * dt, max_speed);
+    pos = wrap_bounds(pos + vel * dt, bounds);
+
+    store_float2(positionsOut, i, n, pos);
+    store_float2(velocitiesOut, i, n, vel);
+    accelerations[i] = acc;
+}
+
+// compute_steering with the neighbours taken from the grid
+__kernel void compute_steering_grid(__global const float* positions,
+                                    __global const float* velocities,
+                                    __global float2* accelerations,
+                                    const float separation_radius,
+                                    const float alignment_radius,
+                                    const float cohesion_radius,
+                                    const float max_force,
+                                    __global const uint* cellStart,
+                                    __global const uint* cellEnd,
+                                    float2 gridOrigin,
+                                    int2 gridSize,
+                                    float cellSize)
+{
+    int i = get_global_id(0);
+    accelerations[i] = steer_grid(positions, velocities, i, accelerations[i], separation_radius, alignment_radius, cohesion_radius, max_force,
+                                  cellStart, cellEnd, gridOrigin, gridSize, cellSize);
+}
+
+// Copies the positions and velocities into interleaved float2 buffers for
+// reading back and drawing, whatever the layout
+__kernel void pack_boids(__global const float* positions,
+                         __global const float* velocities,
+                         int numBoids,
+                         __global float2* packedPositions,
+                         __global float2* packedVelocities)
+{
+    int i = get_global_id(0);
+    if (i < numBoids)
+    {
+        packedPositions[i] = load_float2(positions, i, numBoids);
+        packedVelocities[i] = load_float2(velocities, i, numBoids);
+    }
+}
@@ -1,7 +1,12 @@
+#include "FixedTimestep.h"
 #include "OpenCLUtils.h"
 #include "OpenCVUtils.h"
 #include "RandomUtils.h"
+#include "RateCounter.h"
+#include "Rasterizer.h"
+#include "StateLayout.h"
 #include "Timer.h"
+#include "UniformGrid.h"
 
 #include "opencv2/opencv.hpp"
 
@@ -9,14 +14,38 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
 
 cl_device_id device = nullptr;
 cl_context context = nullptr;
 cl_program program = nullptr;
 cl_kernel kernel = nullptr;
+cl_kernel steeringKernel = nullptr;
+cl_kernel kickDriftKernel = nullptr;
+cl_kernel kickKernel = nullptr;
+cl_kernel simulateGridKernel = nullptr;
+cl_kernel steeringGridKernel = nullptr;
+cl_kernel packKernel = nullptr;
 cl_command_queue queue = nullptr;
 cl_int err = -1;
 
+// Layout of the positions and velocities the program was built for
+StateLayout layout = StateLayout::AoS;
+
+/// <summary>
+/// How the boids advance. Euler is the original fused simulate kernel,
+/// Leapfrog the symplectic kick-drift-kick scheme with the steering
+/// evaluated between its two half kicks.
+/// </summary>
+enum class Integrator
+{
+	Euler,
+	Leapfrog
+};
+
+UniformGrid grid;
+Rasterizer rasterizer;
+
 struct Vector4f
 {
 public:
@@ -54,6 +83,86 @@ public:
 	float y = 0;
 };
 
+/// <summary>
+/// Flocking parameters shared by every step kernel.
+/// </summary>
+struct FlockParams
+{
+public:
+	/// <summary>
+	/// The grid cells cover the largest rule radius, so the 3x3 cells around
+	/// a boid hold every neighbour any rule can see.
+	/// </summary>
+	float GetCellSize() const { return std::max({ separationRadius, alignmentRadius, cohesionRadius }); }
+public:
+	float separationRadius = 5;
+	float alignmentRadius = 95;
+	float cohesionRadius = 5;
+
+	float maxSpeed = 15;
+	float maxForce = 0.5f;
+	float bounceFactor = 0.1f;
+
+	Vector4f bounds;
+};
+
+/// <summary>
+/// Creates a device buffer of n float2 rearranged from interleaved host
+/// data into the active layout.
+/// </summary>
+cl_mem CreateLayoutBuffer(const Vector2f* data, int n)
+{
+	std::vector<float> laidOut = ToStateLayout(layout, &data->x, n, 2);
+	return OpenCLUtils::create_input_buffer(context, laidOut.data(), laidOut.size() * sizeof(float));
+}
+
+/// <summary>
+/// Device state of the flock, positions and velocities stored in the active
+/// layout. Positions and velocities are double buffered: every step reads
+/// the current pair and writes the other before the two are swapped, so no
+/// work-item sees a partially updated state. With the grid enabled the
+/// state is also reordered by cell every step.
+/// </summary>
+struct FlockState
+{
+public:
+	bool Create(const Vector2f* initialPositions, const Vector2f* initialVelocities, int numBoids)
+	{
+		for (int i = 0; i < 2; ++i)
+		{
+			positions[i] = CreateLayoutBuffer(initialPositions, numBoids);
+			velocities[i] = CreateLayoutBuffer(initialVelocities, numBoids);
+		}
+
+		// Padded like the other buffers, the grid swaps them with its scratch
+		const std::vector<Vector2f> zeros(GetStateCapacity(numBoids));
+		accelerations = OpenCLUtils::create_input_buffer(context, const_cast<Vector2f*>(zeros.data()), zeros.size() * sizeof(Vector2f));
+		current = 0;
+		accelerationsValid = false;
+		return positions[0] && positions[1] && velocities[0] && velocities[1] && accelerations;
+	}
+
+	void Swap() { current = 1 - current; }
+
+	void Release()
+	{
+		for (cl_mem* buffer : { &positions[0], &positions[1], &velocities[0], &velocities[1], &accelerations })
+		{
+			if (*buffer)
+				clReleaseMemObject(*buffer);
+			*buffer = nullptr;
+		}
+	}
+public:
+	cl_mem positions[2] = {};
+	cl_mem velocities[2] = {};
+	cl_mem accelerations = nullptr;
+	int current = 0;
+
+	// Leapfrog starts each step from the accelerations of the previous one
+	bool accelerationsValid = false;
+};
+
 bool InitializeDeviceAndContext()
 {
 	device = OpenCLUtils::create_device();
@@ -70,13 +179,90 @@ bool InitializeDeviceAndContext()
     return true;
 }
 
-bool InitializeProgram()
+/// <summary>
+/// Builds the program for the given state layout and creates its kernels.
+/// </summary>
+bool BuildProgram(StateLayout stateLayout)
 {
 	/* Build program */
-	program = OpenCLUtils::build_program(context, device, "shaders/boids.cl");
+	program = OpenCLUtils::build_program(context, device, "shaders/boids.cl", GetStateLayoutOptions(stateLayout).c_str());
 	if (!program)
 		return false;
+	layout = stateLayout;
+
+	/* Create a kernel */
+	kernel = clCreateKernel(program, "simulate", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel");
+		return false;
+	};
+
+	steeringKernel = clCreateKernel(program, "compute_steering", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the steering kernel");
+		return false;
+	};
+
+	kickDriftKernel = clCreateKernel(program, "leapfrog_kick_drift", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the leapfrog kick-drift kernel");
+		return false;
+	};
+
+	kickKernel = clCreateKernel(program, "leapfrog_kick", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the leapfrog kick kernel");
+		return false;
+	};
+
+	simulateGridKernel = clCreateKernel(program, "simulate_grid", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the grid simulate kernel");
+		return false;
+	};
+
+	steeringGridKernel = clCreateKernel(program, "compute_steering_grid", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the grid steering kernel");
+		return false;
+	};
+
+	packKernel = clCreateKernel(program, "pack_boids", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the pack kernel");
+		return false;
+	};
+
+	return grid.Initialize(context, device, program, "hash_boids", "reorder_boids");
+}
+
+/// <summary>
+/// Releases the kernels and program of BuildProgram.
+/// </summary>
+void ReleaseProgram()
+{
+	grid.Release();
+	for (cl_kernel* programKernel : { &kernel, &steeringKernel, &kickDriftKernel, &kickKernel, &simulateGridKernel, &steeringGridKernel, &packKernel })
+	{
+		if (*programKernel)
+			clReleaseKernel(*programKernel);
+		*programKernel = nullptr;
+	}
+
+	if (program)
+		clReleaseProgram(program);
+	program = nullptr;
+}
 
+bool InitializeProgram(StateLayout stateLayout)
+{
 	queue = clCreateCommandQueue(context, device, 0, &err);
 	if (err < 0)
 	{
@@ -84,20 +270,391 @@ bool InitializeProgram()
 		return false;
 	};
 
-	/* Create a kernel */
-	kernel = clCreateKernel(program, "simulate", &err);
+	if (!BuildProgram(stateLayout) || !rasterizer.Initialize(context, device))
+		return false;
+    return true;
+}
+
+/// <summary>
+/// Sets the flocking parameters on every step kernel. The grid kernels take
+/// the arguments of their brute force counterparts, then the grid.
+/// </summary>
+bool SetFlockArgs(const FlockParams& params)
+{
+	err = CL_SUCCESS;
+	for (cl_kernel simulateKernel : { kernel, simulateGridKernel })
+	{
+		err |= clSetKernelArg(simulateKernel, 4, sizeof(float), &params.separationRadius);
+		err |= clSetKernelArg(simulateKernel, 5, sizeof(float), &params.alignmentRadius);
+		err |= clSetKernelArg(simulateKernel, 6, sizeof(float), &params.cohesionRadius);
+		err |= clSetKernelArg(simulateKernel, 7, sizeof(float), &params.maxSpeed);
+		err |= clSetKernelArg(simulateKernel, 8, sizeof(float), &params.maxForce);
+		err |= clSetKernelArg(simulateKernel, 9, sizeof(float), &params.bounceFactor);
+		err |= clSetKernelArg(simulateKernel, 10, sizeof(Vector4f), &params.bounds);
+	}
+
+	for (cl_kernel steerKernel : { steeringKernel, steeringGridKernel })
+	{
+		err |= clSetKernelArg(steerKernel, 3, sizeof(float), &params.separationRadius);
+		err |= clSetKernelArg(steerKernel, 4, sizeof(float), &params.alignmentRadius);
+		err |= clSetKernelArg(steerKernel, 5, sizeof(float), &params.cohesionRadius);
+		err |= clSetKernelArg(steerKernel, 6, sizeof(float), &params.maxForce);
+	}
+
+	err |= clSetKernelArg(kickDriftKernel, 4, sizeof(float), &params.maxSpeed);
+	err |= clSetKernelArg(kickDriftKernel, 5, sizeof(Vector4f), &params.bounds);
+	err |= clSetKernelArg(kickKernel, 3, sizeof(float), &params.maxSpeed);
 	if (err < 0)
 	{
-		perror("Couldn't create a kernel");
+		perror("Couldn't create a kernel argument");
 		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Enqueues one step from the current position and velocity buffers into
+/// the other pair and swaps them, the result is in the current pair afterwards.
+/// With useGrid the state is sorted by cell first and the steering only
+/// visits the 3x3 cells around each boid.
+/// </summary>
+/// <param name="integrator">The integration scheme</param>
+/// <param name="useGrid">Whether to use the uniform grid for the neighbour search</param>
+/// <param name="params">The flocking parameters, set on the kernels by SetFlockArgs</param>
+/// <param name="state">The flock state, updated</param>
+/// <param name="deltaTime_s">The time step</param>
+/// <param name="numBoids">The number of boids</param>
+/// <returns>True if the kernels were enqueued successfully</returns>
+bool Step(Integrator integrator,
+		  bool useGrid,
+		  const FlockParams& params,
+		  FlockState& state,
+		  float deltaTime_s,
+		  int numBoids)
+{
+	const size_t global = numBoids;
+	auto enqueue = [&](cl_kernel stepKernel)
+	{
+		err = clEnqueueNDRangeKernel(queue, stepKernel, 1, NULL, &global, NULL, 0, NULL, NULL);
+		if (err < 0)
+		{
+			perror("Couldn't enqueue the kernel");
+			return false;
+		}
+		return true;
 	};
-    return true;
+
+	auto buildGrid = [&]()
+	{
+		if (!useGrid)
+			return true;
+
+		const cl_float4 area = { { params.bounds.x, params.bounds.y, params.bounds.z, params.bounds.w } };
+		// Every state buffer holds whole layout blocks, and so do the sorted buffers swapped in
+		const size_t float2Size = GetStateCapacity(numBoids) * sizeof(cl_float2);
+		return grid.Build(queue,
+						  state.positions[state.current],
+						  { { &state.positions[state.current], float2Size },
+							{ &state.velocities[state.current], float2Size },
+							{ &state.accelerations, float2Size } },
+						  numBoids,
+						  area,
+						  params.GetCellSize());
+	};
+
+	auto steer = [&]()
+	{
+		cl_kernel steerKernel = useGrid ? steeringGridKernel : steeringKernel;
+		err = clSetKernelArg(steerKernel, 0, sizeof(cl_mem), &state.positions[state.current]);
+		err |= clSetKernelArg(steerKernel, 1, sizeof(cl_mem), &state.velocities[state.current]);
+		err |= clSetKernelArg(steerKernel, 2, sizeof(cl_mem), &state.accelerations);
+		if (err < 0 || (useGrid && !grid.SetGridArgs(steerKernel, 7)))
+		{
+			perror("Couldn't create a kernel argument");
+			return false;
+		}
+		return enqueue(steerKernel);
+	};
+
+	if (integrator == Integrator::Euler)
+	{
+		if (!buildGrid())
+			return false;
+
+		const int next = 1 - state.current;
+		cl_kernel simulateKernel = useGrid ? simulateGridKernel : kernel;
+		err = clSetKernelArg(simulateKernel, 0, sizeof(cl_mem), &state.positions[state.current]);
+		err |= clSetKernelArg(simulateKernel, 1, sizeof(cl_mem), &state.velocities[state.current]);
+		err |= clSetKernelArg(simulateKernel, 2, sizeof(cl_mem), &state.accelerations);
+		err |= clSetKernelArg(simulateKernel, 3, sizeof(float), &deltaTime_s);
+		err |= clSetKernelArg(simulateKernel, 11, sizeof(cl_mem), &state.positions[next]);
+		err |= clSetKernelArg(simulateKernel, 12, sizeof(cl_mem), &state.velocities[next]);
+		if (err < 0 || (useGrid && !grid.SetGridArgs(simulateKernel, 13)))
+		{
+			perror("Couldn't create a kernel argument");
+			return false;
+		}
+
+		if (!enqueue(simulateKernel))
+			return false;
+
+		state.Swap();
+		state.accelerationsValid = false;
+		return true;
+	}
+
+	if (!state.accelerationsValid)
+	{
+		if (!buildGrid() || !steer())
+			return false;
+	}
+
+	// Half kick and drift into the other pair, then the steering at the new positions completes the kick
+	const int next = 1 - state.current;
+	err = clSetKernelArg(kickDriftKernel, 0, sizeof(cl_mem), &state.positions[state.current]);
+	err |= clSetKernelArg(kickDriftKernel, 1, sizeof(cl_mem), &state.velocities[state.current]);
+	err |= clSetKernelArg(kickDriftKernel, 2, sizeof(cl_mem), &state.accelerations);
+	err |= clSetKernelArg(kickDriftKernel, 3, sizeof(float), &deltaTime_s);
+	err |= clSetKernelArg(kickDriftKernel, 6, sizeof(cl_mem), &state.positions[next]);
+	err |= clSetKernelArg(kickDriftKernel, 7, sizeof(cl_mem), &state.velocities[next]);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
+
+	if (!enqueue(kickDriftKernel))
+		return false;
+	state.Swap();
+
+	if (!buildGrid() || !steer())
+		return false;
+
+	// The grid build may have swapped the buffers, so the kick's are set last
+	err = clSetKernelArg(kickKernel, 0, sizeof(cl_mem), &state.velocities[state.current]);
+	err |= clSetKernelArg(kickKernel, 1, sizeof(cl_mem), &state.accelerations);
+	err |= clSetKernelArg(kickKernel, 2, sizeof(float), &deltaTime_s);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
+
+	if (!enqueue(kickKernel))
+		return false;
+
+	state.accelerationsValid = true;
+	return true;
+}
+
+/// <summary>
+/// Measures the time per step of the brute force and grid neighbour searches
+/// without any rendering, for growing flocks at the density of the interactive scene.
+/// </summary>
+bool BenchmarkBoids(Integrator integrator, const FlockParams& baseParams, int baseBoids)
+{
+	const int Boid_Counts[] = { 1024, 4096, 16384, 65536, 262144, 1048576 };
+
+	// Every boid visits every other one, beyond this a step takes seconds
+	const int Brute_Force_Limit = 65536;
+	const int Steps = 20;
+
+	printf("%8s  %14s  %14s  %12s\n", "boids", "brute (ms)", "grid (ms)", "grid steps/s");
+
+	for (int numBoids : Boid_Counts)
+	{
+		const float baseExtent = baseParams.bounds.y - baseParams.bounds.x;
+		const float extent = baseExtent * std::sqrt(static_cast<float>(numBoids) / baseBoids);
+
+		FlockParams params = baseParams;
+		params.bounds = Vector4f(0.0f, extent, 0.0f, extent);
+		if (!SetFlockArgs(params))
+			return false;
+
+		std::vector<Vector2f> positions(numBoids);
+		std::vector<Vector2f> velocities(numBoids);
+		for (int i = 0; i < numBoids; ++i)
+		{
+			positions[i] = Vector2f(RandUtils::RandomRange<float>(0.0f, extent), RandUtils::RandomRange<float>(0.0f, extent));
+			velocities[i] = Vector2f(RandUtils::RandomRange<float>(-params.maxSpeed, params.maxSpeed), RandUtils::RandomRange<float>(-params.maxSpeed, params.maxSpeed));
+		}
+
+		auto timeSteps = [&](bool useGrid) -> double
+		{
+			FlockState state;
+			if (!state.Create(positions.data(), velocities.data(), numBoids))
+				return -1.0;
+
+			Step(integrator, useGrid, params, state, 0.01f, numBoids);
+			clFinish(queue);
+
+			Timer timer(true);
+			for (int step = 0; step < Steps; ++step)
+				Step(integrator, useGrid, params, state, 0.01f, numBoids);
+			clFinish(queue);
+			const double stepTime_ms = timer.Stop_ms() / Steps;
+
+			state.Release();
+			return stepTime_ms;
+		};
+
+		const double gridTime_ms = timeSteps(true);
+		if (numBoids <= Brute_Force_Limit)
+			printf("%8d  %14.3f  %14.3f  %12.1f\n", numBoids, timeSteps(false), gridTime_ms, 1000.0 / gridTime_ms);
+		else
+			printf("%8d  %14s  %14.3f  %12.1f\n", numBoids, "-", gridTime_ms, 1000.0 / gridTime_ms);
+	}
+	return SetFlockArgs(baseParams);
+}
+
+/// <summary>
+/// Enqueues the copy of the state's current positions and velocities into
+/// interleaved float2 buffers, whatever the layout.
+/// </summary>
+bool PackBoids(const FlockState& state, int numBoids, cl_mem packedPositions, cl_mem packedVelocities)
+{
+	err = clSetKernelArg(packKernel, 0, sizeof(cl_mem), &state.positions[state.current]);
+	err |= clSetKernelArg(packKernel, 1, sizeof(cl_mem), &state.velocities[state.current]);
+	err |= clSetKernelArg(packKernel, 2, sizeof(int), &numBoids);
+	err |= clSetKernelArg(packKernel, 3, sizeof(cl_mem), &packedPositions);
+	err |= clSetKernelArg(packKernel, 4, sizeof(cl_mem), &packedVelocities);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
+
+	const size_t global = numBoids;
+	err = clEnqueueNDRangeKernel(queue, packKernel, 1, NULL, &global, NULL, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the kernel");
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Compares the state layouts on this device: the time per grid step for
+/// growing flocks at the density of the interactive scene, and the
+/// bandwidth of the streaming kick-drift update. The program is rebuilt
+/// for every layout and restored afterwards.
+/// </summary>
+bool BenchmarkLayouts(Integrator integrator, const FlockParams& baseParams, int baseBoids)
+{
+	const int Boid_Counts[] = { 16384, 65536, 262144, 1048576 };
+	const int Update_Steps = 100;
+	const int Steps = 20;
+
+	// kick-drift reads a position, a velocity and an acceleration and writes a position and a velocity
+	const double Update_Bytes_Per_Boid = 5 * sizeof(Vector2f);
+
+	const StateLayout activeLayout = layout;
+
+	printf("%6s  %8s  %12s  %12s  %12s\n", "layout", "boids", "update GB/s", "grid (ms)", "grid steps/s");
+
+	for (int layoutIndex = 0; layoutIndex < Num_State_Layouts; ++layoutIndex)
+	{
+		const StateLayout stateLayout = static_cast<StateLayout>(layoutIndex);
+		ReleaseProgram();
+		if (!BuildProgram(stateLayout))
+			return false;
+
+		for (int numBoids : Boid_Counts)
+		{
+			const float baseExtent = baseParams.bounds.y - baseParams.bounds.x;
+			const float extent = baseExtent * std::sqrt(static_cast<float>(numBoids) / baseBoids);
+
+			FlockParams params = baseParams;
+			params.bounds = Vector4f(0.0f, extent, 0.0f, extent);
+			if (!SetFlockArgs(params))
+				return false;
+
+			std::vector<Vector2f> positions(numBoids);
+			std::vector<Vector2f> velocities(numBoids);
+			for (int i = 0; i < numBoids; ++i)
+			{
+				positions[i] = Vector2f(RandUtils::RandomRange<float>(0.0f, extent), RandUtils::RandomRange<float>(0.0f, extent));
+				velocities[i] = Vector2f(RandUtils::RandomRange<float>(-params.maxSpeed, params.maxSpeed), RandUtils::RandomRange<float>(-params.maxSpeed, params.maxSpeed));
+			}
+
+			FlockState state;
+			if (!state.Create(positions.data(), velocities.data(), numBoids))
+				return false;
+
+			// Streaming update, bound by the layout's memory access pattern
+			const size_t global = numBoids;
+			const float deltaTime_s = 0.01f;
+			auto enqueueUpdate = [&]()
+			{
+				const int next = 1 - state.current;
+				err = clSetKernelArg(kickDriftKernel, 0, sizeof(cl_mem), &state.positions[state.current]);
+				err |= clSetKernelArg(kickDriftKernel, 1, sizeof(cl_mem), &state.velocities[state.current]);
+				err |= clSetKernelArg(kickDriftKernel, 2, sizeof(cl_mem), &state.accelerations);
+				err |= clSetKernelArg(kickDriftKernel, 3, sizeof(float), &deltaTime_s);
+				err |= clSetKernelArg(kickDriftKernel, 6, sizeof(cl_mem), &state.positions[next]);
+				err |= clSetKernelArg(kickDriftKernel, 7, sizeof(cl_mem), &state.velocities[next]);
+				err |= clEnqueueNDRangeKernel(queue, kickDriftKernel, 1, NULL, &global, NULL, 0, NULL, NULL);
+				state.Swap();
+				return err >= 0;
+			};
+
+			if (!enqueueUpdate())
+				return false;
+			clFinish(queue);
+
+			Timer timer(true);
+			for (int step = 0; step < Update_Steps; ++step)
+				enqueueUpdate();
+			clFinish(queue);
+			const double updateRate = Update_Bytes_Per_Boid * numBoids * Update_Steps / timer.Stop_s();
+
+			Step(integrator, true, params, state, deltaTime_s, numBoids);
+			clFinish(queue);
+
+			Timer stepTimer(true);
+			for (int step = 0; step < Steps; ++step)
+				Step(integrator, true, params, state, deltaTime_s, numBoids);
+			clFinish(queue);
+			const double gridTime_ms = stepTimer.Stop_ms() / Steps;
+
+			printf("%6s  %8d  %12.2f  %12.3f  %12.1f\n", GetStateLayoutName(stateLayout), numBoids, updateRate / 1e9, gridTime_ms, 1000.0 / gridTime_ms);
+
+			state.Release();
+		}
+	}
+
+	ReleaseProgram();
+	return BuildProgram(activeLayout) && SetFlockArgs(baseParams);
 }
 
 int main()
 {
 	constexpr size_t Num_Boids = 75;
 
+	const Integrator ActiveIntegrator = Integrator::Leapfrog;
+	const bool UseGrid = true;
+
+	// Layout of the positions and velocities, see BenchmarkLayouts
+	const StateLayout ActiveLayout = StateLayout::AoS;
+
+	// Fixed simulation step, advanced at TimeScale simulated seconds per wall-clock second
+	// with at most MaxStepsPerFrame steps of catch-up per rendered frame
+	const float FixedStep_s = 0.04f;
+	const double TimeScale = 10.0;
+	const int MaxStepsPerFrame = 8;
+
+	// Steps run every frame regardless of the clock, to measure the throughput, 0 schedules them by the clock
+	const int StepsPerFrame = 0;
+
+	// Draw the boids on the device and read back only the finished frame
+	const bool DeviceRaster = true;
+
+	// The grid scales to flocks of a million boids, see BenchmarkBoids
+	const bool RunBenchmark = false;
+	const bool RunLayoutBenchmark = false;
+	const bool Headless = false;
+
 	const cv::Scalar BackgroundColor(122, 46, 64);
 	const cv::Scalar BodyColor(245, 112, 75);
 	const cv::Scalar LineColor(236, 194, 61);
@@ -118,15 +675,15 @@ int main()
 
 	std::vector<Vector2f> Positions(Num_Boids);
 	std::vector<Vector2f> Velocities(Num_Boids);
-	std::vector<Vector2f> Accelerations(Num_Boids);
-
-	const float Seperation_Radius = 5;
-	const float Alignment_Radius = 95;
-	const float Cohesion_Radius = 5;
 
-	const float Max_Speed = 15;
-	const float Max_Force = 0.5f;
-	const float Bounce_Factor = 0.1f;
+	FlockParams Params;
+	Params.separationRadius = 5;
+	Params.alignmentRadius = 95;
+	Params.cohesionRadius = 5;
+	Params.maxSpeed = 15;
+	Params.maxForce = 0.5f;
+	Params.bounceFactor = 0.1f;
+	Params.bounds = Bounds;
 
 	// Initialize particles
 	for (int i = 0; i < Num_Boids; i++)
@@ -138,32 +695,42 @@ int main()
 	if (!InitializeDeviceAndContext())
         return -1;
 
-    if (!InitializeProgram())
+    if (!InitializeProgram(ActiveLayout))
         return -1;
 
-	size_t float2BufferDataSize = Num_Boids * sizeof(Vector2f);
-	cl_mem positionsBuffer = OpenCLUtils::create_input_buffer(context, Positions.data(), float2BufferDataSize);
-	cl_mem velocitiesBuffer = OpenCLUtils::create_input_buffer(context, Velocities.data(), float2BufferDataSize);
-	cl_mem accelerationsBuffer = OpenCLUtils::create_input_buffer(context, Accelerations.data(), float2BufferDataSize);
+	if (RunBenchmark)
+	{
+		if (!BenchmarkBoids(ActiveIntegrator, Params, Num_Boids))
+			return -1;
+	}
 
-	/* Create kernel arguments */
-	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &positionsBuffer);
-	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &velocitiesBuffer);
-	err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &accelerationsBuffer);
-	err |= clSetKernelArg(kernel, 4, sizeof(float), &Seperation_Radius);
-	err |= clSetKernelArg(kernel, 5, sizeof(float), &Alignment_Radius);
-	err |= clSetKernelArg(kernel, 6, sizeof(float), &Cohesion_Radius);
-	err |= clSetKernelArg(kernel, 7, sizeof(float), &Max_Speed);
-	err |= clSetKernelArg(kernel, 8, sizeof(float), &Max_Force);
-	err |= clSetKernelArg(kernel, 9, sizeof(float), &Bounce_Factor);
-	err |= clSetKernelArg(kernel, 10, sizeof(Vector4f), &Bounds);
-	if (err < 0)
+	if (RunLayoutBenchmark)
 	{
-		perror("Couldn't create a kernel argument");
-		return false;
+		if (!BenchmarkLayouts(ActiveIntegrator, Params, Num_Boids))
+			return -1;
 	}
 
-	size_t global = Num_Boids;
+	if (Headless)
+	{
+		ReleaseProgram();
+		rasterizer.Release();
+		clReleaseCommandQueue(queue);
+		clReleaseContext(context);
+		return 0;
+	}
+
+	size_t float2BufferDataSize = Num_Boids * sizeof(Vector2f);
+	FlockState state;
+	if (!state.Create(Positions.data(), Velocities.data(), Num_Boids))
+		return -1;
+
+	// Interleaved copies of the state for reading back and drawing when the layout is not AoS
+	cl_mem packedPositionsBuffer = OpenCLUtils::create_output_buffer(context, float2BufferDataSize);
+	cl_mem packedVelocitiesBuffer = OpenCLUtils::create_output_buffer(context, float2BufferDataSize);
+
+	/* Create kernel arguments */
+	if (!SetFlockArgs(Params))
+		return -1;
 
 	const std::string winName = "Boids Simulation";
 	cv::namedWindow(winName, cv::WINDOW_AUTOSIZE);
@@ -171,88 +738,111 @@ int main()
 
 	Timer gpuBufferReadTimer;
 	Timer drawTimer;
+	RateCounter rates;
+	FixedTimestep scheduler(FixedStep_s, MaxStepsPerFrame, TimeScale);
+	scheduler.SetStepsPerFrame(StepsPerFrame);
+
+	Rasterizer::Style rasterStyle;
+	rasterStyle.background = BackgroundColor;
+	rasterStyle.discColor = BodyColor;
+	rasterStyle.lineColor = LineColor;
+	rasterStyle.discThickness = LineThickness;
+	rasterStyle.lineThickness = LineThickness;
 
-	float deltaTime_s = 0.01f;
 	while (true)
 	{
 		gpuBufferReadTimer.Start();
 
-		// Update delta time --------------------------------------------------
-		err = clSetKernelArg(kernel, 3, sizeof(float), &deltaTime_s);
-		if (err < 0)
+		// The steps are enqueued back to back, the state is only read back when it changed
+		const int numSteps = scheduler.Advance();
+		for (int step = 0; step < numSteps; ++step)
 		{
-			perror("Couldn't create a kernel argument");
-			return false;
+			if (!Step(ActiveIntegrator, UseGrid, Params, state, scheduler.GetStep_s(), Num_Boids))
+				return false;
 		}
-		// --------------------------------------------------------------------
-
-		err = clEnqueueNDRangeKernel(queue,
-									 kernel,
-									 1,
-									 NULL,
-									 (const size_t*)&global,
-									 NULL,
-									 0,
-									 NULL,
-									 NULL);
 
-		if (err < 0)
+		cl_mem packedPositions = state.positions[state.current];
+		cl_mem packedVelocities = state.velocities[state.current];
+		if (layout != StateLayout::AoS)
 		{
-			perror("Couldn't enqueue the kernel");
-			return false;
+			if (!PackBoids(state, Num_Boids, packedPositionsBuffer, packedVelocitiesBuffer))
+				return false;
+			packedPositions = packedPositionsBuffer;
+			packedVelocities = packedVelocitiesBuffer;
 		}
 
-		/* Read the kernel's output    */
-		err = clEnqueueReadBuffer(queue,
-								  positionsBuffer,
-								  CL_FALSE,
-								  0,
-								  float2BufferDataSize,
-								  Positions.data(),
-								  0,
-								  NULL,
-								  NULL);
-
-		err |= clEnqueueReadBuffer(queue,
-								   velocitiesBuffer,
-								   CL_FALSE,
-								   0,
-								   float2BufferDataSize,
-								   Velocities.data(),
-								   0,
-								   NULL,
-								   NULL);
-		if (err < 0)
+		if (numSteps > 0 && !DeviceRaster)
 		{
-			perror("Couldn't read the buffer");
-			return false;
-		}
+			/* Read the kernel's output    */
+			err = clEnqueueReadBuffer(queue,
+									  packedPositions,
+									  CL_FALSE,
+									  0,
+									  float2BufferDataSize,
+									  Positions.data(),
+									  0,
+									  NULL,
+									  NULL);
+
+			err |= clEnqueueReadBuffer(queue,
+									   packedVelocities,
+									   CL_FALSE,
+									   0,
+									   float2BufferDataSize,
+									   Velocities.data(),
+									   0,
+									   NULL,
+									   NULL);
+			if (err < 0)
+			{
+				perror("Couldn't read the buffer");
+				return false;
+			}
 
-		clFinish(queue);
+			clFinish(queue);
+		}
 
 		const double gpuBufferTime_ms = gpuBufferReadTimer.Elapsed_ms();
 
 		// Visualization logic
 		drawTimer.Start();
 		{
-			outputImg.setTo(BackgroundColor);
-			for (size_t x = 0; x < Num_Boids; ++x)
+			// The grid reorders the boids every step, so instead of blending two read back states
+			// the latest one is rewound along the velocities to the scheduler's render time
+			const float rewind_s = (1.0f - scheduler.GetAlpha()) * scheduler.GetStep_s();
+
+			if (DeviceRaster)
+			{
+				Rasterizer::Entities boids;
+				boids.positions = packedPositions;
+				boids.velocities = packedVelocities;
+				boids.radius = BoidSize;
+				boids.count = Num_Boids;
+
+				if (!rasterizer.Draw(queue, boids, rasterStyle, MaxX, MaxY, rewind_s) || !rasterizer.Read(queue, outputImg))
+					return false;
+			}
+			else
 			{
-				const Vector2f position = Positions[x];
-				cv::circle(outputImg, 
-						   cv::Point(position.x, position.y),
-						   static_cast<int>(BoidSize),
-						   BodyColor,
-						   LineThickness, 
-						   cv::LineTypes::FILLED);
-
-				Vector2f velocity = Velocities[x];
-				const float speed = velocity.Length();
-				cv::line(outputImg, 
-						 cv::Point(position.x, position.y),
-						 cv::Point(position.x + velocity.x, position.y + velocity.y),
-						 LineColor * speed,
-						 LineThickness);
+				outputImg.setTo(BackgroundColor);
+				for (size_t x = 0; x < Num_Boids; ++x)
+				{
+					const Vector2f position(Positions[x].x - Velocities[x].x * rewind_s, Positions[x].y - Velocities[x].y * rewind_s);
+					cv::circle(outputImg, 
+							   cv::Point(position.x, position.y),
+							   static_cast<int>(BoidSize),
+							   BodyColor,
+							   LineThickness, 
+							   cv::LineTypes::FILLED);
+
+					Vector2f velocity = Velocities[x];
+					const float speed = velocity.Length();
+					cv::line(outputImg, 
+							 cv::Point(position.x, position.y),
+							 cv::Point(position.x + velocity.x, position.y + velocity.y),
+							 LineColor * speed,
+							 LineThickness);
+				}
 			}
 
 			cv::imshow(winName, outputImg);
@@ -265,20 +855,22 @@ int main()
 		}
 
 		const double drawTime_ms = drawTimer.Elapsed_ms();
+		rates.AddFrame(numSteps);
 
-		std::cout << "GPU Read Time: " << std::to_string(gpuBufferTime_ms) << "\tDraw Time: " << std::to_string(drawTime_ms) << std::endl;
-		deltaTime_s = (gpuBufferTime_ms + drawTime_ms) * 0.01f; // Convert back to seconds
+		std::cout << "GPU Read Time: " << std::to_string(gpuBufferTime_ms) << "\tDraw Time: " << std::to_string(drawTime_ms)
+				  << "\tSteps/s: " << std::to_string(rates.GetStepsPerSecond()) << "\tFPS: " << std::to_string(rates.GetFramesPerSecond()) << std::endl;
 	}
 
 	cv::destroyWindow(winName);
 
     ///* Deallocate resources */
     
-	clReleaseKernel(kernel);
-	clReleaseMemObject(positionsBuffer);
-	clReleaseMemObject(velocitiesBuffer);
+	ReleaseProgram();
+	rasterizer.Release();
+	state.Release();
+	clReleaseMemObject(packedPositionsBuffer);
+	clReleaseMemObject(packedVelocitiesBuffer);
     clReleaseCommandQueue(queue);
-    clReleaseProgram(program);
     clReleaseContext(context);
 	return 0;
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "OpenCLUtils.h"
 #include "OpenCVUtils.h"
+#include "PointOps.h"
+#include "Timer.h"
 
 #include "opencv2/opencv.hpp"
 
@@ -15,6 +17,8 @@ cl_kernel kernel = nullptr;
 cl_command_queue queue = nullptr;
 cl_int err = -1;
 
+PointOpEngine pointOpEngine;
+
 bool AdjustBrightness(const cv::Mat& input,
 					  float factor,
 					  cv::Mat& output)
@@ -79,6 +83,122 @@ bool AdjustBrightness(const cv::Mat& input,
     return true;
 }
 
+bool AdjustFused(const cv::Mat& input,
+				 const PointOpChain& chain,
+				 cv::Mat& output)
+{
+	const size_t dataSize = input.cols * input.rows * input.channels() * sizeof(unsigned char);
+	cl_mem inputA = OpenCLUtils::create_input_buffer(context, input.data, dataSize);
+	cl_mem output_buffer = OpenCLUtils::create_output_buffer(context, dataSize);
+
+	const int numPixels = input.cols * input.rows;
+	if (!pointOpEngine.Apply(queue, chain, inputA, numPixels, output_buffer))
+		return false;
+
+    /* Read the kernel's output    */
+    err = clEnqueueReadBuffer(queue,
+                              output_buffer,
+                              CL_TRUE,
+                              0,
+                              dataSize,
+                              output.data,
+                              0,
+                              NULL,
+                              NULL);
+    if (err < 0)
+    {
+        perror("Couldn't read the buffer");
+        return false;
+    }
+
+	clReleaseMemObject(inputA);
+	clReleaseMemObject(output_buffer);
+	return true;
+}
+
+bool BenchmarkFused(const cv::Mat& input,
+					const std::vector<PointOpChain>& operations)
+{
+	const size_t dataSize = input.cols * input.rows * input.channels() * sizeof(unsigned char);
+	cl_mem inputA = OpenCLUtils::create_input_buffer(context, input.data, dataSize);
+	cl_mem output_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, dataSize, NULL, &err);
+
+	const int numPixels = input.cols * input.rows;
+	const int Iterations = 20;
+
+	// Compose every operation into a single chain
+	PointOpChain fused;
+	for (const PointOpChain& operation : operations)
+		fused.Append(operation);
+
+	// One pass per operation, as with the separate single-op kernels
+	const auto RunSeparate = [&]()
+	{
+		bool success = pointOpEngine.Apply(queue, operations.front(), inputA, numPixels, output_buffer);
+		for (size_t i = 1; i < operations.size(); ++i)
+			success &= pointOpEngine.Apply(queue, operations[i], output_buffer, numPixels, output_buffer);
+		return success;
+	};
+
+	// Keep the result of the passes one at a time to verify the fused pass against
+	std::vector<uint8_t> separate(dataSize);
+	if (!RunSeparate())
+		return false;
+	clEnqueueReadBuffer(queue, output_buffer, CL_TRUE, 0, dataSize, separate.data(), 0, NULL, NULL);
+
+	if (!pointOpEngine.Apply(queue, fused, inputA, numPixels, output_buffer))
+		return false;
+	clFinish(queue);
+
+	Timer timer(true);
+	for (int i = 0; i < Iterations; ++i)
+	{
+		if (!RunSeparate())
+			return false;
+	}
+	clFinish(queue);
+	const double separate_ms = timer.Stop_ms() / Iterations;
+
+	timer.Start();
+	for (int i = 0; i < Iterations; ++i)
+	{
+		if (!pointOpEngine.Apply(queue, fused, inputA, numPixels, output_buffer))
+			return false;
+	}
+	clFinish(queue);
+	const double fused_ms = timer.Stop_ms() / Iterations;
+
+	// Verify the fused pass against the operations applied one at a time, on the device
+	// and on the host, rather than against the fused stages themselves
+	std::vector<uint8_t> result(dataSize);
+	clEnqueueReadBuffer(queue, output_buffer, CL_TRUE, 0, dataSize, result.data(), 0, NULL, NULL);
+
+	std::vector<uint8_t> reference(input.data, input.data + dataSize);
+	for (const PointOpChain& operation : operations)
+		operation.ApplyReference(reference.data(), numPixels, reference.data());
+
+	int maxSeparateDifference = 0;
+	int maxReferenceDifference = 0;
+	for (size_t i = 0; i < dataSize; ++i)
+	{
+		maxSeparateDifference = std::max(maxSeparateDifference, std::abs(result[i] - separate[i]));
+		maxReferenceDifference = std::max(maxReferenceDifference, std::abs(result[i] - reference[i]));
+	}
+
+	printf("%zu Operations - Separate: %.3f ms (%zu passes)\tFused: %.3f ms (%zu passes)\tMax Difference: %d (separate), %d (sequential reference)\n",
+		   operations.size(),
+		   separate_ms,
+		   operations.size(),
+		   fused_ms,
+		   fused.GetStages().size(),
+		   maxSeparateDifference,
+		   maxReferenceDifference);
+
+	clReleaseMemObject(inputA);
+	clReleaseMemObject(output_buffer);
+	return true;
+}
+
 bool InitializeDeviceAndContext()
 {
 	device = OpenCLUtils::create_device();
@@ -116,6 +236,9 @@ bool InitializeProgram()
 		perror("Couldn't create a kernel");
 		return false;
 	};
+
+	if (!pointOpEngine.Initialize(context, device))
+		return false;
     return true;
 }
 
@@ -137,8 +260,45 @@ int main()
 	cv::Mat outputImg(inputImg.rows, inputImg.cols, inputImg.type(), cv::Scalar(0, 0, 0));
 
 	const float factor = 1.25f;
-    if (!AdjustBrightness(inputImg, factor, outputImg))
-        return -1;
+
+	// Fuse the brightness adjustment with further point operations into one pass
+	const bool UseFusedChain = false;
+	const bool RunBenchmark = false;
+
+	if (UseFusedChain)
+	{
+		PointOpChain chain;
+		chain.Brightness(factor)
+			 .Contrast(1.1f)
+			 .Gamma(1.2f)
+			 .Sepia();
+
+		// The point operations expect RGBA channel order
+		cv::Mat inputImgRGBA;
+		cv::cvtColor(inputImg, inputImgRGBA, cv::COLOR_BGRA2RGBA);
+
+		if (RunBenchmark)
+		{
+			std::vector<PointOpChain> operations(4);
+			operations[0].Brightness(factor);
+			operations[1].Contrast(1.1f);
+			operations[2].Gamma(1.2f);
+			operations[3].Sepia();
+
+			if (!BenchmarkFused(inputImgRGBA, operations))
+				return -1;
+		}
+
+		if (!AdjustFused(inputImgRGBA, chain, outputImg))
+			return -1;
+
+		cv::cvtColor(outputImg, outputImg, cv::COLOR_RGBA2BGRA);
+	}
+	else
+	{
+		if (!AdjustBrightness(inputImg, factor, outputImg))
+			return -1;
+	}
 
     /// Check Results ---------------------------------------------------------
 
@@ -156,6 +316,7 @@ int main()
     
     ///* Deallocate resources */
     
+	pointOpEngine.Release();
     clReleaseCommandQueue(queue);
     clReleaseProgram(program);
     clReleaseContext(context);
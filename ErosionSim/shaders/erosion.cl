@@ -1,37 +1,62 @@
-__kernel void simulate(__global float* height_map,
-                       __global float* water_map,
-                       __global float* sediment_map,
-                       const float erosion_rate,   
-                       const float deposition_rate,
-                       const float flow_speed,     
-                       const int width,
-                       const int height)
+// Height field erosion in two passes per step, so every cell is only ever
+// written by its own work-item and the sediment is conserved:
+//   1. erode computes the flow of every cell from the current heights, moves
+//      eroded terrain into its sediment and splits the sediment into the
+//      part that stays and the outflow sent to a single target cell.
+//   2. transport gathers the outflow of every neighbour targeting the cell
+//      and deposits part of the sediment back onto the terrain.
+// The heights are double buffered since erode reads the neighbours', the
+// sediment is only read and written by its own cell in both passes. The
+// terrain plus sediment summed over the map only changes by rounding, and
+// the gather visits the neighbours in a fixed order, so every run gives the
+// same result.
+
+__kernel void erode(__global const float* height_map,
+                    __global const float* water_map,
+                    __global float* sediment_map,
+                    const float erosion_rate,
+                    const float flow_speed,
+                    const int width,
+                    const int height,
+                    __global float* height_out,
+                    __global float* outflow,
+                    __global int* targets)
 {
     int x = get_global_id(0);
     int y = get_global_id(1);
+    if (x >= width || y >= height)
+        return;
+
     int idx = y * width + x;
+    float terrain = height_map[idx];
 
-    if (x <= 0 || x >= width - 1 || y <= 0 || y >= height - 1) 
+    // Border cells neither erode nor send sediment, they still receive it
+    if (x <= 0 || x >= width - 1 || y <= 0 || y >= height - 1)
+    {
+        height_out[idx] = terrain;
+        outflow[idx] = 0.0f;
+        targets[idx] = idx;
         return;
+    }
 
     // Water flow directions
     float flow_x = 0.0f;
     float flow_y = 0.0f;
 
     // Calculate height differences with neighbors
-    float height_center = height_map[idx] + water_map[idx];
-    for (int dx = -1; dx <= 1; dx++) 
+    float height_center = terrain + water_map[idx];
+    for (int dx = -1; dx <= 1; dx++)
     {
-        for (int dy = -1; dy <= 1; dy++) 
+        for (int dy = -1; dy <= 1; dy++)
         {
-            if (dx == 0 && dy == 0) 
+            if (dx == 0 && dy == 0)
                 continue;
 
             int neighbor_idx = (y + dy) * width + (x + dx);
             float neighbor_height = height_map[neighbor_idx] + water_map[neighbor_idx];
 
             float delta = height_center - neighbor_height;
-            if (delta > 0) 
+            if (delta > 0)
             {
                 flow_x += dx * delta;
                 flow_y += dy * delta;
@@ -41,38 +66,70 @@ __kernel void simulate(__global float* height_map,
 
     // Normalize flow direction
     float magnitude = sqrt(flow_x * flow_x + flow_y * flow_y);
-    if (magnitude > 0) 
+    if (magnitude > 0)
     {
         flow_x /= magnitude;
         flow_y /= magnitude;
     }
-    else 
+    else
     {
         flow_x = 0.0f;
         flow_y = 0.0f;
     }
 
-    // Erode terrain and add sediment
-    float erosion = erosion_rate * magnitude;
-    height_map[idx] -= erosion;
-    sediment_map[idx] += erosion;
+    // Erode terrain and add sediment, never more terrain than is left
+    float erosion = fmin(erosion_rate * magnitude, fmax(terrain, 0.0f));
+    float sediment = sediment_map[idx] + erosion;
 
-    // Move sediment based on flow
+    // Send sediment along the flow, at most all of it
     int target_x = clamp((int)(x + flow_x * flow_speed), 0, width - 1);
     int target_y = clamp((int)(y + flow_y * flow_speed), 0, height - 1);
     int target_idx = target_y * width + target_x;
 
-    float sediment_transfer = sediment_map[idx] * flow_speed;
-    sediment_map[idx] -= sediment_transfer;
-    sediment_map[target_idx] += sediment_transfer;
+    float sediment_transfer = (target_idx != idx) ? sediment * clamp(flow_speed, 0.0f, 1.0f) : 0.0f;
 
-    // Deposit sediment
-    float deposition = deposition_rate * sediment_map[idx];
-    sediment_map[idx] -= deposition;
-    height_map[idx] += deposition;
+    height_out[idx] = terrain - erosion;
+    sediment_map[idx] = sediment - sediment_transfer;
+    outflow[idx] = sediment_transfer;
+    targets[idx] = target_idx;
+}
+
+// Gathers the outflow of the neighbours within reach cells that target this
+// cell, reach must cover the furthest target of erode, ceil(flow_speed).
+__kernel void transport(__global const float* outflow,
+                        __global const int* targets,
+                        const float deposition_rate,
+                        const int reach,
+                        const int width,
+                        const int height,
+                        __global float* height_map,
+                        __global float* sediment_map)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width || y >= height)
+        return;
+
+    int idx = y * width + x;
+    float sediment = sediment_map[idx];
+
+    for (int ny = max(y - reach, 0); ny <= min(y + reach, height - 1); ++ny)
+    {
+        for (int nx = max(x - reach, 0); nx <= min(x + reach, width - 1); ++nx)
+        {
+            int neighbor_idx = ny * width + nx;
+            if (neighbor_idx != idx && targets[neighbor_idx] == idx)
+                sediment += outflow[neighbor_idx];
+        }
+    }
+
+    // Deposit sediment, border cells only collect it
+    if (x > 0 && x < width - 1 && y > 0 && y < height - 1)
+    {
+        float deposition = deposition_rate * sediment;
+        sediment -= deposition;
+        height_map[idx] += deposition;
+    }
 
-    // Prevent over or underflow
-    height_map[idx] = fmax(height_map[idx], 0.0f);
-    water_map[idx] = fmax(water_map[idx], 0.0f);
-    sediment_map[idx] = fmax(sediment_map[idx], 0.0f);
+    sediment_map[idx] = sediment;
 }
@@ -0,0 +1,213 @@
+// Virtual pipe hydraulic erosion (Mei et al. 2007). Every cell holds a
+// terrain height, a water height and suspended sediment, and is connected to
+// its four edge neighbours by virtual pipes carrying an outflow flux. One
+// step runs the stages in order, each its own kernel:
+//   1. add_rain        water += rain
+//   2. update_flux     outflow flux per edge from the water surface slopes
+//   3. update_water    water height from the net flux, and the velocity field
+//   4. erode_deposit   sediment capacity from tilt and speed, erosion or deposition
+//   5. advect_sediment semi-Lagrangian transport of the sediment along the velocity
+//   6. evaporate       water *= 1 - evaporation
+// Stages reading neighbours write a second buffer which the host swaps with
+// the first, stages only touching their own cell update in place. The flux
+// is float4(left, right, top, bottom), top being y - 1. The map border is
+// closed, no flux leaves through it.
+
+inline int cell_index(int x, int y, int width)
+{
+    return y * width + x;
+}
+
+__kernel void add_rain(__global float* water,
+                       const float rain_rate,
+                       const float dt,
+                       const int width,
+                       const int height)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width || y >= height)
+        return;
+
+    water[cell_index(x, y, width)] += rain_rate * dt;
+}
+
+// The flux along every pipe accelerates with the difference of the water
+// surfaces at its ends, then all four are scaled down together so a cell
+// never sends more water than it holds.
+__kernel void update_flux(__global const float* terrain,
+                          __global const float* water,
+                          __global const float4* flux,
+                          const float dt,
+                          const float pipe_area,
+                          const float gravity,
+                          const float cell_size,
+                          const int width,
+                          const int height,
+                          __global float4* flux_out)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width || y >= height)
+        return;
+
+    int idx = cell_index(x, y, width);
+    float d = water[idx];
+    float surface = terrain[idx] + d;
+    float pipe = dt * pipe_area * gravity / cell_size;
+
+    float4 f = flux[idx];
+    f.x = (x > 0) ? fmax(0.0f, f.x + pipe * (surface - terrain[idx - 1] - water[idx - 1])) : 0.0f;
+    f.y = (x < width - 1) ? fmax(0.0f, f.y + pipe * (surface - terrain[idx + 1] - water[idx + 1])) : 0.0f;
+    f.z = (y > 0) ? fmax(0.0f, f.z + pipe * (surface - terrain[idx - width] - water[idx - width])) : 0.0f;
+    f.w = (y < height - 1) ? fmax(0.0f, f.w + pipe * (surface - terrain[idx + width] - water[idx + width])) : 0.0f;
+
+    float outflow = (f.x + f.y + f.z + f.w) * dt;
+    if (outflow > 0.0f)
+        f *= fmin(1.0f, d * cell_size * cell_size / outflow);
+
+    flux_out[idx] = f;
+}
+
+// Moves the net flux of the cell into its water height and derives the
+// velocity from the water passing through the cell in x and y.
+__kernel void update_water(__global const float* water,
+                           __global const float4* flux,
+                           const float dt,
+                           const float cell_size,
+                           const int width,
+                           const int height,
+                           __global float* water_out,
+                           __global float2* velocity)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width || y >= height)
+        return;
+
+    int idx = cell_index(x, y, width);
+    float4 f = flux[idx];
+
+    // Outflow of the neighbours towards this cell, nothing beyond the border
+    float from_left = (x > 0) ? flux[idx - 1].y : 0.0f;
+    float from_right = (x < width - 1) ? flux[idx + 1].x : 0.0f;
+    float from_top = (y > 0) ? flux[idx - width].w : 0.0f;
+    float from_bottom = (y < height - 1) ? flux[idx + width].z : 0.0f;
+
+    float inflow = from_left + from_right + from_top + from_bottom;
+    float outflow = f.x + f.y + f.z + f.w;
+
+    float d = water[idx];
+    float d_next = fmax(0.0f, d + dt * (inflow - outflow) / (cell_size * cell_size));
+    water_out[idx] = d_next;
+
+    // Water volume passing through the cell per second along each axis
+    float through_x = 0.5f * (from_left - f.x + f.y - from_right);
+    float through_y = 0.5f * (from_top - f.z + f.w - from_bottom);
+
+    float mean_depth = 0.5f * (d + d_next);
+    velocity[idx] = (mean_depth > 1e-4f)
+                  ? (float2)(through_x, through_y) / (cell_size * mean_depth)
+                  : (float2)(0.0f, 0.0f);
+}
+
+// Fast water on steep terrain carries more sediment: below its capacity the
+// water dissolves terrain, above it the excess settles. min_tilt keeps the
+// capacity of flat ground from vanishing.
+__kernel void erode_deposit(__global const float* terrain,
+                            __global const float* sediment,
+                            __global const float2* velocity,
+                            const float dt,
+                            const float cell_size,
+                            const float capacity_rate,
+                            const float dissolve_rate,
+                            const float deposition_rate,
+                            const float min_tilt,
+                            const int width,
+                            const int height,
+                            __global float* terrain_out,
+                            __global float* sediment_out)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width || y >= height)
+        return;
+
+    int idx = cell_index(x, y, width);
+
+    // Sine of the local tilt from the central differences of the terrain
+    float left = terrain[cell_index(max(x - 1, 0), y, width)];
+    float right = terrain[cell_index(min(x + 1, width - 1), y, width)];
+    float top = terrain[cell_index(x, max(y - 1, 0), width)];
+    float bottom = terrain[cell_index(x, min(y + 1, height - 1), width)];
+    float2 gradient = (float2)(right - left, bottom - top) / (2.0f * cell_size);
+    float slope = length(gradient);
+    float tilt = fmax(slope / sqrt(1.0f + slope * slope), min_tilt);
+
+    float b = terrain[idx];
+    float s = sediment[idx];
+    float capacity = capacity_rate * tilt * length(velocity[idx]);
+
+    if (capacity > s)
+    {
+        float dissolved = fmin(dissolve_rate * (capacity - s) * dt, fmax(b, 0.0f));
+        b -= dissolved;
+        s += dissolved;
+    }
+    else
+    {
+        float deposited = fmin(deposition_rate * (s - capacity) * dt, s);
+        b += deposited;
+        s -= deposited;
+    }
+
+    terrain_out[idx] = b;
+    sediment_out[idx] = s;
+}
+
+// Every cell pulls its sediment from where the water came from one step
+// ago, bilinearly interpolated and clamped to the map.
+__kernel void advect_sediment(__global const float* sediment,
+                              __global const float2* velocity,
+                              const float dt,
+                              const float cell_size,
+                              const int width,
+                              const int height,
+                              __global float* sediment_out)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width || y >= height)
+        return;
+
+    int idx = cell_index(x, y, width);
+
+    float2 source = (float2)((float)x, (float)y) - velocity[idx] * (dt / cell_size);
+    source = clamp(source, (float2)(0.0f, 0.0f), (float2)((float)(width - 1), (float)(height - 1)));
+
+    int x0 = (int)source.x;
+    int y0 = (int)source.y;
+    int x1 = min(x0 + 1, width - 1);
+    int y1 = min(y0 + 1, height - 1);
+    float fx = source.x - (float)x0;
+    float fy = source.y - (float)y0;
+
+    float top = mix(sediment[cell_index(x0, y0, width)], sediment[cell_index(x1, y0, width)], fx);
+    float bottom = mix(sediment[cell_index(x0, y1, width)], sediment[cell_index(x1, y1, width)], fx);
+    sediment_out[idx] = mix(top, bottom, fy);
+}
+
+__kernel void evaporate(__global float* water,
+                        const float evaporation_rate,
+                        const float dt,
+                        const int width,
+                        const int height)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width || y >= height)
+        return;
+
+    int idx = cell_index(x, y, width);
+    water[idx] *= fmax(0.0f, 1.0f - evaporation_rate * dt);
+}
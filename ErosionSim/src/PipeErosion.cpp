@@ -0,0 +1,232 @@
+#include "PipeErosion.h"
+
+#include "OpenCLUtils.h"
+
+#include <utility>
+#include <vector>
+#include <stdio.h>
+
+bool PipeErosion::Initialize(cl_context context, cl_device_id device)
+{
+	cl_int err = -1;
+
+	mContext = context;
+
+	mProgram = OpenCLUtils::build_program(context, device, "shaders/pipe_erosion.cl");
+	if (!mProgram)
+		return false;
+
+	const std::pair<cl_kernel*, const char*> kernels[] =
+	{
+		{ &mRainKernel, "add_rain" },
+		{ &mFluxKernel, "update_flux" },
+		{ &mWaterKernel, "update_water" },
+		{ &mErodeKernel, "erode_deposit" },
+		{ &mAdvectKernel, "advect_sediment" },
+		{ &mEvaporateKernel, "evaporate" }
+	};
+
+	for (const auto& [kernel, name] : kernels)
+	{
+		*kernel = clCreateKernel(mProgram, name, &err);
+		if (err < 0)
+		{
+			printf("Couldn't create the %s kernel\n", name);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool PipeErosion::Create(const float* terrain, const float* water, int width, int height)
+{
+	ReleaseBuffers();
+
+	mWidth = width;
+	mHeight = height;
+
+	const size_t numCells = static_cast<size_t>(width) * height;
+	const size_t floatSize = numCells * sizeof(float);
+	const std::vector<float> zeros(numCells * 4, 0.0f);
+
+	for (int i = 0; i < 2; ++i)
+	{
+		mTerrain[i] = OpenCLUtils::create_input_buffer(mContext, const_cast<float*>(terrain), floatSize);
+		mWater[i] = OpenCLUtils::create_input_buffer(mContext, const_cast<float*>(water), floatSize);
+		mSediment[i] = OpenCLUtils::create_input_buffer(mContext, const_cast<float*>(zeros.data()), floatSize);
+		mFlux[i] = OpenCLUtils::create_input_buffer(mContext, const_cast<float*>(zeros.data()), numCells * sizeof(cl_float4));
+	}
+	mVelocity = OpenCLUtils::create_input_buffer(mContext, const_cast<float*>(zeros.data()), numCells * sizeof(cl_float2));
+
+	if (!mTerrain[0] || !mTerrain[1] || !mWater[0] || !mWater[1] || !mSediment[0] || !mSediment[1] || !mFlux[0] || !mFlux[1] || !mVelocity)
+	{
+		ReleaseBuffers();
+		return false;
+	}
+	return true;
+}
+
+bool PipeErosion::Enqueue(cl_command_queue queue, cl_kernel kernel, const char* name, KernelProfiler& profiler) const
+{
+	const size_t global[2] = { static_cast<size_t>(mWidth), static_cast<size_t>(mHeight) };
+	cl_int err = clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global, NULL, 0, NULL, profiler.Record(name));
+	if (err < 0)
+	{
+		printf("Couldn't enqueue the %s kernel (%d)\n", name, err);
+		return false;
+	}
+	return true;
+}
+
+bool PipeErosion::Step(cl_command_queue queue, const PipeErosionParams& params, float deltaTime_s, KernelProfiler& profiler)
+{
+	cl_int err = CL_SUCCESS;
+
+	// 1. Rain, in place
+	err |= clSetKernelArg(mRainKernel, 0, sizeof(cl_mem), &mWater[0]);
+	err |= clSetKernelArg(mRainKernel, 1, sizeof(float), &params.rainRate);
+	err |= clSetKernelArg(mRainKernel, 2, sizeof(float), &deltaTime_s);
+	err |= clSetKernelArg(mRainKernel, 3, sizeof(int), &mWidth);
+	err |= clSetKernelArg(mRainKernel, 4, sizeof(int), &mHeight);
+	if (err < 0)
+	{
+		printf("Couldn't set the rain stage arguments (%d)\n", err);
+		return false;
+	}
+	if (!Enqueue(queue, mRainKernel, "add_rain", profiler))
+		return false;
+
+	// 2. Outflow flux, reads the neighbours' water surfaces
+	err = clSetKernelArg(mFluxKernel, 0, sizeof(cl_mem), &mTerrain[0]);
+	err |= clSetKernelArg(mFluxKernel, 1, sizeof(cl_mem), &mWater[0]);
+	err |= clSetKernelArg(mFluxKernel, 2, sizeof(cl_mem), &mFlux[0]);
+	err |= clSetKernelArg(mFluxKernel, 3, sizeof(float), &deltaTime_s);
+	err |= clSetKernelArg(mFluxKernel, 4, sizeof(float), &params.pipeArea);
+	err |= clSetKernelArg(mFluxKernel, 5, sizeof(float), &params.gravity);
+	err |= clSetKernelArg(mFluxKernel, 6, sizeof(float), &params.cellSize);
+	err |= clSetKernelArg(mFluxKernel, 7, sizeof(int), &mWidth);
+	err |= clSetKernelArg(mFluxKernel, 8, sizeof(int), &mHeight);
+	err |= clSetKernelArg(mFluxKernel, 9, sizeof(cl_mem), &mFlux[1]);
+	if (err < 0)
+	{
+		printf("Couldn't set the flux stage arguments (%d)\n", err);
+		return false;
+	}
+	if (!Enqueue(queue, mFluxKernel, "update_flux", profiler))
+		return false;
+	std::swap(mFlux[0], mFlux[1]);
+
+	// 3. Water height and velocity, reads the neighbours' flux
+	err = clSetKernelArg(mWaterKernel, 0, sizeof(cl_mem), &mWater[0]);
+	err |= clSetKernelArg(mWaterKernel, 1, sizeof(cl_mem), &mFlux[0]);
+	err |= clSetKernelArg(mWaterKernel, 2, sizeof(float), &deltaTime_s);
+	err |= clSetKernelArg(mWaterKernel, 3, sizeof(float), &params.cellSize);
+	err |= clSetKernelArg(mWaterKernel, 4, sizeof(int), &mWidth);
+	err |= clSetKernelArg(mWaterKernel, 5, sizeof(int), &mHeight);
+	err |= clSetKernelArg(mWaterKernel, 6, sizeof(cl_mem), &mWater[1]);
+	err |= clSetKernelArg(mWaterKernel, 7, sizeof(cl_mem), &mVelocity);
+	if (err < 0)
+	{
+		printf("Couldn't set the water stage arguments (%d)\n", err);
+		return false;
+	}
+	if (!Enqueue(queue, mWaterKernel, "update_water", profiler))
+		return false;
+	std::swap(mWater[0], mWater[1]);
+
+	// 4. Erosion and deposition, reads the neighbours' terrain for the tilt
+	err = clSetKernelArg(mErodeKernel, 0, sizeof(cl_mem), &mTerrain[0]);
+	err |= clSetKernelArg(mErodeKernel, 1, sizeof(cl_mem), &mSediment[0]);
+	err |= clSetKernelArg(mErodeKernel, 2, sizeof(cl_mem), &mVelocity);
+	err |= clSetKernelArg(mErodeKernel, 3, sizeof(float), &deltaTime_s);
+	err |= clSetKernelArg(mErodeKernel, 4, sizeof(float), &params.cellSize);
+	err |= clSetKernelArg(mErodeKernel, 5, sizeof(float), &params.capacityRate);
+	err |= clSetKernelArg(mErodeKernel, 6, sizeof(float), &params.dissolveRate);
+	err |= clSetKernelArg(mErodeKernel, 7, sizeof(float), &params.depositionRate);
+	err |= clSetKernelArg(mErodeKernel, 8, sizeof(float), &params.minTilt);
+	err |= clSetKernelArg(mErodeKernel, 9, sizeof(int), &mWidth);
+	err |= clSetKernelArg(mErodeKernel, 10, sizeof(int), &mHeight);
+	err |= clSetKernelArg(mErodeKernel, 11, sizeof(cl_mem), &mTerrain[1]);
+	err |= clSetKernelArg(mErodeKernel, 12, sizeof(cl_mem), &mSediment[1]);
+	if (err < 0)
+	{
+		printf("Couldn't set the erosion stage arguments (%d)\n", err);
+		return false;
+	}
+	if (!Enqueue(queue, mErodeKernel, "erode_deposit", profiler))
+		return false;
+	std::swap(mTerrain[0], mTerrain[1]);
+	std::swap(mSediment[0], mSediment[1]);
+
+	// 5. Sediment transport, reads the sediment upstream
+	err = clSetKernelArg(mAdvectKernel, 0, sizeof(cl_mem), &mSediment[0]);
+	err |= clSetKernelArg(mAdvectKernel, 1, sizeof(cl_mem), &mVelocity);
+	err |= clSetKernelArg(mAdvectKernel, 2, sizeof(float), &deltaTime_s);
+	err |= clSetKernelArg(mAdvectKernel, 3, sizeof(float), &params.cellSize);
+	err |= clSetKernelArg(mAdvectKernel, 4, sizeof(int), &mWidth);
+	err |= clSetKernelArg(mAdvectKernel, 5, sizeof(int), &mHeight);
+	err |= clSetKernelArg(mAdvectKernel, 6, sizeof(cl_mem), &mSediment[1]);
+	if (err < 0)
+	{
+		printf("Couldn't set the transport stage arguments (%d)\n", err);
+		return false;
+	}
+	if (!Enqueue(queue, mAdvectKernel, "advect_sediment", profiler))
+		return false;
+	std::swap(mSediment[0], mSediment[1]);
+
+	// 6. Evaporation, in place
+	err = clSetKernelArg(mEvaporateKernel, 0, sizeof(cl_mem), &mWater[0]);
+	err |= clSetKernelArg(mEvaporateKernel, 1, sizeof(float), &params.evaporationRate);
+	err |= clSetKernelArg(mEvaporateKernel, 2, sizeof(float), &deltaTime_s);
+	err |= clSetKernelArg(mEvaporateKernel, 3, sizeof(int), &mWidth);
+	err |= clSetKernelArg(mEvaporateKernel, 4, sizeof(int), &mHeight);
+	if (err < 0)
+	{
+		printf("Couldn't set the evaporation stage arguments (%d)\n", err);
+		return false;
+	}
+	if (!Enqueue(queue, mEvaporateKernel, "evaporate", profiler))
+		return false;
+	return true;
+}
+
+bool PipeErosion::Read(cl_command_queue queue, float* terrain, float* water, float* sediment) const
+{
+	const size_t floatSize = static_cast<size_t>(mWidth) * mHeight * sizeof(float);
+	cl_int err = clEnqueueReadBuffer(queue, mTerrain[0], CL_FALSE, 0, floatSize, terrain, 0, NULL, NULL);
+	err |= clEnqueueReadBuffer(queue, mWater[0], CL_FALSE, 0, floatSize, water, 0, NULL, NULL);
+	err |= clEnqueueReadBuffer(queue, mSediment[0], CL_FALSE, 0, floatSize, sediment, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't read the erosion maps");
+		return false;
+	}
+	return true;
+}
+
+void PipeErosion::ReleaseBuffers()
+{
+	for (cl_mem* buffer : { &mTerrain[0], &mTerrain[1], &mWater[0], &mWater[1], &mSediment[0], &mSediment[1], &mFlux[0], &mFlux[1], &mVelocity })
+	{
+		if (*buffer)
+			clReleaseMemObject(*buffer);
+		*buffer = nullptr;
+	}
+}
+
+void PipeErosion::Release()
+{
+	ReleaseBuffers();
+
+	for (cl_kernel* kernel : { &mRainKernel, &mFluxKernel, &mWaterKernel, &mErodeKernel, &mAdvectKernel, &mEvaporateKernel })
+	{
+		if (*kernel)
+			clReleaseKernel(*kernel);
+		*kernel = nullptr;
+	}
+
+	if (mProgram)
+		clReleaseProgram(mProgram);
+	mProgram = nullptr;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "Cl/cl.h"
+
+#include "KernelProfiler.h"
+
+/// <summary>
+/// Rates of the virtual pipe model, per second of simulated time.
+/// </summary>
+struct PipeErosionParams
+{
+	// Water height added to every cell
+	float rainRate = 0.01f;
+
+	// Cross section of the virtual pipes, gravity and the edge of a cell
+	float pipeArea = 1.0f;
+	float gravity = 9.81f;
+	float cellSize = 1.0f;
+
+	// Sediment carried per unit of tilt and speed, and how fast the water
+	// dissolves terrain below that capacity or deposits the excess above it
+	float capacityRate = 0.1f;
+	float dissolveRate = 0.3f;
+	float depositionRate = 0.3f;
+
+	// Smallest tilt used for the capacity, so flat ground still erodes
+	float minTilt = 0.05f;
+
+	// Fraction of the water evaporated
+	float evaporationRate = 0.02f;
+};
+
+/// <summary>
+/// Hydraulic erosion with the virtual pipe model. Water flows between edge
+/// neighbours through pipes whose flux accelerates with the slope of the
+/// water surface, the resulting velocity field dissolves and deposits
+/// terrain and carries the sediment along. A step is a pipeline of six
+/// kernels, the fields read by their neighbours are double buffered and the
+/// handles are swapped after every stage writing them.
+/// </summary>
+class PipeErosion
+{
+public:
+	/// <summary>
+	/// Builds the pipe erosion program and creates the kernels.
+	/// </summary>
+	/// <param name="context">The OpenCL context</param>
+	/// <param name="device">The device to build the program for</param>
+	/// <returns>True if the kernels were created successfully</returns>
+	bool Initialize(cl_context context, cl_device_id device);
+
+	/// <summary>
+	/// Creates the maps from the initial terrain and water heights, without sediment or flux.
+	/// </summary>
+	/// <param name="terrain">width * height terrain heights</param>
+	/// <param name="water">width * height water heights</param>
+	/// <returns>True if the buffers were created successfully</returns>
+	bool Create(const float* terrain, const float* water, int width, int height);
+
+	/// <summary>
+	/// Enqueues one step of the six stages.
+	/// </summary>
+	/// <param name="queue">The command queue to enqueue the kernels on</param>
+	/// <param name="params">The model rates</param>
+	/// <param name="deltaTime_s">The time step, the flux stays stable while it is well below cellSize / (pipeArea * gravity)</param>
+	/// <param name="profiler">Records the time of every stage when enabled</param>
+	/// <returns>True if the kernels were enqueued successfully</returns>
+	bool Step(cl_command_queue queue, const PipeErosionParams& params, float deltaTime_s, KernelProfiler& profiler);
+
+	/// <summary>
+	/// Enqueues the reads of the current maps, without waiting for them.
+	/// </summary>
+	/// <returns>True if the reads were enqueued successfully</returns>
+	bool Read(cl_command_queue queue, float* terrain, float* water, float* sediment) const;
+
+	/// <summary>
+	/// Releases the maps, kernels and program.
+	/// </summary>
+	void Release();
+private:
+	/// <summary>
+	/// Enqueues a stage over the map, timed under its name.
+	/// </summary>
+	bool Enqueue(cl_command_queue queue, cl_kernel kernel, const char* name, KernelProfiler& profiler) const;
+
+	void ReleaseBuffers();
+private:
+	cl_context mContext = nullptr;
+	cl_program mProgram = nullptr;
+
+	cl_kernel mRainKernel = nullptr;
+	cl_kernel mFluxKernel = nullptr;
+	cl_kernel mWaterKernel = nullptr;
+	cl_kernel mErodeKernel = nullptr;
+	cl_kernel mAdvectKernel = nullptr;
+	cl_kernel mEvaporateKernel = nullptr;
+
+	int mWidth = 0;
+	int mHeight = 0;
+
+	// The current field is always at index 0, the other is the next stage's output
+	cl_mem mTerrain[2] = {};
+	cl_mem mWater[2] = {};
+	cl_mem mSediment[2] = {};
+	cl_mem mFlux[2] = {};
+
+	cl_mem mVelocity = nullptr;
+};
@@ -1,6 +1,10 @@
+#include "FixedTimestep.h"
+#include "KernelProfiler.h"
 #include "OpenCLUtils.h"
 #include "OpenCVUtils.h"
+#include "PipeErosion.h"
 #include "RandomUtils.h"
+#include "RateCounter.h"
 #include "Timer.h"
 
 #include "opencv2/opencv.hpp"
@@ -9,14 +13,73 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <cmath>
 
 cl_device_id device = nullptr;
 cl_context context = nullptr;
 cl_program program = nullptr;
-cl_kernel kernel = nullptr;
+cl_kernel erodeKernel = nullptr;
+cl_kernel transportKernel = nullptr;
 cl_command_queue queue = nullptr;
 cl_int err = -1;
 
+/// <summary>
+/// How the terrain erodes. FlowTransport sends the sediment of every cell
+/// down the steepest descent of the static water surface, VirtualPipe
+/// simulates the water itself with rain, flux, velocity and evaporation.
+/// </summary>
+enum class ErosionModel
+{
+	FlowTransport,
+	VirtualPipe
+};
+
+PipeErosion pipeErosion;
+KernelProfiler profiler;
+
+/// <summary>
+/// Device state of the erosion. The heights are double buffered: erode
+/// reads the current map and writes the other before the two are swapped.
+/// The sediment is updated in place, the outflow and targets are scratch
+/// passed from erode to transport within a step.
+/// </summary>
+struct ErosionState
+{
+public:
+	bool Create(const cv::Mat& heightmap, const cv::Mat& waterMap, const cv::Mat& sedimentMap)
+	{
+		const size_t bufferDataSize = heightmap.total() * sizeof(float);
+		for (int i = 0; i < 2; ++i)
+			heights[i] = OpenCLUtils::create_input_buffer(context, heightmap.data, bufferDataSize);
+		water = OpenCLUtils::create_input_buffer(context, waterMap.data, bufferDataSize);
+		sediment = OpenCLUtils::create_input_buffer(context, sedimentMap.data, bufferDataSize);
+		outflow = OpenCLUtils::create_output_buffer(context, bufferDataSize);
+		targets = OpenCLUtils::create_output_buffer(context, heightmap.total() * sizeof(cl_int));
+		current = 0;
+		return heights[0] && heights[1] && water && sediment && outflow && targets;
+	}
+
+	void Swap() { current = 1 - current; }
+
+	void Release()
+	{
+		for (cl_mem* buffer : { &heights[0], &heights[1], &water, &sediment, &outflow, &targets })
+		{
+			if (*buffer)
+				clReleaseMemObject(*buffer);
+			*buffer = nullptr;
+		}
+	}
+public:
+	cl_mem heights[2] = {};
+	cl_mem water = nullptr;
+	cl_mem sediment = nullptr;
+	cl_mem outflow = nullptr;
+	cl_mem targets = nullptr;
+	int current = 0;
+};
+
 bool InitializeDeviceAndContext()
 {
 	device = OpenCLUtils::create_device();
@@ -33,14 +96,16 @@ bool InitializeDeviceAndContext()
     return true;
 }
 
-bool InitializeProgram()
+bool InitializeProgram(bool profileKernels)
 {
 	/* Build program */
 	program = OpenCLUtils::build_program(context, device, "shaders/erosion.cl");
 	if (!program)
 		return false;
 
-	queue = clCreateCommandQueue(context, device, 0, &err);
+	// Kernel timings need the start and end timestamps of their events
+	const cl_command_queue_properties properties = profileKernels ? CL_QUEUE_PROFILING_ENABLE : 0;
+	queue = clCreateCommandQueue(context, device, properties, &err);
 	if (err < 0)
 	{
 		perror("Couldn't create a command queue");
@@ -48,21 +113,203 @@ bool InitializeProgram()
 	};
 
 	/* Create a kernel */
-	kernel = clCreateKernel(program, "simulate", &err);
+	erodeKernel = clCreateKernel(program, "erode", &err);
 	if (err < 0)
 	{
-		perror("Couldn't create a kernel");
+		perror("Couldn't create the erode kernel");
 		return false;
 	};
-    return true;
+
+	transportKernel = clCreateKernel(program, "transport", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the transport kernel");
+		return false;
+	};
+
+	profiler.SetEnabled(profileKernels);
+	return pipeErosion.Initialize(context, device);
+}
+
+/// <summary>
+/// Sets the erosion parameters and map size on both passes. The transport
+/// gathers from every cell erode can target, ceil(flowSpeed) cells away.
+/// </summary>
+bool SetErosionArgs(float erosionRate, float depositionRate, float flowSpeed, int width, int height)
+{
+	const int reach = std::max(1, static_cast<int>(std::ceil(flowSpeed)));
+
+	err = clSetKernelArg(erodeKernel, 3, sizeof(float), &erosionRate);
+	err |= clSetKernelArg(erodeKernel, 4, sizeof(float), &flowSpeed);
+	err |= clSetKernelArg(erodeKernel, 5, sizeof(int), &width);
+	err |= clSetKernelArg(erodeKernel, 6, sizeof(int), &height);
+
+	err |= clSetKernelArg(transportKernel, 2, sizeof(float), &depositionRate);
+	err |= clSetKernelArg(transportKernel, 3, sizeof(int), &reach);
+	err |= clSetKernelArg(transportKernel, 4, sizeof(int), &width);
+	err |= clSetKernelArg(transportKernel, 5, sizeof(int), &height);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Enqueues one step, erode from the current heights into the other map
+/// followed by the sediment transport, and swaps the heights. The result is
+/// in the current heights afterwards.
+/// </summary>
+bool Step(ErosionState& state, size_t width, size_t height)
+{
+	const size_t global[2] = { width, height };
+	const int next = 1 - state.current;
+
+	err = clSetKernelArg(erodeKernel, 0, sizeof(cl_mem), &state.heights[state.current]);
+	err |= clSetKernelArg(erodeKernel, 1, sizeof(cl_mem), &state.water);
+	err |= clSetKernelArg(erodeKernel, 2, sizeof(cl_mem), &state.sediment);
+	err |= clSetKernelArg(erodeKernel, 7, sizeof(cl_mem), &state.heights[next]);
+	err |= clSetKernelArg(erodeKernel, 8, sizeof(cl_mem), &state.outflow);
+	err |= clSetKernelArg(erodeKernel, 9, sizeof(cl_mem), &state.targets);
+
+	err |= clSetKernelArg(transportKernel, 0, sizeof(cl_mem), &state.outflow);
+	err |= clSetKernelArg(transportKernel, 1, sizeof(cl_mem), &state.targets);
+	err |= clSetKernelArg(transportKernel, 6, sizeof(cl_mem), &state.heights[next]);
+	err |= clSetKernelArg(transportKernel, 7, sizeof(cl_mem), &state.sediment);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
+
+	err = clEnqueueNDRangeKernel(queue, erodeKernel, 2, NULL, global, NULL, 0, NULL, profiler.Record("erode"));
+	err |= clEnqueueNDRangeKernel(queue, transportKernel, 2, NULL, global, NULL, 0, NULL, profiler.Record("transport"));
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the kernel");
+		return false;
+	}
+
+	state.Swap();
+	return true;
+}
+
+/// <summary>
+/// Enqueues the reads of the current heights and sediment, without waiting for them.
+/// </summary>
+bool ReadMaps(const ErosionState& state, cv::Mat& heightmap, cv::Mat& sedimentMap)
+{
+	const size_t bufferDataSize = heightmap.total() * sizeof(float);
+	err = clEnqueueReadBuffer(queue, state.heights[state.current], CL_FALSE, 0, bufferDataSize, heightmap.data, 0, NULL, NULL);
+	err |= clEnqueueReadBuffer(queue, state.sediment, CL_FALSE, 0, bufferDataSize, sedimentMap.data, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't read the buffer");
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Retrieves the terrain plus sediment of the maps, accumulated in double
+/// precision. Erosion and deposition only move mass between the two.
+/// </summary>
+double GetTotalMass(const cv::Mat& heightmap, const cv::Mat& sedimentMap)
+{
+	return cv::sum(heightmap)[0] + cv::sum(sedimentMap)[0];
+}
+
+/// <summary>
+/// Runs the given number of steps on a copy of the maps, reading them back
+/// every checkInterval steps, and reports the drift of the total mass
+/// relative to the initial one.
+/// </summary>
+bool CheckMassConservation(const cv::Mat& initialHeightmap,
+						   const cv::Mat& waterMap,
+						   const cv::Mat& initialSedimentMap,
+						   int numSteps,
+						   int checkInterval)
+{
+	// Float rounding of the per-cell updates, well below any lost transfer
+	const double Tolerance = 1e-4;
+
+	cv::Mat heightmap = initialHeightmap.clone();
+	cv::Mat sedimentMap = initialSedimentMap.clone();
+	const double initialMass = GetTotalMass(heightmap, sedimentMap);
+
+	// Every exit goes through the release of the state, also when only some buffers were created
+	ErosionState state;
+	bool success = state.Create(heightmap, waterMap, sedimentMap);
+	if (success)
+		printf("%8s  %16s  %16s  %12s\n", "step", "terrain", "sediment", "drift");
+
+	double maxDrift = 0.0;
+	for (int step = 0; success && step < numSteps; )
+	{
+		const int batch = std::min(checkInterval, numSteps - step);
+		for (int i = 0; success && i < batch; ++i)
+			success = Step(state, heightmap.cols, heightmap.rows);
+		step += batch;
+
+		success = success && ReadMaps(state, heightmap, sedimentMap);
+		if (!success)
+			break;
+		clFinish(queue);
+
+		const double terrain = cv::sum(heightmap)[0];
+		const double sediment = cv::sum(sedimentMap)[0];
+		const double drift = std::abs(terrain + sediment - initialMass) / initialMass;
+		maxDrift = std::max(maxDrift, drift);
+		printf("%8d  %16.4f  %16.4f  %12.3e\n", step, terrain, sediment, drift);
+	}
+
+	// Wait for anything enqueued before a failure before the buffers go away
+	clFinish(queue);
+	state.Release();
+	if (!success)
+		return false;
+
+	if (maxDrift <= Tolerance)
+		printf("Mass conserved over %d steps, largest drift %.3e\n", numSteps, maxDrift);
+	else
+		printf("Mass not conserved over %d steps, largest drift %.3e\n", numSteps, maxDrift);
+	return true;
 }
 
 int main()
 {
+	const ErosionModel ActiveModel = ErosionModel::VirtualPipe;
+
+	// Times every kernel on the device and prints the totals on exit
+	const bool ProfileKernels = false;
+
+	// FlowTransport rates
 	const float ErosionRate = 0.005f;
 	const float DepositionRate = 0.01f;
 	const float FlowSpeed = 1.0f;
 
+	// Erosion steps run at a fixed rate of wall-clock time, with at most MaxStepsPerFrame
+	// steps of catch-up per rendered frame
+	const float FixedStep_s = 1.0f / 120.0f;
+	const int MaxStepsPerFrame = 8;
+
+	// Steps run every frame regardless of the clock, to measure the throughput, 0 schedules them by the clock
+	const int StepsPerFrame = 0;
+
+	// VirtualPipe rates, per simulated second
+	PipeErosionParams PipeParams;
+	PipeParams.rainRate = 0.01f;
+	PipeParams.evaporationRate = 0.02f;
+	PipeParams.capacityRate = 0.1f;
+	PipeParams.dissolveRate = 0.3f;
+	PipeParams.depositionRate = 0.3f;
+
+	// Runs MassCheckSteps FlowTransport steps up front and reports the drift of terrain plus sediment
+	const bool RunMassCheck = false;
+	const int MassCheckSteps = 5000;
+	const int MassCheckInterval = 500;
+
 	const uint8_t WaterThresholdValue = 128;
 
 	// Create float-based heightmap and water map
@@ -91,30 +338,31 @@ int main()
 	if (!InitializeDeviceAndContext())
         return -1;
 
-    if (!InitializeProgram())
+    if (!InitializeProgram(ProfileKernels))
         return -1;
 
-	const size_t bufferDataSize = MapWidth * MapHeight * sizeof(float);
-	cl_mem heightMapBuffer = OpenCLUtils::create_input_buffer(context, heightmap.data, bufferDataSize);
-	cl_mem waterMapBuffer = OpenCLUtils::create_input_buffer(context, water_map.data, bufferDataSize);
-	cl_mem sedimentMapBuffer = OpenCLUtils::create_input_buffer(context, sediment_map.data, bufferDataSize);
-
 	/* Create kernel arguments */
-	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &heightMapBuffer);
-	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &waterMapBuffer);
-	err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &sedimentMapBuffer);
-	err |= clSetKernelArg(kernel, 3, sizeof(float), &ErosionRate);
-	err |= clSetKernelArg(kernel, 4, sizeof(float), &DepositionRate);
-	err |= clSetKernelArg(kernel, 5, sizeof(float), &FlowSpeed);
-	err |= clSetKernelArg(kernel, 6, sizeof(int), &MapWidth);
-	err |= clSetKernelArg(kernel, 7, sizeof(int), &MapHeight);
-	if (err < 0)
+	if (!SetErosionArgs(ErosionRate, DepositionRate, FlowSpeed, static_cast<int>(MapWidth), static_cast<int>(MapHeight)))
+		return -1;
+
+	if (RunMassCheck)
 	{
-		perror("Couldn't create a kernel argument");
-		return false;
+		if (!CheckMassConservation(heightmap, water_map, sediment_map, MassCheckSteps, MassCheckInterval))
+			return -1;
+		profiler.Reset();
 	}
 
-	size_t global[2] = { MapWidth, MapHeight };
+	ErosionState state;
+	if (!state.Create(heightmap, water_map, sediment_map))
+		return -1;
+
+	if (!pipeErosion.Create(heightmap.ptr<float>(), water_map.ptr<float>(), static_cast<int>(MapWidth), static_cast<int>(MapHeight)))
+		return -1;
+
+	// Terrain plus sediment gained or lost since the start, only rounding for FlowTransport.
+	// The pipe model's semi-Lagrangian transport is not conservative, its drift shows how far it strays
+	const double initialMass = GetTotalMass(heightmap, sediment_map);
+	double massDrift = 0.0;
 
 	const std::string winName = "Erosion Simulation";
 	cv::namedWindow(winName, cv::WINDOW_AUTOSIZE);
@@ -124,66 +372,48 @@ int main()
 
 	Timer gpuBufferReadTimer;
 	Timer drawTimer;
+	RateCounter rates;
+	FixedTimestep scheduler(FixedStep_s, MaxStepsPerFrame);
+	scheduler.SetStepsPerFrame(StepsPerFrame);
 
 	while (true)
 	{
 		gpuBufferReadTimer.Start();
 
-		err = clEnqueueNDRangeKernel(queue,
-									 kernel,
-									 2,
-									 NULL,
-									 (const size_t*)&global,
-									 NULL,
-									 0,
-									 NULL,
-									 NULL);
-
-		if (err < 0)
+		// The steps are enqueued back to back, the maps are only read back when they changed
+		const int numSteps = scheduler.Advance();
+		for (int step = 0; step < numSteps; ++step)
 		{
-			perror("Couldn't enqueue the kernel");
-			return false;
+			const bool stepped = (ActiveModel == ErosionModel::VirtualPipe)
+							   ? pipeErosion.Step(queue, PipeParams, scheduler.GetStep_s(), profiler)
+							   : Step(state, MapWidth, MapHeight);
+			if (!stepped)
+				return false;
 		}
 
-		/* Read the kernel's output    */
-		err = clEnqueueReadBuffer(queue,
-								  heightMapBuffer,
-								  CL_FALSE,
-								  0,
-								  bufferDataSize,
-								  heightmap.data,
-								  0,
-								  NULL,
-								  NULL);
-
-		err |= clEnqueueReadBuffer(queue,
-								   sedimentMapBuffer,
-								   CL_FALSE,
-								   0,
-								   bufferDataSize,
-								   sediment_map.data,
-								   0,
-								   NULL,
-								   NULL);
-
-		if (err < 0)
+		if (numSteps > 0)
 		{
-			perror("Couldn't read the buffer");
-			return false;
+			/* Read the kernel's output    */
+			const bool read = (ActiveModel == ErosionModel::VirtualPipe)
+							? pipeErosion.Read(queue, heightmap.ptr<float>(), water_map.ptr<float>(), sediment_map.ptr<float>())
+							: ReadMaps(state, heightmap, sediment_map);
+			if (!read)
+				return false;
+
+			clFinish(queue);
+			profiler.Collect();
+			massDrift = GetTotalMass(heightmap, sediment_map) - initialMass;
 		}
 
-		clFinish(queue);
-
 		const double gpuBufferTime_ms = gpuBufferReadTimer.Elapsed_ms();
 
 		// Visualization logic
 		drawTimer.Start();
 
-		// Apply sediment visualization factor
-		sediment_map *= SedimentVisualizeFactor;
-
+		// Apply sediment visualization factor, the read back map is kept as is since frames without steps redraw it
 		heightmap.copyTo(outputImg(cv::Rect(0, 0, heightmap.cols, heightmap.rows)));
-		sediment_map.copyTo(outputImg(cv::Rect(MapWidth, 0, sediment_map.cols, sediment_map.rows)));
+		cv::Mat sedimentView = outputImg(cv::Rect(MapWidth, 0, sediment_map.cols, sediment_map.rows));
+		sediment_map.convertTo(sedimentView, CV_32F, SedimentVisualizeFactor);
 		water_map.copyTo(outputImg(cv::Rect(MapWidth * 2, 0, water_map.cols, water_map.rows)));
 
 		cv::imshow(winName, outputImg);
@@ -195,17 +425,25 @@ int main()
 		}
 
 		const double drawTime_ms = drawTimer.Elapsed_ms();
+		rates.AddFrame(numSteps);
 
-		std::cout << "GPU Read Time: " << std::to_string(gpuBufferTime_ms) << "\tDraw Time: " << std::to_string(drawTime_ms) << std::endl;
+		std::cout << "GPU Read Time: " << std::to_string(gpuBufferTime_ms) << "\tDraw Time: " << std::to_string(drawTime_ms)
+				  << "\tSteps/s: " << std::to_string(rates.GetStepsPerSecond()) << "\tFPS: " << std::to_string(rates.GetFramesPerSecond())
+				  << "\tMass drift: " << std::to_string(massDrift) << std::endl;
 	}
 
 	cv::destroyWindow(winName);
 
+	if (profiler.IsEnabled())
+		profiler.Print();
+
     ///* Deallocate resources */
     
-	clReleaseKernel(kernel);
-	clReleaseMemObject(heightMapBuffer);
-	clReleaseMemObject(waterMapBuffer);
+	profiler.Reset();
+	pipeErosion.Release();
+	state.Release();
+	clReleaseKernel(erodeKernel);
+	clReleaseKernel(transportKernel);
     clReleaseCommandQueue(queue);
     clReleaseProgram(program);
     clReleaseContext(context);
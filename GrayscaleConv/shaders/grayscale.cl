@@ -7,6 +7,9 @@ __kernel void grayscale(__global const uchar* input,
     int x = get_global_id(0);
     int y = get_global_id(1);
 
+    if (x >= width || y >= height)
+        return;
+
     int idx = (y * width + x) * 3;
 
     uchar r = input[idx];
@@ -15,3 +18,93 @@ __kernel void grayscale(__global const uchar* input,
 
     output[y * width + x] = (uchar)(0.3f * r + 0.59f * g + 0.11f * b);
 }
+
+// Vectorized variants: each work-item converts 16 pixels with wide vload16 /
+// vstore16 transactions. The weights are given in memory channel order, so
+// the same kernels serve BGR and RGB (or BGRA and RGBA) layouts.
+
+#define PIXELS_PER_ITEM 16
+
+__kernel void grayscale_vec16_c3(__global const uchar* input,
+                                 float4 weights,
+                                 int num_pixels,
+                                 __global uchar* output)
+{
+    int base = get_global_id(0) * PIXELS_PER_ITEM;
+    if (base >= num_pixels)
+        return;
+
+    if (base + PIXELS_PER_ITEM <= num_pixels)
+    {
+        // 16 packed 3-channel pixels span exactly three uchar16
+        __global const uchar* src = input + base * 3;
+        uchar16 a = vload16(0, src);
+        uchar16 b = vload16(1, src);
+        uchar16 c = vload16(2, src);
+
+        uchar16 c0 = (uchar16)(a.s0, a.s3, a.s6, a.s9, a.sc, a.sf, b.s2, b.s5,
+                               b.s8, b.sb, b.se, c.s1, c.s4, c.s7, c.sa, c.sd);
+        uchar16 c1 = (uchar16)(a.s1, a.s4, a.s7, a.sa, a.sd, b.s0, b.s3, b.s6,
+                               b.s9, b.sc, b.sf, c.s2, c.s5, c.s8, c.sb, c.se);
+        uchar16 c2 = (uchar16)(a.s2, a.s5, a.s8, a.sb, a.se, b.s1, b.s4, b.s7,
+                               b.sa, b.sd, c.s0, c.s3, c.s6, c.s9, c.sc, c.sf);
+
+        float16 luma = weights.x * convert_float16(c0) +
+                       weights.y * convert_float16(c1) +
+                       weights.z * convert_float16(c2);
+
+        vstore16(convert_uchar16_sat_rte(luma), 0, output + base);
+    }
+    else
+    {
+        // Bounds-checked tail
+        for (int i = base; i < num_pixels; ++i)
+        {
+            float luma = weights.x * input[i * 3] +
+                         weights.y * input[i * 3 + 1] +
+                         weights.z * input[i * 3 + 2];
+            output[i] = convert_uchar_sat_rte(luma);
+        }
+    }
+}
+
+__kernel void grayscale_vec16_c4(__global const uchar* input,
+                                 float4 weights,
+                                 int num_pixels,
+                                 __global uchar* output)
+{
+    int base = get_global_id(0) * PIXELS_PER_ITEM;
+    if (base >= num_pixels)
+        return;
+
+    if (base + PIXELS_PER_ITEM <= num_pixels)
+    {
+        // 16 packed 4-channel pixels span four uchar16, the fourth channel is skipped
+        __global const uchar* src = input + base * 4;
+        uchar16 a = vload16(0, src);
+        uchar16 b = vload16(1, src);
+        uchar16 c = vload16(2, src);
+        uchar16 d = vload16(3, src);
+
+        uchar16 c0 = (uchar16)(a.s048c, b.s048c, c.s048c, d.s048c);
+        uchar16 c1 = (uchar16)(a.s159d, b.s159d, c.s159d, d.s159d);
+        uchar16 c2 = (uchar16)(a.s26ae, b.s26ae, c.s26ae, d.s26ae);
+
+        float16 luma = weights.x * convert_float16(c0) +
+                       weights.y * convert_float16(c1) +
+                       weights.z * convert_float16(c2);
+
+        vstore16(convert_uchar16_sat_rte(luma), 0, output + base);
+    }
+    else
+    {
+        // Bounds-checked tail
+        for (int i = base; i < num_pixels; ++i)
+        {
+            float luma = weights.x * input[i * 4] +
+                         weights.y * input[i * 4 + 1] +
+                         weights.z * input[i * 4 + 2];
+            output[i] = convert_uchar_sat_rte(luma);
+        }
+    }
+}
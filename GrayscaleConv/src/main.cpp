@@ -1,5 +1,6 @@
 #include "OpenCLUtils.h"
 #include "OpenCVUtils.h"
+#include "Timer.h"
 
 #include "opencv2/opencv.hpp"
 
@@ -7,14 +8,63 @@
 
 #include <vector>
 #include <string>
+#include <functional>
+#include <algorithm>
 
 cl_device_id device = nullptr;
 cl_context context = nullptr;
 cl_program program = nullptr;
 cl_kernel kernel = nullptr;
+cl_kernel vec3Kernel = nullptr;
+cl_kernel vec4Kernel = nullptr;
 cl_command_queue queue = nullptr;
 cl_int err = -1;
 
+enum class PixelLayout
+{
+	BGR,
+	BGRA,
+	RGB
+};
+
+enum class LumaWeights
+{
+	BT601,
+	BT709
+};
+
+constexpr size_t Pixels_Per_Item = 16;
+
+int GetChannelCount(PixelLayout layout)
+{
+	return layout == PixelLayout::BGRA ? 4 : 3;
+}
+
+/// <summary>
+/// Retrieves the luma weights ordered as the channels are laid out in memory.
+/// </summary>
+cl_float4 GetChannelWeights(PixelLayout layout, LumaWeights weights)
+{
+	const float r = (weights == LumaWeights::BT709) ? 0.2126f : 0.299f;
+	const float g = (weights == LumaWeights::BT709) ? 0.7152f : 0.587f;
+	const float b = (weights == LumaWeights::BT709) ? 0.0722f : 0.114f;
+
+	cl_float4 channelWeights = {};
+	if (layout == PixelLayout::RGB)
+	{
+		channelWeights.x = r;
+		channelWeights.y = g;
+		channelWeights.z = b;
+	}
+	else
+	{
+		channelWeights.x = b;
+		channelWeights.y = g;
+		channelWeights.z = r;
+	}
+	return channelWeights;
+}
+
 bool GrayscaleImage(const cv::Mat& input,
                     cv::Mat& output)
 {
@@ -77,6 +127,182 @@ bool GrayscaleImage(const cv::Mat& input,
     return true;
 }
 
+bool EnqueueGrayscaleVec16(cl_mem input,
+						   int numPixels,
+						   PixelLayout layout,
+						   LumaWeights weights,
+						   cl_mem output)
+{
+	cl_kernel vecKernel = (GetChannelCount(layout) == 4) ? vec4Kernel : vec3Kernel;
+	const cl_float4 channelWeights = GetChannelWeights(layout, weights);
+
+	err = clSetKernelArg(vecKernel, 0, sizeof(cl_mem), &input);
+	err |= clSetKernelArg(vecKernel, 1, sizeof(cl_float4), &channelWeights);
+	err |= clSetKernelArg(vecKernel, 2, sizeof(int), &numPixels);
+	err |= clSetKernelArg(vecKernel, 3, sizeof(cl_mem), &output);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
+
+	// One work-item per 16 pixels, the last one handles the remainder
+	const size_t global = (static_cast<size_t>(numPixels) + Pixels_Per_Item - 1) / Pixels_Per_Item;
+
+	err = clEnqueueNDRangeKernel(queue,
+								 vecKernel,
+								 1,
+								 NULL,
+								 &global,
+								 NULL,
+								 0,
+								 NULL,
+								 NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the kernel");
+		return false;
+	}
+	return true;
+}
+
+bool GrayscaleImageVec16(const cv::Mat& input,
+						 PixelLayout layout,
+						 LumaWeights weights,
+						 cv::Mat& output)
+{
+	const size_t inputDataSize = input.cols * input.rows * input.channels() * sizeof(unsigned char);
+	const size_t outputDataSize = input.cols * input.rows * output.channels() * sizeof(unsigned char);
+	cl_mem inputA = OpenCLUtils::create_input_buffer(context, input.data, inputDataSize);
+	cl_mem output_buffer = OpenCLUtils::create_output_buffer(context, outputDataSize);
+
+	if (!EnqueueGrayscaleVec16(inputA, input.cols * input.rows, layout, weights, output_buffer))
+		return false;
+
+    /* Read the kernel's output    */
+    err = clEnqueueReadBuffer(queue,
+                              output_buffer,
+                              CL_TRUE,
+                              0,
+                              outputDataSize,
+                              output.data,
+                              0,
+                              NULL,
+                              NULL);
+    if (err < 0)
+    {
+        perror("Couldn't read the buffer");
+        return false;
+    }
+
+	clReleaseMemObject(inputA);
+	clReleaseMemObject(output_buffer);
+	return true;
+}
+
+bool BenchmarkGrayscale(const cv::Mat& inputBGR)
+{
+	const int width = inputBGR.cols;
+	const int height = inputBGR.rows;
+	const int numPixels = width * height;
+	const int Iterations = 50;
+
+	cv::Mat inputBGRA;
+	cv::Mat inputRGB;
+	cv::cvtColor(inputBGR, inputBGRA, cv::COLOR_BGR2BGRA);
+	cv::cvtColor(inputBGR, inputRGB, cv::COLOR_BGR2RGB);
+
+	cl_mem output_buffer = OpenCLUtils::create_output_buffer(context, numPixels);
+	std::vector<uint8_t> result(numPixels);
+
+	const auto TimeRuns = [&](const std::function<bool()>& enqueue)
+	{
+		enqueue();
+		clFinish(queue);
+
+		Timer timer(true);
+		for (int i = 0; i < Iterations; ++i)
+			enqueue();
+		clFinish(queue);
+		return timer.Stop_ms() / Iterations;
+	};
+
+	const auto ReportTime = [&](const std::string& name, int channels, double elapsed_ms, int maxDifference)
+	{
+		// Bytes read plus bytes written
+		const double gigabytes = static_cast<double>(numPixels) * (channels + 1) / 1e9;
+		printf("%-22s %8.3f ms  %7.2f GB/s", name.c_str(), elapsed_ms, gigabytes / (elapsed_ms / 1000.0));
+		if (maxDifference >= 0)
+			printf("  Max Difference: %d", maxDifference);
+		printf("\n");
+	};
+
+	// Current scalar kernel
+	{
+		cl_mem inputA = OpenCLUtils::create_input_buffer(context, inputBGR.data, numPixels * 3);
+		size_t global[2] = { static_cast<size_t>(width), static_cast<size_t>(height) };
+
+		err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &inputA);
+		err |= clSetKernelArg(kernel, 1, sizeof(int), &width);
+		err |= clSetKernelArg(kernel, 2, sizeof(int), &height);
+		err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &output_buffer);
+		if (err < 0)
+		{
+			perror("Couldn't create a kernel argument");
+			return false;
+		}
+
+		const double elapsed_ms = TimeRuns([&]()
+		{
+			return clEnqueueNDRangeKernel(queue, kernel, 2, NULL, (const size_t*)&global, NULL, 0, NULL, NULL) == CL_SUCCESS;
+		});
+		ReportTime("grayscale (scalar)", 3, elapsed_ms, -1);
+
+		clReleaseMemObject(inputA);
+	}
+
+	// Vectorized kernels per layout and weights
+	const std::pair<PixelLayout, const cv::Mat*> layouts[] =
+	{
+		{ PixelLayout::BGR, &inputBGR },
+		{ PixelLayout::BGRA, &inputBGRA },
+		{ PixelLayout::RGB, &inputRGB }
+	};
+	const char* layoutNames[] = { "BGR", "BGRA", "RGB" };
+
+	for (const auto& [layout, image] : layouts)
+	{
+		const int channels = GetChannelCount(layout);
+		cl_mem inputA = OpenCLUtils::create_input_buffer(context, image->data, static_cast<size_t>(numPixels) * channels);
+
+		for (LumaWeights weights : { LumaWeights::BT601, LumaWeights::BT709 })
+		{
+			const double elapsed_ms = TimeRuns([&]() { return EnqueueGrayscaleVec16(inputA, numPixels, layout, weights, output_buffer); });
+			clEnqueueReadBuffer(queue, output_buffer, CL_TRUE, 0, numPixels, result.data(), 0, NULL, NULL);
+
+			// Host reference
+			const cl_float4 channelWeights = GetChannelWeights(layout, weights);
+			int maxDifference = 0;
+			for (int i = 0; i < numPixels; ++i)
+			{
+				const uint8_t* pixel = image->data + static_cast<size_t>(i) * channels;
+				const float luma = channelWeights.x * pixel[0] + channelWeights.y * pixel[1] + channelWeights.z * pixel[2];
+				const int expected = std::clamp(static_cast<int>(std::lround(luma)), 0, 255);
+				maxDifference = std::max(maxDifference, std::abs(expected - result[i]));
+			}
+
+			const std::string name = std::string("vec16 ") + layoutNames[static_cast<int>(layout)] +
+									 (weights == LumaWeights::BT709 ? " BT.709" : " BT.601");
+			ReportTime(name, channels, elapsed_ms, maxDifference);
+		}
+
+		clReleaseMemObject(inputA);
+	}
+
+	clReleaseMemObject(output_buffer);
+	return true;
+}
+
 bool InitializeDeviceAndContext()
 {
 	device = OpenCLUtils::create_device();
@@ -114,6 +340,20 @@ bool InitializeProgram()
 		perror("Couldn't create a kernel");
 		return false;
 	};
+
+	vec3Kernel = clCreateKernel(program, "grayscale_vec16_c3", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel");
+		return false;
+	};
+
+	vec4Kernel = clCreateKernel(program, "grayscale_vec16_c4", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel");
+		return false;
+	};
     return true;
 }
 
@@ -128,8 +368,27 @@ int main()
 	cv::Mat inputImg = cv::imread("content/test.jpg");
 	cv::Mat outputImg(inputImg.rows, inputImg.cols, CV_8UC1, cv::Scalar(0, 0, 0));
 
-    if (!GrayscaleImage(inputImg, outputImg))
-        return -1;
+	// Vectorized conversion of the packed BGR input
+	const bool UseVectorized = true;
+	const LumaWeights Weights = LumaWeights::BT601;
+	const bool RunBenchmark = false;
+
+	if (RunBenchmark)
+	{
+		if (!BenchmarkGrayscale(inputImg))
+			return -1;
+	}
+
+	if (UseVectorized)
+	{
+		if (!GrayscaleImageVec16(inputImg, PixelLayout::BGR, Weights, outputImg))
+			return -1;
+	}
+	else
+	{
+		if (!GrayscaleImage(inputImg, outputImg))
+			return -1;
+	}
 
     /// Check Results ---------------------------------------------------------
 
@@ -153,6 +412,8 @@ int main()
     
     ///* Deallocate resources */
     
+	clReleaseKernel(vec3Kernel);
+	clReleaseKernel(vec4Kernel);
     clReleaseCommandQueue(queue);
     clReleaseProgram(program);
     clReleaseContext(context);
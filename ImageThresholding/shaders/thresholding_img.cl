@@ -20,3 +20,100 @@ __kernel void threshold(__global const uchar4* input,
         output[index] = (uchar4)(new_color, new_color, new_color, pixel.w);
     }
 }
+
+
+__kernel void luminance(__global const uchar4* input,
+                        int width,
+                        int height,
+                        __global uint* output)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+
+    if (x < width && y < height)
+    {
+        int index = y * width + x;
+        uchar4 pixel = input[index];
+
+        // Same luminance formula as the global threshold
+        output[index] = (uint)(0.299f * pixel.x + 0.587f * pixel.y + 0.114f * pixel.z);
+    }
+}
+
+__kernel void adaptive_threshold(__global const uchar4* input,
+                                 __global const uint* luma,
+                                 __global const uint* sat,
+                                 int radius,
+                                 int bias,
+                                 int width,
+                                 int height,
+                                 __global uchar4* output)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+
+    if (x < width && y < height)
+    {
+        int index = y * width + x;
+
+        // Clamp the window to the image
+        int x0 = max(x - radius, 0) - 1;
+        int y0 = max(y - radius, 0) - 1;
+        int x1 = min(x + radius, width - 1);
+        int y1 = min(y + radius, height - 1);
+
+        // Window sum from four table lookups (the uint wrap-around cancels out)
+        uint sum = sat[y1 * width + x1];
+        if (x0 >= 0)
+            sum -= sat[y1 * width + x0];
+        if (y0 >= 0)
+            sum -= sat[y0 * width + x1];
+        if (x0 >= 0 && y0 >= 0)
+            sum += sat[y0 * width + x0];
+
+        int area = (x1 - x0) * (y1 - y0);
+
+        // Compare against the local mean minus the bias (integer math keeps it exact)
+        int gray = (int)luma[index];
+        uchar new_color = ((long)(gray + bias) * area > (long)sum) ? 255 : 0;
+        output[index] = (uchar4)(new_color, new_color, new_color, input[index].w);
+    }
+}
+
+__kernel void adaptive_threshold_naive(__global const uchar4* input,
+                                       __global const uint* luma,
+                                       int radius,
+                                       int bias,
+                                       int width,
+                                       int height,
+                                       __global uchar4* output)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+
+    if (x < width && y < height)
+    {
+        int index = y * width + x;
+
+        int x0 = max(x - radius, 0);
+        int y0 = max(y - radius, 0);
+        int x1 = min(x + radius, width - 1);
+        int y1 = min(y + radius, height - 1);
+
+        // O(r^2) reference window sum
+        uint sum = 0;
+        for (int wy = y0; wy <= y1; ++wy)
+        {
+            for (int wx = x0; wx <= x1; ++wx)
+            {
+                sum += luma[wy * width + wx];
+            }
+        }
+
+        int area = (x1 - x0 + 1) * (y1 - y0 + 1);
+
+        int gray = (int)luma[index];
+        uchar new_color = ((long)(gray + bias) * area > (long)sum) ? 255 : 0;
+        output[index] = (uchar4)(new_color, new_color, new_color, input[index].w);
+    }
+}
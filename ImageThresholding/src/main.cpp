@@ -1,5 +1,7 @@
 #include "OpenCLUtils.h"
 #include "OpenCVUtils.h"
+#include "SummedAreaTable.h"
+#include "Timer.h"
 
 #include "opencv2/opencv.hpp"
 
@@ -12,9 +14,14 @@ cl_device_id device = nullptr;
 cl_context context = nullptr;
 cl_program program = nullptr;
 cl_kernel kernel = nullptr;
+cl_kernel luminanceKernel = nullptr;
+cl_kernel adaptiveKernel = nullptr;
+cl_kernel adaptiveNaiveKernel = nullptr;
 cl_command_queue queue = nullptr;
 cl_int err = -1;
 
+SummedAreaTable summedAreaTable;
+
 bool Threshold(const cv::Mat& input,
 			   uint8_t threshold,
                cv::Mat& output)
@@ -79,6 +86,223 @@ bool Threshold(const cv::Mat& input,
     return true;
 }
 
+bool EnqueueAdaptiveThreshold(cl_mem input,
+							  cl_mem luma,
+							  cl_mem sat,
+							  int width,
+							  int height,
+							  int radius,
+							  int bias,
+							  bool naive,
+							  cl_mem output)
+{
+	size_t global[2] = { static_cast<size_t>(width), static_cast<size_t>(height) };
+
+	// Luminance pass
+	err = clSetKernelArg(luminanceKernel, 0, sizeof(cl_mem), &input);
+	err |= clSetKernelArg(luminanceKernel, 1, sizeof(int), &width);
+	err |= clSetKernelArg(luminanceKernel, 2, sizeof(int), &height);
+	err |= clSetKernelArg(luminanceKernel, 3, sizeof(cl_mem), &luma);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
+
+	err = clEnqueueNDRangeKernel(queue,
+								 luminanceKernel,
+								 2,
+								 NULL,
+								 (const size_t*)&global,
+								 NULL,
+								 0,
+								 NULL,
+								 NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the kernel");
+		return false;
+	}
+
+	if (naive)
+	{
+		err = clSetKernelArg(adaptiveNaiveKernel, 0, sizeof(cl_mem), &input);
+		err |= clSetKernelArg(adaptiveNaiveKernel, 1, sizeof(cl_mem), &luma);
+		err |= clSetKernelArg(adaptiveNaiveKernel, 2, sizeof(int), &radius);
+		err |= clSetKernelArg(adaptiveNaiveKernel, 3, sizeof(int), &bias);
+		err |= clSetKernelArg(adaptiveNaiveKernel, 4, sizeof(int), &width);
+		err |= clSetKernelArg(adaptiveNaiveKernel, 5, sizeof(int), &height);
+		err |= clSetKernelArg(adaptiveNaiveKernel, 6, sizeof(cl_mem), &output);
+		if (err < 0)
+		{
+			perror("Couldn't create a kernel argument");
+			return false;
+		}
+
+		err = clEnqueueNDRangeKernel(queue,
+									 adaptiveNaiveKernel,
+									 2,
+									 NULL,
+									 (const size_t*)&global,
+									 NULL,
+									 0,
+									 NULL,
+									 NULL);
+		if (err < 0)
+		{
+			perror("Couldn't enqueue the kernel");
+			return false;
+		}
+		return true;
+	}
+
+	// Summed-area table of the luminance
+	if (!summedAreaTable.Compute(queue, luma, width, height, sat))
+		return false;
+
+	err = clSetKernelArg(adaptiveKernel, 0, sizeof(cl_mem), &input);
+	err |= clSetKernelArg(adaptiveKernel, 1, sizeof(cl_mem), &luma);
+	err |= clSetKernelArg(adaptiveKernel, 2, sizeof(cl_mem), &sat);
+	err |= clSetKernelArg(adaptiveKernel, 3, sizeof(int), &radius);
+	err |= clSetKernelArg(adaptiveKernel, 4, sizeof(int), &bias);
+	err |= clSetKernelArg(adaptiveKernel, 5, sizeof(int), &width);
+	err |= clSetKernelArg(adaptiveKernel, 6, sizeof(int), &height);
+	err |= clSetKernelArg(adaptiveKernel, 7, sizeof(cl_mem), &output);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
+
+	err = clEnqueueNDRangeKernel(queue,
+								 adaptiveKernel,
+								 2,
+								 NULL,
+								 (const size_t*)&global,
+								 NULL,
+								 0,
+								 NULL,
+								 NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the kernel");
+		return false;
+	}
+	return true;
+}
+
+bool AdaptiveThreshold(const cv::Mat& input,
+					   int windowSize,
+					   int bias,
+					   cv::Mat& output)
+{
+	const size_t inputDataSize = input.cols * input.rows * input.channels() * sizeof(unsigned char);
+	const size_t outputDataSize = input.cols * input.rows * output.channels() * sizeof(unsigned char);
+	const size_t tableDataSize = input.cols * input.rows * sizeof(cl_uint);
+	cl_mem inputA = OpenCLUtils::create_input_buffer(context, input.data, inputDataSize);
+	cl_mem luma_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, tableDataSize, NULL, &err);
+	cl_mem sat_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, tableDataSize, NULL, &err);
+	cl_mem output_buffer = OpenCLUtils::create_output_buffer(context, outputDataSize);
+
+	const int width = input.cols;
+	const int height = input.rows;
+	const int radius = windowSize / 2;
+
+	if (!EnqueueAdaptiveThreshold(inputA, luma_buffer, sat_buffer, width, height, radius, bias, false, output_buffer))
+		return false;
+
+    /* Read the kernel's output    */
+    err = clEnqueueReadBuffer(queue,
+                              output_buffer,
+                              CL_TRUE,
+                              0,
+                              outputDataSize,
+                              output.data,
+                              0,
+                              NULL,
+                              NULL);
+    if (err < 0)
+    {
+        perror("Couldn't read the buffer");
+        return false;
+    }
+
+	clReleaseMemObject(inputA);
+	clReleaseMemObject(luma_buffer);
+	clReleaseMemObject(sat_buffer);
+	clReleaseMemObject(output_buffer);
+    return true;
+}
+
+bool BenchmarkAdaptiveThreshold(const cv::Mat& input,
+								int bias)
+{
+	const size_t dataSize = input.cols * input.rows * input.channels() * sizeof(unsigned char);
+	const size_t tableDataSize = input.cols * input.rows * sizeof(cl_uint);
+	cl_mem inputA = OpenCLUtils::create_input_buffer(context, input.data, dataSize);
+	cl_mem luma_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, tableDataSize, NULL, &err);
+	cl_mem sat_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, tableDataSize, NULL, &err);
+	cl_mem sat_output = OpenCLUtils::create_output_buffer(context, dataSize);
+	cl_mem naive_output = OpenCLUtils::create_output_buffer(context, dataSize);
+
+	const int width = input.cols;
+	const int height = input.rows;
+	const int Iterations = 10;
+
+	std::vector<uint8_t> satResult(dataSize);
+	std::vector<uint8_t> naiveResult(dataSize);
+
+	printf("Window\tSAT (ms)\tNaive (ms)\tSpeedup\tMatch\n");
+	for (int windowSize = 3; windowSize <= 101; windowSize += 14)
+	{
+		const int radius = windowSize / 2;
+
+		double elapsed_ms[2] = { 0.0, 0.0 };
+		for (int naive = 0; naive < 2; ++naive)
+		{
+			cl_mem output_buffer = naive ? naive_output : sat_output;
+
+			// Warm up
+			if (!EnqueueAdaptiveThreshold(inputA, luma_buffer, sat_buffer, width, height, radius, bias, naive, output_buffer))
+				return false;
+			clFinish(queue);
+
+			Timer timer(true);
+			for (int i = 0; i < Iterations; ++i)
+			{
+				if (!EnqueueAdaptiveThreshold(inputA, luma_buffer, sat_buffer, width, height, radius, bias, naive, output_buffer))
+					return false;
+			}
+			clFinish(queue);
+			elapsed_ms[naive] = timer.Stop_ms() / Iterations;
+		}
+
+		err = clEnqueueReadBuffer(queue, sat_output, CL_FALSE, 0, dataSize, satResult.data(), 0, NULL, NULL);
+		err |= clEnqueueReadBuffer(queue, naive_output, CL_TRUE, 0, dataSize, naiveResult.data(), 0, NULL, NULL);
+		if (err < 0)
+		{
+			perror("Couldn't read the buffer");
+			return false;
+		}
+
+		const bool match = (satResult == naiveResult);
+		printf("%dx%d\t%.3f\t\t%.3f\t\t%.2fx\t%s\n",
+			   windowSize,
+			   windowSize,
+			   elapsed_ms[0],
+			   elapsed_ms[1],
+			   elapsed_ms[1] / elapsed_ms[0],
+			   match ? "Yes" : "No");
+	}
+
+	clReleaseMemObject(inputA);
+	clReleaseMemObject(luma_buffer);
+	clReleaseMemObject(sat_buffer);
+	clReleaseMemObject(sat_output);
+	clReleaseMemObject(naive_output);
+	return true;
+}
+
 bool InitializeDeviceAndContext()
 {
 	device = OpenCLUtils::create_device();
@@ -116,6 +340,30 @@ bool InitializeProgram()
 		perror("Couldn't create a kernel");
 		return false;
 	};
+
+	luminanceKernel = clCreateKernel(program, "luminance", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel");
+		return false;
+	};
+
+	adaptiveKernel = clCreateKernel(program, "adaptive_threshold", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel");
+		return false;
+	};
+
+	adaptiveNaiveKernel = clCreateKernel(program, "adaptive_threshold_naive", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel");
+		return false;
+	};
+
+	if (!summedAreaTable.Initialize(context, device))
+		return false;
     return true;
 }
 
@@ -137,10 +385,32 @@ int main()
 	cv::Mat outputImg(inputImg.rows, inputImg.cols, inputImg.type(), cv::Scalar(0, 0, 0));
 
 	const uint8_t thresholdValue = 125;
+
+	// Adaptive (local mean) thresholding
+	const bool UseAdaptive = true;
+	const int AdaptiveWindowSize = 31;
+	const int AdaptiveBias = 7;
+	const bool RunBenchmark = false;
+
 	cv::Mat inputImgRGBA;
 	cv::cvtColor(inputImg, inputImgRGBA, cv::COLOR_BGRA2RGBA);
-    if (!Threshold(inputImgRGBA, thresholdValue, outputImg))
-        return -1;
+
+	if (RunBenchmark)
+	{
+		if (!BenchmarkAdaptiveThreshold(inputImgRGBA, AdaptiveBias))
+			return -1;
+	}
+
+	if (UseAdaptive)
+	{
+		if (!AdaptiveThreshold(inputImgRGBA, AdaptiveWindowSize, AdaptiveBias, outputImg))
+			return -1;
+	}
+	else
+	{
+		if (!Threshold(inputImgRGBA, thresholdValue, outputImg))
+			return -1;
+	}
 
     /// Check Results ---------------------------------------------------------
 
@@ -159,6 +429,10 @@ int main()
     
     ///* Deallocate resources */
     
+	summedAreaTable.Release();
+	clReleaseKernel(luminanceKernel);
+	clReleaseKernel(adaptiveKernel);
+	clReleaseKernel(adaptiveNaiveKernel);
     clReleaseCommandQueue(queue);
     clReleaseProgram(program);
     clReleaseContext(context);
@@ -0,0 +1,114 @@
+// Batched GEMM for many small matrices: C[i] = A[i] * B[i] with A[i] M x N,
+// B[i] N x K and C[i] M x K, all row-major and stored in one buffer per
+// operand. Matrix i starts either at offsets[i] or, when no offset table is
+// bound, at i * stride (a stride of 0 broadcasts one matrix to the batch).
+//
+// Every work-group handles matrices_per_group consecutive matrices, which is
+// 1 for matrices with at least BATCH_WG outputs. The inner dimension is
+// walked in BATCH_TN wide slices staged in local memory, and each work-item
+// accumulates up to MAX_OUTPUTS outputs strided by BATCH_WG, so M * K may
+// not exceed BATCH_WG * MAX_OUTPUTS (64 x 64).
+
+#define BATCH_WG 256
+#define BATCH_TN 16
+#define MAX_OUTPUTS 16
+
+inline int matrix_offset(__global const int* offsets, int stride, int index)
+{
+    return offsets ? offsets[index] : index * stride;
+}
+
+__kernel __attribute__((reqd_work_group_size(BATCH_WG, 1, 1)))
+void gemm_batched(const int M,
+                  const int N,
+                  const int K,
+                  __global const float* a,
+                  __global const int* offsets_a,
+                  const int stride_a,
+                  __global const float* b,
+                  __global const int* offsets_b,
+                  const int stride_b,
+                  __global float* c,
+                  __global const int* offsets_c,
+                  const int stride_c,
+                  const int batch,
+                  const int matrices_per_group,
+                  __local float* a_tile,
+                  __local float* b_tile)
+{
+    const int lid = get_local_id(0);
+    const int first = get_group_id(0) * matrices_per_group;
+    const int outputs_per_matrix = M * K;
+    const int group_outputs = matrices_per_group * outputs_per_matrix;
+
+    float acc[MAX_OUTPUTS];
+    for (int j = 0; j < MAX_OUTPUTS; ++j)
+    {
+        acc[j] = 0.0f;
+    }
+
+    for (int t = 0; t < N; t += BATCH_TN)
+    {
+        const int tn = min(BATCH_TN, N - t);
+
+        // Stage the M x BATCH_TN slices of A, zero-filling past N and the batch end
+        for (int idx = lid; idx < matrices_per_group * M * BATCH_TN; idx += BATCH_WG)
+        {
+            int m = idx / (M * BATCH_TN);
+            int row = (idx / BATCH_TN) % M;
+            int k = idx % BATCH_TN;
+            int mat = first + m;
+
+            a_tile[idx] = (mat < batch && k < tn) ? a[matrix_offset(offsets_a, stride_a, mat) + row * N + t + k] : 0.0f;
+        }
+
+        // Stage the BATCH_TN x K slices of B
+        for (int idx = lid; idx < matrices_per_group * BATCH_TN * K; idx += BATCH_WG)
+        {
+            int m = idx / (BATCH_TN * K);
+            int k = (idx / K) % BATCH_TN;
+            int col = idx % K;
+            int mat = first + m;
+
+            b_tile[idx] = (mat < batch && k < tn) ? b[matrix_offset(offsets_b, stride_b, mat) + (t + k) * K + col] : 0.0f;
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int j = 0; j < MAX_OUTPUTS; ++j)
+        {
+            int o = lid + j * BATCH_WG;
+            if (o >= group_outputs)
+                break;
+
+            int m = o / outputs_per_matrix;
+            int row = (o / K) % M;
+            int col = o % K;
+
+            __local const float* a_row = a_tile + (m * M + row) * BATCH_TN;
+            __local const float* b_col = b_tile + m * BATCH_TN * K + col;
+
+            float sum = acc[j];
+            for (int k = 0; k < BATCH_TN; ++k)
+            {
+                sum = mad(a_row[k], b_col[k * K], sum);
+            }
+            acc[j] = sum;
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    for (int j = 0; j < MAX_OUTPUTS; ++j)
+    {
+        int o = lid + j * BATCH_WG;
+        if (o >= group_outputs)
+            break;
+
+        int mat = first + o / outputs_per_matrix;
+        if (mat < batch)
+        {
+            c[matrix_offset(offsets_c, stride_c, mat) + o % outputs_per_matrix] = acc[j];
+        }
+    }
+}
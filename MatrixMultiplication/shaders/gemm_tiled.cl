@@ -0,0 +1,149 @@
+// Tiled, register-blocked GEMM: C[M x K] = A[M x N] * B[N x K], row-major.
+//
+// Every work-group is RTS x RTS work-items and computes a TSM x TSC tile of
+// C. Each work-item accumulates a WPT x WPT micro-tile in registers, with its
+// rows and columns strided by RTS so that the local memory reads of a
+// wavefront are either broadcasts (A) or consecutive (B), and the final
+// stores to C are coalesced. Tiles of A and B are staged in local memory with
+// float4 loads; A is stored transposed and padded to avoid bank conflicts.
+//
+// The kernel expects M to be a multiple of TSM, K of TSC and N of TSN, the
+// host pads the operands with zeros otherwise.
+
+#ifndef WPT
+#define WPT 4
+#endif
+
+#ifndef RTS
+#define RTS 16
+#endif
+
+#define TSM (RTS * WPT)
+#define TSC (RTS * WPT)
+#define TSN 16
+
+#define LOADS_A ((TSM * TSN) / (RTS * RTS * 4))
+#define LOADS_B ((TSN * TSC) / (RTS * RTS * 4))
+
+#define A_PADDING 2
+
+__kernel __attribute__((reqd_work_group_size(RTS, RTS, 1)))
+void gemm_tiled(const int M,
+                const int N,
+                const int K,
+                __global const float* a,
+                __global const float* b,
+                __global float* result)
+{
+    __local float a_sub[TSN][TSM + A_PADDING];
+    __local float b_sub[TSN][TSC];
+
+    const int tx = get_local_id(0);
+    const int ty = get_local_id(1);
+    const int tid = ty * RTS + tx;
+
+    const int col0 = get_group_id(0) * TSC;
+    const int row0 = get_group_id(1) * TSM;
+
+    float acc[WPT][WPT];
+    for (int wm = 0; wm < WPT; ++wm)
+    {
+        for (int wc = 0; wc < WPT; ++wc)
+        {
+            acc[wm][wc] = 0.0f;
+        }
+    }
+
+    for (int t = 0; t < N; t += TSN)
+    {
+        // Stage the A tile (TSM x TSN), transposed
+        for (int l = 0; l < LOADS_A; ++l)
+        {
+            int id = l * RTS * RTS + tid;
+            int row = id / (TSN / 4);
+            int col = (id % (TSN / 4)) * 4;
+
+            float4 v = vload4(0, a + (row0 + row) * N + t + col);
+            a_sub[col + 0][row] = v.x;
+            a_sub[col + 1][row] = v.y;
+            a_sub[col + 2][row] = v.z;
+            a_sub[col + 3][row] = v.w;
+        }
+
+        // Stage the B tile (TSN x TSC)
+        for (int l = 0; l < LOADS_B; ++l)
+        {
+            int id = l * RTS * RTS + tid;
+            int row = id / (TSC / 4);
+            int col = (id % (TSC / 4)) * 4;
+
+            float4 v = vload4(0, b + (t + row) * K + col0 + col);
+            vstore4(v, 0, &b_sub[row][col]);
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        for (int k = 0; k < TSN; ++k)
+        {
+            float b_reg[WPT];
+            for (int wc = 0; wc < WPT; ++wc)
+            {
+                b_reg[wc] = b_sub[k][tx + wc * RTS];
+            }
+
+            for (int wm = 0; wm < WPT; ++wm)
+            {
+                float a_reg = a_sub[k][ty + wm * RTS];
+                for (int wc = 0; wc < WPT; ++wc)
+                {
+                    acc[wm][wc] = mad(a_reg, b_reg[wc], acc[wm][wc]);
+                }
+            }
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    for (int wm = 0; wm < WPT; ++wm)
+    {
+        int row = row0 + ty + wm * RTS;
+        for (int wc = 0; wc < WPT; ++wc)
+        {
+            int col = col0 + tx + wc * RTS;
+            result[row * K + col] = acc[wm][wc];
+        }
+    }
+}
+
+// Copies a rows x cols matrix into a zero-padded padded_rows x padded_cols matrix.
+__kernel void pad_matrix(__global const float* input,
+                         int rows,
+                         int cols,
+                         int padded_rows,
+                         int padded_cols,
+                         __global float* output)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+
+    if (x < padded_cols && y < padded_rows)
+    {
+        output[y * padded_cols + x] = (x < cols && y < rows) ? input[y * cols + x] : 0.0f;
+    }
+}
+
+// Copies the top-left rows x cols block out of a padded matrix.
+__kernel void unpad_matrix(__global const float* input,
+                           int padded_cols,
+                           int rows,
+                           int cols,
+                           __global float* output)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+
+    if (x < cols && y < rows)
+    {
+        output[y * cols + x] = input[y * padded_cols + x];
+    }
+}
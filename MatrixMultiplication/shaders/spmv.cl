@@ -0,0 +1,97 @@
+// Sparse matrix-vector products y = A * x for CSR and ELLPACK matrices.
+
+#ifndef VECTOR_SIZE
+#define VECTOR_SIZE 32
+#endif
+
+// CSR, one work-item per row. Simple, but neighbouring work-items walk
+// different rows so the value and column reads are poorly coalesced.
+__kernel void spmv_csr_scalar(const int num_rows,
+                              __global const int* row_ptr,
+                              __global const int* col_idx,
+                              __global const float* values,
+                              __global const float* x,
+                              __global float* y)
+{
+    int row = get_global_id(0);
+
+    if (row < num_rows)
+    {
+        float sum = 0.0f;
+        int end = row_ptr[row + 1];
+        for (int j = row_ptr[row]; j < end; ++j)
+        {
+            sum = mad(values[j], x[col_idx[j]], sum);
+        }
+        y[row] = sum;
+    }
+}
+
+// CSR, VECTOR_SIZE work-items per row. The lanes read consecutive entries
+// of the row and their partial sums are reduced in local memory. The
+// work-group size must be a multiple of VECTOR_SIZE.
+__kernel void spmv_csr_vector(const int num_rows,
+                              __global const int* row_ptr,
+                              __global const int* col_idx,
+                              __global const float* values,
+                              __global const float* x,
+                              __global float* y,
+                              __local float* partial)
+{
+    int lid = get_local_id(0);
+    int lane = lid & (VECTOR_SIZE - 1);
+    int row = get_global_id(0) / VECTOR_SIZE;
+
+    float sum = 0.0f;
+    if (row < num_rows)
+    {
+        int end = row_ptr[row + 1];
+        for (int j = row_ptr[row] + lane; j < end; j += VECTOR_SIZE)
+        {
+            sum = mad(values[j], x[col_idx[j]], sum);
+        }
+    }
+    partial[lid] = sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int offset = VECTOR_SIZE / 2; offset > 0; offset >>= 1)
+    {
+        if (lane < offset)
+        {
+            partial[lid] += partial[lid + offset];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (lane == 0 && row < num_rows)
+    {
+        y[row] = partial[lid];
+    }
+}
+
+// ELLPACK, one work-item per row. Entries are stored column-major
+// (entry j of row r at j * num_rows + r) so consecutive rows read
+// consecutive addresses. Padding entries have a column index of -1.
+__kernel void spmv_ell(const int num_rows,
+                       const int width,
+                       __global const int* col_idx,
+                       __global const float* values,
+                       __global const float* x,
+                       __global float* y)
+{
+    int row = get_global_id(0);
+
+    if (row < num_rows)
+    {
+        float sum = 0.0f;
+        for (int j = 0; j < width; ++j)
+        {
+            int index = j * num_rows + row;
+            int col = col_idx[index];
+            if (col < 0)
+                break;
+            sum = mad(values[index], x[col], sum);
+        }
+        y[row] = sum;
+    }
+}
@@ -0,0 +1,155 @@
+#include "BatchedGemm.h"
+
+#include "OpenCLUtils.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+bool BatchedGemm::Initialize(cl_context context, cl_device_id device)
+{
+	cl_int err = -1;
+
+	mProgram = OpenCLUtils::build_program(context, device, "shaders/gemm_batched.cl");
+	if (!mProgram)
+		return false;
+
+	mKernel = clCreateKernel(mProgram, "gemm_batched", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the batched gemm kernel");
+		return false;
+	}
+
+	cl_ulong localMemSize = 0;
+	clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &localMemSize, NULL);
+	if (localMemSize > 0)
+		mLocalBytes = std::min<size_t>(Max_Local_Bytes, static_cast<size_t>(localMemSize));
+	return true;
+}
+
+bool BatchedGemm::MultiplyStrided(cl_command_queue queue,
+								  int M,
+								  int N,
+								  int K,
+								  cl_mem a,
+								  int strideA,
+								  cl_mem b,
+								  int strideB,
+								  cl_mem c,
+								  int strideC,
+								  int batch)
+{
+	return Enqueue(queue, M, N, K, a, nullptr, strideA, b, nullptr, strideB, c, nullptr, strideC, batch);
+}
+
+bool BatchedGemm::MultiplyIndexed(cl_command_queue queue,
+								  int M,
+								  int N,
+								  int K,
+								  cl_mem a,
+								  cl_mem offsetsA,
+								  cl_mem b,
+								  cl_mem offsetsB,
+								  cl_mem c,
+								  cl_mem offsetsC,
+								  int batch)
+{
+	if (!offsetsA || !offsetsB || !offsetsC)
+	{
+		printf("Indexed batched gemm requires offset tables for all operands!\n");
+		return false;
+	}
+	return Enqueue(queue, M, N, K, a, offsetsA, 0, b, offsetsB, 0, c, offsetsC, 0, batch);
+}
+
+bool BatchedGemm::Enqueue(cl_command_queue queue,
+						  int M,
+						  int N,
+						  int K,
+						  cl_mem a,
+						  cl_mem offsetsA,
+						  int strideA,
+						  cl_mem b,
+						  cl_mem offsetsB,
+						  int strideB,
+						  cl_mem c,
+						  cl_mem offsetsC,
+						  int strideC,
+						  int batch)
+{
+	cl_int err = -1;
+
+	// Every work-item holds at most MAX_OUTPUTS outputs and the M x Inner_Tile and
+	// Inner_Tile x K slices of one matrix must fit in local memory, so M and K are
+	// bounded separately, a skinny 1 x 4096 product has few outputs but huge slices
+	const size_t sliceBytes = static_cast<size_t>(M + K) * Inner_Tile * sizeof(float);
+	if (M <= 0 || N <= 0 || K <= 0 || M > Max_Dimension || K > Max_Dimension || M * K > Max_Outputs || sliceBytes > mLocalBytes)
+	{
+		printf("Unsupported batched gemm size: %d x %d x %d, M and K must be at most %d\n", M, N, K, Max_Dimension);
+		return false;
+	}
+	if (batch <= 0)
+		return true;
+
+	// Pack several tiny matrices into a work-group, as long as their slices fit in local memory
+	const int matricesPerGroup = std::max(1, std::min({ Group_Size / (M * K),
+														static_cast<int>(mLocalBytes / sliceBytes),
+														batch }));
+
+	const size_t aTileBytes = static_cast<size_t>(matricesPerGroup) * M * Inner_Tile * sizeof(float);
+	const size_t bTileBytes = static_cast<size_t>(matricesPerGroup) * Inner_Tile * K * sizeof(float);
+
+	// A NULL buffer argument selects the strided addressing in the kernel
+	err = clSetKernelArg(mKernel, 0, sizeof(int), &M);
+	err |= clSetKernelArg(mKernel, 1, sizeof(int), &N);
+	err |= clSetKernelArg(mKernel, 2, sizeof(int), &K);
+	err |= clSetKernelArg(mKernel, 3, sizeof(cl_mem), &a);
+	err |= clSetKernelArg(mKernel, 4, sizeof(cl_mem), offsetsA ? &offsetsA : NULL);
+	err |= clSetKernelArg(mKernel, 5, sizeof(int), &strideA);
+	err |= clSetKernelArg(mKernel, 6, sizeof(cl_mem), &b);
+	err |= clSetKernelArg(mKernel, 7, sizeof(cl_mem), offsetsB ? &offsetsB : NULL);
+	err |= clSetKernelArg(mKernel, 8, sizeof(int), &strideB);
+	err |= clSetKernelArg(mKernel, 9, sizeof(cl_mem), &c);
+	err |= clSetKernelArg(mKernel, 10, sizeof(cl_mem), offsetsC ? &offsetsC : NULL);
+	err |= clSetKernelArg(mKernel, 11, sizeof(int), &strideC);
+	err |= clSetKernelArg(mKernel, 12, sizeof(int), &batch);
+	err |= clSetKernelArg(mKernel, 13, sizeof(int), &matricesPerGroup);
+	err |= clSetKernelArg(mKernel, 14, aTileBytes, NULL);
+	err |= clSetKernelArg(mKernel, 15, bTileBytes, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't create a batched gemm kernel argument");
+		return false;
+	}
+
+	const size_t numGroups = (static_cast<size_t>(batch) + matricesPerGroup - 1) / matricesPerGroup;
+	const size_t global = numGroups * Group_Size;
+	const size_t local = Group_Size;
+
+	err = clEnqueueNDRangeKernel(queue,
+								 mKernel,
+								 1,
+								 NULL,
+								 &global,
+								 &local,
+								 0,
+								 NULL,
+								 NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the batched gemm kernel");
+		return false;
+	}
+	return true;
+}
+
+void BatchedGemm::Release()
+{
+	if (mKernel)
+		clReleaseKernel(mKernel);
+	if (mProgram)
+		clReleaseProgram(mProgram);
+
+	mKernel = nullptr;
+	mProgram = nullptr;
+}
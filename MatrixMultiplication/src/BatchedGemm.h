@@ -0,0 +1,113 @@
+#pragma once
+
+#include "Cl/cl.h"
+
+/// <summary>
+/// Batched GEMM computing C[i] = A[i] * B[i] for many small row-major
+/// matrices (up to 64 x 64 outputs) with a single kernel launch.
+/// Each operand lives in one buffer, addressed either with a fixed stride
+/// between matrices or with a per-matrix table of offsets.
+/// </summary>
+class BatchedGemm
+{
+public:
+	/// <summary>
+	/// Builds the batched GEMM program.
+	/// </summary>
+	/// <param name="context">The OpenCL context</param>
+	/// <param name="device">The device to build the program for</param>
+	/// <returns>True if the kernel was created successfully</returns>
+	bool Initialize(cl_context context, cl_device_id device);
+
+	/// <summary>
+	/// Enqueues a batch whose matrices are laid out at fixed strides.
+	/// </summary>
+	/// <param name="queue">The command queue to enqueue the kernel on</param>
+	/// <param name="M">The rows in every A</param>
+	/// <param name="N">The columns in every A and rows in every B</param>
+	/// <param name="K">The columns in every B</param>
+	/// <param name="a">Buffer holding the A matrices</param>
+	/// <param name="strideA">Floats between consecutive A matrices, 0 to share one matrix</param>
+	/// <param name="b">Buffer holding the B matrices</param>
+	/// <param name="strideB">Floats between consecutive B matrices, 0 to share one matrix</param>
+	/// <param name="c">Buffer receiving the C matrices</param>
+	/// <param name="strideC">Floats between consecutive C matrices</param>
+	/// <param name="batch">The number of products</param>
+	/// <returns>True if the kernel was enqueued successfully</returns>
+	bool MultiplyStrided(cl_command_queue queue,
+						 int M,
+						 int N,
+						 int K,
+						 cl_mem a,
+						 int strideA,
+						 cl_mem b,
+						 int strideB,
+						 cl_mem c,
+						 int strideC,
+						 int batch);
+
+	/// <summary>
+	/// Enqueues a batch whose matrices are located through offset tables,
+	/// the buffer equivalent of an array of pointers.
+	/// </summary>
+	/// <param name="queue">The command queue to enqueue the kernel on</param>
+	/// <param name="M">The rows in every A</param>
+	/// <param name="N">The columns in every A and rows in every B</param>
+	/// <param name="K">The columns in every B</param>
+	/// <param name="a">Buffer holding the A matrices</param>
+	/// <param name="offsetsA">Buffer of batch ints, the float offset of each A</param>
+	/// <param name="b">Buffer holding the B matrices</param>
+	/// <param name="offsetsB">Buffer of batch ints, the float offset of each B</param>
+	/// <param name="c">Buffer receiving the C matrices</param>
+	/// <param name="offsetsC">Buffer of batch ints, the float offset of each C</param>
+	/// <param name="batch">The number of products</param>
+	/// <returns>True if the kernel was enqueued successfully</returns>
+	bool MultiplyIndexed(cl_command_queue queue,
+						 int M,
+						 int N,
+						 int K,
+						 cl_mem a,
+						 cl_mem offsetsA,
+						 cl_mem b,
+						 cl_mem offsetsB,
+						 cl_mem c,
+						 cl_mem offsetsC,
+						 int batch);
+
+	/// <summary>
+	/// Releases the kernel and program.
+	/// </summary>
+	void Release();
+private:
+	bool Enqueue(cl_command_queue queue,
+				 int M,
+				 int N,
+				 int K,
+				 cl_mem a,
+				 cl_mem offsetsA,
+				 int strideA,
+				 cl_mem b,
+				 cl_mem offsetsB,
+				 int strideB,
+				 cl_mem c,
+				 cl_mem offsetsC,
+				 int strideC,
+				 int batch);
+private:
+	// Must match BATCH_WG, BATCH_TN and MAX_OUTPUTS in gemm_batched.cl
+	static constexpr int Group_Size = 256;
+	static constexpr int Inner_Tile = 16;
+	static constexpr int Max_Outputs = Group_Size * 16;
+
+	// Largest M and K, the staged slices of one 64 x 64 product take 8 KB
+	static constexpr int Max_Dimension = 64;
+
+	// Local memory budget for the staged slices of all matrices in a group
+	static constexpr size_t Max_Local_Bytes = 16 * 1024;
+
+	// Max_Local_Bytes, or less when the device has less local memory
+	size_t mLocalBytes = Max_Local_Bytes;
+
+	cl_program mProgram = nullptr;
+	cl_kernel mKernel = nullptr;
+};
@@ -0,0 +1,248 @@
+#include "CpuGemm.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <immintrin.h>
+	#define CPU_GEMM_X86
+#endif
+
+namespace
+{
+	constexpr int MR = CpuGemm::Micro_Rows;
+	constexpr int NR = CpuGemm::Micro_Cols;
+
+	/// <summary>
+	/// Packs a rows x depth block of A into strips of MR rows, stored
+	/// column by column and zero-padded to a multiple of MR rows.
+	/// </summary>
+	void PackA(const float* a, int lda, int rows, int depth, float* packed)
+	{
+		for (int i = 0; i < rows; i += MR)
+		{
+			const int strip = std::min(MR, rows - i);
+			for (int k = 0; k < depth; ++k)
+			{
+				for (int r = 0; r < MR; ++r)
+					*packed++ = (r < strip) ? a[(i + r) * lda + k] : 0.0f;
+			}
+		}
+	}
+
+	/// <summary>
+	/// Packs a depth x cols panel of B into strips of NR columns, stored
+	/// row by row and zero-padded to a multiple of NR columns.
+	/// </summary>
+	void PackB(const float* b, int ldb, int depth, int cols, float* packed)
+	{
+		for (int j = 0; j < cols; j += NR)
+		{
+			const int strip = std::min(NR, cols - j);
+			for (int k = 0; k < depth; ++k)
+			{
+				const float* row = b + k * ldb + j;
+				for (int c = 0; c < NR; ++c)
+					*packed++ = (c < strip) ? row[c] : 0.0f;
+			}
+		}
+	}
+
+	/// <summary>
+	/// Accumulates the MR x NR product of a packed A strip and a packed B
+	/// strip into the MR x NR tile at c.
+	/// </summary>
+	void MicroKernel(int depth, const float* a, const float* b, float* c, int ldc)
+	{
+#if defined(__AVX__)
+		__m256 c0 = _mm256_loadu_ps(c);
+		__m256 c1 = _mm256_loadu_ps(c + ldc);
+		__m256 c2 = _mm256_loadu_ps(c + 2 * ldc);
+		__m256 c3 = _mm256_loadu_ps(c + 3 * ldc);
+
+		for (int k = 0; k < depth; ++k, a += MR, b += NR)
+		{
+			const __m256 bv = _mm256_loadu_ps(b);
+	#if defined(__FMA__)
+			c0 = _mm256_fmadd_ps(_mm256_broadcast_ss(a), bv, c0);
+			c1 = _mm256_fmadd_ps(_mm256_broadcast_ss(a + 1), bv, c1);
+			c2 = _mm256_fmadd_ps(_mm256_broadcast_ss(a + 2), bv, c2);
+			c3 = _mm256_fmadd_ps(_mm256_broadcast_ss(a + 3), bv, c3);
+	#else
+			c0 = _mm256_add_ps(c0, _mm256_mul_ps(_mm256_broadcast_ss(a), bv));
+			c1 = _mm256_add_ps(c1, _mm256_mul_ps(_mm256_broadcast_ss(a + 1), bv));
+			c2 = _mm256_add_ps(c2, _mm256_mul_ps(_mm256_broadcast_ss(a + 2), bv));
+			c3 = _mm256_add_ps(c3, _mm256_mul_ps(_mm256_broadcast_ss(a + 3), bv));
+	#endif
+		}
+
+		_mm256_storeu_ps(c, c0);
+		_mm256_storeu_ps(c + ldc, c1);
+		_mm256_storeu_ps(c + 2 * ldc, c2);
+		_mm256_storeu_ps(c + 3 * ldc, c3);
+#elif defined(CPU_GEMM_X86)
+		__m128 acc[MR][2];
+		for (int r = 0; r < MR; ++r)
+		{
+			acc[r][0] = _mm_loadu_ps(c + r * ldc);
+			acc[r][1] = _mm_loadu_ps(c + r * ldc + 4);
+		}
+
+		for (int k = 0; k < depth; ++k, a += MR, b += NR)
+		{
+			const __m128 b0 = _mm_loadu_ps(b);
+			const __m128 b1 = _mm_loadu_ps(b + 4);
+			for (int r = 0; r < MR; ++r)
+			{
+				const __m128 av = _mm_set1_ps(a[r]);
+				acc[r][0] = _mm_add_ps(acc[r][0], _mm_mul_ps(av, b0));
+				acc[r][1] = _mm_add_ps(acc[r][1], _mm_mul_ps(av, b1));
+			}
+		}
+
+		for (int r = 0; r < MR; ++r)
+		{
+			_mm_storeu_ps(c + r * ldc, acc[r][0]);
+			_mm_storeu_ps(c + r * ldc + 4, acc[r][1]);
+		}
+#else
+		float acc[MR][NR];
+		for (int r = 0; r < MR; ++r)
+		{
+			for (int col = 0; col < NR; ++col)
+				acc[r][col] = c[r * ldc + col];
+		}
+
+		for (int k = 0; k < depth; ++k, a += MR, b += NR)
+		{
+			for (int r = 0; r < MR; ++r)
+			{
+				for (int col = 0; col < NR; ++col)
+					acc[r][col] += a[r] * b[col];
+			}
+		}
+
+		for (int r = 0; r < MR; ++r)
+		{
+			for (int col = 0; col < NR; ++col)
+				c[r * ldc + col] = acc[r][col];
+		}
+#endif
+	}
+
+	/// <summary>
+	/// Multiplies a packed A block with a packed B panel, accumulating into C.
+	/// Edge tiles go through a scratch tile so the micro-kernel always
+	/// operates on a full MR x NR block.
+	/// </summary>
+	void MacroKernel(int rows, int cols, int depth, const float* packedA, const float* packedB, float* c, int ldc)
+	{
+		float edge[MR * NR];
+
+		for (int j = 0; j < cols; j += NR)
+		{
+			const int tileCols = std::min(NR, cols - j);
+			const float* bStrip = packedB + static_cast<size_t>(j / NR) * depth * NR;
+
+			for (int i = 0; i < rows; i += MR)
+			{
+				const int tileRows = std::min(MR, rows - i);
+				const float* aStrip = packedA + static_cast<size_t>(i / MR) * depth * MR;
+				float* tile = c + i * ldc + j;
+
+				if (tileRows == MR && tileCols == NR)
+				{
+					MicroKernel(depth, aStrip, bStrip, tile, ldc);
+					continue;
+				}
+
+				for (int r = 0; r < MR; ++r)
+				{
+					for (int col = 0; col < NR; ++col)
+						edge[r * NR + col] = (r < tileRows && col < tileCols) ? tile[r * ldc + col] : 0.0f;
+				}
+
+				MicroKernel(depth, aStrip, bStrip, edge, NR);
+
+				for (int r = 0; r < tileRows; ++r)
+				{
+					for (int col = 0; col < tileCols; ++col)
+						tile[r * ldc + col] = edge[r * NR + col];
+				}
+			}
+		}
+	}
+}
+
+void CpuGemm::Multiply(const float* a,
+					   const float* b,
+					   int M,
+					   int N,
+					   int K,
+					   float* c,
+					   int numThreads)
+{
+	std::fill(c, c + static_cast<size_t>(M) * K, 0.0f);
+	if (M <= 0 || N <= 0 || K <= 0)
+		return;
+
+	// Threads claim row blocks of column panels of C, which never overlap
+	const int numPanels = (K + Block_K - 1) / Block_K;
+	const int numRowBlocks = (M + Block_M - 1) / Block_M;
+	const int numJobs = numPanels * numRowBlocks;
+
+	if (numThreads <= 0)
+		numThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+	numThreads = std::min(numThreads, numJobs);
+
+	std::atomic<int> nextJob = 0;
+
+	const auto Worker = [&]()
+	{
+		std::vector<float> packedA(static_cast<size_t>(Block_M + MR) * Block_N);
+		std::vector<float> packedB(static_cast<size_t>(Block_N) * (Block_K + NR));
+
+		// Jobs are ordered row block fastest so a thread tends to keep its B panel
+		int packedPanel = -1;
+		int packedDepth = -1;
+
+		for (int job = nextJob++; job < numJobs; job = nextJob++)
+		{
+			const int panel = job / numRowBlocks;
+			const int rowBlock = job % numRowBlocks;
+
+			const int j0 = panel * Block_K;
+			const int cols = std::min(Block_K, K - j0);
+			const int i0 = rowBlock * Block_M;
+			const int rows = std::min(Block_M, M - i0);
+
+			for (int k0 = 0; k0 < N; k0 += Block_N)
+			{
+				const int depth = std::min(Block_N, N - k0);
+
+				// With a single depth block the packed panel is reused across row blocks
+				if (packedPanel != panel || packedDepth != k0)
+				{
+					PackB(b + static_cast<size_t>(k0) * K + j0, K, depth, cols, packedB.data());
+					packedPanel = panel;
+					packedDepth = k0;
+				}
+
+				PackA(a + static_cast<size_t>(i0) * N + k0, N, rows, depth, packedA.data());
+				MacroKernel(rows, cols, depth, packedA.data(), packedB.data(), c + static_cast<size_t>(i0) * K + j0, K);
+			}
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(numThreads - 1);
+	for (int t = 1; t < numThreads; ++t)
+		threads.emplace_back(Worker);
+
+	Worker();
+
+	for (std::thread& thread : threads)
+		thread.join();
+}
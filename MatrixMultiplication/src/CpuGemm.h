@@ -0,0 +1,40 @@
+#pragma once
+
+/// <summary>
+/// Cache-blocked, SIMD-vectorized and multithreaded host GEMM computing
+/// C[M x K] = A[M x N] * B[N x K] for row-major matrices.
+/// Blocks of A and B are packed into contiguous panels that a 4 x 8
+/// register micro-kernel streams through, using AVX or SSE when available.
+/// It serves both as the correctness reference and as the CPU fallback.
+/// </summary>
+class CpuGemm
+{
+public:
+	/// <summary>
+	/// Multiplies A and B, overwriting C.
+	/// </summary>
+	/// <param name="a">The M * N floats of A</param>
+	/// <param name="b">The N * K floats of B</param>
+	/// <param name="M">The rows in A</param>
+	/// <param name="N">The columns in A and rows in B</param>
+	/// <param name="K">The columns in B</param>
+	/// <param name="c">The M * K floats receiving the product</param>
+	/// <param name="numThreads">The number of worker threads, 0 to use every hardware thread</param>
+	static void Multiply(const float* a,
+						 const float* b,
+						 int M,
+						 int N,
+						 int K,
+						 float* c,
+						 int numThreads = 0);
+public:
+	// Micro-tile computed in registers
+	static constexpr int Micro_Rows = 4;
+	static constexpr int Micro_Cols = 8;
+
+	// Cache blocks: an A block of Block_M x Block_N stays in L2 while a
+	// Block_N x Block_K panel of B is streamed from L3
+	static constexpr int Block_M = 96;
+	static constexpr int Block_N = 256;
+	static constexpr int Block_K = 512;
+};
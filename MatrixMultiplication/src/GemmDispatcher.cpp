@@ -0,0 +1,215 @@
+#include "GemmDispatcher.h"
+
+#include "GemmEngine.h"
+#include "CpuGemm.h"
+
+#include "OpenCLUtils.h"
+#include "Timer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <vector>
+#include <stdio.h>
+
+namespace
+{
+	double GetFlops(int M, int N, int K)
+	{
+		return 2.0 * M * N * K;
+	}
+}
+
+bool GemmDispatcher::Initialize(cl_context context, cl_device_id device, cl_command_queue queue, GemmEngine* engine)
+{
+	mContext = context;
+	mQueue = queue;
+	mEngine = engine;
+
+	char name[256] = {};
+	cl_int err = clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name) - 1, name, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't query the device name");
+		return false;
+	}
+	mDeviceName = name;
+	return true;
+}
+
+bool GemmDispatcher::Load(const std::string& filename)
+{
+	std::ifstream file(filename);
+	if (!file.is_open())
+		return false;
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		std::istringstream stream(line);
+		double crossover = 0.0;
+		std::string name;
+		if (!(stream >> crossover) || !std::getline(stream >> std::ws, name))
+			continue;
+
+		if (name == mDeviceName)
+		{
+			mCrossoverFlops = crossover;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool GemmDispatcher::Save(const std::string& filename) const
+{
+	// Keep the entries of the other devices on this machine
+	std::vector<std::string> lines;
+	{
+		std::ifstream file(filename);
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream stream(line);
+			double crossover = 0.0;
+			std::string name;
+			if ((stream >> crossover) && std::getline(stream >> std::ws, name) && name != mDeviceName)
+				lines.push_back(line);
+		}
+	}
+
+	std::ofstream file(filename);
+	if (!file.is_open())
+	{
+		perror("Couldn't create the gemm crossover file");
+		return false;
+	}
+
+	for (const std::string& line : lines)
+		file << line << "\n";
+	file << mCrossoverFlops << " " << mDeviceName << "\n";
+	return true;
+}
+
+bool GemmDispatcher::Calibrate()
+{
+	const int Sizes[] = { 16, 32, 64, 128, 256, 384, 512, 768, 1024, 1536, 2048 };
+	const int Repeats = 3;
+
+	std::mt19937 generator(3);
+	std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+	const auto BestTime = [&](const std::function<bool()>& run)
+	{
+		double best = std::numeric_limits<double>::max();
+		for (int i = 0; i < Repeats; ++i)
+		{
+			Timer timer(true);
+			if (!run())
+				return -1.0;
+			best = std::min(best, timer.Stop_ms());
+		}
+		return best;
+	};
+
+	// The crossover is the smallest size from which the device wins every larger size
+	double crossover = std::numeric_limits<double>::max();
+
+	printf("Calibrating GEMM dispatch for %s\n", mDeviceName.c_str());
+	for (int size : Sizes)
+	{
+		std::vector<float> a(static_cast<size_t>(size) * size);
+		std::vector<float> b(a.size());
+		std::vector<float> c(a.size());
+		for (float& value : a)
+			value = distribution(generator);
+		for (float& value : b)
+			value = distribution(generator);
+
+		// Warm up the device path so program and buffer setup costs are excluded
+		if (!MultiplyDevice(a.data(), b.data(), size, size, size, c.data()))
+			return false;
+
+		const double cpu_ms = BestTime([&]()
+		{
+			CpuGemm::Multiply(a.data(), b.data(), size, size, size, c.data());
+			return true;
+		});
+		const double device_ms = BestTime([&]()
+		{
+			return MultiplyDevice(a.data(), b.data(), size, size, size, c.data());
+		});
+		if (device_ms < 0.0)
+			return false;
+
+		printf("%6d  cpu %10.3f ms  device %10.3f ms\n", size, cpu_ms, device_ms);
+
+		if (device_ms < cpu_ms)
+			crossover = std::min(crossover, GetFlops(size, size, size));
+		else
+			crossover = std::numeric_limits<double>::max();
+	}
+
+	mCrossoverFlops = crossover;
+	if (mCrossoverFlops == std::numeric_limits<double>::max())
+		printf("The device never outperformed the CPU\n");
+	else
+		printf("Crossover at %.3g flops\n", mCrossoverFlops);
+	return true;
+}
+
+GemmDispatcher::Backend GemmDispatcher::Select(int M, int N, int K) const
+{
+	if (!mEngine || GetFlops(M, N, K) < mCrossoverFlops)
+		return Backend::CPU;
+	return Backend::OpenCL;
+}
+
+bool GemmDispatcher::Multiply(const float* a, const float* b, int M, int N, int K, float* c, Backend* used)
+{
+	const Backend backend = Select(M, N, K);
+	if (used)
+		*used = backend;
+
+	if (backend == Backend::CPU)
+	{
+		CpuGemm::Multiply(a, b, M, N, K, c);
+		return true;
+	}
+	return MultiplyDevice(a, b, M, N, K, c);
+}
+
+bool GemmDispatcher::MultiplyDevice(const float* a, const float* b, int M, int N, int K, float* c)
+{
+	cl_int err = -1;
+
+	const size_t sizeA = static_cast<size_t>(M) * N * sizeof(float);
+	const size_t sizeB = static_cast<size_t>(N) * K * sizeof(float);
+	const size_t sizeC = static_cast<size_t>(M) * K * sizeof(float);
+
+	cl_mem inputA = OpenCLUtils::create_input_buffer(mContext, const_cast<float*>(a), sizeA);
+	cl_mem inputB = OpenCLUtils::create_input_buffer(mContext, const_cast<float*>(b), sizeB);
+	cl_mem output = OpenCLUtils::create_output_buffer(mContext, sizeC);
+
+	bool success = inputA && inputB && output && mEngine->Multiply(mQueue, inputA, inputB, M, N, K, output);
+	if (success)
+	{
+		err = clEnqueueReadBuffer(mQueue, output, CL_TRUE, 0, sizeC, c, 0, NULL, NULL);
+		if (err < 0)
+		{
+			perror("Couldn't read the gemm result");
+			success = false;
+		}
+	}
+
+	if (inputA)
+		clReleaseMemObject(inputA);
+	if (inputB)
+		clReleaseMemObject(inputB);
+	if (output)
+		clReleaseMemObject(output);
+	return success;
+}
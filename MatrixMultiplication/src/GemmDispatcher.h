@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Cl/cl.h"
+
+#include <string>
+
+class GemmEngine;
+
+/// <summary>
+/// Routes host-side GEMMs to the CPU or the OpenCL device depending on the
+/// amount of work. The crossover point is measured once per machine and
+/// device by Calibrate and persisted in a small text file, one
+/// "flops device-name" line per device.
+/// </summary>
+class GemmDispatcher
+{
+public:
+	enum class Backend
+	{
+		CPU,
+		OpenCL
+	};
+public:
+	/// <summary>
+	/// Binds the dispatcher to a device and the GEMM engine running on it.
+	/// </summary>
+	/// <param name="context">The OpenCL context</param>
+	/// <param name="device">The device the engine was built for</param>
+	/// <param name="queue">The command queue to run device GEMMs on</param>
+	/// <param name="engine">The initialized device GEMM engine</param>
+	/// <returns>True if the device could be queried</returns>
+	bool Initialize(cl_context context, cl_device_id device, cl_command_queue queue, GemmEngine* engine);
+
+	/// <summary>
+	/// Reads the crossover point stored for the bound device.
+	/// </summary>
+	/// <param name="filename">The crossover file</param>
+	/// <returns>True if an entry for the device was found</returns>
+	bool Load(const std::string& filename);
+
+	/// <summary>
+	/// Stores the crossover point of the bound device, keeping the entries
+	/// of other devices.
+	/// </summary>
+	/// <param name="filename">The crossover file</param>
+	/// <returns>True if the file was written</returns>
+	bool Save(const std::string& filename) const;
+
+	/// <summary>
+	/// Times both backends on square problems of growing size, including the
+	/// device transfers, and sets the crossover to the smallest size from
+	/// which the device stays faster.
+	/// </summary>
+	/// <returns>True if every measurement succeeded</returns>
+	bool Calibrate();
+
+	/// <summary>
+	/// Selects the backend for a problem size.
+	/// </summary>
+	Backend Select(int M, int N, int K) const;
+
+	/// <summary>
+	/// Multiplies host matrices on the selected backend.
+	/// </summary>
+	/// <param name="a">The M * N floats of A</param>
+	/// <param name="b">The N * K floats of B</param>
+	/// <param name="M">The rows in A</param>
+	/// <param name="N">The columns in A and rows in B</param>
+	/// <param name="K">The columns in B</param>
+	/// <param name="c">The M * K floats receiving the product</param>
+	/// <param name="used">Optionally receives the backend that ran</param>
+	/// <returns>True if the multiplication succeeded</returns>
+	bool Multiply(const float* a, const float* b, int M, int N, int K, float* c, Backend* used = nullptr);
+public:
+	/// <summary>
+	/// Retrieves the number of flops (2 * M * N * K) from which the device is used.
+	/// </summary>
+	double GetCrossoverFlops() const { return mCrossoverFlops; }
+
+	const std::string& GetDeviceName() const { return mDeviceName; }
+private:
+	/// <summary>
+	/// Runs a GEMM on the device, uploading the operands and reading back the result.
+	/// </summary>
+	bool MultiplyDevice(const float* a, const float* b, int M, int N, int K, float* c);
+private:
+	cl_context mContext = nullptr;
+	cl_command_queue mQueue = nullptr;
+	GemmEngine* mEngine = nullptr;
+
+	std::string mDeviceName;
+
+	// Uncalibrated default, roughly a 256^3 problem
+	double mCrossoverFlops = 2.0 * 256.0 * 256.0 * 256.0;
+};
@@ -0,0 +1,249 @@
+#include "GemmEngine.h"
+
+#include "OpenCLUtils.h"
+
+#include <string>
+#include <stdio.h>
+
+namespace
+{
+	int RoundUp(int value, int multiple)
+	{
+		return (value + multiple - 1) / multiple * multiple;
+	}
+}
+
+bool GemmEngine::Initialize(cl_context context, cl_device_id device, int workPerThread)
+{
+	cl_int err = -1;
+
+	if (workPerThread != 4 && workPerThread != 8)
+	{
+		printf("Unsupported GEMM micro-tile size: %d\n", workPerThread);
+		return false;
+	}
+
+	mContext = context;
+	mWorkPerThread = workPerThread;
+
+	const std::string options = "-DWPT=" + std::to_string(mWorkPerThread) + " -DRTS=" + std::to_string(Threads_Per_Dim);
+	mProgram = OpenCLUtils::build_program(context, device, "shaders/gemm_tiled.cl", options.c_str());
+	if (!mProgram)
+		return false;
+
+	mGemmKernel = clCreateKernel(mProgram, "gemm_tiled", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the tiled gemm kernel");
+		return false;
+	}
+
+	mPadKernel = clCreateKernel(mProgram, "pad_matrix", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the pad matrix kernel");
+		return false;
+	}
+
+	mUnpadKernel = clCreateKernel(mProgram, "unpad_matrix", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the unpad matrix kernel");
+		return false;
+	}
+	return true;
+}
+
+bool GemmEngine::Multiply(cl_command_queue queue,
+						  cl_mem a,
+						  cl_mem b,
+						  int M,
+						  int N,
+						  int K,
+						  cl_mem result)
+{
+	cl_int err = -1;
+
+	const int tileSize = GetTileSize();
+	const int paddedM = RoundUp(M, tileSize);
+	const int paddedN = RoundUp(N, Inner_Tile);
+	const int paddedK = RoundUp(K, tileSize);
+
+	cl_mem gemmA = a;
+	cl_mem gemmB = b;
+	cl_mem gemmC = result;
+
+	// Pad the operands with zeros, the extra rows and columns don't contribute to the product
+	if (paddedM != M || paddedN != N)
+	{
+		if (!Reserve(mPaddedA, mPaddedACapacity, static_cast<size_t>(paddedM) * paddedN))
+			return false;
+		if (!EnqueuePad(queue, a, M, N, paddedM, paddedN, mPaddedA))
+			return false;
+		gemmA = mPaddedA;
+	}
+
+	if (paddedN != N || paddedK != K)
+	{
+		if (!Reserve(mPaddedB, mPaddedBCapacity, static_cast<size_t>(paddedN) * paddedK))
+			return false;
+		if (!EnqueuePad(queue, b, N, K, paddedN, paddedK, mPaddedB))
+			return false;
+		gemmB = mPaddedB;
+	}
+
+	if (paddedM != M || paddedK != K)
+	{
+		if (!Reserve(mPaddedC, mPaddedCCapacity, static_cast<size_t>(paddedM) * paddedK))
+			return false;
+		gemmC = mPaddedC;
+	}
+
+	err = clSetKernelArg(mGemmKernel, 0, sizeof(int), &paddedM);
+	err |= clSetKernelArg(mGemmKernel, 1, sizeof(int), &paddedN);
+	err |= clSetKernelArg(mGemmKernel, 2, sizeof(int), &paddedK);
+	err |= clSetKernelArg(mGemmKernel, 3, sizeof(cl_mem), &gemmA);
+	err |= clSetKernelArg(mGemmKernel, 4, sizeof(cl_mem), &gemmB);
+	err |= clSetKernelArg(mGemmKernel, 5, sizeof(cl_mem), &gemmC);
+	if (err < 0)
+	{
+		perror("Couldn't create a tiled gemm kernel argument");
+		return false;
+	}
+
+	// Every work-item computes a WPT x WPT block of C
+	const size_t global[2] = { static_cast<size_t>(paddedK / mWorkPerThread), static_cast<size_t>(paddedM / mWorkPerThread) };
+	const size_t local[2] = { Threads_Per_Dim, Threads_Per_Dim };
+
+	err = clEnqueueNDRangeKernel(queue,
+								 mGemmKernel,
+								 2,
+								 NULL,
+								 global,
+								 local,
+								 0,
+								 NULL,
+								 NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the tiled gemm kernel");
+		return false;
+	}
+
+	if (gemmC != result)
+	{
+		err = clSetKernelArg(mUnpadKernel, 0, sizeof(cl_mem), &gemmC);
+		err |= clSetKernelArg(mUnpadKernel, 1, sizeof(int), &paddedK);
+		err |= clSetKernelArg(mUnpadKernel, 2, sizeof(int), &M);
+		err |= clSetKernelArg(mUnpadKernel, 3, sizeof(int), &K);
+		err |= clSetKernelArg(mUnpadKernel, 4, sizeof(cl_mem), &result);
+		if (err < 0)
+		{
+			perror("Couldn't create an unpad matrix kernel argument");
+			return false;
+		}
+
+		const size_t unpadGlobal[2] = { static_cast<size_t>(K), static_cast<size_t>(M) };
+		err = clEnqueueNDRangeKernel(queue,
+									 mUnpadKernel,
+									 2,
+									 NULL,
+									 unpadGlobal,
+									 NULL,
+									 0,
+									 NULL,
+									 NULL);
+		if (err < 0)
+		{
+			perror("Couldn't enqueue the unpad matrix kernel");
+			return false;
+		}
+	}
+	return true;
+}
+
+bool GemmEngine::EnqueuePad(cl_command_queue queue, cl_mem input, int rows, int cols, int paddedRows, int paddedCols, cl_mem output)
+{
+	cl_int err = -1;
+
+	err = clSetKernelArg(mPadKernel, 0, sizeof(cl_mem), &input);
+	err |= clSetKernelArg(mPadKernel, 1, sizeof(int), &rows);
+	err |= clSetKernelArg(mPadKernel, 2, sizeof(int), &cols);
+	err |= clSetKernelArg(mPadKernel, 3, sizeof(int), &paddedRows);
+	err |= clSetKernelArg(mPadKernel, 4, sizeof(int), &paddedCols);
+	err |= clSetKernelArg(mPadKernel, 5, sizeof(cl_mem), &output);
+	if (err < 0)
+	{
+		perror("Couldn't create a pad matrix kernel argument");
+		return false;
+	}
+
+	const size_t global[2] = { static_cast<size_t>(paddedCols), static_cast<size_t>(paddedRows) };
+	err = clEnqueueNDRangeKernel(queue,
+								 mPadKernel,
+								 2,
+								 NULL,
+								 global,
+								 NULL,
+								 0,
+								 NULL,
+								 NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the pad matrix kernel");
+		return false;
+	}
+	return true;
+}
+
+bool GemmEngine::Reserve(cl_mem& buffer, size_t& capacity, size_t required)
+{
+	if (buffer && capacity >= required)
+		return true;
+
+	if (buffer)
+		clReleaseMemObject(buffer);
+
+	cl_int err = -1;
+	buffer = clCreateBuffer(mContext, CL_MEM_READ_WRITE, required * sizeof(float), NULL, &err);
+	if (err < 0)
+	{
+		perror("Couldn't create a gemm padding buffer");
+		buffer = nullptr;
+		capacity = 0;
+		return false;
+	}
+	capacity = required;
+	return true;
+}
+
+void GemmEngine::Release()
+{
+	if (mPaddedA)
+		clReleaseMemObject(mPaddedA);
+	if (mPaddedB)
+		clReleaseMemObject(mPaddedB);
+	if (mPaddedC)
+		clReleaseMemObject(mPaddedC);
+
+	mPaddedA = nullptr;
+	mPaddedB = nullptr;
+	mPaddedC = nullptr;
+	mPaddedACapacity = 0;
+	mPaddedBCapacity = 0;
+	mPaddedCCapacity = 0;
+
+	if (mGemmKernel)
+		clReleaseKernel(mGemmKernel);
+	if (mPadKernel)
+		clReleaseKernel(mPadKernel);
+	if (mUnpadKernel)
+		clReleaseKernel(mUnpadKernel);
+	if (mProgram)
+		clReleaseProgram(mProgram);
+
+	mGemmKernel = nullptr;
+	mPadKernel = nullptr;
+	mUnpadKernel = nullptr;
+	mProgram = nullptr;
+}
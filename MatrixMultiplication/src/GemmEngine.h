@@ -0,0 +1,83 @@
+#pragma once
+
+#include "Cl/cl.h"
+
+/// <summary>
+/// Tiled, register-blocked single precision GEMM computing
+/// C[M x K] = A[M x N] * B[N x K] for row-major matrices.
+/// Operands whose sizes are not multiples of the tile sizes are copied into
+/// zero-padded scratch buffers, which are kept between calls.
+/// </summary>
+class GemmEngine
+{
+public:
+	/// <summary>
+	/// Builds the tiled GEMM program for the given micro-tile size.
+	/// </summary>
+	/// <param name="context">The OpenCL context</param>
+	/// <param name="device">The device to build the program for</param>
+	/// <param name="workPerThread">The micro-tile edge computed by each work-item, 4 or 8</param>
+	/// <returns>True if the kernels were created successfully</returns>
+	bool Initialize(cl_context context, cl_device_id device, int workPerThread = 4);
+
+	/// <summary>
+	/// Enqueues the multiplication of A and B.
+	/// </summary>
+	/// <param name="queue">The command queue to enqueue the kernels on</param>
+	/// <param name="a">Buffer of M * N floats</param>
+	/// <param name="b">Buffer of N * K floats</param>
+	/// <param name="M">The rows in A</param>
+	/// <param name="N">The columns in A and rows in B</param>
+	/// <param name="K">The columns in B</param>
+	/// <param name="result">Buffer of M * K floats receiving the product</param>
+	/// <returns>True if the kernels were enqueued successfully</returns>
+	bool Multiply(cl_command_queue queue,
+				  cl_mem a,
+				  cl_mem b,
+				  int M,
+				  int N,
+				  int K,
+				  cl_mem result);
+
+	/// <summary>
+	/// Releases the scratch buffers, kernels and program.
+	/// </summary>
+	void Release();
+public:
+	/// <summary>
+	/// Retrieves the edge of the C tile computed by each work-group.
+	/// </summary>
+	int GetTileSize() const { return Threads_Per_Dim * mWorkPerThread; }
+private:
+	/// <summary>
+	/// Ensures the scratch buffer holds at least the given number of floats.
+	/// </summary>
+	/// <param name="buffer">The scratch buffer to grow</param>
+	/// <param name="capacity">The current capacity of the buffer in floats</param>
+	/// <param name="required">The required capacity in floats</param>
+	/// <returns>True if the buffer is large enough</returns>
+	bool Reserve(cl_mem& buffer, size_t& capacity, size_t required);
+
+	/// <summary>
+	/// Enqueues the copy of a matrix into a zero-padded matrix.
+	/// </summary>
+	bool EnqueuePad(cl_command_queue queue, cl_mem input, int rows, int cols, int paddedRows, int paddedCols, cl_mem output);
+private:
+	static constexpr int Threads_Per_Dim = 16;
+	static constexpr int Inner_Tile = 16;
+
+	cl_context mContext = nullptr;
+	cl_program mProgram = nullptr;
+	cl_kernel mGemmKernel = nullptr;
+	cl_kernel mPadKernel = nullptr;
+	cl_kernel mUnpadKernel = nullptr;
+
+	int mWorkPerThread = 4;
+
+	cl_mem mPaddedA = nullptr;
+	cl_mem mPaddedB = nullptr;
+	cl_mem mPaddedC = nullptr;
+	size_t mPaddedACapacity = 0;
+	size_t mPaddedBCapacity = 0;
+	size_t mPaddedCCapacity = 0;
+};
@@ -0,0 +1,135 @@
+#include "SpMV.h"
+
+#include "OpenCLUtils.h"
+
+#include <stdio.h>
+
+bool SpMV::Initialize(cl_context context, cl_device_id device)
+{
+	cl_int err = -1;
+
+	mProgram = OpenCLUtils::build_program(context, device, "shaders/spmv.cl");
+	if (!mProgram)
+		return false;
+
+	mCsrScalarKernel = clCreateKernel(mProgram, "spmv_csr_scalar", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the scalar CSR kernel");
+		return false;
+	}
+
+	mCsrVectorKernel = clCreateKernel(mProgram, "spmv_csr_vector", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the vector CSR kernel");
+		return false;
+	}
+
+	mEllKernel = clCreateKernel(mProgram, "spmv_ell", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the ELL kernel");
+		return false;
+	}
+	return true;
+}
+
+bool SpMV::MultiplyCsrScalar(cl_command_queue queue, int numRows, cl_mem rowPtr, cl_mem colIndices, cl_mem values, cl_mem x, cl_mem y)
+{
+	cl_int err = -1;
+
+	err = clSetKernelArg(mCsrScalarKernel, 0, sizeof(int), &numRows);
+	err |= clSetKernelArg(mCsrScalarKernel, 1, sizeof(cl_mem), &rowPtr);
+	err |= clSetKernelArg(mCsrScalarKernel, 2, sizeof(cl_mem), &colIndices);
+	err |= clSetKernelArg(mCsrScalarKernel, 3, sizeof(cl_mem), &values);
+	err |= clSetKernelArg(mCsrScalarKernel, 4, sizeof(cl_mem), &x);
+	err |= clSetKernelArg(mCsrScalarKernel, 5, sizeof(cl_mem), &y);
+	if (err < 0)
+	{
+		perror("Couldn't create a scalar CSR kernel argument");
+		return false;
+	}
+
+	const size_t global = static_cast<size_t>(numRows);
+	err = clEnqueueNDRangeKernel(queue, mCsrScalarKernel, 1, NULL, &global, NULL, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the scalar CSR kernel");
+		return false;
+	}
+	return true;
+}
+
+bool SpMV::MultiplyCsrVector(cl_command_queue queue, int numRows, cl_mem rowPtr, cl_mem colIndices, cl_mem values, cl_mem x, cl_mem y)
+{
+	cl_int err = -1;
+
+	err = clSetKernelArg(mCsrVectorKernel, 0, sizeof(int), &numRows);
+	err |= clSetKernelArg(mCsrVectorKernel, 1, sizeof(cl_mem), &rowPtr);
+	err |= clSetKernelArg(mCsrVectorKernel, 2, sizeof(cl_mem), &colIndices);
+	err |= clSetKernelArg(mCsrVectorKernel, 3, sizeof(cl_mem), &values);
+	err |= clSetKernelArg(mCsrVectorKernel, 4, sizeof(cl_mem), &x);
+	err |= clSetKernelArg(mCsrVectorKernel, 5, sizeof(cl_mem), &y);
+	err |= clSetKernelArg(mCsrVectorKernel, 6, Vector_Group_Size * sizeof(float), NULL);
+	if (err < 0)
+	{
+		perror("Couldn't create a vector CSR kernel argument");
+		return false;
+	}
+
+	const size_t threads = static_cast<size_t>(numRows) * Vector_Size;
+	const size_t global = (threads + Vector_Group_Size - 1) / Vector_Group_Size * Vector_Group_Size;
+	const size_t local = Vector_Group_Size;
+
+	err = clEnqueueNDRangeKernel(queue, mCsrVectorKernel, 1, NULL, &global, &local, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the vector CSR kernel");
+		return false;
+	}
+	return true;
+}
+
+bool SpMV::MultiplyEll(cl_command_queue queue, int numRows, int width, cl_mem colIndices, cl_mem values, cl_mem x, cl_mem y)
+{
+	cl_int err = -1;
+
+	err = clSetKernelArg(mEllKernel, 0, sizeof(int), &numRows);
+	err |= clSetKernelArg(mEllKernel, 1, sizeof(int), &width);
+	err |= clSetKernelArg(mEllKernel, 2, sizeof(cl_mem), &colIndices);
+	err |= clSetKernelArg(mEllKernel, 3, sizeof(cl_mem), &values);
+	err |= clSetKernelArg(mEllKernel, 4, sizeof(cl_mem), &x);
+	err |= clSetKernelArg(mEllKernel, 5, sizeof(cl_mem), &y);
+	if (err < 0)
+	{
+		perror("Couldn't create an ELL kernel argument");
+		return false;
+	}
+
+	const size_t global = static_cast<size_t>(numRows);
+	err = clEnqueueNDRangeKernel(queue, mEllKernel, 1, NULL, &global, NULL, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the ELL kernel");
+		return false;
+	}
+	return true;
+}
+
+void SpMV::Release()
+{
+	if (mCsrScalarKernel)
+		clReleaseKernel(mCsrScalarKernel);
+	if (mCsrVectorKernel)
+		clReleaseKernel(mCsrVectorKernel);
+	if (mEllKernel)
+		clReleaseKernel(mEllKernel);
+	if (mProgram)
+		clReleaseProgram(mProgram);
+
+	mCsrScalarKernel = nullptr;
+	mCsrVectorKernel = nullptr;
+	mEllKernel = nullptr;
+	mProgram = nullptr;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "Cl/cl.h"
+
+/// <summary>
+/// Device sparse matrix-vector products y = A * x for matrices stored in
+/// CSR (one work-item per row, or a vector of work-items per row) and in
+/// column-major ELLPACK.
+/// </summary>
+class SpMV
+{
+public:
+	/// <summary>
+	/// Builds the SpMV program and creates the kernels.
+	/// </summary>
+	/// <param name="context">The OpenCL context</param>
+	/// <param name="device">The device to build the program for</param>
+	/// <returns>True if the kernels were created successfully</returns>
+	bool Initialize(cl_context context, cl_device_id device);
+
+	/// <summary>
+	/// Enqueues a CSR product with one work-item per row.
+	/// </summary>
+	/// <param name="queue">The command queue to enqueue the kernel on</param>
+	/// <param name="numRows">The number of rows</param>
+	/// <param name="rowPtr">Buffer of numRows + 1 ints</param>
+	/// <param name="colIndices">Buffer of nnz ints</param>
+	/// <param name="values">Buffer of nnz floats</param>
+	/// <param name="x">The input vector</param>
+	/// <param name="y">Buffer of numRows floats receiving the product</param>
+	/// <returns>True if the kernel was enqueued successfully</returns>
+	bool MultiplyCsrScalar(cl_command_queue queue, int numRows, cl_mem rowPtr, cl_mem colIndices, cl_mem values, cl_mem x, cl_mem y);
+
+	/// <summary>
+	/// Enqueues a CSR product with Vector_Size work-items cooperating on each row.
+	/// </summary>
+	bool MultiplyCsrVector(cl_command_queue queue, int numRows, cl_mem rowPtr, cl_mem colIndices, cl_mem values, cl_mem x, cl_mem y);
+
+	/// <summary>
+	/// Enqueues an ELLPACK product with one work-item per row.
+	/// </summary>
+	/// <param name="queue">The command queue to enqueue the kernel on</param>
+	/// <param name="numRows">The number of rows</param>
+	/// <param name="width">The padded row width</param>
+	/// <param name="colIndices">Buffer of numRows * width ints, column-major</param>
+	/// <param name="values">Buffer of numRows * width floats, column-major</param>
+	/// <param name="x">The input vector</param>
+	/// <param name="y">Buffer of numRows floats receiving the product</param>
+	/// <returns>True if the kernel was enqueued successfully</returns>
+	bool MultiplyEll(cl_command_queue queue, int numRows, int width, cl_mem colIndices, cl_mem values, cl_mem x, cl_mem y);
+
+	/// <summary>
+	/// Releases the kernels and program.
+	/// </summary>
+	void Release();
+private:
+	// Must match VECTOR_SIZE in spmv.cl
+	static constexpr size_t Vector_Size = 32;
+	static constexpr size_t Vector_Group_Size = 128;
+
+	cl_program mProgram = nullptr;
+	cl_kernel mCsrScalarKernel = nullptr;
+	cl_kernel mCsrVectorKernel = nullptr;
+	cl_kernel mEllKernel = nullptr;
+};
@@ -0,0 +1,241 @@
+#include "SparseMatrix.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <stdio.h>
+
+bool SparseMatrix::ReadMatrixMarket(const std::string& filename, CooMatrix& matrix)
+{
+	std::ifstream file(filename);
+	if (!file.is_open())
+	{
+		perror("Couldn't open the matrix market file");
+		return false;
+	}
+
+	std::string line;
+	if (!std::getline(file, line))
+	{
+		printf("Empty matrix market file: %s\n", filename.c_str());
+		return false;
+	}
+
+	// %%MatrixMarket matrix coordinate <field> <symmetry>
+	std::transform(line.begin(), line.end(), line.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+
+	std::istringstream header(line);
+	std::string banner, object, format, field, symmetry;
+	header >> banner >> object >> format >> field >> symmetry;
+
+	if (banner != "%%matrixmarket" || object != "matrix")
+	{
+		printf("Not a matrix market file: %s\n", filename.c_str());
+		return false;
+	}
+	if (format != "coordinate")
+	{
+		printf("Only coordinate matrix market files are supported!\n");
+		return false;
+	}
+	if (field != "real" && field != "integer" && field != "pattern")
+	{
+		printf("Unsupported matrix market field: %s\n", field.c_str());
+		return false;
+	}
+
+	const bool pattern = (field == "pattern");
+	const bool symmetric = (symmetry == "symmetric");
+	const bool skewSymmetric = (symmetry == "skew-symmetric");
+	if (!symmetric && !skewSymmetric && symmetry != "general")
+	{
+		printf("Unsupported matrix market symmetry: %s\n", symmetry.c_str());
+		return false;
+	}
+
+	// Skip comments up to the size line
+	do
+	{
+		if (!std::getline(file, line))
+		{
+			printf("Missing matrix market size line!\n");
+			return false;
+		}
+	} while (line.empty() || line[0] == '%');
+
+	size_t numEntries = 0;
+	{
+		std::istringstream sizes(line);
+		if (!(sizes >> matrix.rows >> matrix.cols >> numEntries))
+		{
+			printf("Malformed matrix market size line: %s\n", line.c_str());
+			return false;
+		}
+	}
+
+	matrix.rowIndices.clear();
+	matrix.colIndices.clear();
+	matrix.values.clear();
+
+	const size_t capacity = (symmetric || skewSymmetric) ? numEntries * 2 : numEntries;
+	matrix.rowIndices.reserve(capacity);
+	matrix.colIndices.reserve(capacity);
+	matrix.values.reserve(capacity);
+
+	for (size_t i = 0; i < numEntries; ++i)
+	{
+		int row = 0, col = 0;
+		double value = 1.0;
+
+		if (!(file >> row >> col) || (!pattern && !(file >> value)))
+		{
+			printf("Expected %zu matrix market entries but read %zu!\n", numEntries, i);
+			return false;
+		}
+		if (row < 1 || row > matrix.rows || col < 1 || col > matrix.cols)
+		{
+			printf("Matrix market entry (%d, %d) is out of range!\n", row, col);
+			return false;
+		}
+
+		// Indices are 1-based
+		matrix.rowIndices.push_back(row - 1);
+		matrix.colIndices.push_back(col - 1);
+		matrix.values.push_back(static_cast<float>(value));
+
+		// Only the lower triangle of symmetric matrices is stored
+		if ((symmetric || skewSymmetric) && row != col)
+		{
+			matrix.rowIndices.push_back(col - 1);
+			matrix.colIndices.push_back(row - 1);
+			matrix.values.push_back(static_cast<float>(skewSymmetric ? -value : value));
+		}
+	}
+	return true;
+}
+
+CooMatrix SparseMatrix::GeneratePowerLaw(int rows, int cols, int minRowLength, float exponent, uint32_t seed)
+{
+	std::mt19937 generator(seed);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+	std::uniform_int_distribution<int> column(0, cols - 1);
+
+	CooMatrix coo;
+	coo.rows = rows;
+	coo.cols = cols;
+
+	for (int row = 0; row < rows; ++row)
+	{
+		// Pareto distributed row length by inverse transform sampling
+		const float u = std::max(unit(generator), 1e-7f);
+		const double length = minRowLength * std::pow(u, -1.0 / (exponent - 1.0));
+		const int rowLength = static_cast<int>(std::min<double>(length, cols));
+
+		for (int j = 0; j < rowLength; ++j)
+		{
+			coo.rowIndices.push_back(row);
+			coo.colIndices.push_back(column(generator));
+			coo.values.push_back(value(generator));
+		}
+	}
+	return coo;
+}
+
+CsrMatrix SparseMatrix::CooToCsr(const CooMatrix& coo)
+{
+	CsrMatrix csr;
+	csr.rows = coo.rows;
+	csr.cols = coo.cols;
+	csr.rowPtr.assign(static_cast<size_t>(coo.rows) + 1, 0);
+
+	// Sort the entries by (row, column)
+	std::vector<size_t> order(coo.GetNonZeros());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs)
+	{
+		if (coo.rowIndices[lhs] != coo.rowIndices[rhs])
+			return coo.rowIndices[lhs] < coo.rowIndices[rhs];
+		return coo.colIndices[lhs] < coo.colIndices[rhs];
+	});
+
+	csr.colIndices.reserve(order.size());
+	csr.values.reserve(order.size());
+
+	int previousRow = -1;
+	int previousCol = -1;
+	for (size_t index : order)
+	{
+		const int row = coo.rowIndices[index];
+		const int col = coo.colIndices[index];
+
+		// Duplicate entries are summed
+		if (row == previousRow && col == previousCol)
+		{
+			csr.values.back() += coo.values[index];
+			continue;
+		}
+
+		csr.colIndices.push_back(col);
+		csr.values.push_back(coo.values[index]);
+		++csr.rowPtr[row + 1];
+
+		previousRow = row;
+		previousCol = col;
+	}
+
+	std::partial_sum(csr.rowPtr.begin(), csr.rowPtr.end(), csr.rowPtr.begin());
+	return csr;
+}
+
+EllMatrix SparseMatrix::CooToEll(const CooMatrix& coo)
+{
+	return CsrToEll(CooToCsr(coo));
+}
+
+EllMatrix SparseMatrix::CsrToEll(const CsrMatrix& csr)
+{
+	EllMatrix ell;
+	ell.rows = csr.rows;
+	ell.cols = csr.cols;
+	ell.width = GetMaxRowLength(csr);
+
+	const size_t size = static_cast<size_t>(ell.rows) * ell.width;
+	ell.colIndices.assign(size, -1);
+	ell.values.assign(size, 0.0f);
+
+	for (int row = 0; row < csr.rows; ++row)
+	{
+		for (int j = csr.rowPtr[row]; j < csr.rowPtr[row + 1]; ++j)
+		{
+			const size_t index = static_cast<size_t>(j - csr.rowPtr[row]) * ell.rows + row;
+			ell.colIndices[index] = csr.colIndices[j];
+			ell.values[index] = csr.values[j];
+		}
+	}
+	return ell;
+}
+
+int SparseMatrix::GetMaxRowLength(const CsrMatrix& csr)
+{
+	int maxLength = 0;
+	for (int row = 0; row < csr.rows; ++row)
+		maxLength = std::max(maxLength, csr.rowPtr[row + 1] - csr.rowPtr[row]);
+	return maxLength;
+}
+
+void SparseMatrix::MultiplyReference(const CsrMatrix& csr, const std::vector<float>& x, std::vector<float>& y)
+{
+	y.resize(csr.rows);
+	for (int row = 0; row < csr.rows; ++row)
+	{
+		double sum = 0.0;
+		for (int j = csr.rowPtr[row]; j < csr.rowPtr[row + 1]; ++j)
+			sum += static_cast<double>(csr.values[j]) * x[csr.colIndices[j]];
+		y[row] = static_cast<float>(sum);
+	}
+}
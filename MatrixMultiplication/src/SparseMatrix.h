@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Coordinate format: one (row, column, value) triplet per non-zero, in any order.
+/// </summary>
+struct CooMatrix
+{
+	int rows = 0;
+	int cols = 0;
+
+	std::vector<int> rowIndices;
+	std::vector<int> colIndices;
+	std::vector<float> values;
+
+	size_t GetNonZeros() const { return values.size(); }
+};
+
+/// <summary>
+/// Compressed sparse row format: the entries of row r are
+/// [rowPtr[r], rowPtr[r + 1]) in colIndices and values.
+/// </summary>
+struct CsrMatrix
+{
+	int rows = 0;
+	int cols = 0;
+
+	std::vector<int> rowPtr;
+	std::vector<int> colIndices;
+	std::vector<float> values;
+
+	size_t GetNonZeros() const { return values.size(); }
+};
+
+/// <summary>
+/// ELLPACK format: every row padded to the same width, stored column-major
+/// so that entry j of row r lives at j * rows + r. Padding entries have a
+/// column index of -1 and a value of 0.
+/// </summary>
+struct EllMatrix
+{
+	int rows = 0;
+	int cols = 0;
+	int width = 0;
+
+	std::vector<int> colIndices;
+	std::vector<float> values;
+};
+
+/// <summary>
+/// Host-side helpers to load, generate and convert sparse matrices.
+/// </summary>
+class SparseMatrix
+{
+public:
+	/// <summary>
+	/// Reads a Matrix Market coordinate file (real, integer or pattern;
+	/// general or symmetric).
+	/// </summary>
+	/// <param name="filename">The path to the .mtx file</param>
+	/// <param name="matrix">Receives the triplets with 0-based indices</param>
+	/// <returns>True if the file was read successfully</returns>
+	static bool ReadMatrixMarket(const std::string& filename, CooMatrix& matrix);
+
+	/// <summary>
+	/// Generates a matrix whose row lengths follow a power law, as found in
+	/// web and social graphs: most rows are short and a few are very long.
+	/// </summary>
+	/// <param name="rows">The number of rows</param>
+	/// <param name="cols">The number of columns</param>
+	/// <param name="minRowLength">The length of the shortest rows</param>
+	/// <param name="exponent">The power law exponent, larger values give fewer long rows</param>
+	/// <param name="seed">The random seed</param>
+	/// <returns>The generated triplets</returns>
+	static CooMatrix GeneratePowerLaw(int rows, int cols, int minRowLength, float exponent, uint32_t seed);
+
+	/// <summary>
+	/// Converts triplets to CSR, sorting each row by column and summing duplicates.
+	/// </summary>
+	static CsrMatrix CooToCsr(const CooMatrix& coo);
+
+	/// <summary>
+	/// Converts triplets to ELLPACK, padding every row to the longest one.
+	/// </summary>
+	static EllMatrix CooToEll(const CooMatrix& coo);
+
+	/// <summary>
+	/// Converts CSR to ELLPACK, padding every row to the longest one.
+	/// </summary>
+	static EllMatrix CsrToEll(const CsrMatrix& csr);
+
+	/// <summary>
+	/// Retrieves the length of the longest row of a CSR matrix.
+	/// </summary>
+	static int GetMaxRowLength(const CsrMatrix& csr);
+
+	/// <summary>
+	/// Computes y = A * x on the host in double precision.
+	/// </summary>
+	static void MultiplyReference(const CsrMatrix& csr, const std::vector<float>& x, std::vector<float>& y);
+};
@@ -1,9 +1,21 @@
 #include "OpenCLUtils.h"
+#include "Timer.h"
+
+#include "GemmEngine.h"
+#include "BatchedGemm.h"
+#include "CpuGemm.h"
+#include "GemmDispatcher.h"
+#include "SparseMatrix.h"
+#include "SpMV.h"
 
 #include "Cl/cl.h"
 
 #include <vector>
 #include <string>
+#include <random>
+#include <cmath>
+#include <functional>
+#include <algorithm>
 
 cl_device_id device = nullptr;
 cl_context context = nullptr;
@@ -12,8 +24,12 @@ cl_kernel kernel = nullptr;
 cl_command_queue queue = nullptr;
 cl_int err = -1;
 
-bool MatrixMult(size_t local_size,
-                std::vector<float>& matrixA,
+GemmEngine gemm;
+BatchedGemm batchedGemm;
+GemmDispatcher dispatcher;
+SpMV spmv;
+
+bool MatrixMult(std::vector<float>& matrixA,
                 std::vector<float>& matrixB,
                 size_t M,
                 size_t N,
@@ -24,12 +40,16 @@ bool MatrixMult(size_t local_size,
 	cl_mem inputB = OpenCLUtils::create_input_buffer(context, matrixB.data(), matrixB.size() * sizeof(float));
 	cl_mem output_buffer = OpenCLUtils::create_output_buffer(context, output.size() * sizeof(float));
 
+	const int rows = static_cast<int>(M);
+	const int inner = static_cast<int>(N);
+	const int columns = static_cast<int>(K);
+
     /* Create kernel arguments */
 	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &inputA);
 	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &inputB);
-	err |= clSetKernelArg(kernel, 2, sizeof(int), &M);
-	err |= clSetKernelArg(kernel, 3, sizeof(int), &N);
-	err |= clSetKernelArg(kernel, 4, sizeof(int), &K);
+	err |= clSetKernelArg(kernel, 2, sizeof(int), &rows);
+	err |= clSetKernelArg(kernel, 3, sizeof(int), &inner);
+	err |= clSetKernelArg(kernel, 4, sizeof(int), &columns);
     err |= clSetKernelArg(kernel, 5, sizeof(cl_mem), &output_buffer);
     if (err < 0)
     {
@@ -37,15 +57,15 @@ bool MatrixMult(size_t local_size,
         return false;
     }
 
+	// Let the runtime pick the work-group size, {M, K} only works for toy sizes
 	size_t global[2] = { M, K };
-	size_t local[2] = { M, K };
 
     err = clEnqueueNDRangeKernel(queue,
                                  kernel,
                                  2,
                                  NULL,
                                  (const size_t*)&global,
-                                 (const size_t*)&local,
+                                 NULL,
                                  0,
                                  NULL,
                                  NULL);
@@ -72,13 +92,417 @@ bool MatrixMult(size_t local_size,
         return false;
     }
 
-	clReleaseKernel(kernel);
 	clReleaseMemObject(inputA);
 	clReleaseMemObject(inputB);
 	clReleaseMemObject(output_buffer);
     return true;
 }
 
+bool MatrixMultTiled(std::vector<float>& matrixA,
+                     std::vector<float>& matrixB,
+                     size_t M,
+                     size_t N,
+                     size_t K,
+                     std::vector<float>& output)
+{
+	cl_mem inputA = OpenCLUtils::create_input_buffer(context, matrixA.data(), matrixA.size() * sizeof(float));
+	cl_mem inputB = OpenCLUtils::create_input_buffer(context, matrixB.data(), matrixB.size() * sizeof(float));
+	cl_mem output_buffer = OpenCLUtils::create_output_buffer(context, output.size() * sizeof(float));
+
+	if (!gemm.Multiply(queue, inputA, inputB, static_cast<int>(M), static_cast<int>(N), static_cast<int>(K), output_buffer))
+		return false;
+
+    /* Read the kernel's output    */
+    err = clEnqueueReadBuffer(queue,
+                              output_buffer,
+                              CL_TRUE,
+                              0,
+                              output.size() * sizeof(float),
+                              output.data(),
+                              0,
+                              NULL,
+                              NULL);
+    if (err < 0)
+    {
+        perror("Couldn't read the buffer");
+        return false;
+    }
+
+	clReleaseMemObject(inputA);
+	clReleaseMemObject(inputB);
+	clReleaseMemObject(output_buffer);
+    return true;
+}
+
+/// <summary>
+/// Computes the largest error of a result relative to the CPU reference,
+/// measured against max(1, |expected|).
+/// </summary>
+double MaxRelativeError(const float* result, const float* expected, size_t count)
+{
+	double maxError = 0.0;
+	for (size_t i = 0; i < count; ++i)
+	{
+		const double reference = expected[i];
+		maxError = std::max(maxError, std::abs(result[i] - reference) / std::max(1.0, std::abs(reference)));
+	}
+	return maxError;
+}
+
+bool BenchmarkGemm()
+{
+	const int Iterations = 5;
+	// (M, N, K), the rectangular shapes that are not tile multiples exercise
+	// the edge tiles and the leading dimensions of the tiled kernel
+	const size_t Shapes[][3] =
+	{
+		{ 64, 64, 64 }, { 100, 100, 100 }, { 128, 128, 128 }, { 256, 256, 256 }, { 512, 512, 512 },
+		{ 1000, 1000, 1000 }, { 1024, 1024, 1024 }, { 2048, 2048, 2048 }, { 4096, 4096, 4096 }, { 8192, 8192, 8192 },
+		{ 1, 77, 9 }, { 67, 131, 35 }, { 300, 17, 513 }, { 1000, 723, 259 }
+	};
+
+	// The naive kernel takes minutes at the largest sizes
+	const size_t Naive_Size_Limit = 2048;
+
+	// Float accumulation orders differ between the tiled kernel and the CPU reference
+	const double Tolerance = 1e-3;
+	bool allCorrect = true;
+
+	std::mt19937 generator(42);
+	std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+	const auto TimeRuns = [&](const std::function<bool()>& enqueue)
+	{
+		if (!enqueue())
+			return -1.0;
+		clFinish(queue);
+
+		Timer timer(true);
+		for (int i = 0; i < Iterations; ++i)
+			enqueue();
+		clFinish(queue);
+		return timer.Stop_ms() / Iterations;
+	};
+
+	printf("%6s %6s %6s  %12s %10s  %12s %10s  %12s %10s  %s\n", "M", "N", "K", "cpu (ms)", "GFLOP/s", "naive (ms)", "GFLOP/s", "tiled (ms)", "GFLOP/s", "max rel error");
+
+	for (const auto& shape : Shapes)
+	{
+		const size_t M = shape[0], N = shape[1], K = shape[2];
+
+		std::vector<float> matrixA(M * N);
+		std::vector<float> matrixB(N * K);
+		for (float& value : matrixA)
+			value = distribution(generator);
+		for (float& value : matrixB)
+			value = distribution(generator);
+
+		cl_mem inputA = OpenCLUtils::create_input_buffer(context, matrixA.data(), matrixA.size() * sizeof(float));
+		cl_mem inputB = OpenCLUtils::create_input_buffer(context, matrixB.data(), matrixB.size() * sizeof(float));
+		cl_mem output_buffer = OpenCLUtils::create_output_buffer(context, M * K * sizeof(float));
+		if (!inputA || !inputB || !output_buffer)
+			return false;
+
+		const double gflop = 2.0 * M * N * K / 1e9;
+
+		// The blocked CPU GEMM is both the host baseline and the correctness reference
+		std::vector<float> expected(M * K);
+		Timer cpuTimer(true);
+		CpuGemm::Multiply(matrixA.data(), matrixB.data(), static_cast<int>(M), static_cast<int>(N), static_cast<int>(K), expected.data());
+		const double cpu_ms = cpuTimer.Stop_ms();
+
+		double naive_ms = -1.0;
+		if (std::max({ M, N, K }) <= Naive_Size_Limit)
+		{
+			const int rows = static_cast<int>(M), inner = static_cast<int>(N), columns = static_cast<int>(K);
+			err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &inputA);
+			err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &inputB);
+			err |= clSetKernelArg(kernel, 2, sizeof(int), &rows);
+			err |= clSetKernelArg(kernel, 3, sizeof(int), &inner);
+			err |= clSetKernelArg(kernel, 4, sizeof(int), &columns);
+			err |= clSetKernelArg(kernel, 5, sizeof(cl_mem), &output_buffer);
+			if (err < 0)
+			{
+				perror("Couldn't create a kernel argument");
+				return false;
+			}
+
+			const size_t global[2] = { M, K };
+			naive_ms = TimeRuns([&]()
+			{
+				return clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global, NULL, 0, NULL, NULL) == CL_SUCCESS;
+			});
+		}
+
+		const double tiled_ms = TimeRuns([&]()
+		{
+			return gemm.Multiply(queue, inputA, inputB, static_cast<int>(M), static_cast<int>(N), static_cast<int>(K), output_buffer);
+		});
+		if (tiled_ms < 0.0)
+			return false;
+
+		std::vector<float> output(M * K);
+		err = clEnqueueReadBuffer(queue, output_buffer, CL_TRUE, 0, output.size() * sizeof(float), output.data(), 0, NULL, NULL);
+		if (err < 0)
+		{
+			perror("Couldn't read the buffer");
+			return false;
+		}
+
+		const double maxError = MaxRelativeError(output.data(), expected.data(), output.size());
+
+		printf("%6zu %6zu %6zu  %12.3f %10.2f", M, N, K, cpu_ms, gflop / (cpu_ms / 1000.0));
+		if (naive_ms >= 0.0)
+			printf("  %12.3f %10.2f", naive_ms, gflop / (naive_ms / 1000.0));
+		else
+			printf("  %12s %10s", "-", "-");
+		printf("  %12.3f %10.2f  %.2e%s\n", tiled_ms, gflop / (tiled_ms / 1000.0), maxError, maxError <= Tolerance ? "" : "  FAILED");
+		allCorrect &= maxError <= Tolerance;
+
+		clReleaseMemObject(inputA);
+		clReleaseMemObject(inputB);
+		clReleaseMemObject(output_buffer);
+	}
+
+	if (!allCorrect)
+		printf("The tiled GEMM exceeded the error tolerance of %.0e\n", Tolerance);
+	return allCorrect;
+}
+
+bool BenchmarkBatchedGemm()
+{
+	const int Batch = 4096;
+	const int Iterations = 20;
+	const int Sizes[] = { 8, 16, 32, 64 };
+
+	// One MatrixMult call per matrix is slow enough to only time a slice of the batch
+	const int Per_Matrix_Count = 256;
+
+	std::mt19937 generator(7);
+	std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+	printf("%4s  %16s  %16s  %16s  %s\n", "size", "per-matrix (m/s)", "strided (m/s)", "indexed (m/s)", "max rel error");
+
+	for (int size : Sizes)
+	{
+		const int M = size, N = size, K = size;
+		const int matrixSize = size * size;
+
+		std::vector<float> matricesA(static_cast<size_t>(Batch) * matrixSize);
+		std::vector<float> matricesB(static_cast<size_t>(Batch) * matrixSize);
+		for (float& value : matricesA)
+			value = distribution(generator);
+		for (float& value : matricesB)
+			value = distribution(generator);
+
+		// Pointer-array style batch: the products are written in reverse order
+		std::vector<int> offsets(Batch);
+		std::vector<int> reversedOffsets(Batch);
+		for (int i = 0; i < Batch; ++i)
+		{
+			offsets[i] = i * matrixSize;
+			reversedOffsets[i] = (Batch - 1 - i) * matrixSize;
+		}
+
+		cl_mem inputA = OpenCLUtils::create_input_buffer(context, matricesA.data(), matricesA.size() * sizeof(float));
+		cl_mem inputB = OpenCLUtils::create_input_buffer(context, matricesB.data(), matricesB.size() * sizeof(float));
+		cl_mem output_buffer = OpenCLUtils::create_output_buffer(context, matricesA.size() * sizeof(float));
+		cl_mem offsets_buffer = OpenCLUtils::create_input_buffer(context, offsets.data(), offsets.size() * sizeof(int));
+		cl_mem reversed_buffer = OpenCLUtils::create_input_buffer(context, reversedOffsets.data(), reversedOffsets.size() * sizeof(int));
+		if (!inputA || !inputB || !output_buffer || !offsets_buffer || !reversed_buffer)
+			return false;
+
+		// Baseline: one launch, three buffers and a blocking read per matrix
+		double perMatrixRate = 0.0;
+		{
+			std::vector<float> matrixA(matrixSize), matrixB(matrixSize), output(matrixSize);
+
+			Timer timer(true);
+			for (int i = 0; i < Per_Matrix_Count; ++i)
+			{
+				std::copy_n(matricesA.begin() + static_cast<size_t>(i) * matrixSize, matrixSize, matrixA.begin());
+				std::copy_n(matricesB.begin() + static_cast<size_t>(i) * matrixSize, matrixSize, matrixB.begin());
+				if (!MatrixMult(matrixA, matrixB, M, N, K, output))
+					return false;
+			}
+			perMatrixRate = Per_Matrix_Count / timer.Stop_s();
+		}
+
+		const auto TimeBatch = [&](const std::function<bool()>& enqueue)
+		{
+			if (!enqueue())
+				return -1.0;
+			clFinish(queue);
+
+			Timer timer(true);
+			for (int i = 0; i < Iterations; ++i)
+				enqueue();
+			clFinish(queue);
+			return static_cast<double>(Batch) * Iterations / timer.Stop_s();
+		};
+
+		const double stridedRate = TimeBatch([&]()
+		{
+			return batchedGemm.MultiplyStrided(queue, M, N, K, inputA, matrixSize, inputB, matrixSize, output_buffer, matrixSize, Batch);
+		});
+		const double indexedRate = TimeBatch([&]()
+		{
+			return batchedGemm.MultiplyIndexed(queue, M, N, K, inputA, offsets_buffer, inputB, offsets_buffer, output_buffer, reversed_buffer, Batch);
+		});
+		if (stridedRate < 0.0 || indexedRate < 0.0)
+			return false;
+
+		std::vector<float> output(matricesA.size());
+		err = clEnqueueReadBuffer(queue, output_buffer, CL_TRUE, 0, output.size() * sizeof(float), output.data(), 0, NULL, NULL);
+		if (err < 0)
+		{
+			perror("Couldn't read the buffer");
+			return false;
+		}
+
+		// The last run was the indexed one, product i sits at slot Batch - 1 - i
+		double maxError = 0.0;
+		std::vector<float> expected(matrixSize);
+		for (int i = 0; i < Batch; i += 97)
+		{
+			const size_t offset = static_cast<size_t>(i) * matrixSize;
+			CpuGemm::Multiply(matricesA.data() + offset, matricesB.data() + offset, M, N, K, expected.data(), 1);
+
+			const float* result = output.data() + static_cast<size_t>(Batch - 1 - i) * matrixSize;
+			maxError = std::max(maxError, MaxRelativeError(result, expected.data(), matrixSize));
+		}
+
+		printf("%4d  %16.0f  %16.0f  %16.0f  %.2e\n", size, perMatrixRate, stridedRate, indexedRate, maxError);
+
+		clReleaseMemObject(inputA);
+		clReleaseMemObject(inputB);
+		clReleaseMemObject(output_buffer);
+		clReleaseMemObject(offsets_buffer);
+		clReleaseMemObject(reversed_buffer);
+	}
+	return true;
+}
+
+bool BenchmarkSpMV(const std::string& matrixMarketFile)
+{
+	const int Iterations = 20;
+	const int Rows = 1 << 20;
+
+	// ELL is skipped once padding would inflate the matrix beyond this factor
+	const double Max_Ell_Padding = 8.0;
+
+	std::vector<std::pair<std::string, CooMatrix>> matrices;
+	for (float exponent : { 3.0f, 2.5f, 2.2f })
+		matrices.emplace_back("power law " + std::to_string(exponent).substr(0, 3), SparseMatrix::GeneratePowerLaw(Rows, Rows, 4, exponent, 11));
+
+	if (!matrixMarketFile.empty())
+	{
+		CooMatrix coo;
+		if (!SparseMatrix::ReadMatrixMarket(matrixMarketFile, coo))
+			return false;
+		matrices.emplace_back(matrixMarketFile, std::move(coo));
+	}
+
+	const auto TimeRuns = [&](const std::function<bool()>& enqueue)
+	{
+		if (!enqueue())
+			return -1.0;
+		clFinish(queue);
+
+		Timer timer(true);
+		for (int i = 0; i < Iterations; ++i)
+			enqueue();
+		clFinish(queue);
+		return timer.Stop_ms() / Iterations;
+	};
+
+	std::mt19937 generator(5);
+	std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+	for (const auto& [name, coo] : matrices)
+	{
+		const CsrMatrix csr = SparseMatrix::CooToCsr(coo);
+		const size_t nnz = csr.GetNonZeros();
+		const int maxRowLength = SparseMatrix::GetMaxRowLength(csr);
+
+		std::vector<float> x(csr.cols);
+		for (float& value : x)
+			value = distribution(generator);
+
+		std::vector<float> expected;
+		SparseMatrix::MultiplyReference(csr, x, expected);
+
+		printf("%s: %d x %d, %zu non-zeros, max row %d\n", name.c_str(), csr.rows, csr.cols, nnz, maxRowLength);
+
+		// Effective traffic: values, column indices, the gathered x and y, plus row pointers for CSR.
+		// ELL padding is not counted, so its figure reflects useful work.
+		const double usefulBytes = static_cast<double>(nnz) * (sizeof(float) * 2 + sizeof(int)) + static_cast<double>(csr.rows) * sizeof(float);
+		const double csrBytes = usefulBytes + static_cast<double>(csr.rows + 1) * sizeof(int);
+
+		cl_mem x_buffer = OpenCLUtils::create_input_buffer(context, x.data(), x.size() * sizeof(float));
+		cl_mem y_buffer = OpenCLUtils::create_output_buffer(context, static_cast<size_t>(csr.rows) * sizeof(float));
+		cl_mem row_ptr = OpenCLUtils::create_input_buffer(context, const_cast<int*>(csr.rowPtr.data()), csr.rowPtr.size() * sizeof(int));
+		cl_mem col_idx = OpenCLUtils::create_input_buffer(context, const_cast<int*>(csr.colIndices.data()), csr.colIndices.size() * sizeof(int));
+		cl_mem values = OpenCLUtils::create_input_buffer(context, const_cast<float*>(csr.values.data()), csr.values.size() * sizeof(float));
+		if (!x_buffer || !y_buffer || !row_ptr || !col_idx || !values)
+			return false;
+
+		const auto Report = [&](const char* format, double elapsed_ms, double bytes)
+		{
+			std::vector<float> y(csr.rows);
+			err = clEnqueueReadBuffer(queue, y_buffer, CL_TRUE, 0, y.size() * sizeof(float), y.data(), 0, NULL, NULL);
+			if (err < 0)
+			{
+				perror("Couldn't read the buffer");
+				return false;
+			}
+
+			double maxError = 0.0;
+			for (size_t i = 0; i < y.size(); ++i)
+				maxError = std::max(maxError, std::abs(y[i] - expected[i]) / std::max(1.0, std::abs(static_cast<double>(expected[i]))));
+
+			printf("  %-12s %9.3f ms  %8.2f GB/s  Max Rel Error: %.2e\n", format, elapsed_ms, bytes / 1e9 / (elapsed_ms / 1000.0), maxError);
+			return true;
+		};
+
+		const double scalar_ms = TimeRuns([&]() { return spmv.MultiplyCsrScalar(queue, csr.rows, row_ptr, col_idx, values, x_buffer, y_buffer); });
+		if (scalar_ms < 0.0 || !Report("CSR scalar", scalar_ms, csrBytes))
+			return false;
+
+		const double vector_ms = TimeRuns([&]() { return spmv.MultiplyCsrVector(queue, csr.rows, row_ptr, col_idx, values, x_buffer, y_buffer); });
+		if (vector_ms < 0.0 || !Report("CSR vector", vector_ms, csrBytes))
+			return false;
+
+		const double padding = static_cast<double>(csr.rows) * maxRowLength / std::max<size_t>(1, nnz);
+		if (padding > Max_Ell_Padding)
+		{
+			printf("  %-12s skipped, padding would be %.1fx the non-zeros\n", "ELL", padding);
+		}
+		else
+		{
+			const EllMatrix ell = SparseMatrix::CsrToEll(csr);
+			cl_mem ell_col_idx = OpenCLUtils::create_input_buffer(context, const_cast<int*>(ell.colIndices.data()), ell.colIndices.size() * sizeof(int));
+			cl_mem ell_values = OpenCLUtils::create_input_buffer(context, const_cast<float*>(ell.values.data()), ell.values.size() * sizeof(float));
+			if (!ell_col_idx || !ell_values)
+				return false;
+
+			const double ell_ms = TimeRuns([&]() { return spmv.MultiplyEll(queue, ell.rows, ell.width, ell_col_idx, ell_values, x_buffer, y_buffer); });
+			if (ell_ms < 0.0 || !Report("ELL", ell_ms, usefulBytes))
+				return false;
+
+			clReleaseMemObject(ell_col_idx);
+			clReleaseMemObject(ell_values);
+		}
+
+		clReleaseMemObject(x_buffer);
+		clReleaseMemObject(y_buffer);
+		clReleaseMemObject(row_ptr);
+		clReleaseMemObject(col_idx);
+		clReleaseMemObject(values);
+	}
+	return true;
+}
+
 bool InitializeDeviceAndContext()
 {
 	device = OpenCLUtils::create_device();
@@ -116,6 +540,19 @@ bool InitializeProgram()
 		perror("Couldn't create a kernel");
 		return false;
 	};
+
+	/* Work-per-thread of 8 suits GPUs with large register files, 4 is the safer default */
+	if (!gemm.Initialize(context, device, 4))
+		return false;
+
+	if (!batchedGemm.Initialize(context, device))
+		return false;
+
+	if (!dispatcher.Initialize(context, device, queue, &gemm))
+		return false;
+
+	if (!spmv.Initialize(context, device))
+		return false;
     return true;
 }
 
@@ -127,6 +564,38 @@ int main()
     if (!InitializeProgram())
         return -1;
 
+	const bool RunBenchmark = false;
+	const bool RunBatchedBenchmark = false;
+	const bool RunSparseBenchmark = false;
+	const bool UseTiled = true;
+	const bool UseDispatcher = false;
+
+	// Crossover points are measured once per machine and device
+	const std::string Crossover_File = "gemm_crossover.txt";
+	if (UseDispatcher && !dispatcher.Load(Crossover_File))
+	{
+		if (!dispatcher.Calibrate() || !dispatcher.Save(Crossover_File))
+			return -1;
+	}
+
+	if (RunBenchmark)
+	{
+		if (!BenchmarkGemm())
+			return -1;
+	}
+
+	if (RunBatchedBenchmark)
+	{
+		if (!BenchmarkBatchedGemm())
+			return -1;
+	}
+
+	if (RunSparseBenchmark)
+	{
+		if (!BenchmarkSpMV("content/sparse_sample.mtx"))
+			return -1;
+	}
+
 	std::vector<float> matrixA =
 	{
 		1, 2, 3,
@@ -157,40 +626,43 @@ int main()
 	// Result matrix
 	std::vector<float> output(M * K, 0);
 
-	const size_t local_size = 4;
-
-    if (!MatrixMult(local_size, matrixA, matrixB, M, N, K, output))
-        return -1;
+	if (UseDispatcher)
+	{
+		GemmDispatcher::Backend backend;
+		if (!dispatcher.Multiply(matrixA.data(), matrixB.data(), static_cast<int>(M), static_cast<int>(N), static_cast<int>(K), output.data(), &backend))
+			return -1;
+		printf("Dispatched to the %s\n", backend == GemmDispatcher::Backend::CPU ? "CPU" : "device");
+	}
+	else if (UseTiled)
+	{
+		if (!MatrixMultTiled(matrixA, matrixB, M, N, K, output))
+			return -1;
+	}
+	else
+	{
+		if (!MatrixMult(matrixA, matrixB, M, N, K, output))
+			return -1;
+	}
 
     /// Check Results ---------------------------------------------------------
 
-    // Perform Manual Multiplication
+    // Compare against the blocked CPU GEMM
 	std::vector<float> checkOutput(M * K, 0.0f);
-	for (size_t i = 0; i < rowsA; ++i)
-    {
-		for (size_t j = 0; j < columnB; ++j)
-        {
-			for (size_t k = 0; k < columnsA; ++k)
-            {
-                size_t outputIndex = i * columnB + j;
-                size_t indexA = i * columnsA + k;
-                size_t indexB = k * columnB + j;
-                checkOutput[outputIndex] += matrixA[indexA] * matrixB[indexB];
-			}
-		}
-	}
+	CpuGemm::Multiply(matrixA.data(), matrixB.data(), static_cast<int>(M), static_cast<int>(N), static_cast<int>(K), checkOutput.data());
+
+	const double Tolerance = 1e-5;
 
 	bool success = true;
 	for (size_t i = 0; i < output.size(); ++i)
 	{
-		if (checkOutput[i] != output[i])
+		if (MaxRelativeError(&output[i], &checkOutput[i], 1) > Tolerance)
 		{
 			std::string msg = (std::to_string(checkOutput[i]) + " != " + std::to_string(output[i]));
 			printf(msg.c_str());
 			success = false;
 			break;
 		}
-}
+	}
 
 	if (success)
 	{
@@ -205,6 +677,10 @@ int main()
     
     ///* Deallocate resources */
     
+	gemm.Release();
+	batchedGemm.Release();
+	spmv.Release();
+	clReleaseKernel(kernel);
     clReleaseCommandQueue(queue);
     clReleaseProgram(program);
     clReleaseContext(context);
@@ -1,5 +1,121 @@
-__kernel void simulate(__global float2* positions,
-                       __global float2* velocities,
+// State layout of the packed bodies and their velocities, selected at build
+// time. The buffers have the same size in every layout:
+//   LAYOUT_AOS    interleaved, float4(x, y, radius, mass) and float2 per body
+//   LAYOUT_SOA    one plane of numBodies floats per component
+//   LAYOUT_AOSOA  blocks of AOSOA_WIDTH bodies holding one vector per component
+// Every work-item accesses its own element, a single vector load or store
+// only in AoS. In SoA and AoSoA the components are scalar accesses,
+// contiguous with the same component of the neighbouring work-items, and
+// the force tiles are staged 4 bodies per component with load_lanes4.
+// The accelerations are scratch written and read by the same work-item and
+// always stay float2.
+#if !defined(LAYOUT_SOA) && !defined(LAYOUT_AOSOA) && !defined(LAYOUT_AOS)
+#define LAYOUT_AOS
+#endif
+
+#ifndef AOSOA_WIDTH
+#define AOSOA_WIDTH 4
+#endif
+
+// Float index of component c of element i among n elements of the given width
+inline int element_index(int i, int c, int n, int components)
+{
+#if defined(LAYOUT_SOA)
+    return c * n + i;
+#elif defined(LAYOUT_AOSOA)
+    return (i / AOSOA_WIDTH) * components * AOSOA_WIDTH + c * AOSOA_WIDTH + i % AOSOA_WIDTH;
+#else
+    return i * components + c;
+#endif
+}
+
+inline float4 load_float4(__global const float* data, int i, int n)
+{
+#if defined(LAYOUT_AOS)
+    return vload4(i, data);
+#else
+    return (float4)(data[element_index(i, 0, n, 4)], data[element_index(i, 1, n, 4)],
+                    data[element_index(i, 2, n, 4)], data[element_index(i, 3, n, 4)]);
+#endif
+}
+
+inline void store_float4(__global float* data, int i, int n, float4 value)
+{
+#if defined(LAYOUT_AOS)
+    vstore4(value, i, data);
+#else
+    data[element_index(i, 0, n, 4)] = value.x;
+    data[element_index(i, 1, n, 4)] = value.y;
+    data[element_index(i, 2, n, 4)] = value.z;
+    data[element_index(i, 3, n, 4)] = value.w;
+#endif
+}
+
+inline float2 load_float2(__global const float* data, int i, int n)
+{
+#if defined(LAYOUT_AOS)
+    return vload2(i, data);
+#else
+    return (float2)(data[element_index(i, 0, n, 2)], data[element_index(i, 1, n, 2)]);
+#endif
+}
+
+inline void store_float2(__global float* data, int i, int n, float2 value)
+{
+#if defined(LAYOUT_AOS)
+    vstore2(value, i, data);
+#else
+    data[element_index(i, 0, n, 2)] = value.x;
+    data[element_index(i, 1, n, 2)] = value.y;
+#endif
+}
+
+#if !defined(LAYOUT_AOS)
+#if AOSOA_WIDTH % 4 != 0
+#error AOSOA_WIDTH must be a multiple of 4 for the lane loads
+#endif
+
+// Component c of the 4 elements j .. j + 3, j a multiple of 4, as a single
+// vector load: the lanes are contiguous within an SoA plane or AoSoA block.
+// Lanes past n hold padding or the next plane and must be masked by the caller.
+inline float4 load_lanes4(__global const float* data, int j, int c, int n, int components)
+{
+    return vload4(0, data + element_index(j, c, n, components));
+}
+#endif
+
+// Keeps a body inside bounds, reflecting and damping the velocity on contact
+inline void apply_bounds(float2* position, float2* velocity, float bounceFactor, float4 bounds)
+{
+    const float buffer = 0.1f; // Small buffer to prevent sticking
+    if (position->x < bounds.x)
+    {
+        velocity->x *= -bounceFactor;
+        position->x = bounds.x + buffer;
+    }
+    else if (position->x > bounds.y)
+    {
+        velocity->x *= -bounceFactor;
+        position->x = bounds.y - buffer;
+    }
+
+    if (position->y < bounds.z)
+    {
+        velocity->y *= -bounceFactor;
+        position->y = bounds.z + buffer;
+    }
+    else if (position->y > bounds.w)
+    {
+        velocity->y *= -bounceFactor;
+        position->y = bounds.w - buffer;
+    }
+}
+
+// Reads the current state from positions and velocities and writes the next
+// one to positionsOut and velocitiesOut, so no work-item can observe a
+// neighbour that has already moved. The host swaps the buffers every step.
+__kernel void simulate(__global const float2* positions,
+                       __global const float2* velocities,
                        __global float2* accelerations,
                        __global float* radii,
                        __global float* masses,
@@ -7,7 +123,9 @@ __kernel void simulate(__global float2* positions,
                        int numParticles,
                        float gravitationalConstant,
                        float bounceFactor,
-                       float4 bounds) 
+                       float4 bounds,
+                       __global float2* positionsOut,
+                       __global float2* velocitiesOut) 
 {
     int i = get_global_id(0);
     
@@ -41,36 +159,424 @@ __kernel void simulate(__global float2* positions,
     accelerations[i] = Acc;
 
     // Update velocity and position
-    velocities[i] += Acc * dt;
-    positions[i] += velocities[i] * dt;
-
-    // Handle boundary collisions
-    float minX = bounds.x;
-    float maxX = bounds.y;
-    float minY = bounds.z;
-    float maxY = bounds.w;
+    float2 Vel = velocities[i] + Acc * dt;
+    Pos += Vel * dt;
 
     // Constrain to bounding area
-    const float buffer = 0.1; // Small buffer to prevent sticking
-    if (positions[i].x < minX) 
+    apply_bounds(&Pos, &Vel, bounceFactor, bounds);
+
+    positionsOut[i] = Pos;
+    velocitiesOut[i] = Vel;
+}
+
+// Softened pairwise attraction of body i towards body j, matching simulate.
+// A body contributes nothing to itself (diff is zero) and zero-mass padding
+// bodies contribute nothing at all, so neither needs a branch.
+inline float2 body_interaction(float4 body, float4 other, float gravitationalConstant)
+{
+    float2 diff = other.xy - body.xy;
+    float distanceSq = diff.x * diff.x + diff.y * diff.y + 1e-10f;
+    float invDistance = rsqrt(distanceSq);
+    float distance = distanceSq * invDistance;
+
+    float distWithSoftening = distance + (body.z + other.z);
+    float force = gravitationalConstant * body.w * other.w / (distanceSq + distWithSoftening * distWithSoftening);
+    return (force * invDistance) * diff;
+}
+
+// All-pairs accelerations of float4(x, y, radius, mass) bodies in the state layout.
+// Each work-group cooperatively stages one tile of bodies in local memory
+// at a time, so every body is read from global memory once per work-group
+// instead of once per work-item. The tile holds get_local_size(0) bodies.
+__kernel void compute_forces_tiled(__global const float* bodies,
+                                   int numBodies,
+                                   float gravitationalConstant,
+                                   __global float2* accelerations,
+                                   __local float4* tile)
+{
+    int i = get_global_id(0);
+    int lid = get_local_id(0);
+    int tileSize = get_local_size(0);
+
+    float4 body = (i < numBodies) ? load_float4(bodies, i, numBodies) : (float4)(0.0f);
+    float2 acc = (float2)(0.0f, 0.0f);
+
+    for (int tileStart = 0; tileStart < numBodies; tileStart += tileSize)
+    {
+#if defined(LAYOUT_AOS)
+        int j = tileStart + lid;
+        tile[lid] = (j < numBodies) ? load_float4(bodies, j, numBodies) : (float4)(0.0f);
+#else
+        // A quarter of the work-items stage 4 bodies each, one vector load per
+        // component. Groups starting past the last body load nothing, the
+        // others stay inside the buffer padded to whole blocks of 4.
+        int first = 4 * lid;
+        if (first < tileSize)
+        {
+            int j = tileStart + first;
+            float4 x = (float4)(0.0f), y = (float4)(0.0f), radius = (float4)(0.0f), mass = (float4)(0.0f);
+            if (j < numBodies)
+            {
+                x = load_lanes4(bodies, j, 0, numBodies, 4);
+                y = load_lanes4(bodies, j, 1, numBodies, 4);
+                radius = load_lanes4(bodies, j, 2, numBodies, 4);
+                mass = load_lanes4(bodies, j, 3, numBodies, 4);
+            }
+
+            // Masked lanes get no mass and exert no force
+            tile[first] = (j < numBodies) ? (float4)(x.s0, y.s0, radius.s0, mass.s0) : (float4)(0.0f);
+            if (first + 1 < tileSize)
+                tile[first + 1] = (j + 1 < numBodies) ? (float4)(x.s1, y.s1, radius.s1, mass.s1) : (float4)(0.0f);
+            if (first + 2 < tileSize)
+                tile[first + 2] = (j + 2 < numBodies) ? (float4)(x.s2, y.s2, radius.s2, mass.s2) : (float4)(0.0f);
+            if (first + 3 < tileSize)
+                tile[first + 3] = (j + 3 < numBodies) ? (float4)(x.s3, y.s3, radius.s3, mass.s3) : (float4)(0.0f);
+        }
+#endif
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        #pragma unroll 8
+        for (int k = 0; k < tileSize; ++k)
+        {
+            acc += body_interaction(body, tile[k], gravitationalConstant);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (i < numBodies)
+    {
+        accelerations[i] = acc;
+    }
+}
+
+// Semi-implicit Euler step and boundary bounce for packed bodies, the
+// same update simulate performs after its force loop. Reads one buffer set
+// and writes the other.
+__kernel void integrate(__global const float* bodies,
+                        __global const float* velocities,
+                        __global const float2* accelerations,
+                        float dt,
+                        int numBodies,
+                        float bounceFactor,
+                        float4 bounds,
+                        __global float* bodiesOut,
+                        __global float* velocitiesOut)
+{
+    int i = get_global_id(0);
+    if (i >= numBodies)
+        return;
+
+    float4 body = load_float4(bodies, i, numBodies);
+    float2 velocity = load_float2(velocities, i, numBodies) + accelerations[i] * dt;
+    float2 position = body.xy + velocity * dt;
+
+    apply_bounds(&position, &velocity, bounceFactor, bounds);
+
+    store_float2(velocitiesOut, i, numBodies, velocity);
+    store_float4(bodiesOut, i, numBodies, (float4)(position, body.zw));
+}
+
+// Kick-drift-kick leapfrog, equivalent to velocity Verlet:
+//   v(t + dt/2) = v(t) + a(t) dt/2
+//   x(t + dt)   = x(t) + v(t + dt/2) dt
+//   v(t + dt)   = v(t + dt/2) + a(t + dt) dt/2
+// leapfrog_kick_drift performs the first two lines from the accelerations of
+// the previous step, the forces are then evaluated at the new positions and
+// leapfrog_kick completes the step in place. Being symplectic, it keeps the
+// energy bounded over long runs where Euler drifts.
+__kernel void leapfrog_kick_drift(__global const float* bodies,
+                                  __global const float* velocities,
+                                  __global const float2* accelerations,
+                                  float dt,
+                                  int numBodies,
+                                  float bounceFactor,
+                                  float4 bounds,
+                                  __global float* bodiesOut,
+                                  __global float* velocitiesOut)
+{
+    int i = get_global_id(0);
+    if (i >= numBodies)
+        return;
+
+    float4 body = load_float4(bodies, i, numBodies);
+    float2 velocity = load_float2(velocities, i, numBodies) + accelerations[i] * (0.5f * dt);
+    float2 position = body.xy + velocity * dt;
+
+    apply_bounds(&position, &velocity, bounceFactor, bounds);
+
+    store_float2(velocitiesOut, i, numBodies, velocity);
+    store_float4(bodiesOut, i, numBodies, (float4)(position, body.zw));
+}
+
+__kernel void leapfrog_kick(__global float* velocities,
+                            __global const float2* accelerations,
+                            float dt,
+                            int numBodies)
+{
+    int i = get_global_id(0);
+    if (i < numBodies)
     {
-        velocities[i].x *= -bounceFactor; // Reflect velocity
-        positions[i].x = minX + buffer; // Adjust position inward
+        store_float2(velocities, i, numBodies, load_float2(velocities, i, numBodies) + accelerations[i] * (0.5f * dt));
     }
-    else if (positions[i].x > maxX) 
+}
+
+// Copies the bodies and velocities of any layout into interleaved float4
+// and float2 arrays for drawing and reading back
+__kernel void pack_bodies(__global const float* bodies,
+                          __global const float* velocities,
+                          int numBodies,
+                          __global float4* packedBodies,
+                          __global float2* packedVelocities)
+{
+    int i = get_global_id(0);
+    if (i < numBodies)
     {
-        velocities[i].x *= -bounceFactor; // Reflect velocity
-        positions[i].x = maxX - buffer; // Adjust position inward
+        packedBodies[i] = load_float4(bodies, i, numBodies);
+        packedVelocities[i] = load_float2(velocities, i, numBodies);
     }
+}
+
+// ---------------------------------------------------------------------------
+// Barnes-Hut
+//
+// Bodies are sorted along a Morton curve and a binary radix tree is built
+// over the sorted codes (Karras 2012). Every radix tree node covers a
+// contiguous range of bodies and each pair of levels splits a quadtree cell
+// into its four quadrants. Tree nodes are stored in one array, internal
+// nodes first at [0, n - 1) followed by one leaf per sorted body at
+// [n - 1, 2n - 1). Node summaries use the body layout, float4(center of
+// mass x, y, mass-weighted radius, total mass), so a far node is applied
+// with body_interaction exactly like a single body.
+// ---------------------------------------------------------------------------
+
+// The host passes the bound of BarnesHut::GetBuildOptions. The common prefix
+// of an internal node grows along every path and stays below 64 bits (32
+// code bits plus the index bits telling equal codes apart), so the tree is
+// at most 65 levels deep and a traversal holds at most depth + 1 nodes.
+#ifndef BH_STACK_SIZE
+#define BH_STACK_SIZE 66
+#endif
+
+// Spreads the lower 16 bits of v over the even bits
+inline uint expand_bits(uint v)
+{
+    v &= 0x0000ffffu;
+    v = (v | (v << 8)) & 0x00ff00ffu;
+    v = (v | (v << 4)) & 0x0f0f0f0fu;
+    v = (v | (v << 2)) & 0x33333333u;
+    v = (v | (v << 1)) & 0x55555555u;
+    return v;
+}
 
-    if (positions[i].y < minY) 
+// 32-bit Morton code of every body within bounds, along with the index of
+// the body so the codes can be sorted as key/value pairs.
+__kernel void morton_codes(__global const float* bodies,
+                           int numBodies,
+                           float4 bounds,
+                           __global uint* codes,
+                           __global uint* indices)
+{
+    int i = get_global_id(0);
+    if (i >= numBodies)
+        return;
+
+    indices[i] = i;
+
+    float2 extent = (float2)(bounds.y - bounds.x, bounds.w - bounds.z);
+    float2 normalized = (load_float4(bodies, i, numBodies).xy - (float2)(bounds.x, bounds.z)) / extent;
+    normalized = clamp(normalized, 0.0f, 1.0f) * 65535.0f;
+
+    codes[i] = (expand_bits((uint)normalized.y) << 1) | expand_bits((uint)normalized.x);
+}
+
+__kernel void gather_bodies(__global const float* bodies,
+                            __global const uint* indices,
+                            int numBodies,
+                            __global float4* sortedBodies)
+{
+    int i = get_global_id(0);
+    if (i < numBodies)
     {
-        velocities[i].y *= -bounceFactor; // Reflect velocity
-        positions[i].y = minY + buffer; // Adjust position inward
+        sortedBodies[i] = load_float4(bodies, indices[i], numBodies);
     }
-    else if (positions[i].y > maxY) 
+}
+
+// Length of the common prefix of the codes at i and j, -1 when j is out of
+// range. Equal codes are told apart by their indices.
+inline int common_prefix(__global const uint* codes, int numBodies, int i, int j)
+{
+    if (j < 0 || j >= numBodies)
+        return -1;
+
+    uint a = codes[i];
+    uint b = codes[j];
+    if (a == b)
+        return 32 + clz((uint)(i ^ j));
+    return clz(a ^ b);
+}
+
+// Builds internal node i of the radix tree: finds the range of sorted bodies
+// it covers, then the split position between its two children. Also clears
+// the arrival counter used by compute_node_mass.
+__kernel void build_radix_tree(__global const uint* codes,
+                               int numBodies,
+                               __global int2* children,
+                               __global int* parents,
+                               __global int* arrivals)
+{
+    int i = get_global_id(0);
+    if (i >= numBodies - 1)
+        return;
+
+    // Direction of the range, towards the neighbour sharing the longer prefix
+    int d = (common_prefix(codes, numBodies, i, i + 1) - common_prefix(codes, numBodies, i, i - 1)) > 0 ? 1 : -1;
+    int prefixMin = common_prefix(codes, numBodies, i, i - d);
+
+    // Upper bound on the range length, then binary search for the other end
+    int lengthMax = 2;
+    while (common_prefix(codes, numBodies, i, i + lengthMax * d) > prefixMin)
+        lengthMax *= 2;
+
+    int length = 0;
+    for (int t = lengthMax / 2; t >= 1; t /= 2)
+    {
+        if (common_prefix(codes, numBodies, i, i + (length + t) * d) > prefixMin)
+            length += t;
+    }
+    int j = i + length * d;
+
+    // The split is the last body sharing more than the range's common prefix with i
+    int prefixNode = common_prefix(codes, numBodies, i, j);
+    int split = 0;
+    int t = length;
+    do
+    {
+        t = (t + 1) / 2;
+        if (common_prefix(codes, numBodies, i, i + (split + t) * d) > prefixNode)
+            split += t;
+    }
+    while (t > 1);
+    int gamma = i + split * d + min(d, 0);
+
+    int leafOffset = numBodies - 1;
+    int left = (min(i, j) == gamma) ? leafOffset + gamma : gamma;
+    int right = (max(i, j) == gamma + 1) ? leafOffset + gamma + 1 : gamma + 1;
+
+    children[i] = (int2)(left, right);
+    parents[left] = i;
+    parents[right] = i;
+    arrivals[i] = 0;
+
+    if (i == 0)
+        parents[0] = -1;
+}
+
+// Bottom-up center of mass and bounding box of every node. Each leaf walks
+// towards the root, the first work-item to reach an internal node stops and
+// the second, which knows both children are complete, merges them.
+__kernel void compute_node_mass(__global const float4* sortedBodies,
+                                int numBodies,
+                                __global const int2* children,
+                                __global const int* parents,
+                                __global int* arrivals,
+                                volatile __global float4* nodes,
+                                volatile __global float4* nodeBounds)
+{
+    int i = get_global_id(0);
+    if (i >= numBodies)
+        return;
+
+    int node = numBodies - 1 + i;
+    float4 body = sortedBodies[i];
+    nodes[node] = body;
+    nodeBounds[node] = (float4)(body.x, body.x, body.y, body.y);
+
+    node = parents[node];
+    while (node >= 0)
     {
-        velocities[i].y *= -bounceFactor; // Reflect velocity
-        positions[i].y = maxY - buffer; // Adjust position inward
+        // Publish this subtree before signalling the arrival
+        mem_fence(CLK_GLOBAL_MEM_FENCE);
+        if (atomic_inc(&arrivals[node]) == 0)
+            return;
+
+        int2 child = children[node];
+        float4 a = nodes[child.x];
+        float4 b = nodes[child.y];
+        float4 boundsA = nodeBounds[child.x];
+        float4 boundsB = nodeBounds[child.y];
+
+        float mass = a.w + b.w;
+        float invMass = (mass > 0.0f) ? 1.0f / mass : 0.0f;
+        float2 center = (a.xy * a.w + b.xy * b.w) * invMass;
+        float radius = (a.z * a.w + b.z * b.w) * invMass;
+
+        nodes[node] = (float4)(center, radius, mass);
+        nodeBounds[node] = (float4)(min(boundsA.x, boundsB.x), max(boundsA.y, boundsB.y),
+                                    min(boundsA.z, boundsB.z), max(boundsA.w, boundsB.w));
+        node = parents[node];
+    }
+}
+
+// Walks the tree for every sorted body, applying a node as a whole when its
+// extent is small relative to its distance (size / distance < theta) and
+// opening it otherwise. Consecutive work-items hold nearby bodies and follow
+// similar paths. Accelerations are written back in the original order.
+// A node that should be opened but does not fit on the stack is applied as
+// a whole, possibly including the body itself, and stackOverflow is set.
+__kernel void compute_forces_barnes_hut(__global const float4* sortedBodies,
+                                        __global const uint* indices,
+                                        int numBodies,
+                                        __global const int2* children,
+                                        __global const float4* nodes,
+                                        __global const float4* nodeBounds,
+                                        float theta,
+                                        float gravitationalConstant,
+                                        __global float2* accelerations,
+                                        __global int* stackOverflow)
+{
+    int i = get_global_id(0);
+    if (i >= numBodies)
+        return;
+
+    float4 body = sortedBodies[i];
+    float2 acc = (float2)(0.0f, 0.0f);
+    float thetaSq = theta * theta;
+    int leafOffset = numBodies - 1;
+
+    int stack[BH_STACK_SIZE];
+    int top = 0;
+    stack[top++] = 0;
+
+    while (top > 0)
+    {
+        int node = stack[--top];
+        float4 other = nodes[node];
+
+        if (node < leafOffset)
+        {
+            float4 b = nodeBounds[node];
+            float size = max(b.y - b.x, b.w - b.z);
+            float2 diff = other.xy - body.xy;
+            float distanceSq = dot(diff, diff);
+
+            // A node containing the body is always opened, so it never acts on itself
+            bool inside = body.x >= b.x && body.x <= b.y && body.y >= b.z && body.y <= b.w;
+            bool open = inside || size * size >= thetaSq * distanceSq;
+            if (open)
+            {
+                if (top + 2 <= BH_STACK_SIZE)
+                {
+                    int2 child = children[node];
+                    stack[top++] = child.x;
+                    stack[top++] = child.y;
+                    continue;
+                }
+                *stackOverflow = 1;
+            }
+        }
+
+        acc += body_interaction(body, other, gravitationalConstant);
     }
+
+    accelerations[indices[i]] = acc;
 }
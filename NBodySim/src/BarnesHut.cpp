@@ -0,0 +1,212 @@
+#include "BarnesHut.h"
+
+#include <string>
+#include <utility>
+#include <stdio.h>
+
+const char* BarnesHut::GetBuildOptions()
+{
+	static const std::string options = "-DBH_STACK_SIZE=" + std::to_string(Stack_Size);
+	return options.c_str();
+}
+
+bool BarnesHut::Initialize(cl_context context, cl_device_id device, cl_program program)
+{
+	cl_int err = -1;
+
+	mContext = context;
+
+	const std::pair<cl_kernel*, const char*> kernels[] =
+	{
+		{ &mMortonKernel, "morton_codes" },
+		{ &mGatherKernel, "gather_bodies" },
+		{ &mBuildTreeKernel, "build_radix_tree" },
+		{ &mNodeMassKernel, "compute_node_mass" },
+		{ &mForcesKernel, "compute_forces_barnes_hut" }
+	};
+
+	for (const auto& [kernel, name] : kernels)
+	{
+		*kernel = clCreateKernel(program, name, &err);
+		if (err < 0)
+		{
+			printf("Couldn't create the %s kernel\n", name);
+			return false;
+		}
+	}
+
+	cl_int noOverflow = 0;
+	mStackOverflow = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(cl_int), &noOverflow, &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the Barnes-Hut overflow flag");
+		return false;
+	}
+	return mSort.Initialize(context, device);
+}
+
+bool BarnesHut::Reserve(int numBodies)
+{
+	if (numBodies <= mCapacity)
+		return true;
+
+	ReleaseBuffers();
+
+	const size_t numNodes = 2 * static_cast<size_t>(numBodies) - 1;
+	const size_t numInternal = static_cast<size_t>(numBodies) - 1;
+
+	const std::pair<cl_mem*, size_t> buffers[] =
+	{
+		{ &mCodes, numBodies * sizeof(cl_uint) },
+		{ &mIndices, numBodies * sizeof(cl_uint) },
+		{ &mSortedBodies, numBodies * sizeof(cl_float4) },
+		{ &mChildren, numInternal * sizeof(cl_int2) },
+		{ &mParents, numNodes * sizeof(cl_int) },
+		{ &mArrivals, numInternal * sizeof(cl_int) },
+		{ &mNodes, numNodes * sizeof(cl_float4) },
+		{ &mNodeBounds, numNodes * sizeof(cl_float4) }
+	};
+
+	cl_int err = CL_SUCCESS;
+	for (const auto& [buffer, size] : buffers)
+	{
+		cl_int bufferErr = -1;
+		*buffer = clCreateBuffer(mContext, CL_MEM_READ_WRITE, size, NULL, &bufferErr);
+		err |= bufferErr;
+	}
+	if (err < 0)
+	{
+		perror("Couldn't create the Barnes-Hut buffers");
+		ReleaseBuffers();
+		return false;
+	}
+
+	mCapacity = numBodies;
+	return true;
+}
+
+bool BarnesHut::ComputeAccelerations(cl_command_queue queue,
+									 cl_mem bodies,
+									 int numBodies,
+									 const cl_float4& bounds,
+									 float gravitationalConstant,
+									 float theta,
+									 cl_mem accelerations)
+{
+	if (numBodies < 2)
+	{
+		printf("Barnes-Hut requires at least 2 bodies\n");
+		return false;
+	}
+
+	if (!Reserve(numBodies))
+		return false;
+
+	const size_t bodyCount = numBodies;
+	const size_t internalCount = bodyCount - 1;
+
+	cl_int err = clSetKernelArg(mMortonKernel, 0, sizeof(cl_mem), &bodies);
+	err |= clSetKernelArg(mMortonKernel, 1, sizeof(int), &numBodies);
+	err |= clSetKernelArg(mMortonKernel, 2, sizeof(cl_float4), &bounds);
+	err |= clSetKernelArg(mMortonKernel, 3, sizeof(cl_mem), &mCodes);
+	err |= clSetKernelArg(mMortonKernel, 4, sizeof(cl_mem), &mIndices);
+
+	err |= clSetKernelArg(mGatherKernel, 0, sizeof(cl_mem), &bodies);
+	err |= clSetKernelArg(mGatherKernel, 1, sizeof(cl_mem), &mIndices);
+	err |= clSetKernelArg(mGatherKernel, 2, sizeof(int), &numBodies);
+	err |= clSetKernelArg(mGatherKernel, 3, sizeof(cl_mem), &mSortedBodies);
+
+	err |= clSetKernelArg(mBuildTreeKernel, 0, sizeof(cl_mem), &mCodes);
+	err |= clSetKernelArg(mBuildTreeKernel, 1, sizeof(int), &numBodies);
+	err |= clSetKernelArg(mBuildTreeKernel, 2, sizeof(cl_mem), &mChildren);
+	err |= clSetKernelArg(mBuildTreeKernel, 3, sizeof(cl_mem), &mParents);
+	err |= clSetKernelArg(mBuildTreeKernel, 4, sizeof(cl_mem), &mArrivals);
+
+	err |= clSetKernelArg(mNodeMassKernel, 0, sizeof(cl_mem), &mSortedBodies);
+	err |= clSetKernelArg(mNodeMassKernel, 1, sizeof(int), &numBodies);
+	err |= clSetKernelArg(mNodeMassKernel, 2, sizeof(cl_mem), &mChildren);
+	err |= clSetKernelArg(mNodeMassKernel, 3, sizeof(cl_mem), &mParents);
+	err |= clSetKernelArg(mNodeMassKernel, 4, sizeof(cl_mem), &mArrivals);
+	err |= clSetKernelArg(mNodeMassKernel, 5, sizeof(cl_mem), &mNodes);
+	err |= clSetKernelArg(mNodeMassKernel, 6, sizeof(cl_mem), &mNodeBounds);
+
+	err |= clSetKernelArg(mForcesKernel, 0, sizeof(cl_mem), &mSortedBodies);
+	err |= clSetKernelArg(mForcesKernel, 1, sizeof(cl_mem), &mIndices);
+	err |= clSetKernelArg(mForcesKernel, 2, sizeof(int), &numBodies);
+	err |= clSetKernelArg(mForcesKernel, 3, sizeof(cl_mem), &mChildren);
+	err |= clSetKernelArg(mForcesKernel, 4, sizeof(cl_mem), &mNodes);
+	err |= clSetKernelArg(mForcesKernel, 5, sizeof(cl_mem), &mNodeBounds);
+	err |= clSetKernelArg(mForcesKernel, 6, sizeof(float), &theta);
+	err |= clSetKernelArg(mForcesKernel, 7, sizeof(float), &gravitationalConstant);
+	err |= clSetKernelArg(mForcesKernel, 8, sizeof(cl_mem), &accelerations);
+	err |= clSetKernelArg(mForcesKernel, 9, sizeof(cl_mem), &mStackOverflow);
+	if (err < 0)
+	{
+		perror("Couldn't create a Barnes-Hut kernel argument");
+		return false;
+	}
+
+	err = clEnqueueNDRangeKernel(queue, mMortonKernel, 1, NULL, &bodyCount, NULL, 0, NULL, NULL);
+	if (err < 0 || !mSort.Sort(queue, mCodes, mIndices, numBodies))
+	{
+		perror("Couldn't enqueue the Morton code sort");
+		return false;
+	}
+
+	err = clEnqueueNDRangeKernel(queue, mGatherKernel, 1, NULL, &bodyCount, NULL, 0, NULL, NULL);
+	err |= clEnqueueNDRangeKernel(queue, mBuildTreeKernel, 1, NULL, &internalCount, NULL, 0, NULL, NULL);
+	err |= clEnqueueNDRangeKernel(queue, mNodeMassKernel, 1, NULL, &bodyCount, NULL, 0, NULL, NULL);
+	err |= clEnqueueNDRangeKernel(queue, mForcesKernel, 1, NULL, &bodyCount, NULL, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the Barnes-Hut kernels");
+		return false;
+	}
+	return true;
+}
+
+bool BarnesHut::CheckStackOverflow(cl_command_queue queue)
+{
+	cl_int overflow = 0;
+	cl_int err = clEnqueueReadBuffer(queue, mStackOverflow, CL_TRUE, 0, sizeof(cl_int), &overflow, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't read the Barnes-Hut overflow flag");
+		return true;
+	}
+
+	if (overflow)
+	{
+		const cl_int noOverflow = 0;
+		clEnqueueWriteBuffer(queue, mStackOverflow, CL_TRUE, 0, sizeof(cl_int), &noOverflow, 0, NULL, NULL);
+	}
+	return overflow != 0;
+}
+
+void BarnesHut::ReleaseBuffers()
+{
+	for (cl_mem* buffer : { &mCodes, &mIndices, &mSortedBodies, &mChildren, &mParents, &mArrivals, &mNodes, &mNodeBounds })
+	{
+		if (*buffer)
+			clReleaseMemObject(*buffer);
+		*buffer = nullptr;
+	}
+	mCapacity = 0;
+}
+
+void BarnesHut::Release()
+{
+	ReleaseBuffers();
+	mSort.Release();
+
+	if (mStackOverflow)
+		clReleaseMemObject(mStackOverflow);
+	mStackOverflow = nullptr;
+
+	for (cl_kernel* kernel : { &mMortonKernel, &mGatherKernel, &mBuildTreeKernel, &mNodeMassKernel, &mForcesKernel })
+	{
+		if (*kernel)
+			clReleaseKernel(*kernel);
+		*kernel = nullptr;
+	}
+}
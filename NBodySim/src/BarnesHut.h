@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Cl/cl.h"
+
+#include "RadixSort.h"
+
+/// <summary>
+/// Barnes-Hut gravity solver. Every step sorts the bodies along a Morton
+/// curve, builds a radix tree over the sorted codes, sums the center of mass
+/// of every node bottom-up and walks the tree per body, treating nodes that
+/// are small relative to their distance as a single body.
+/// All stages run on the device, scratch buffers are kept between calls.
+/// </summary>
+class BarnesHut
+{
+public:
+	/// <summary>
+	/// Retrieves the options nbody.cl must be built with, the traversal stack
+	/// size covering the deepest possible tree.
+	/// </summary>
+	static const char* GetBuildOptions();
+
+	/// <summary>
+	/// Creates the Barnes-Hut kernels from the simulation program and the Morton code sort.
+	/// </summary>
+	/// <param name="context">The OpenCL context</param>
+	/// <param name="device">The device the program was built for</param>
+	/// <param name="program">The built nbody.cl program</param>
+	/// <returns>True if the kernels were created successfully</returns>
+	bool Initialize(cl_context context, cl_device_id device, cl_program program);
+
+	/// <summary>
+	/// Enqueues the computation of the acceleration of every body.
+	/// </summary>
+	/// <param name="queue">The command queue to enqueue the kernels on</param>
+	/// <param name="bodies">Buffer of float4(x, y, radius, mass) bodies in the program's state layout</param>
+	/// <param name="numBodies">The number of bodies, at least 2</param>
+	/// <param name="bounds">The simulation area as (minX, maxX, minY, maxY)</param>
+	/// <param name="gravitationalConstant">The gravitational constant</param>
+	/// <param name="theta">The opening angle, 0 visits every body</param>
+	/// <param name="accelerations">Buffer of float2 receiving the accelerations</param>
+	/// <returns>True if the kernels were enqueued successfully</returns>
+	bool ComputeAccelerations(cl_command_queue queue,
+							  cl_mem bodies,
+							  int numBodies,
+							  const cl_float4& bounds,
+							  float gravitationalConstant,
+							  float theta,
+							  cl_mem accelerations);
+
+	/// <summary>
+	/// Reads and clears the flag set when a traversal ran out of stack since
+	/// the last call, in which case some accelerations are approximate.
+	/// </summary>
+	/// <param name="queue">The command queue to read the flag on</param>
+	/// <returns>True if a traversal overflowed or the flag couldn't be read</returns>
+	bool CheckStackOverflow(cl_command_queue queue);
+
+	/// <summary>
+	/// Releases the scratch buffers and kernels.
+	/// </summary>
+	void Release();
+private:
+	// 32 Morton code bits and up to 32 index bits per key, see compute_forces_barnes_hut
+	static constexpr int Max_Tree_Depth = 65;
+	static constexpr int Stack_Size = Max_Tree_Depth + 1;
+
+	/// <summary>
+	/// Ensures the scratch buffers hold the tree for the given number of bodies.
+	/// </summary>
+	bool Reserve(int numBodies);
+
+	void ReleaseBuffers();
+private:
+	cl_context mContext = nullptr;
+
+	cl_kernel mMortonKernel = nullptr;
+	cl_kernel mGatherKernel = nullptr;
+	cl_kernel mBuildTreeKernel = nullptr;
+	cl_kernel mNodeMassKernel = nullptr;
+	cl_kernel mForcesKernel = nullptr;
+
+	RadixSort mSort;
+
+	// Single int, set by the traversal on overflow
+	cl_mem mStackOverflow = nullptr;
+
+	int mCapacity = 0;
+
+	cl_mem mCodes = nullptr;
+	cl_mem mIndices = nullptr;
+
+	cl_mem mSortedBodies = nullptr;
+	cl_mem mChildren = nullptr;
+	cl_mem mParents = nullptr;
+	cl_mem mArrivals = nullptr;
+	cl_mem mNodes = nullptr;
+	cl_mem mNodeBounds = nullptr;
+};
@@ -1,6 +1,11 @@
+#include "BarnesHut.h"
+#include "FixedTimestep.h"
 #include "OpenCLUtils.h"
 #include "OpenCVUtils.h"
 #include "RandomUtils.h"
+#include "RateCounter.h"
+#include "Rasterizer.h"
+#include "StateLayout.h"
 #include "Timer.h"
 
 #include "opencv2/opencv.hpp"
@@ -9,14 +14,51 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
 
 cl_device_id device = nullptr;
 cl_context context = nullptr;
 cl_program program = nullptr;
 cl_kernel kernel = nullptr;
+cl_kernel forcesKernel = nullptr;
+cl_kernel integrateKernel = nullptr;
+cl_kernel kickDriftKernel = nullptr;
+cl_kernel kickKernel = nullptr;
+cl_kernel packKernel = nullptr;
 cl_command_queue queue = nullptr;
 cl_int err = -1;
 
+// Bodies staged per tile by the tiled force kernel, its work-group size
+size_t tileSize = 0;
+
+// Layout of the bodies and velocities the program was built for
+StateLayout layout = StateLayout::AoS;
+
+BarnesHut barnesHut;
+Rasterizer rasterizer;
+
+/// <summary>
+/// How the accelerations are computed. Direct is the original simulate
+/// kernel, Tiled and BarnesHut work on packed float4(x, y, radius, mass) bodies.
+/// </summary>
+enum class Solver
+{
+	Direct,
+	Tiled,
+	BarnesHut
+};
+
+/// <summary>
+/// How the packed bodies advance. Leapfrog is the symplectic kick-drift-kick
+/// scheme, it evaluates the forces once per step like Euler but keeps the
+/// energy bounded over long runs.
+/// </summary>
+enum class Integrator
+{
+	Euler,
+	Leapfrog
+};
+
 struct Vector4f
 {
 public:
@@ -54,6 +96,62 @@ public:
 	float y = 0;
 };
 
+/// <summary>
+/// Creates a device buffer of n entities with the given number of float
+/// components, rearranged from interleaved host data into the active layout.
+/// </summary>
+cl_mem CreateLayoutBuffer(const float* data, int n, int components)
+{
+	std::vector<float> laidOut = ToStateLayout(layout, data, n, components);
+	return OpenCLUtils::create_input_buffer(context, laidOut.data(), laidOut.size() * sizeof(float));
+}
+
+/// <summary>
+/// Device state of the packed simulation, float4(x, y, radius, mass) bodies
+/// and float2 velocities stored in the active layout. Bodies and velocities
+/// are double buffered: every step reads the current set and writes the
+/// other before the two are swapped, so no work-item sees a partially
+/// updated state.
+/// </summary>
+struct PackedState
+{
+public:
+	bool Create(const Vector4f* initialBodies, const Vector2f* initialVelocities, int numBodies)
+	{
+		for (int i = 0; i < 2; ++i)
+		{
+			bodies[i] = CreateLayoutBuffer(&initialBodies->x, numBodies, 4);
+			velocities[i] = CreateLayoutBuffer(&initialVelocities->x, numBodies, 2);
+		}
+		// Zeroed so a kick before the first force evaluation integrates nothing rather than garbage
+		const std::vector<Vector2f> zeros(numBodies);
+		accelerations = OpenCLUtils::create_input_buffer(context, const_cast<Vector2f*>(zeros.data()), numBodies * sizeof(Vector2f));
+		current = 0;
+		accelerationsValid = false;
+		return bodies[0] && bodies[1] && velocities[0] && velocities[1] && accelerations;
+	}
+
+	void Swap() { current = 1 - current; }
+
+	void Release()
+	{
+		for (cl_mem* buffer : { &bodies[0], &bodies[1], &velocities[0], &velocities[1], &accelerations })
+		{
+			if (*buffer)
+				clReleaseMemObject(*buffer);
+			*buffer = nullptr;
+		}
+	}
+public:
+	cl_mem bodies[2] = {};
+	cl_mem velocities[2] = {};
+	cl_mem accelerations = nullptr;
+	int current = 0;
+
+	// Leapfrog starts each step from the accelerations of the previous one
+	bool accelerationsValid = false;
+};
+
 bool InitializeDeviceAndContext()
 {
 	device = OpenCLUtils::create_device();
@@ -70,33 +168,653 @@ bool InitializeDeviceAndContext()
     return true;
 }
 
-bool InitializeProgram()
+/// <summary>
+/// Builds the program for the given state layout and creates its kernels.
+/// </summary>
+bool BuildProgram(StateLayout stateLayout)
 {
 	/* Build program */
-	program = OpenCLUtils::build_program(context, device, "shaders/nbody.cl");
+	const std::string options = GetStateLayoutOptions(stateLayout) + " " + BarnesHut::GetBuildOptions();
+	program = OpenCLUtils::build_program(context, device, "shaders/nbody.cl", options.c_str());
 	if (!program)
 		return false;
+	layout = stateLayout;
 
-	queue = clCreateCommandQueue(context, device, 0, &err);
+	/* Create a kernel */
+	kernel = clCreateKernel(program, "simulate", &err);
 	if (err < 0)
 	{
-		perror("Couldn't create a command queue");
+		perror("Couldn't create a kernel");
 		return false;
 	};
 
-	/* Create a kernel */
-	kernel = clCreateKernel(program, "simulate", &err);
+	forcesKernel = clCreateKernel(program, "compute_forces_tiled", &err);
 	if (err < 0)
 	{
-		perror("Couldn't create a kernel");
+		perror("Couldn't create the tiled forces kernel");
 		return false;
 	};
+
+	integrateKernel = clCreateKernel(program, "integrate", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the integrate kernel");
+		return false;
+	};
+
+	kickDriftKernel = clCreateKernel(program, "leapfrog_kick_drift", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the leapfrog kick-drift kernel");
+		return false;
+	};
+
+	kickKernel = clCreateKernel(program, "leapfrog_kick", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the leapfrog kick kernel");
+		return false;
+	};
+
+	packKernel = clCreateKernel(program, "pack_bodies", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the pack kernel");
+		return false;
+	};
+
+	size_t maxGroupSize = 0;
+	clGetKernelWorkGroupInfo(forcesKernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxGroupSize, NULL);
+	// A multiple of 4, so the SoA and AoSoA tiles are staged in whole groups of 4 bodies
+	tileSize = std::max<size_t>(4, std::min<size_t>(256, maxGroupSize) / 4 * 4);
+
+	return barnesHut.Initialize(context, device, program);
+}
+
+/// <summary>
+/// Releases the kernels and program of BuildProgram.
+/// </summary>
+void ReleaseProgram()
+{
+	barnesHut.Release();
+	for (cl_kernel* programKernel : { &kernel, &forcesKernel, &integrateKernel, &kickDriftKernel, &kickKernel, &packKernel })
+	{
+		if (*programKernel)
+			clReleaseKernel(*programKernel);
+		*programKernel = nullptr;
+	}
+
+	if (program)
+		clReleaseProgram(program);
+	program = nullptr;
+}
+
+bool InitializeProgram(StateLayout stateLayout)
+{
+	queue = clCreateCommandQueue(context, device, 0, &err);
+	if (err < 0)
+	{
+		perror("Couldn't create a command queue");
+		return false;
+	};
+
+	if (!BuildProgram(stateLayout) || !rasterizer.Initialize(context, device))
+		return false;
     return true;
 }
 
+/// <summary>
+/// Enqueues the tiled all-pairs accelerations of every body.
+/// </summary>
+bool ComputeAccelerationsTiled(cl_mem bodiesBuffer,
+							   cl_mem accelerationsBuffer,
+							   int numBodies,
+							   float gravitationConstant)
+{
+	err = clSetKernelArg(forcesKernel, 0, sizeof(cl_mem), &bodiesBuffer);
+	err |= clSetKernelArg(forcesKernel, 1, sizeof(int), &numBodies);
+	err |= clSetKernelArg(forcesKernel, 2, sizeof(float), &gravitationConstant);
+	err |= clSetKernelArg(forcesKernel, 3, sizeof(cl_mem), &accelerationsBuffer);
+	err |= clSetKernelArg(forcesKernel, 4, tileSize * sizeof(Vector4f), NULL);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
+
+	// Every work-group stages tileSize bodies, so the range is padded to whole tiles
+	const size_t global = (static_cast<size_t>(numBodies) + tileSize - 1) / tileSize * tileSize;
+
+	err = clEnqueueNDRangeKernel(queue, forcesKernel, 1, NULL, &global, &tileSize, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the kernel");
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Enqueues the accelerations of every body from the chosen solver.
+/// </summary>
+bool ComputeAccelerations(Solver solver,
+						  float theta,
+						  cl_mem bodiesBuffer,
+						  cl_mem accelerationsBuffer,
+						  int numBodies,
+						  float gravitationConstant,
+						  const Vector4f& bounds)
+{
+	if (solver == Solver::BarnesHut)
+	{
+		const cl_float4 area = { { bounds.x, bounds.y, bounds.z, bounds.w } };
+		return barnesHut.ComputeAccelerations(queue, bodiesBuffer, numBodies, area, gravitationConstant, theta, accelerationsBuffer);
+	}
+	return ComputeAccelerationsTiled(bodiesBuffer, accelerationsBuffer, numBodies, gravitationConstant);
+}
+
+/// <summary>
+/// Enqueues integrate or leapfrog_kick_drift, which share their arguments,
+/// from the current buffer set of the state into the other one.
+/// </summary>
+bool EnqueueUpdate(cl_kernel updateKernel,
+				   const PackedState& state,
+				   int numBodies,
+				   float deltaTime_s,
+				   float bounceFactor,
+				   const Vector4f& bounds)
+{
+	const int next = 1 - state.current;
+
+	err = clSetKernelArg(updateKernel, 0, sizeof(cl_mem), &state.bodies[state.current]);
+	err |= clSetKernelArg(updateKernel, 1, sizeof(cl_mem), &state.velocities[state.current]);
+	err |= clSetKernelArg(updateKernel, 2, sizeof(cl_mem), &state.accelerations);
+	err |= clSetKernelArg(updateKernel, 3, sizeof(float), &deltaTime_s);
+	err |= clSetKernelArg(updateKernel, 4, sizeof(int), &numBodies);
+	err |= clSetKernelArg(updateKernel, 5, sizeof(float), &bounceFactor);
+	err |= clSetKernelArg(updateKernel, 6, sizeof(Vector4f), &bounds);
+	err |= clSetKernelArg(updateKernel, 7, sizeof(cl_mem), &state.bodies[next]);
+	err |= clSetKernelArg(updateKernel, 8, sizeof(cl_mem), &state.velocities[next]);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
+
+	const size_t global = numBodies;
+	err = clEnqueueNDRangeKernel(queue, updateKernel, 1, NULL, &global, NULL, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the kernel");
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Enqueues one step of the packed-body simulation and swaps the state's
+/// buffers, the result is in the current set afterwards.
+/// </summary>
+bool Step(Solver solver,
+		  Integrator integrator,
+		  float theta,
+		  PackedState& state,
+		  int numBodies,
+		  float deltaTime_s,
+		  float gravitationConstant,
+		  float bounceFactor,
+		  const Vector4f& bounds)
+{
+	if (integrator == Integrator::Euler)
+	{
+		if (!ComputeAccelerations(solver, theta, state.bodies[state.current], state.accelerations, numBodies, gravitationConstant, bounds))
+			return false;
+		if (!EnqueueUpdate(integrateKernel, state, numBodies, deltaTime_s, bounceFactor, bounds))
+			return false;
+
+		state.Swap();
+		state.accelerationsValid = false;
+		return true;
+	}
+
+	if (!state.accelerationsValid)
+	{
+		if (!ComputeAccelerations(solver, theta, state.bodies[state.current], state.accelerations, numBodies, gravitationConstant, bounds))
+			return false;
+	}
+
+	// Half kick and drift into the other set, then the forces at the new positions complete the kick
+	if (!EnqueueUpdate(kickDriftKernel, state, numBodies, deltaTime_s, bounceFactor, bounds))
+		return false;
+	state.Swap();
+
+	if (!ComputeAccelerations(solver, theta, state.bodies[state.current], state.accelerations, numBodies, gravitationConstant, bounds))
+		return false;
+
+	err = clSetKernelArg(kickKernel, 0, sizeof(cl_mem), &state.velocities[state.current]);
+	err |= clSetKernelArg(kickKernel, 1, sizeof(cl_mem), &state.accelerations);
+	err |= clSetKernelArg(kickKernel, 2, sizeof(float), &deltaTime_s);
+	err |= clSetKernelArg(kickKernel, 3, sizeof(int), &numBodies);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
+
+	const size_t global = numBodies;
+	err = clEnqueueNDRangeKernel(queue, kickKernel, 1, NULL, &global, NULL, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the kernel");
+		return false;
+	}
+
+	state.accelerationsValid = true;
+	return true;
+}
+
+/// <summary>
+/// Enqueues the copy of the state's current bodies and velocities into
+/// interleaved float4 and float2 buffers, whatever the layout.
+/// </summary>
+bool PackBodies(const PackedState& state, int numBodies, cl_mem packedBodies, cl_mem packedVelocities)
+{
+	err = clSetKernelArg(packKernel, 0, sizeof(cl_mem), &state.bodies[state.current]);
+	err |= clSetKernelArg(packKernel, 1, sizeof(cl_mem), &state.velocities[state.current]);
+	err |= clSetKernelArg(packKernel, 2, sizeof(int), &numBodies);
+	err |= clSetKernelArg(packKernel, 3, sizeof(cl_mem), &packedBodies);
+	err |= clSetKernelArg(packKernel, 4, sizeof(cl_mem), &packedVelocities);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
+
+	const size_t global = numBodies;
+	err = clEnqueueNDRangeKernel(queue, packKernel, 1, NULL, &global, NULL, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the kernel");
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Generates bodies with the same radius and mass ranges as the interactive
+/// scene, spread over a square of the given extent.
+/// </summary>
+std::vector<Vector4f> GenerateBodies(int numBodies, float extent)
+{
+	std::vector<Vector4f> bodies(numBodies);
+	for (Vector4f& body : bodies)
+	{
+		body = Vector4f(RandUtils::RandomRange<float>(0.0f, extent),
+						RandUtils::RandomRange<float>(0.0f, extent),
+						RandUtils::RandomRange<float>(5.0f, 35.0f),
+						RandUtils::RandomRange<float>(5.0f, 100.0f));
+	}
+	return bodies;
+}
+
+/// <summary>
+/// Compares the Barnes-Hut accelerations against the direct tiled kernel for
+/// several opening angles, then the time per step of both as N grows.
+/// </summary>
+bool BenchmarkBarnesHut(float gravitationConstant, float bounceFactor)
+{
+	const float Thetas[] = { 0.25f, 0.5f, 0.75f, 1.0f };
+	const int Accuracy_Bodies = 65536;
+
+	const int Body_Counts[] = { 16384, 65536, 262144, 1048576 };
+	const float Timing_Theta = 0.5f;
+
+	// A direct step at a million bodies takes seconds, it is only timed up to here
+	const int Direct_Body_Limit = 262144;
+	const int Steps = 10;
+
+	// Keep the density of the interactive scene
+	auto extentFor = [](int numBodies) { return 512.0f * std::sqrt(numBodies / 50.0f); };
+
+	// Accuracy versus theta ----------------------------------------------
+	{
+		const int numBodies = Accuracy_Bodies;
+		const float extent = extentFor(numBodies);
+		const Vector4f bounds(0.0f, extent, 0.0f, extent);
+
+		std::vector<Vector4f> bodies = GenerateBodies(numBodies, extent);
+		cl_mem bodiesBuffer = CreateLayoutBuffer(&bodies.data()->x, numBodies, 4);
+		cl_mem accelerationsBuffer = OpenCLUtils::create_output_buffer(context, numBodies * sizeof(Vector2f));
+
+		std::vector<Vector2f> direct(numBodies);
+		std::vector<Vector2f> approximate(numBodies);
+
+		if (!ComputeAccelerationsTiled(bodiesBuffer, accelerationsBuffer, numBodies, gravitationConstant))
+			return false;
+		clEnqueueReadBuffer(queue, accelerationsBuffer, CL_TRUE, 0, numBodies * sizeof(Vector2f), direct.data(), 0, NULL, NULL);
+
+		printf("Barnes-Hut accuracy, %d bodies\n", numBodies);
+		printf("%6s  %14s  %14s  %12s\n", "theta", "rms rel error", "max rel error", "ms/step");
+
+		const cl_float4 area = { { bounds.x, bounds.y, bounds.z, bounds.w } };
+		for (float theta : Thetas)
+		{
+			// Warm-up, also sizes the tree buffers
+			if (!barnesHut.ComputeAccelerations(queue, bodiesBuffer, numBodies, area, gravitationConstant, theta, accelerationsBuffer))
+				return false;
+			clFinish(queue);
+
+			Timer timer(true);
+			for (int step = 0; step < Steps; ++step)
+				barnesHut.ComputeAccelerations(queue, bodiesBuffer, numBodies, area, gravitationConstant, theta, accelerationsBuffer);
+			clFinish(queue);
+			const double stepTime_ms = timer.Stop_ms() / Steps;
+
+			clEnqueueReadBuffer(queue, accelerationsBuffer, CL_TRUE, 0, numBodies * sizeof(Vector2f), approximate.data(), 0, NULL, NULL);
+
+			double errorSq = 0.0;
+			double referenceSq = 0.0;
+			double maxRelative = 0.0;
+			for (int i = 0; i < numBodies; ++i)
+			{
+				const double dx = approximate[i].x - direct[i].x;
+				const double dy = approximate[i].y - direct[i].y;
+				const double magnitudeSq = static_cast<double>(direct[i].x) * direct[i].x + static_cast<double>(direct[i].y) * direct[i].y;
+
+				errorSq += dx * dx + dy * dy;
+				referenceSq += magnitudeSq;
+				if (magnitudeSq > 0.0)
+					maxRelative = std::max(maxRelative, std::sqrt((dx * dx + dy * dy) / magnitudeSq));
+			}
+			printf("%6.2f  %14.3e  %14.3e  %12.3f\n", theta, std::sqrt(errorSq / referenceSq), maxRelative, stepTime_ms);
+			if (barnesHut.CheckStackOverflow(queue))
+				printf("Barnes-Hut traversal ran out of stack, accelerations are approximate\n");
+		}
+
+		clReleaseMemObject(bodiesBuffer);
+		clReleaseMemObject(accelerationsBuffer);
+	}
+	// --------------------------------------------------------------------
+
+	// Time per step versus N ---------------------------------------------
+	printf("Time per step (ms), Barnes-Hut theta = %.2f\n", Timing_Theta);
+	printf("%8s  %12s  %12s\n", "bodies", "direct", "barnes-hut");
+
+	for (int numBodies : Body_Counts)
+	{
+		const float extent = extentFor(numBodies);
+		const Vector4f bounds(0.0f, extent, 0.0f, extent);
+
+		std::vector<Vector4f> bodies = GenerateBodies(numBodies, extent);
+		const std::vector<Vector2f> zeros(numBodies);
+
+		PackedState state;
+		if (!state.Create(bodies.data(), zeros.data(), numBodies))
+			return false;
+
+		auto timeSteps = [&](Solver solver) -> double
+		{
+			Step(solver, Integrator::Euler, Timing_Theta, state, numBodies, 0.01f, gravitationConstant, bounceFactor, bounds);
+			clFinish(queue);
+
+			Timer timer(true);
+			for (int step = 0; step < Steps; ++step)
+				Step(solver, Integrator::Euler, Timing_Theta, state, numBodies, 0.01f, gravitationConstant, bounceFactor, bounds);
+			clFinish(queue);
+			return timer.Stop_ms() / Steps;
+		};
+
+		const double barnesHutTime_ms = timeSteps(Solver::BarnesHut);
+		if (numBodies <= Direct_Body_Limit)
+			printf("%8d  %12.3f  %12.3f\n", numBodies, timeSteps(Solver::Tiled), barnesHutTime_ms);
+		else
+			printf("%8d  %12s  %12.3f\n", numBodies, "-", barnesHutTime_ms);
+
+		state.Release();
+	}
+	// --------------------------------------------------------------------
+	return true;
+}
+
+/// <summary>
+/// Measures the interactions per second of the original and tiled force
+/// kernels without any rendering, for growing body counts.
+/// </summary>
+bool BenchmarkNBody(float gravitationConstant, float bounceFactor)
+{
+	const int Body_Counts[] = { 1024, 4096, 16384, 65536, 131072, 262144 };
+
+	// The original kernel rereads every body from global memory per work-item
+	const int Naive_Body_Limit = 65536;
+
+	// Roughly this many interactions are timed per body count
+	const double Target_Interactions = 2e10;
+
+	printf("%8s  %6s  %14s  %14s\n", "bodies", "steps", "naive (G/s)", "tiled (G/s)");
+
+	for (int numBodies : Body_Counts)
+	{
+		// Grow the area with the body count to keep the density constant
+		const float extent = 512.0f * std::sqrt(numBodies / 50.0f);
+		const Vector4f bounds(0.0f, extent, 0.0f, extent);
+
+		std::vector<Vector4f> bodies(numBodies);
+		std::vector<Vector2f> positions(numBodies);
+		std::vector<float> radii(numBodies);
+		std::vector<float> masses(numBodies);
+		for (int i = 0; i < numBodies; ++i)
+		{
+			positions[i] = Vector2f(RandUtils::RandomRange<float>(0.0f, extent), RandUtils::RandomRange<float>(0.0f, extent));
+			radii[i] = RandUtils::RandomRange<float>(5.0f, 35.0f);
+			masses[i] = RandUtils::RandomRange<float>(5.0f, 100.0f);
+			bodies[i] = Vector4f(positions[i].x, positions[i].y, radii[i], masses[i]);
+		}
+		const std::vector<Vector2f> zeros(numBodies);
+
+		const size_t float2Size = numBodies * sizeof(Vector2f);
+		const size_t floatSize = numBodies * sizeof(float);
+
+		PackedState state;
+		if (!state.Create(bodies.data(), zeros.data(), numBodies))
+			return false;
+
+		cl_mem positionsBuffer = OpenCLUtils::create_input_buffer(context, positions.data(), float2Size);
+		cl_mem velocitiesBuffer = OpenCLUtils::create_input_buffer(context, const_cast<Vector2f*>(zeros.data()), float2Size);
+		cl_mem positionsOutBuffer = OpenCLUtils::create_output_buffer(context, float2Size);
+		cl_mem velocitiesOutBuffer = OpenCLUtils::create_output_buffer(context, float2Size);
+		cl_mem accelerationsBuffer = OpenCLUtils::create_input_buffer(context, const_cast<Vector2f*>(zeros.data()), float2Size);
+		cl_mem radiiBuffer = OpenCLUtils::create_input_buffer(context, radii.data(), floatSize);
+		cl_mem massesBuffer = OpenCLUtils::create_input_buffer(context, masses.data(), floatSize);
+
+		const double interactionsPerStep = static_cast<double>(numBodies) * numBodies;
+		const int steps = static_cast<int>(std::clamp(Target_Interactions / interactionsPerStep, 1.0, 100.0));
+		const float deltaTime_s = 0.01f;
+
+		double naiveRate = 0.0;
+		if (numBodies <= Naive_Body_Limit)
+		{
+			err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &positionsBuffer);
+			err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &velocitiesBuffer);
+			err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &accelerationsBuffer);
+			err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &radiiBuffer);
+			err |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &massesBuffer);
+			err |= clSetKernelArg(kernel, 5, sizeof(float), &deltaTime_s);
+			err |= clSetKernelArg(kernel, 6, sizeof(int), &numBodies);
+			err |= clSetKernelArg(kernel, 7, sizeof(float), &gravitationConstant);
+			err |= clSetKernelArg(kernel, 8, sizeof(float), &bounceFactor);
+			err |= clSetKernelArg(kernel, 9, sizeof(Vector4f), &bounds);
+
+			// Every step restarts from the same state, which does not change the work done
+			err |= clSetKernelArg(kernel, 10, sizeof(cl_mem), &positionsOutBuffer);
+			err |= clSetKernelArg(kernel, 11, sizeof(cl_mem), &velocitiesOutBuffer);
+			if (err < 0)
+			{
+				perror("Couldn't create a kernel argument");
+				return false;
+			}
+
+			const size_t global = numBodies;
+			clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global, NULL, 0, NULL, NULL);
+			clFinish(queue);
+
+			Timer timer(true);
+			for (int step = 0; step < steps; ++step)
+				clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global, NULL, 0, NULL, NULL);
+			clFinish(queue);
+			naiveRate = interactionsPerStep * steps / timer.Stop_s();
+		}
+
+		if (!Step(Solver::Tiled, Integrator::Euler, 0.0f, state, numBodies, deltaTime_s, gravitationConstant, bounceFactor, bounds))
+			return false;
+		clFinish(queue);
+
+		Timer timer(true);
+		for (int step = 0; step < steps; ++step)
+		{
+			if (!Step(Solver::Tiled, Integrator::Euler, 0.0f, state, numBodies, deltaTime_s, gravitationConstant, bounceFactor, bounds))
+				return false;
+		}
+		clFinish(queue);
+		const double tiledRate = interactionsPerStep * steps / timer.Stop_s();
+
+		if (naiveRate > 0.0)
+			printf("%8d  %6d  %14.3f  %14.3f\n", numBodies, steps, naiveRate / 1e9, tiledRate / 1e9);
+		else
+			printf("%8d  %6d  %14s  %14.3f\n", numBodies, steps, "-", tiledRate / 1e9);
+
+		state.Release();
+		clReleaseMemObject(positionsBuffer);
+		clReleaseMemObject(velocitiesBuffer);
+		clReleaseMemObject(positionsOutBuffer);
+		clReleaseMemObject(velocitiesOutBuffer);
+		clReleaseMemObject(accelerationsBuffer);
+		clReleaseMemObject(radiiBuffer);
+		clReleaseMemObject(massesBuffer);
+	}
+	return true;
+}
+
+/// <summary>
+/// Compares the state layouts on this device: the bandwidth of the streaming
+/// kick-drift update, the interactions per second of the tiled step and the
+/// time per Barnes-Hut step. The program is rebuilt for every layout and
+/// restored afterwards.
+/// </summary>
+bool BenchmarkLayouts(float gravitationConstant, float bounceFactor)
+{
+	const int Body_Counts[] = { 16384, 65536, 262144, 1048576 };
+
+	// All-pairs steps are only timed up to here
+	const int Tiled_Body_Limit = 65536;
+	const int Update_Steps = 100;
+	const int Steps = 5;
+
+	// kick-drift reads a body, a velocity and an acceleration and writes a body and a velocity
+	const double Update_Bytes_Per_Body = 2 * sizeof(Vector4f) + 3 * sizeof(Vector2f);
+
+	const StateLayout activeLayout = layout;
+
+	printf("%6s  %8s  %12s  %12s  %12s\n", "layout", "bodies", "update GB/s", "tiled G/s", "bh ms/step");
+
+	for (int layoutIndex = 0; layoutIndex < Num_State_Layouts; ++layoutIndex)
+	{
+		const StateLayout stateLayout = static_cast<StateLayout>(layoutIndex);
+		ReleaseProgram();
+		if (!BuildProgram(stateLayout))
+			return false;
+
+		for (int numBodies : Body_Counts)
+		{
+			const float extent = 512.0f * std::sqrt(numBodies / 50.0f);
+			const Vector4f bounds(0.0f, extent, 0.0f, extent);
+
+			std::vector<Vector4f> bodies = GenerateBodies(numBodies, extent);
+			const std::vector<Vector2f> zeros(numBodies);
+
+			PackedState state;
+			if (!state.Create(bodies.data(), zeros.data(), numBodies))
+				return false;
+
+			// Real accelerations for the kick, so the update and the steps timed after it
+			// run on a physical state rather than on zeros or NaNs
+			const cl_float4 area = { { bounds.x, bounds.y, bounds.z, bounds.w } };
+			if (!barnesHut.ComputeAccelerations(queue, state.bodies[state.current], numBodies, area, gravitationConstant, 0.5f, state.accelerations))
+				return false;
+			state.accelerationsValid = true;
+
+			// Streaming update, bound by the layout's memory access pattern
+			if (!EnqueueUpdate(kickDriftKernel, state, numBodies, 0.01f, bounceFactor, bounds))
+				return false;
+			clFinish(queue);
+
+			Timer timer(true);
+			for (int step = 0; step < Update_Steps; ++step)
+			{
+				EnqueueUpdate(kickDriftKernel, state, numBodies, 0.01f, bounceFactor, bounds);
+				state.Swap();
+			}
+			clFinish(queue);
+			const double updateRate = Update_Bytes_Per_Body * numBodies * Update_Steps / timer.Stop_s();
+
+			auto timeSteps = [&](Solver solver) -> double
+			{
+				Step(solver, Integrator::Euler, 0.5f, state, numBodies, 0.01f, gravitationConstant, bounceFactor, bounds);
+				clFinish(queue);
+
+				Timer stepTimer(true);
+				for (int step = 0; step < Steps; ++step)
+					Step(solver, Integrator::Euler, 0.5f, state, numBodies, 0.01f, gravitationConstant, bounceFactor, bounds);
+				clFinish(queue);
+				return stepTimer.Stop_s() / Steps;
+			};
+
+			const double barnesHutTime_ms = timeSteps(Solver::BarnesHut) * 1000.0;
+			if (numBodies <= Tiled_Body_Limit)
+			{
+				const double tiledRate = static_cast<double>(numBodies) * numBodies / timeSteps(Solver::Tiled);
+				printf("%6s  %8d  %12.2f  %12.3f  %12.3f\n", GetStateLayoutName(stateLayout), numBodies, updateRate / 1e9, tiledRate / 1e9, barnesHutTime_ms);
+			}
+			else
+			{
+				printf("%6s  %8d  %12.2f  %12s  %12.3f\n", GetStateLayoutName(stateLayout), numBodies, updateRate / 1e9, "-", barnesHutTime_ms);
+			}
+
+			state.Release();
+		}
+	}
+
+	ReleaseProgram();
+	return BuildProgram(activeLayout);
+}
+
 int main()
 {
-	constexpr size_t Num_Bodies = 50;
+	// The tiled path handles hundreds of thousands of bodies, drawing becomes the bottleneck long before
+	constexpr int Num_Bodies = 50;
+
+	const Solver ActiveSolver = Solver::Tiled;
+	const Integrator ActiveIntegrator = Integrator::Leapfrog;
+	const float Theta = 0.5f;
+
+	// Layout of the bodies and velocities on the tiled and Barnes-Hut paths, see BenchmarkLayouts
+	const StateLayout ActiveLayout = StateLayout::AoS;
+
+	// Fixed simulation step, advanced at TimeScale simulated seconds per wall-clock second
+	// with at most MaxStepsPerFrame steps of catch-up per rendered frame
+	const float FixedStep_s = 0.04f;
+	const double TimeScale = 10.0;
+	const int MaxStepsPerFrame = 8;
+
+	// Steps run every frame regardless of the clock, to measure the throughput, 0 schedules them by the clock
+	const int StepsPerFrame = 0;
+
+	// Draw the bodies on the device and read back only the finished frame
+	const bool DeviceRaster = true;
+
+	const bool RunBenchmark = false;
+	const bool RunBarnesHutBenchmark = false;
+	const bool RunLayoutBenchmark = false;
+	const bool Headless = false;
 
 	const cv::Scalar BackgroundColor(57, 36, 36);
 	const cv::Scalar BodyColor(204, 232, 169);
@@ -147,12 +865,59 @@ int main()
 	if (!InitializeDeviceAndContext())
         return -1;
 
-    if (!InitializeProgram())
+    if (!InitializeProgram(ActiveLayout))
         return -1;
 
+	if (RunBenchmark)
+	{
+		if (!BenchmarkNBody(GravitationConstant, BounceFactor))
+			return -1;
+	}
+
+	if (RunBarnesHutBenchmark)
+	{
+		if (!BenchmarkBarnesHut(GravitationConstant, BounceFactor))
+			return -1;
+	}
+
+	if (RunLayoutBenchmark)
+	{
+		if (!BenchmarkLayouts(GravitationConstant, BounceFactor))
+			return -1;
+	}
+
+	if (Headless)
+	{
+		ReleaseProgram();
+		rasterizer.Release();
+		clReleaseCommandQueue(queue);
+		clReleaseContext(context);
+		return 0;
+	}
+
+	// Packed float4(x, y, radius, mass) bodies for the tiled path
+	std::vector<Vector4f> Bodies(Num_Bodies);
+	for (int i = 0; i < Num_Bodies; ++i)
+		Bodies[i] = Vector4f(Positions[i].x, Positions[i].y, Radii[i], Masses[i]);
+
+	PackedState state;
+	if (!state.Create(Bodies.data(), Velocities.data(), Num_Bodies))
+		return -1;
+
+	// Interleaved copies of the state for reading back and drawing when the layout is not AoS
+	cl_mem packedBodiesBuffer = OpenCLUtils::create_output_buffer(context, Num_Bodies * sizeof(Vector4f));
+	cl_mem packedVelocitiesBuffer = OpenCLUtils::create_output_buffer(context, Num_Bodies * sizeof(Vector2f));
+
+	// The direct path ping-pongs its positions and velocities the same way
 	size_t float2BufferDataSize = Num_Bodies * sizeof(Vector2f);
-	cl_mem positionsBuffer = OpenCLUtils::create_input_buffer(context, Positions.data(), float2BufferDataSize);
-	cl_mem velocitiesBuffer = OpenCLUtils::create_input_buffer(context, Velocities.data(), float2BufferDataSize);
+	cl_mem positionsBuffers[2];
+	cl_mem velocitiesBuffers[2];
+	for (int i = 0; i < 2; ++i)
+	{
+		positionsBuffers[i] = OpenCLUtils::create_input_buffer(context, Positions.data(), float2BufferDataSize);
+		velocitiesBuffers[i] = OpenCLUtils::create_input_buffer(context, Velocities.data(), float2BufferDataSize);
+	}
+	int current = 0;
 	cl_mem accelerationsBuffer = OpenCLUtils::create_input_buffer(context, Accelerations.data(), float2BufferDataSize);
 
 	size_t floatBufferDataSize = Num_Bodies * sizeof(float);
@@ -160,9 +925,7 @@ int main()
 	cl_mem massesBuffer = OpenCLUtils::create_input_buffer(context, Masses.data(), floatBufferDataSize);
 
 	/* Create kernel arguments */
-	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &positionsBuffer);
-	err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &velocitiesBuffer);
-	err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &accelerationsBuffer);
+	err = clSetKernelArg(kernel, 2, sizeof(cl_mem), &accelerationsBuffer);
 	err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &radiiBuffer);
 	err |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &massesBuffer);
 	err |= clSetKernelArg(kernel, 6, sizeof(int), &Num_Bodies);
@@ -183,89 +946,180 @@ int main()
 
 	Timer gpuBufferReadTimer;
 	Timer drawTimer;
+	RateCounter rates;
+
+	FixedTimestep scheduler(FixedStep_s, MaxStepsPerFrame, TimeScale);
+	scheduler.SetStepsPerFrame(StepsPerFrame);
+
+	Rasterizer::Style rasterStyle;
+	rasterStyle.background = BackgroundColor;
+	rasterStyle.discColor = BodyColor;
+	rasterStyle.lineColor = LineColor;
+	rasterStyle.discThickness = LineThickness;
+	rasterStyle.lineThickness = LineThickness;
 
-	float deltaTime_s = 0.01f;
 	while (true)
 	{
 		gpuBufferReadTimer.Start();
 
-		// Update delta time --------------------------------------------------
-		err = clSetKernelArg(kernel, 5, sizeof(float), &deltaTime_s);
-		if (err < 0)
+		// The steps are enqueued back to back, the state is only read back when it changed
+		const int numSteps = scheduler.Advance();
+		const float step_s = scheduler.GetStep_s();
+		if (ActiveSolver != Solver::Direct)
 		{
-			perror("Couldn't create a kernel argument");
-			return false;
+			for (int step = 0; step < numSteps; ++step)
+			{
+				if (!Step(ActiveSolver, ActiveIntegrator, Theta, state, Num_Bodies, step_s, GravitationConstant, BounceFactor, Bounds))
+					return false;
+			}
 		}
-		// --------------------------------------------------------------------
-
-		err = clEnqueueNDRangeKernel(queue,
-									 kernel,
-									 1,
-									 NULL,
-									 (const size_t*)&global,
-									 NULL,
-									 0,
-									 NULL,
-									 NULL);
-
-		if (err < 0)
+		else
 		{
-			perror("Couldn't enqueue the kernel");
-			return false;
+			for (int step = 0; step < numSteps; ++step)
+			{
+				// Update delta time and the buffer sets ------------------------------
+				err = clSetKernelArg(kernel, 5, sizeof(float), &step_s);
+				err |= clSetKernelArg(kernel, 0, sizeof(cl_mem), &positionsBuffers[current]);
+				err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &velocitiesBuffers[current]);
+				err |= clSetKernelArg(kernel, 10, sizeof(cl_mem), &positionsBuffers[1 - current]);
+				err |= clSetKernelArg(kernel, 11, sizeof(cl_mem), &velocitiesBuffers[1 - current]);
+				if (err < 0)
+				{
+					perror("Couldn't create a kernel argument");
+					return false;
+				}
+				// --------------------------------------------------------------------
+
+				err = clEnqueueNDRangeKernel(queue,
+											 kernel,
+											 1,
+											 NULL,
+											 (const size_t*)&global,
+											 NULL,
+											 0,
+											 NULL,
+											 NULL);
+
+				if (err < 0)
+				{
+					perror("Couldn't enqueue the kernel");
+					return false;
+				}
+				current = 1 - current;
+			}
 		}
 
-		/* Read the kernel's output    */
-		err = clEnqueueReadBuffer(queue,
-								  positionsBuffer,
-								  CL_FALSE,
-								  0,
-								  float2BufferDataSize,
-								  Positions.data(),
-								  0,
-								  NULL,
-								  NULL);
-
-		err |= clEnqueueReadBuffer(queue,
-								   velocitiesBuffer,
-								   CL_FALSE,
-								   0,
-								   float2BufferDataSize,
-								   Velocities.data(),
-								   0,
-								   NULL,
-								   NULL);
-		if (err < 0)
+		cl_mem packedBodies = state.bodies[state.current];
+		cl_mem packedVelocities = state.velocities[state.current];
+		if (ActiveSolver != Solver::Direct && layout != StateLayout::AoS)
 		{
-			perror("Couldn't read the buffer");
-			return false;
+			if (!PackBodies(state, Num_Bodies, packedBodiesBuffer, packedVelocitiesBuffer))
+				return false;
+			packedBodies = packedBodiesBuffer;
+			packedVelocities = packedVelocitiesBuffer;
 		}
 
-		clFinish(queue);
+		if (numSteps > 0 && !DeviceRaster)
+		{
+			if (ActiveSolver != Solver::Direct)
+			{
+				err = clEnqueueReadBuffer(queue,
+										  packedBodies,
+										  CL_TRUE,
+										  0,
+										  Num_Bodies * sizeof(Vector4f),
+										  Bodies.data(),
+										  0,
+										  NULL,
+										  NULL);
+				for (int i = 0; i < Num_Bodies; ++i)
+					Positions[i] = Vector2f(Bodies[i].x, Bodies[i].y);
+			}
+			else
+			{
+				/* Read the kernel's output    */
+				err = clEnqueueReadBuffer(queue,
+										  positionsBuffers[current],
+										  CL_FALSE,
+										  0,
+										  float2BufferDataSize,
+										  Positions.data(),
+										  0,
+										  NULL,
+										  NULL);
+			}
+
+			cl_mem velocitiesBuffer = (ActiveSolver != Solver::Direct) ? packedVelocities : velocitiesBuffers[current];
+			err |= clEnqueueReadBuffer(queue,
+									   velocitiesBuffer,
+									   CL_FALSE,
+									   0,
+									   float2BufferDataSize,
+									   Velocities.data(),
+									   0,
+									   NULL,
+									   NULL);
+			if (err < 0)
+			{
+				perror("Couldn't read the buffer");
+				return false;
+			}
+
+			clFinish(queue);
+		}
 
 		const double gpuBufferTime_ms = gpuBufferReadTimer.Elapsed_ms();
 
 		// Visualization logic
 		drawTimer.Start();
 		{
-			outputImg.setTo(BackgroundColor);
-			for (size_t x = 0; x < Num_Bodies; ++x)
+			// Rewind the latest state along the velocities to the scheduler's render time between the last two steps
+			const float rewind_s = (1.0f - scheduler.GetAlpha()) * step_s;
+
+			if (DeviceRaster)
 			{
-				const Vector2f position = Positions[x];
-				const float radius = Radii[x];
-				cv::circle(outputImg, 
-						   cv::Point(position.x, position.y),
-						   static_cast<int>(radius), 
-						   BodyColor,
-						   LineThickness, 
-						   cv::LineTypes::FILLED);
-
-				Vector2f velocity = Velocities[x];
-				const float speed = velocity.Length();
-				cv::line(outputImg, 
-						 cv::Point(position.x, position.y),
-						 cv::Point(position.x + velocity.x, position.y + velocity.y),
-						 LineColor * speed,
-						 LineThickness);
+				// The tiled and Barnes-Hut paths keep the radius in the packed bodies
+				Rasterizer::Entities bodies;
+				bodies.count = Num_Bodies;
+				if (ActiveSolver != Solver::Direct)
+				{
+					bodies.positions = packedBodies;
+					bodies.positionStride = 4;
+					bodies.radiusOffset = 2;
+					bodies.velocities = packedVelocities;
+				}
+				else
+				{
+					bodies.positions = positionsBuffers[current];
+					bodies.radii = radiiBuffer;
+					bodies.velocities = velocitiesBuffers[current];
+				}
+
+				if (!rasterizer.Draw(queue, bodies, rasterStyle, MaxX, MaxY, rewind_s) || !rasterizer.Read(queue, outputImg))
+					return false;
+			}
+			else
+			{
+				outputImg.setTo(BackgroundColor);
+				for (size_t x = 0; x < Num_Bodies; ++x)
+				{
+					const Vector2f position(Positions[x].x - Velocities[x].x * rewind_s, Positions[x].y - Velocities[x].y * rewind_s);
+					const float radius = Radii[x];
+					cv::circle(outputImg, 
+							   cv::Point(position.x, position.y),
+							   static_cast<int>(radius), 
+							   BodyColor,
+							   LineThickness, 
+							   cv::LineTypes::FILLED);
+
+					Vector2f velocity = Velocities[x];
+					const float speed = velocity.Length();
+					cv::line(outputImg, 
+							 cv::Point(position.x, position.y),
+							 cv::Point(position.x + velocity.x, position.y + velocity.y),
+							 LineColor * speed,
+							 LineThickness);
+				}
 			}
 
 			cv::imshow(winName, outputImg);
@@ -278,20 +1132,30 @@ int main()
 		}
 
 		const double drawTime_ms = drawTimer.Elapsed_ms();
+		rates.AddFrame(numSteps);
 
-		std::cout << "GPU Read Time: " << std::to_string(gpuBufferTime_ms) << "\tDraw Time: " << std::to_string(drawTime_ms) << std::endl;
-		deltaTime_s = (gpuBufferTime_ms + drawTime_ms) * 0.01f; // Convert back to seconds
+		std::cout << "GPU Read Time: " << std::to_string(gpuBufferTime_ms) << "\tDraw Time: " << std::to_string(drawTime_ms)
+				  << "\tSteps/s: " << std::to_string(rates.GetStepsPerSecond()) << "\tFPS: " << std::to_string(rates.GetFramesPerSecond()) << std::endl;
 	}
 
 	cv::destroyWindow(winName);
 
     ///* Deallocate resources */
     
-	clReleaseKernel(kernel);
-	clReleaseMemObject(positionsBuffer);
-	clReleaseMemObject(velocitiesBuffer);
+	ReleaseProgram();
+	rasterizer.Release();
+	state.Release();
+	clReleaseMemObject(packedBodiesBuffer);
+	clReleaseMemObject(packedVelocitiesBuffer);
+	for (int i = 0; i < 2; ++i)
+	{
+		clReleaseMemObject(positionsBuffers[i]);
+		clReleaseMemObject(velocitiesBuffers[i]);
+	}
+	clReleaseMemObject(accelerationsBuffer);
+	clReleaseMemObject(radiiBuffer);
+	clReleaseMemObject(massesBuffer);
     clReleaseCommandQueue(queue);
-    clReleaseProgram(program);
     clReleaseContext(context);
 	return 0;
 }
\ No newline at end of file
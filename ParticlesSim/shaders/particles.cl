@@ -1,3 +1,32 @@
+// Clamps the position to the bounds and reflects the velocity off any side it crossed
+inline void apply_bounds(float2* pos, float2* vel, float4 bounds, float bounce_factor)
+{
+    float minX = bounds.x;
+    float maxX = bounds.y;
+    float minY = bounds.z;
+    float maxY = bounds.w;
+    if (pos->x < minX)
+    {
+        pos->x = minX;
+        vel->x = -vel->x * bounce_factor;
+    }
+    else if (pos->x > maxX)
+    {
+        pos->x = maxX;
+        vel->x = -vel->x * bounce_factor;
+    }
+
+    if (pos->y < minY)
+    {
+        pos->y = minY;
+        vel->y = -vel->y * bounce_factor;
+    }
+    else if (pos->y > maxY) {
+        pos->y = maxY;
+        vel->y = -vel->y * bounce_factor;
+    }
+}
+
 __kernel void simulate(__global float2* positions,
                        __global float2* velocities,
                        float dt,
@@ -18,32 +47,278 @@ __kernel void simulate(__global float2* positions,
     pos += vel * dt;
 
     // Handle boundary collisions
-    float minX = bounds.x;
-    float maxX = bounds.y;
-    float minY = bounds.z;
-    float maxY = bounds.w;
-    if (pos.x < minX)
+    apply_bounds(&pos, &vel, bounds, bounce_factor);
+
+    // Store updated values
+    positions[id] = pos;
+    velocities[id] = vel;
+}
+
+// ---------------------------------------------------------------------------
+// Collisions
+//
+// Position-based dynamics: every step predicts the positions from gravity,
+// sorts the particles into a uniform grid of cells one diameter wide, then
+// pushes overlapping pairs apart over several Jacobi iterations. The
+// velocities are finally derived from how far each particle moved.
+// cellStart and cellEnd, built by UniformGrid (uniform_grid.cl), hold the
+// sorted range of every cell, empty cells have a start of EMPTY_CELL.
+// ---------------------------------------------------------------------------
+
+#define EMPTY_CELL 0xffffffffu
+
+inline int2 cell_of(float2 pos, float2 gridOrigin, int2 gridSize, float cellSize)
+{
+    int2 cell = convert_int2_rtn((pos - gridOrigin) / cellSize);
+    return clamp(cell, (int2)(0, 0), gridSize - 1);
+}
+
+__kernel void predict_positions(__global const float2* positions,
+                                __global const float2* velocities,
+                                float dt,
+                                float2 gravity,
+                                int numParticles,
+                                __global float2* predicted)
+{
+    int i = get_global_id(0);
+    if (i >= numParticles)
+        return;
+
+    float2 vel = velocities[i] + gravity * dt;
+    predicted[i] = positions[i] + vel * dt;
+}
+
+// Cell key of every particle, along with the index of the particle so the
+// keys can be sorted as key/value pairs.
+__kernel void hash_particles(__global const float2* positions,
+                             int numParticles,
+                             float2 gridOrigin,
+                             int2 gridSize,
+                             float cellSize,
+                             __global uint* cellKeys,
+                             __global uint* indices)
+{
+    int i = get_global_id(0);
+    if (i >= numParticles)
+        return;
+
+    indices[i] = i;
+
+    int2 cell = cell_of(positions[i], gridOrigin, gridSize, cellSize);
+    cellKeys[i] = cell.y * gridSize.x + cell.x;
+}
+
+// Gathers the particle state into cell order
+__kernel void reorder_particles(__global const uint* indices,
+                                int numParticles,
+                                __global const float2* positions,
+                                __global const float2* velocities,
+                                __global const float* lifetimes,
+                                __global const float2* predicted,
+                                __global float2* sortedPositions,
+                                __global float2* sortedVelocities,
+                                __global float* sortedLifetimes,
+                                __global float2* sortedPredicted)
+{
+    int i = get_global_id(0);
+    if (i >= numParticles)
+        return;
+
+    uint j = indices[i];
+    sortedPositions[i] = positions[j];
+    sortedVelocities[i] = velocities[j];
+    sortedLifetimes[i] = lifetimes[j];
+    sortedPredicted[i] = predicted[j];
+}
+
+// One Jacobi iteration of the contact constraints. Every overlapping pair
+// in the 3x3 cells around particle i asks for half the overlap along the
+// line between the centres, the requests are averaged and scaled by the
+// relaxation factor so crowded particles don't overshoot. Reads predicted
+// and writes corrected, so every work-item sees the same iterate.
+__kernel void solve_collisions(__global const float2* predicted,
+                               int numParticles,
+                               float radius,
+                               float relaxation,
+                               __global float2* corrected,
+                               __global const uint* cellStart,
+                               __global const uint* cellEnd,
+                               float2 gridOrigin,
+                               int2 gridSize,
+                               float cellSize)
+{
+    int i = get_global_id(0);
+    if (i >= numParticles)
+        return;
+
+    float2 pos = predicted[i];
+    float diameter = 2.0f * radius;
+
+    float2 delta = (float2)(0.0f, 0.0f);
+    int contacts = 0;
+
+    int2 cell = cell_of(pos, gridOrigin, gridSize, cellSize);
+    for (int y = max(cell.y - 1, 0); y <= min(cell.y + 1, gridSize.y - 1); ++y)
     {
-        pos.x = minX;
-        vel.x = -vel.x * bounce_factor;
+        for (int x = max(cell.x - 1, 0); x <= min(cell.x + 1, gridSize.x - 1); ++x)
+        {
+            int key = y * gridSize.x + x;
+            uint start = cellStart[key];
+            if (start == EMPTY_CELL)
+                continue;
+
+            uint end = cellEnd[key];
+            for (uint j = start; j < end; ++j)
+            {
+                if ((int)j == i)
+                    continue;
+
+                float2 offset = pos - predicted[j];
+                float distSq = dot(offset, offset);
+                if (distSq >= diameter * diameter)
+                    continue;
+
+                // Coincident centres separate along x, in opposite directions for the two
+                float dist = sqrt(distSq);
+                float2 normal = (dist > 1e-6f) ? offset / dist : (float2)(((int)j < i) ? 1.0f : -1.0f, 0.0f);
+
+                delta += 0.5f * (diameter - dist) * normal;
+                ++contacts;
+            }
+        }
     }
-    else if (pos.x > maxX)
+
+    if (contacts > 0)
+        pos += delta * (relaxation / contacts);
+    corrected[i] = pos;
+}
+
+// Derives the velocities from the solved positions, then bounces off the bounds
+__kernel void finalize_positions(__global float2* positions,
+                                 __global float2* velocities,
+                                 __global const float2* predicted,
+                                 float dt,
+                                 int numParticles,
+                                 float4 bounds,
+                                 float bounce_factor)
+{
+    int i = get_global_id(0);
+    if (i >= numParticles)
+        return;
+
+    float2 pos = predicted[i];
+    float2 vel = (pos - positions[i]) / dt;
+
+    apply_bounds(&pos, &vel, bounds, bounce_factor);
+
+    positions[i] = pos;
+    velocities[i] = vel;
+}
+
+// ---------------------------------------------------------------------------
+// Emitters and lifetimes
+//
+// The live particles occupy the first count entries of the state buffers.
+// Every frame ages the live particles and flags the ones still alive, an
+// exclusive scan of the flags gives every survivor its compacted index and
+// compact_particles scatters them into the spare buffers, writing the new
+// count. The emitters then append behind the survivors by bumping the count
+// atomically, so the host only has to read the count back.
+// ---------------------------------------------------------------------------
+
+// Integer hash used as the random source of the emitters
+inline uint wang_hash(uint seed)
+{
+    seed = (seed ^ 61u) ^ (seed >> 16);
+    seed *= 9u;
+    seed = seed ^ (seed >> 4);
+    seed *= 0x27d4eb2du;
+    seed = seed ^ (seed >> 15);
+    return seed;
+}
+
+// Uniform float in [0, 1), advancing the state
+inline float random_float(uint* state)
+{
+    *state = wang_hash(*state);
+    return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+__kernel void age_particles(__global float* lifetimes,
+                            float dt,
+                            int numParticles,
+                            __global uint* alive)
+{
+    int i = get_global_id(0);
+    if (i >= numParticles)
+        return;
+
+    float lifetime = lifetimes[i] - dt;
+    lifetimes[i] = lifetime;
+    alive[i] = (lifetime > 0.0f) ? 1 : 0;
+}
+
+// offsets is the exclusive scan of alive, the last work-item also knows the total
+__kernel void compact_particles(__global const float2* positions,
+                                __global const float2* velocities,
+                                __global const float* lifetimes,
+                                __global const uint* alive,
+                                __global const uint* offsets,
+                                int numParticles,
+                                __global float2* compactedPositions,
+                                __global float2* compactedVelocities,
+                                __global float* compactedLifetimes,
+                                __global int* count)
+{
+    int i = get_global_id(0);
+    if (i >= numParticles)
+        return;
+
+    uint offset = offsets[i];
+    if (alive[i])
     {
-        pos.x = maxX;
-        vel.x = -vel.x * bounce_factor;
+        compactedPositions[offset] = positions[i];
+        compactedVelocities[offset] = velocities[i];
+        compactedLifetimes[offset] = lifetimes[i];
     }
 
-    if (pos.y < minY)
+    if (i == numParticles - 1)
+        *count = (int)(offset + alive[i]);
+}
+
+// Appends numToEmit particles at the origin behind the live ones. Each
+// reserves its slot with an atomic increment of the count and backs out
+// once the buffers are full, leaving the count at the capacity. Velocities
+// are spread uniformly in a disc of the given radius around the mean
+// velocity, lifetimes vary by +-25%.
+__kernel void emit_particles(__global float2* positions,
+                             __global float2* velocities,
+                             __global float* lifetimes,
+                             __global int* count,
+                             int capacity,
+                             int numToEmit,
+                             float2 origin,
+                             float2 velocity,
+                             float spread,
+                             float lifetime,
+                             uint seed)
+{
+    int i = get_global_id(0);
+    if (i >= numToEmit)
+        return;
+
+    int slot = atomic_inc(count);
+    if (slot >= capacity)
     {
-        pos.y = minY;
-        vel.y = -vel.y * bounce_factor;
-    }
-    else if (pos.y > maxY) {
-        pos.y = maxY;
-        vel.y = -vel.y * bounce_factor;
+        atomic_dec(count);
+        return;
     }
 
-    // Store updated values
-    positions[id] = pos;
-    velocities[id] = vel;
+    uint rng = wang_hash(seed ^ wang_hash((uint)i));
+    float angle = 2.0f * M_PI_F * random_float(&rng);
+    float magnitude = spread * sqrt(random_float(&rng));
+
+    positions[slot] = origin;
+    velocities[slot] = velocity + magnitude * (float2)(cos(angle), sin(angle));
+    lifetimes[slot] = lifetime * (0.75f + 0.5f * random_float(&rng));
 }
@@ -1,6 +1,12 @@
+#include "FixedTimestep.h"
 #include "OpenCLUtils.h"
 #include "OpenCVUtils.h"
+#include "RandomUtils.h"
+#include "RateCounter.h"
+#include "Rasterizer.h"
+#include "Scan.h"
 #include "Timer.h"
+#include "UniformGrid.h"
 
 #include "opencv2/opencv.hpp"
 
@@ -8,16 +14,40 @@
 
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <numeric>
+#include <limits>
 
 cl_device_id device = nullptr;
 cl_context context = nullptr;
 cl_program program = nullptr;
 cl_kernel kernel = nullptr;
+cl_kernel predictKernel = nullptr;
+cl_kernel solveKernel = nullptr;
+cl_kernel finalizeKernel = nullptr;
+cl_kernel ageKernel = nullptr;
+cl_kernel compactKernel = nullptr;
+cl_kernel emitKernel = nullptr;
 cl_command_queue queue = nullptr;
 cl_int err = -1;
 
+UniformGrid grid;
+Scan scan;
+Rasterizer rasterizer;
+
 struct Vector4f
 {
+public:
+	Vector4f() = default;
+
+	Vector4f(float _x, float _y, float _z, float _w)
+		: x(_x),
+		y(_y),
+		z(_z),
+		w(_w)
+	{
+	}
+
 public:
 	float x = 0;
 	float y = 0;
@@ -40,6 +70,153 @@ public:
 	float y = 0;
 };
 
+/// <summary>
+/// Parameters shared by every step kernel.
+/// </summary>
+struct SimParams
+{
+public:
+	Vector2f gravity;
+	float bounceFactor = 0.95f;
+	Vector4f bounds;
+
+	// Collisions
+	float radius = 5;
+	int solverIterations = 4;
+	float relaxation = 1.5f;
+};
+
+/// <summary>
+/// Device state of the particles. The live particles occupy the first
+/// numAlive entries of buffers holding capacity particles. The solver
+/// iterations ping-pong between the two predicted position buffers, with
+/// collisions enabled the state is reordered by cell every step, and with
+/// emitters the survivors are compacted into the spare buffers every frame.
+/// </summary>
+struct ParticleState
+{
+public:
+	bool Create(const Vector2f* initialPositions, const Vector2f* initialVelocities, int numParticles, int maxParticles)
+	{
+		capacity = maxParticles;
+		numAlive = std::min(numParticles, maxParticles);
+
+		// The initial particles live forever, only emitted ones age
+		std::vector<Vector2f> initialState(capacity);
+		std::vector<float> initialLifetimes(capacity, std::numeric_limits<float>::infinity());
+
+		const size_t float2Size = capacity * sizeof(Vector2f);
+		const size_t floatSize = capacity * sizeof(float);
+
+		// Every buffer is written by the kernels, and swapped with the grid and compaction scratch
+		cl_int bufferErr = CL_SUCCESS;
+		auto createInitialized = [&](void* data, size_t size)
+		{
+			cl_mem buffer = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, size, data, &err);
+			bufferErr |= err;
+			return buffer;
+		};
+
+		std::copy(initialPositions, initialPositions + numAlive, initialState.begin());
+		positions = createInitialized(initialState.data(), float2Size);
+		std::copy(initialVelocities, initialVelocities + numAlive, initialState.begin());
+		velocities = createInitialized(initialState.data(), float2Size);
+		lifetimes = createInitialized(initialLifetimes.data(), floatSize);
+		count = createInitialized(&numAlive, sizeof(int));
+
+		for (cl_mem& buffer : predicted)
+		{
+			buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, float2Size, NULL, &err);
+			bufferErr |= err;
+		}
+		spare.positions = clCreateBuffer(context, CL_MEM_READ_WRITE, float2Size, NULL, &err);
+		bufferErr |= err;
+		spare.velocities = clCreateBuffer(context, CL_MEM_READ_WRITE, float2Size, NULL, &err);
+		bufferErr |= err;
+		spare.lifetimes = clCreateBuffer(context, CL_MEM_READ_WRITE, floatSize, NULL, &err);
+		bufferErr |= err;
+		alive = clCreateBuffer(context, CL_MEM_READ_WRITE, capacity * sizeof(cl_uint), NULL, &err);
+		bufferErr |= err;
+		offsets = clCreateBuffer(context, CL_MEM_READ_WRITE, capacity * sizeof(cl_uint), NULL, &err);
+		bufferErr |= err;
+		return bufferErr >= 0;
+	}
+
+	/// <summary>
+	/// Makes the compacted buffers the current state.
+	/// </summary>
+	void SwapSpare()
+	{
+		std::swap(positions, spare.positions);
+		std::swap(velocities, spare.velocities);
+		std::swap(lifetimes, spare.lifetimes);
+	}
+
+	void Release()
+	{
+		for (cl_mem* buffer : { &positions, &velocities, &lifetimes, &predicted[0], &predicted[1],
+								&spare.positions, &spare.velocities, &spare.lifetimes, &alive, &offsets, &count })
+		{
+			if (*buffer)
+				clReleaseMemObject(*buffer);
+			*buffer = nullptr;
+		}
+	}
+public:
+	cl_mem positions = nullptr;
+	cl_mem velocities = nullptr;
+	cl_mem lifetimes = nullptr;
+	cl_mem predicted[2] = {};
+
+	// Compaction targets, alive flags and their scan
+	struct
+	{
+		cl_mem positions = nullptr;
+		cl_mem velocities = nullptr;
+		cl_mem lifetimes = nullptr;
+	} spare;
+	cl_mem alive = nullptr;
+	cl_mem offsets = nullptr;
+
+	// Device copy of the live count, bumped by the emitters
+	cl_mem count = nullptr;
+
+	int numAlive = 0;
+	int capacity = 0;
+};
+
+/// <summary>
+/// A point spawning particles at a constant rate.
+/// </summary>
+struct Emitter
+{
+public:
+	Vector2f position;
+	Vector2f velocity;
+
+	// Radius of the disc of velocities around the mean velocity
+	float spread = 0;
+
+	// Mean lifetime in seconds, particles vary by +-25%
+	float lifetime = 1;
+
+	// Particles per second, the fraction left over carries to the next frame
+	float rate = 0;
+	float carry = 0;
+};
+
+/// <summary>
+/// Time spent in every stage of a collision step, in milliseconds.
+/// </summary>
+struct StepTimings
+{
+public:
+	double predict_ms = 0.0;
+	double grid_ms = 0.0;
+	std::vector<double> iterations_ms;
+	double finalize_ms = 0.0;
+};
+
 bool InitializeDeviceAndContext()
 {
 	device = OpenCLUtils::create_device();
@@ -77,13 +254,410 @@ bool InitializeProgram()
 		perror("Couldn't create a kernel");
 		return false;
 	};
+
+	predictKernel = clCreateKernel(program, "predict_positions", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the predict kernel");
+		return false;
+	};
+
+	solveKernel = clCreateKernel(program, "solve_collisions", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the collision solver kernel");
+		return false;
+	};
+
+	finalizeKernel = clCreateKernel(program, "finalize_positions", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the finalize kernel");
+		return false;
+	};
+
+	ageKernel = clCreateKernel(program, "age_particles", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the age kernel");
+		return false;
+	};
+
+	compactKernel = clCreateKernel(program, "compact_particles", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the compaction kernel");
+		return false;
+	};
+
+	emitKernel = clCreateKernel(program, "emit_particles", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the emit kernel");
+		return false;
+	};
+
+	if (!grid.Initialize(context, device, program, "hash_particles", "reorder_particles") || !scan.Initialize(context, device) || !rasterizer.Initialize(context, device))
+		return false;
     return true;
 }
 
+/// <summary>
+/// Enqueues one step of the particles. Without collisions this is the
+/// original simulate kernel. With collisions the positions are predicted
+/// from gravity, the particles sorted into the grid and the overlaps
+/// resolved over params.solverIterations Jacobi iterations before the
+/// velocities are derived from the corrected positions.
+/// </summary>
+/// <param name="useCollisions">Whether to resolve particle-particle collisions</param>
+/// <param name="params">The simulation parameters</param>
+/// <param name="state">The particle state, the first numAlive particles are updated</param>
+/// <param name="deltaTime_s">The time step</param>
+/// <param name="timings">Optional stage timings, waiting for every stage to complete when given</param>
+/// <returns>True if the kernels were enqueued successfully</returns>
+bool Step(bool useCollisions,
+		  const SimParams& params,
+		  ParticleState& state,
+		  float deltaTime_s,
+		  StepTimings* timings = nullptr)
+{
+	int numParticles = state.numAlive;
+	if (numParticles == 0)
+		return true;
+
+	const size_t global = numParticles;
+	auto enqueue = [&](cl_kernel stepKernel)
+	{
+		err = clEnqueueNDRangeKernel(queue, stepKernel, 1, NULL, &global, NULL, 0, NULL, NULL);
+		if (err < 0)
+		{
+			perror("Couldn't enqueue the kernel");
+			return false;
+		}
+		return true;
+	};
+
+	if (!useCollisions)
+	{
+		err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &state.positions);
+		err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &state.velocities);
+		err |= clSetKernelArg(kernel, 2, sizeof(float), &deltaTime_s);
+		err |= clSetKernelArg(kernel, 3, sizeof(Vector2f), &params.gravity);
+		err |= clSetKernelArg(kernel, 4, sizeof(Vector4f), &params.bounds);
+		err |= clSetKernelArg(kernel, 5, sizeof(float), &params.bounceFactor);
+		if (err < 0)
+		{
+			perror("Couldn't create a kernel argument");
+			return false;
+		}
+		return enqueue(kernel);
+	}
+
+	// Waits for the enqueued work and charges it to the given stage
+	Timer stageTimer(true);
+	auto endStage = [&](double& stage_ms)
+	{
+		clFinish(queue);
+		stage_ms = stageTimer.Stop_ms();
+		stageTimer.Start();
+	};
+
+	if (timings)
+		timings->iterations_ms.assign(params.solverIterations, 0.0);
+
+	err = clSetKernelArg(predictKernel, 0, sizeof(cl_mem), &state.positions);
+	err |= clSetKernelArg(predictKernel, 1, sizeof(cl_mem), &state.velocities);
+	err |= clSetKernelArg(predictKernel, 2, sizeof(float), &deltaTime_s);
+	err |= clSetKernelArg(predictKernel, 3, sizeof(Vector2f), &params.gravity);
+	err |= clSetKernelArg(predictKernel, 4, sizeof(int), &numParticles);
+	err |= clSetKernelArg(predictKernel, 5, sizeof(cl_mem), &state.predicted[0]);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
+
+	if (!enqueue(predictKernel))
+		return false;
+	if (timings)
+		endStage(timings->predict_ms);
+
+	// One cell per particle diameter keeps every possible contact within the 3x3 cells
+	const cl_float4 area = { { params.bounds.x, params.bounds.y, params.bounds.z, params.bounds.w } };
+	// The sorted buffers swapped in must still hold every slot the emitters may fill
+	const size_t float2Size = state.capacity * sizeof(cl_float2);
+	if (!grid.Build(queue,
+					state.predicted[0],
+					{ { &state.positions, float2Size },
+					  { &state.velocities, float2Size },
+					  { &state.lifetimes, state.capacity * sizeof(float) },
+					  { &state.predicted[0], float2Size } },
+					numParticles,
+					area,
+					2.0f * params.radius))
+		return false;
+	if (timings)
+		endStage(timings->grid_ms);
+
+	int current = 0;
+	for (int iteration = 0; iteration < params.solverIterations; ++iteration)
+	{
+		const int next = 1 - current;
+		err = clSetKernelArg(solveKernel, 0, sizeof(cl_mem), &state.predicted[current]);
+		err |= clSetKernelArg(solveKernel, 1, sizeof(int), &numParticles);
+		err |= clSetKernelArg(solveKernel, 2, sizeof(float), &params.radius);
+		err |= clSetKernelArg(solveKernel, 3, sizeof(float), &params.relaxation);
+		err |= clSetKernelArg(solveKernel, 4, sizeof(cl_mem), &state.predicted[next]);
+		if (err < 0 || !grid.SetGridArgs(solveKernel, 5))
+		{
+			perror("Couldn't create a kernel argument");
+			return false;
+		}
+
+		if (!enqueue(solveKernel))
+			return false;
+		if (timings)
+			endStage(timings->iterations_ms[iteration]);
+		current = next;
+	}
+
+	err = clSetKernelArg(finalizeKernel, 0, sizeof(cl_mem), &state.positions);
+	err |= clSetKernelArg(finalizeKernel, 1, sizeof(cl_mem), &state.velocities);
+	err |= clSetKernelArg(finalizeKernel, 2, sizeof(cl_mem), &state.predicted[current]);
+	err |= clSetKernelArg(finalizeKernel, 3, sizeof(float), &deltaTime_s);
+	err |= clSetKernelArg(finalizeKernel, 4, sizeof(int), &numParticles);
+	err |= clSetKernelArg(finalizeKernel, 5, sizeof(Vector4f), &params.bounds);
+	err |= clSetKernelArg(finalizeKernel, 6, sizeof(float), &params.bounceFactor);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
+
+	if (!enqueue(finalizeKernel))
+		return false;
+	if (timings)
+		endStage(timings->finalize_ms);
+	return true;
+}
+
+/// <summary>
+/// Ages the live particles, compacts the survivors to the front of the
+/// state on the device and appends the particles spawned by the emitters
+/// this frame. Every launch covers just the live range, the only value
+/// read back is the new live count.
+/// </summary>
+/// <param name="emitters">The emitters, their carried fractions are updated</param>
+/// <param name="state">The particle state, updated</param>
+/// <param name="deltaTime_s">The time step</param>
+/// <param name="seed">Seed of this frame's emission</param>
+/// <returns>True if the kernels were enqueued and the count read successfully</returns>
+bool UpdateLifetimes(std::vector<Emitter>& emitters, ParticleState& state, float deltaTime_s, cl_uint seed)
+{
+	int numParticles = state.numAlive;
+	if (numParticles > 0)
+	{
+		const size_t global = numParticles;
+
+		err = clSetKernelArg(ageKernel, 0, sizeof(cl_mem), &state.lifetimes);
+		err |= clSetKernelArg(ageKernel, 1, sizeof(float), &deltaTime_s);
+		err |= clSetKernelArg(ageKernel, 2, sizeof(int), &numParticles);
+		err |= clSetKernelArg(ageKernel, 3, sizeof(cl_mem), &state.alive);
+
+		err |= clSetKernelArg(compactKernel, 0, sizeof(cl_mem), &state.positions);
+		err |= clSetKernelArg(compactKernel, 1, sizeof(cl_mem), &state.velocities);
+		err |= clSetKernelArg(compactKernel, 2, sizeof(cl_mem), &state.lifetimes);
+		err |= clSetKernelArg(compactKernel, 3, sizeof(cl_mem), &state.alive);
+		err |= clSetKernelArg(compactKernel, 4, sizeof(cl_mem), &state.offsets);
+		err |= clSetKernelArg(compactKernel, 5, sizeof(int), &numParticles);
+		err |= clSetKernelArg(compactKernel, 6, sizeof(cl_mem), &state.spare.positions);
+		err |= clSetKernelArg(compactKernel, 7, sizeof(cl_mem), &state.spare.velocities);
+		err |= clSetKernelArg(compactKernel, 8, sizeof(cl_mem), &state.spare.lifetimes);
+		err |= clSetKernelArg(compactKernel, 9, sizeof(cl_mem), &state.count);
+		if (err < 0)
+		{
+			perror("Couldn't create a kernel argument");
+			return false;
+		}
+
+		err = clEnqueueNDRangeKernel(queue, ageKernel, 1, NULL, &global, NULL, 0, NULL, NULL);
+		if (err < 0 || !scan.Exclusive(queue, ElementType::UInt, state.alive, numParticles, state.offsets))
+		{
+			perror("Couldn't enqueue the lifetime update");
+			return false;
+		}
+
+		err = clEnqueueNDRangeKernel(queue, compactKernel, 1, NULL, &global, NULL, 0, NULL, NULL);
+		if (err < 0)
+		{
+			perror("Couldn't enqueue the compaction kernel");
+			return false;
+		}
+		state.SwapSpare();
+	}
+
+	for (size_t e = 0; e < emitters.size(); ++e)
+	{
+		Emitter& emitter = emitters[e];
+
+		const float spawn = emitter.rate * deltaTime_s + emitter.carry;
+		const int numToEmit = static_cast<int>(spawn);
+		emitter.carry = spawn - numToEmit;
+		if (numToEmit == 0)
+			continue;
+
+		const size_t global = numToEmit;
+		const cl_uint emitterSeed = seed * static_cast<cl_uint>(emitters.size()) + static_cast<cl_uint>(e);
+
+		err = clSetKernelArg(emitKernel, 0, sizeof(cl_mem), &state.positions);
+		err |= clSetKernelArg(emitKernel, 1, sizeof(cl_mem), &state.velocities);
+		err |= clSetKernelArg(emitKernel, 2, sizeof(cl_mem), &state.lifetimes);
+		err |= clSetKernelArg(emitKernel, 3, sizeof(cl_mem), &state.count);
+		err |= clSetKernelArg(emitKernel, 4, sizeof(int), &state.capacity);
+		err |= clSetKernelArg(emitKernel, 5, sizeof(int), &numToEmit);
+		err |= clSetKernelArg(emitKernel, 6, sizeof(Vector2f), &emitter.position);
+		err |= clSetKernelArg(emitKernel, 7, sizeof(Vector2f), &emitter.velocity);
+		err |= clSetKernelArg(emitKernel, 8, sizeof(float), &emitter.spread);
+		err |= clSetKernelArg(emitKernel, 9, sizeof(float), &emitter.lifetime);
+		err |= clSetKernelArg(emitKernel, 10, sizeof(cl_uint), &emitterSeed);
+		if (err < 0)
+		{
+			perror("Couldn't create a kernel argument");
+			return false;
+		}
+
+		err = clEnqueueNDRangeKernel(queue, emitKernel, 1, NULL, &global, NULL, 0, NULL, NULL);
+		if (err < 0)
+		{
+			perror("Couldn't enqueue the emit kernel");
+			return false;
+		}
+	}
+
+	err = clEnqueueReadBuffer(queue, state.count, CL_TRUE, 0, sizeof(int), &state.numAlive, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't read the particle count");
+		return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Measures the time per step with collisions for growing particle counts
+/// at the density of the interactive scene, without any rendering. Full
+/// steps are timed back to back, a second pass waits after every stage to
+/// break the step down into the prediction, the grid build, every solver
+/// iteration and the finalization.
+/// </summary>
+bool BenchmarkCollisions(const SimParams& baseParams, int baseParticles)
+{
+	const int Particle_Counts[] = { 1024, 16384, 65536, 262144, 1048576 };
+	const int Steps = 20;
+	const float DeltaTime_s = 0.01f;
+
+	printf("%8s  %10s  %10s  %10s  %10s  %12s  %10s\n", "particles", "step (ms)", "steps/s", "predict", "grid", "iteration", "finalize");
+
+	for (int numParticles : Particle_Counts)
+	{
+		const float baseExtent = baseParams.bounds.y - baseParams.bounds.x;
+		const float extent = baseExtent * std::sqrt(static_cast<float>(numParticles) / baseParticles);
+
+		SimParams params = baseParams;
+		params.bounds = Vector4f(0.0f, extent, 0.0f, extent);
+
+		std::vector<Vector2f> positions(numParticles);
+		std::vector<Vector2f> velocities(numParticles);
+		for (int i = 0; i < numParticles; ++i)
+			positions[i] = Vector2f(RandUtils::RandomRange<float>(0.0f, extent), RandUtils::RandomRange<float>(0.0f, extent));
+
+		ParticleState state;
+		if (!state.Create(positions.data(), velocities.data(), numParticles, numParticles))
+		{
+			perror("Couldn't create the particle buffers");
+			return false;
+		}
+
+		// Warm-up
+		if (!Step(true, params, state, DeltaTime_s))
+		{
+			state.Release();
+			return false;
+		}
+		clFinish(queue);
+
+		Timer timer(true);
+		for (int step = 0; step < Steps; ++step)
+		{
+			if (!Step(true, params, state, DeltaTime_s))
+			{
+				state.Release();
+				return false;
+			}
+		}
+		clFinish(queue);
+		const double stepTime_ms = timer.Stop_ms() / Steps;
+
+		StepTimings total;
+		total.iterations_ms.assign(params.solverIterations, 0.0);
+		for (int step = 0; step < Steps; ++step)
+		{
+			StepTimings timings;
+			if (!Step(true, params, state, DeltaTime_s, &timings))
+			{
+				state.Release();
+				return false;
+			}
+
+			total.predict_ms += timings.predict_ms;
+			total.grid_ms += timings.grid_ms;
+			total.finalize_ms += timings.finalize_ms;
+			for (int iteration = 0; iteration < params.solverIterations; ++iteration)
+				total.iterations_ms[iteration] += timings.iterations_ms[iteration];
+		}
+
+		const double iterations_ms = std::accumulate(total.iterations_ms.begin(), total.iterations_ms.end(), 0.0);
+		printf("%8d  %10.3f  %10.1f  %10.3f  %10.3f  %12.3f  %10.3f\n",
+			   numParticles,
+			   stepTime_ms,
+			   1000.0 / stepTime_ms,
+			   total.predict_ms / Steps,
+			   total.grid_ms / Steps,
+			   iterations_ms / (Steps * std::max(1, params.solverIterations)),
+			   total.finalize_ms / Steps);
+
+		state.Release();
+	}
+	return true;
+}
+
 int main()
 {
 	constexpr size_t Num_Particles = 1000;
 
+	// With emitters the particles are spawned and killed every frame, up to Max_Particles alive
+	constexpr int Max_Particles = 1 << 16;
+	const bool UseEmitters = true;
+
+	const bool UseCollisions = true;
+
+	// Fixed simulation step, advanced at TimeScale simulated seconds per wall-clock second
+	// with at most MaxStepsPerFrame steps of catch-up per rendered frame.
+	// Emitters and lifetimes are updated once per frame over the frame's steps.
+	const float FixedStep_s = 0.04f;
+	const double TimeScale = 10.0;
+	const int MaxStepsPerFrame = 8;
+
+	// Steps run every frame regardless of the clock, to measure the throughput, 0 schedules them by the clock
+	const int StepsPerFrame = 0;
+
+	// Draw the particles on the device and read back only the finished frame
+	const bool DeviceRaster = true;
+
+	// Collisions scale to a million particles, see BenchmarkCollisions
+	const bool RunBenchmark = false;
+	const bool Headless = false;
+
 	const size_t ParticleRadius = 5;
 	const cv::Scalar BackgroundColor(49, 40, 34);
 	const cv::Scalar LineColor(5, 131, 236);
@@ -105,6 +679,26 @@ int main()
 	Bounds.z = 0;			// MinY
 	Bounds.w = MaxY;		// MaxY
 
+	SimParams Params;
+	Params.gravity = Gravity;
+	Params.bounceFactor = BounceFactor;
+	Params.bounds = Bounds;
+	Params.radius = static_cast<float>(ParticleRadius);
+	Params.solverIterations = 4;
+	Params.relaxation = 1.5f;
+
+	std::vector<Emitter> Emitters(2);
+	Emitters[0].position = Vector2f(MaxX * 0.25f, MaxY - 1.0f);
+	Emitters[0].velocity = Vector2f(8.0f, -45.0f);
+	Emitters[1].position = Vector2f(MaxX * 0.75f, MaxY - 1.0f);
+	Emitters[1].velocity = Vector2f(-8.0f, -45.0f);
+	for (Emitter& emitter : Emitters)
+	{
+		emitter.spread = 8.0f;
+		emitter.lifetime = 10.0f;
+		emitter.rate = 150.0f;
+	}
+
 	std::vector<Vector2f> Positions(Num_Particles);
 	std::vector<Vector2f> Velocities(Num_Particles);
 
@@ -123,92 +717,136 @@ int main()
     if (!InitializeProgram())
         return -1;
 
+	if (RunBenchmark)
+	{
+		if (!BenchmarkCollisions(Params, Num_Particles))
+			return -1;
+	}
 
-	const size_t bufferDataSize = Num_Particles * sizeof(Vector2f);
+	if (Headless)
+	{
+		grid.Release();
+		scan.Release();
+		rasterizer.Release();
+		for (cl_kernel stepKernel : { kernel, predictKernel, solveKernel, finalizeKernel, ageKernel, compactKernel, emitKernel })
+			clReleaseKernel(stepKernel);
+		clReleaseCommandQueue(queue);
+		clReleaseProgram(program);
+		clReleaseContext(context);
+		return 0;
+	}
 
-	cl_mem positionsBuffer = OpenCLUtils::create_input_buffer(context, Positions.data(), bufferDataSize);
-	cl_mem velocitiesBuffer = OpenCLUtils::create_input_buffer(context, Velocities.data(), bufferDataSize);
+	// The initial particles live forever, with emitters the scene starts empty
+	const int initialParticles = UseEmitters ? 0 : static_cast<int>(Num_Particles);
+	const int capacity = UseEmitters ? Max_Particles : static_cast<int>(Num_Particles);
 
-	/* Create kernel arguments */
-	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &positionsBuffer);
-	err = clSetKernelArg(kernel, 1, sizeof(cl_mem), &velocitiesBuffer);
-	err |= clSetKernelArg(kernel, 3, sizeof(Vector2f), &Gravity);
-	err |= clSetKernelArg(kernel, 4, sizeof(Vector4f), &Bounds);
-	err |= clSetKernelArg(kernel, 5, sizeof(float), &BounceFactor);
-	if (err < 0)
+	ParticleState state;
+	if (!state.Create(Positions.data(), Velocities.data(), initialParticles, capacity))
 	{
-		perror("Couldn't create a kernel argument");
-		return false;
+		perror("Couldn't create the particle buffers");
+		return -1;
 	}
 
-	size_t global = Num_Particles;
-
 	const std::string winName = "Particles Simulation";
 	cv::namedWindow(winName, cv::WINDOW_AUTOSIZE);
 	cv::Mat outputImg(MaxY, MaxX, CV_8UC4, BackgroundColor);
 
 	Timer gpuBufferReadTimer;
 	Timer drawTimer;
+	RateCounter rates;
+
+	FixedTimestep scheduler(FixedStep_s, MaxStepsPerFrame, TimeScale);
+	scheduler.SetStepsPerFrame(StepsPerFrame);
 
-	float deltaTime_s = 0.01f;
+	Rasterizer::Style rasterStyle;
+	rasterStyle.background = BackgroundColor;
+	rasterStyle.discColor = LineColor;
+	rasterStyle.discThickness = LineThickness;
+
+	cl_uint frame = 0;
 	while (true)
 	{
 		gpuBufferReadTimer.Start();
 
-		// Update delta time --------------------------------------------------
-		err = clSetKernelArg(kernel, 2, sizeof(float), &deltaTime_s);
-		if (err < 0)
+		// The steps are enqueued back to back, the state is only read back when it changed
+		const int numSteps = scheduler.Advance();
+		for (int step = 0; step < numSteps; ++step)
 		{
-			perror("Couldn't create a kernel argument");
-			return false;
+			if (!Step(UseCollisions, Params, state, scheduler.GetStep_s()))
+				return false;
 		}
-		// --------------------------------------------------------------------
-
-		err = clEnqueueNDRangeKernel(queue,
-									 kernel,
-									 1,
-									 NULL,
-									 (const size_t*)&global,
-									 NULL,
-									 0,
-									 NULL,
-									 NULL);
 
-		if (err < 0)
-		{
-			perror("Couldn't enqueue the kernel");
+		if (numSteps > 0 && UseEmitters && !UpdateLifetimes(Emitters, state, numSteps * scheduler.GetStep_s(), frame++))
 			return false;
-		}
 
-		/* Read the kernel's output    */
-		err = clEnqueueReadBuffer(queue,
-								  positionsBuffer,
-								  CL_TRUE, // Blocking read
-								  0,
-								  bufferDataSize,
-								  Positions.data(),
-								  0,
-								  NULL,
-								  NULL);
-		if (err < 0)
+		if (numSteps > 0 && !DeviceRaster)
 		{
-			perror("Couldn't read the buffer");
-			return false;
+			/* Read the kernel's output    */
+			Positions.resize(state.numAlive);
+			Velocities.resize(state.numAlive);
+			err = CL_SUCCESS;
+			if (state.numAlive > 0)
+			{
+				err = clEnqueueReadBuffer(queue,
+										  state.positions,
+										  CL_FALSE,
+										  0,
+										  state.numAlive * sizeof(Vector2f),
+										  Positions.data(),
+										  0,
+										  NULL,
+										  NULL);
+
+				err |= clEnqueueReadBuffer(queue,
+										   state.velocities,
+										   CL_FALSE,
+										   0,
+										   state.numAlive * sizeof(Vector2f),
+										   Velocities.data(),
+										   0,
+										   NULL,
+										   NULL);
+			}
+			if (err < 0)
+			{
+				perror("Couldn't read the buffer");
+				return false;
+			}
+
+			clFinish(queue);
 		}
 		const double gpuBufferTime_ms = gpuBufferReadTimer.Elapsed_ms();
 
 		// Visualization logic
 		drawTimer.Start();
 		{
-			outputImg.setTo(BackgroundColor);
-			for (size_t x = 0; x < Num_Particles; ++x)
+			// The grid reorders the particles every step, so instead of blending two read back states
+			// the latest one is rewound along the velocities to the scheduler's render time
+			const float rewind_s = (1.0f - scheduler.GetAlpha()) * scheduler.GetStep_s();
+
+			if (DeviceRaster)
+			{
+				Rasterizer::Entities particles;
+				particles.positions = state.positions;
+				particles.velocities = state.velocities;
+				particles.radius = ParticleRadius;
+				particles.count = state.numAlive;
+
+				if (!rasterizer.Draw(queue, particles, rasterStyle, MaxX, MaxY, rewind_s) || !rasterizer.Read(queue, outputImg))
+					return false;
+			}
+			else
 			{
-				cv::circle(outputImg, 
-						   cv::Point(Positions[x].x, Positions[x].y), 
-						   ParticleRadius, 
-						   LineColor, 
-						   LineThickness, 
-						   cv::LineTypes::FILLED);
+				outputImg.setTo(BackgroundColor);
+				for (size_t x = 0; x < Positions.size(); ++x)
+				{
+					cv::circle(outputImg, 
+							   cv::Point(Positions[x].x - Velocities[x].x * rewind_s, Positions[x].y - Velocities[x].y * rewind_s), 
+							   ParticleRadius, 
+							   LineColor, 
+							   LineThickness, 
+							   cv::LineTypes::FILLED);
+				}
 			}
 
 			cv::imshow(winName, outputImg);
@@ -221,18 +859,23 @@ int main()
 		}
 
 		const double drawTime_ms = drawTimer.Elapsed_ms();
+		rates.AddFrame(numSteps);
 
-		std::cout << "GPU Read Time: " << std::to_string(gpuBufferTime_ms) << "\tDraw Time: " << std::to_string(drawTime_ms) << std::endl;
-		deltaTime_s = (gpuBufferTime_ms + drawTime_ms) * 0.01f; // Convert back to seconds
+		std::cout << "GPU Read Time: " << std::to_string(gpuBufferTime_ms) << "\tDraw Time: " << std::to_string(drawTime_ms)
+				  << "\tSteps/s: " << std::to_string(rates.GetStepsPerSecond()) << "\tFPS: " << std::to_string(rates.GetFramesPerSecond())
+				  << "\tAlive: " << state.numAlive << std::endl;
 	}
 
 	cv::destroyWindow(winName);
 
     ///* Deallocate resources */
     
-	clReleaseKernel(kernel);
-	clReleaseMemObject(positionsBuffer);
-	clReleaseMemObject(velocitiesBuffer);
+	grid.Release();
+	scan.Release();
+	rasterizer.Release();
+	state.Release();
+	for (cl_kernel stepKernel : { kernel, predictKernel, solveKernel, finalizeKernel, ageKernel, compactKernel, emitKernel })
+		clReleaseKernel(stepKernel);
     clReleaseCommandQueue(queue);
     clReleaseProgram(program);
     clReleaseContext(context);
@@ -15,3 +15,66 @@ __kernel void rotate(__global const uchar4* input,
         output[output_index] = input[input_index];
     }
 }
+
+
+#ifndef TILE_DIM
+#define TILE_DIM 16
+#endif
+
+// Generic dihedral transform (rotations, flips and transposes) described by
+// three flags applied to the output coordinate to find its source pixel:
+//   swap_axes : (sx, sy) = (oy, ox), otherwise (ox, oy)
+//   flip_x    : ix = width - 1 - sx, otherwise sx
+//   flip_y    : iy = height - 1 - sy, otherwise sy
+// Each work-group owns one TILE_DIM x TILE_DIM output tile. The matching
+// input block is staged through local memory so that both the global reads
+// and the global writes are row-contiguous (coalesced). The extra column of
+// padding keeps the column-wise tile reads free of local memory bank conflicts.
+__kernel void dihedral_transform(__global const uchar4* input,
+                                 int width,
+                                 int height,
+                                 int swap_axes,
+                                 int flip_x,
+                                 int flip_y,
+                                 __global uchar4* output)
+{
+    __local uchar4 tile[TILE_DIM][TILE_DIM + 1];
+
+    int tx = get_local_id(0);
+    int ty = get_local_id(1);
+
+    int out_width = swap_axes ? height : width;
+    int out_height = swap_axes ? width : height;
+
+    // Origin of the output tile in output coordinates
+    int ox0 = get_group_id(0) * TILE_DIM;
+    int oy0 = get_group_id(1) * TILE_DIM;
+
+    // Origin of the source block in input coordinates
+    int sx0 = swap_axes ? oy0 : ox0;
+    int sy0 = swap_axes ? ox0 : oy0;
+    int ix0 = flip_x ? (width - TILE_DIM - sx0) : sx0;
+    int iy0 = flip_y ? (height - TILE_DIM - sy0) : sy0;
+
+    // Coalesced load of the source block
+    int ix = ix0 + tx;
+    int iy = iy0 + ty;
+    if (ix >= 0 && ix < width && iy >= 0 && iy < height)
+    {
+        tile[ty][tx] = input[iy * width + ix];
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Coalesced store of the output tile
+    int ox = ox0 + tx;
+    int oy = oy0 + ty;
+    if (ox < out_width && oy < out_height)
+    {
+        int sx = swap_axes ? oy : ox;
+        int sy = swap_axes ? ox : oy;
+        int lx = (flip_x ? (width - 1 - sx) : sx) - ix0;
+        int ly = (flip_y ? (height - 1 - sy) : sy) - iy0;
+        output[oy * out_width + ox] = tile[ly][lx];
+    }
+}
@@ -1,5 +1,6 @@
 #include "OpenCLUtils.h"
 #include "OpenCVUtils.h"
+#include "Timer.h"
 
 #include "opencv2/opencv.hpp"
 
@@ -12,56 +13,162 @@ cl_device_id device = nullptr;
 cl_context context = nullptr;
 cl_program program = nullptr;
 cl_kernel kernel = nullptr;
+cl_kernel transformKernel = nullptr;
 cl_command_queue queue = nullptr;
 cl_int err = -1;
 
-bool EdgeDetect(const cv::Mat& input,
-                cv::Mat& output)
+/// <summary>
+/// The eight rotations and flips of an image. The values match the EXIF
+/// orientation tag, naming the transform that normalizes an image carrying
+/// that tag.
+/// </summary>
+enum class Orientation : int
 {
-	const size_t inputDataSize = input.cols * input.rows * input.channels() * sizeof(unsigned char);
-	const size_t outputDataSize = input.cols * input.rows * output.channels() * sizeof(unsigned char);
-	cl_mem inputA = OpenCLUtils::create_input_buffer(context, input.data, inputDataSize);
-	cl_mem output_buffer = OpenCLUtils::create_output_buffer(context, outputDataSize);
+	Identity		= 1,
+	FlipHorizontal	= 2,
+	Rotate180		= 3,
+	FlipVertical	= 4,
+	Transpose		= 5,
+	Rotate90CW		= 6,
+	AntiTranspose	= 7,
+	Rotate270CW		= 8
+};
 
-	const int width = input.cols;
-	const int height = input.rows;
-	const int channels = input.channels();
+struct TransformFlags
+{
+	int swapAxes = 0;
+	int flipX = 0;
+	int flipY = 0;
+};
+
+TransformFlags GetTransformFlags(Orientation orientation)
+{
+	switch (orientation)
+	{
+		case Orientation::FlipHorizontal:	return { 0, 1, 0 };
+		case Orientation::Rotate180:		return { 0, 1, 1 };
+		case Orientation::FlipVertical:		return { 0, 0, 1 };
+		case Orientation::Transpose:		return { 1, 0, 0 };
+		case Orientation::Rotate90CW:		return { 1, 0, 1 };
+		case Orientation::AntiTranspose:	return { 1, 1, 1 };
+		case Orientation::Rotate270CW:		return { 1, 1, 0 };
+		default:							return { 0, 0, 0 };
+	}
+}
+
+const char* GetOrientationName(Orientation orientation)
+{
+	switch (orientation)
+	{
+		case Orientation::FlipHorizontal:	return "Flip Horizontal";
+		case Orientation::Rotate180:		return "Rotate 180";
+		case Orientation::FlipVertical:		return "Flip Vertical";
+		case Orientation::Transpose:		return "Transpose";
+		case Orientation::Rotate90CW:		return "Rotate 90CW";
+		case Orientation::AntiTranspose:	return "Anti-Transpose";
+		case Orientation::Rotate270CW:		return "Rotate 270CW";
+		default:							return "Identity";
+	}
+}
+
+constexpr size_t Tile_Dim = 16;
+
+bool EnqueueTransform(cl_mem input,
+					  int width,
+					  int height,
+					  Orientation orientation,
+					  cl_mem output)
+{
+	const TransformFlags flags = GetTransformFlags(orientation);
+
+	err = clSetKernelArg(transformKernel, 0, sizeof(cl_mem), &input);
+	err |= clSetKernelArg(transformKernel, 1, sizeof(int), &width);
+	err |= clSetKernelArg(transformKernel, 2, sizeof(int), &height);
+	err |= clSetKernelArg(transformKernel, 3, sizeof(int), &flags.swapAxes);
+	err |= clSetKernelArg(transformKernel, 4, sizeof(int), &flags.flipX);
+	err |= clSetKernelArg(transformKernel, 5, sizeof(int), &flags.flipY);
+	err |= clSetKernelArg(transformKernel, 6, sizeof(cl_mem), &output);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
+
+	// One work-group per output tile
+	const size_t outWidth = flags.swapAxes ? height : width;
+	const size_t outHeight = flags.swapAxes ? width : height;
+	size_t global[2] = { (outWidth + Tile_Dim - 1) / Tile_Dim * Tile_Dim,
+						 (outHeight + Tile_Dim - 1) / Tile_Dim * Tile_Dim };
+	size_t local[2] = { Tile_Dim, Tile_Dim };
+
+	err = clEnqueueNDRangeKernel(queue,
+								 transformKernel,
+								 2,
+								 NULL,
+								 (const size_t*)&global,
+								 (const size_t*)&local,
+								 0,
+								 NULL,
+								 NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the kernel");
+		return false;
+	}
+	return true;
+}
 
-    /* Create kernel arguments */
-	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &inputA);
+bool EnqueueRotate(cl_mem input,
+				   int width,
+				   int height,
+				   cl_mem output)
+{
+	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
 	err |= clSetKernelArg(kernel, 1, sizeof(int), &width);
 	err |= clSetKernelArg(kernel, 2, sizeof(int), &height);
-    err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &output_buffer);
-    if (err < 0)
-    {
-        perror("Couldn't create a kernel argument");
-        return false;
-    }
+	err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &output);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
 
-	size_t global[2] = { width, height };
+	size_t global[2] = { static_cast<size_t>(width), static_cast<size_t>(height) };
 
-    err = clEnqueueNDRangeKernel(queue,
-                                 kernel,
-                                 2,
-                                 NULL,
-                                 (const size_t*)&global,
-                                 NULL,
-                                 0,
-                                 NULL,
-                                 NULL);
+	err = clEnqueueNDRangeKernel(queue,
+								 kernel,
+								 2,
+								 NULL,
+								 (const size_t*)&global,
+								 NULL,
+								 0,
+								 NULL,
+								 NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the kernel");
+		return false;
+	}
+	return true;
+}
 
-    if (err < 0)
-    {
-        perror("Couldn't enqueue the kernel");
-        return false;
-    }
+bool Transform(const cv::Mat& input,
+			   Orientation orientation,
+			   cv::Mat& output)
+{
+	const size_t dataSize = input.cols * input.rows * input.channels() * sizeof(unsigned char);
+	cl_mem inputA = OpenCLUtils::create_input_buffer(context, input.data, dataSize);
+	cl_mem output_buffer = OpenCLUtils::create_output_buffer(context, dataSize);
+
+	if (!EnqueueTransform(inputA, input.cols, input.rows, orientation, output_buffer))
+		return false;
 
     /* Read the kernel's output    */
     err = clEnqueueReadBuffer(queue,
                               output_buffer,
                               CL_TRUE,
                               0,
-                              outputDataSize,
+                              dataSize,
                               output.data,
                               0,
                               NULL,
@@ -72,10 +179,95 @@ bool EdgeDetect(const cv::Mat& input,
         return false;
     }
 
-	clReleaseKernel(kernel);
 	clReleaseMemObject(inputA);
 	clReleaseMemObject(output_buffer);
-    return true;
+	return true;
+}
+
+/// <summary>
+/// Reference result of a transform computed with OpenCV.
+/// </summary>
+cv::Mat ReferenceTransform(const cv::Mat& input, Orientation orientation)
+{
+	cv::Mat result;
+	switch (orientation)
+	{
+		case Orientation::FlipHorizontal:	cv::flip(input, result, 1); break;
+		case Orientation::Rotate180:		cv::rotate(input, result, cv::ROTATE_180); break;
+		case Orientation::FlipVertical:		cv::flip(input, result, 0); break;
+		case Orientation::Transpose:		cv::transpose(input, result); break;
+		case Orientation::Rotate90CW:		cv::rotate(input, result, cv::ROTATE_90_CLOCKWISE); break;
+		case Orientation::AntiTranspose:	cv::transpose(input, result); cv::rotate(result, result, cv::ROTATE_180); break;
+		case Orientation::Rotate270CW:		cv::rotate(input, result, cv::ROTATE_90_COUNTERCLOCKWISE); break;
+		default:							result = input.clone(); break;
+	}
+	return result;
+}
+
+bool BenchmarkTransforms(const cv::Mat& input)
+{
+	const size_t dataSize = input.cols * input.rows * input.channels() * sizeof(unsigned char);
+	cl_mem inputA = OpenCLUtils::create_input_buffer(context, input.data, dataSize);
+	cl_mem output_buffer = OpenCLUtils::create_output_buffer(context, dataSize);
+
+	const int width = input.cols;
+	const int height = input.rows;
+	const int Iterations = 20;
+
+	// Bytes read plus bytes written per transform
+	const double gigabytes = 2.0 * dataSize / 1e9;
+
+	const auto ReportTime = [&](const char* name, double elapsed_ms, bool match)
+	{
+		printf("%-16s %8.3f ms  %7.2f GB/s  %s\n", name, elapsed_ms, gigabytes / (elapsed_ms / 1000.0), match ? "Match" : "MISMATCH");
+	};
+
+	// Original scattered-write rotate
+	{
+		EnqueueRotate(inputA, width, height, output_buffer);
+		clFinish(queue);
+
+		Timer timer(true);
+		for (int i = 0; i < Iterations; ++i)
+		{
+			if (!EnqueueRotate(inputA, width, height, output_buffer))
+				return false;
+		}
+		clFinish(queue);
+		const double elapsed_ms = timer.Stop_ms() / Iterations;
+
+		cv::Mat result(width, height, input.type());
+		clEnqueueReadBuffer(queue, output_buffer, CL_TRUE, 0, dataSize, result.data, 0, NULL, NULL);
+		const cv::Mat reference = ReferenceTransform(input, Orientation::Rotate90CW);
+		ReportTime("rotate (naive)", elapsed_ms, cv::norm(result, reference, cv::NORM_INF) == 0);
+	}
+
+	// Tiled transforms
+	for (int i = static_cast<int>(Orientation::Identity); i <= static_cast<int>(Orientation::Rotate270CW); ++i)
+	{
+		const Orientation orientation = static_cast<Orientation>(i);
+
+		EnqueueTransform(inputA, width, height, orientation, output_buffer);
+		clFinish(queue);
+
+		Timer timer(true);
+		for (int j = 0; j < Iterations; ++j)
+		{
+			if (!EnqueueTransform(inputA, width, height, orientation, output_buffer))
+				return false;
+		}
+		clFinish(queue);
+		const double elapsed_ms = timer.Stop_ms() / Iterations;
+
+		const cv::Mat reference = ReferenceTransform(input, orientation);
+		cv::Mat result(reference.rows, reference.cols, input.type());
+		clEnqueueReadBuffer(queue, output_buffer, CL_TRUE, 0, dataSize, result.data, 0, NULL, NULL);
+		ReportTime(GetOrientationName(orientation), elapsed_ms, cv::norm(result, reference, cv::NORM_INF) == 0);
+	}
+
+	clReleaseMemObject(inputA);
+	clReleaseMemObject(output_buffer);
+	return true;
 }
 
 bool InitializeDeviceAndContext()
@@ -115,6 +307,13 @@ bool InitializeProgram()
 		perror("Couldn't create a kernel");
 		return false;
 	};
+
+	transformKernel = clCreateKernel(program, "dihedral_transform", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel");
+		return false;
+	};
     return true;
 }
 
@@ -133,15 +332,29 @@ int main()
 		return -1;
 	}
 
-	cv::Mat outputImg(inputImg.rows, inputImg.cols, inputImg.type(), cv::Scalar(0, 0, 0));
+	// EXIF orientation to normalize
+	const Orientation TargetOrientation = Orientation::Rotate90CW;
+	const bool RunBenchmark = false;
 
-    if (!EdgeDetect(inputImg, outputImg))
+	if (RunBenchmark)
+	{
+		if (!BenchmarkTransforms(inputImg))
+			return -1;
+	}
+
+	const bool swapAxes = GetTransformFlags(TargetOrientation).swapAxes;
+	const int outputRows = swapAxes ? inputImg.cols : inputImg.rows;
+	const int outputCols = swapAxes ? inputImg.rows : inputImg.cols;
+	cv::Mat outputImg(outputRows, outputCols, inputImg.type(), cv::Scalar(0, 0, 0));
+
+    if (!Transform(inputImg, TargetOrientation, outputImg))
         return -1;
 
     /// Check Results ---------------------------------------------------------
 
 	const size_t combinedWidth = inputImg.cols + outputImg.cols;
-	cv::Mat combinedImage(cv::Size(combinedWidth, inputImg.rows), inputImg.type());
+	const size_t combinedHeight = std::max(inputImg.rows, outputImg.rows);
+	cv::Mat combinedImage(cv::Size(combinedWidth, combinedHeight), inputImg.type(), cv::Scalar(0, 0, 0, 0));
 
 	// Copy the first image into the left side of the combined image
     inputImg.copyTo(combinedImage(cv::Rect(0, 0, inputImg.cols, inputImg.rows)));
@@ -154,6 +367,8 @@ int main()
     
     ///* Deallocate resources */
     
+	clReleaseKernel(kernel);
+	clReleaseKernel(transformKernel);
     clReleaseCommandQueue(queue);
     clReleaseProgram(program);
     clReleaseContext(context);
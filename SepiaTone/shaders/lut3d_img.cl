@@ -0,0 +1,138 @@
+// 3D color LUT application. The LUT is indexed as (r, g, b) with red
+// varying fastest, matching the .cube data order, and is read either from a
+// 3D image or from a flat float4 buffer on devices without image support.
+
+#define LUT_TRILINEAR 0
+#define LUT_TETRAHEDRAL 1
+
+// Interpolates the LUT cell at `base` with fractional offsets `f` using the
+// FETCH(x, y, z) accessor, writing the float3 color to `result`.
+#define LUT_INTERPOLATE(FETCH, base, f, mode, result)                                           \
+{                                                                                               \
+    int x0 = base.x, y0 = base.y, z0 = base.z;                                                  \
+    int x1 = x0 + 1, y1 = y0 + 1, z1 = z0 + 1;                                                  \
+    float3 c000 = FETCH(x0, y0, z0);                                                            \
+    float3 c111 = FETCH(x1, y1, z1);                                                            \
+    if (mode == LUT_TETRAHEDRAL)                                                                \
+    {                                                                                           \
+        /* Only the 4 corners of the tetrahedron containing the point are read */               \
+        if (f.x > f.y)                                                                          \
+        {                                                                                       \
+            if (f.y > f.z)                                                                      \
+                result = (1.0f - f.x) * c000 + (f.x - f.y) * FETCH(x1, y0, z0) +                \
+                         (f.y - f.z) * FETCH(x1, y1, z0) + f.z * c111;                          \
+            else if (f.x > f.z)                                                                 \
+                result = (1.0f - f.x) * c000 + (f.x - f.z) * FETCH(x1, y0, z0) +                \
+                         (f.z - f.y) * FETCH(x1, y0, z1) + f.y * c111;                          \
+            else                                                                                \
+                result = (1.0f - f.z) * c000 + (f.z - f.x) * FETCH(x0, y0, z1) +                \
+                         (f.x - f.y) * FETCH(x1, y0, z1) + f.y * c111;                          \
+        }                                                                                       \
+        else                                                                                    \
+        {                                                                                       \
+            if (f.z > f.y)                                                                      \
+                result = (1.0f - f.z) * c000 + (f.z - f.y) * FETCH(x0, y0, z1) +                \
+                         (f.y - f.x) * FETCH(x0, y1, z1) + f.x * c111;                          \
+            else if (f.z > f.x)                                                                 \
+                result = (1.0f - f.y) * c000 + (f.y - f.z) * FETCH(x0, y1, z0) +                \
+                         (f.z - f.x) * FETCH(x0, y1, z1) + f.x * c111;                          \
+            else                                                                                \
+                result = (1.0f - f.y) * c000 + (f.y - f.x) * FETCH(x0, y1, z0) +                \
+                         (f.x - f.z) * FETCH(x1, y1, z0) + f.z * c111;                          \
+        }                                                                                       \
+    }                                                                                           \
+    else                                                                                        \
+    {                                                                                           \
+        float3 c00 = mix(c000, FETCH(x1, y0, z0), f.x);                                         \
+        float3 c10 = mix(FETCH(x0, y1, z0), FETCH(x1, y1, z0), f.x);                            \
+        float3 c01 = mix(FETCH(x0, y0, z1), FETCH(x1, y0, z1), f.x);                            \
+        float3 c11 = mix(FETCH(x0, y1, z1), c111, f.x);                                         \
+        result = mix(mix(c00, c10, f.y), mix(c01, c11, f.y), f.z);                              \
+    }                                                                                           \
+}
+
+// Maps an 8-bit pixel into LUT cell coordinates, returning the lower corner
+// of the cell and the fractional position within it.
+inline float3 lut_coordinates(uchar4 pixel,
+                              float4 domain_min,
+                              float4 domain_scale,
+                              int size,
+                              int3* base)
+{
+    float3 color = convert_float3(pixel.xyz) * (1.0f / 255.0f);
+    float3 coord = clamp((color - domain_min.xyz) * domain_scale.xyz, 0.0f, (float)(size - 1));
+
+    // Keep the upper corner inside the table
+    int3 cell = min(convert_int3(coord), (int3)(size - 2));
+    *base = cell;
+    return coord - convert_float3(cell);
+}
+
+// Images are optional, the program must still build for the buffer path
+#ifdef __IMAGE_SUPPORT__
+__constant sampler_t lut_sampler = CLK_NORMALIZED_COORDS_FALSE |
+                                   CLK_ADDRESS_CLAMP_TO_EDGE |
+                                   CLK_FILTER_NEAREST;
+
+__kernel void apply_lut3d_image(__global const uchar4* input,
+                                __read_only image3d_t lut,
+                                int size,
+                                float4 domain_min,
+                                float4 domain_scale,
+                                int mode,
+                                int width,
+                                int height,
+                                __global uchar4* output)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+
+    if (x < width && y < height)
+    {
+        int index = y * width + x;
+        uchar4 pixel = input[index];
+
+        int3 base;
+        float3 f = lut_coordinates(pixel, domain_min, domain_scale, size, &base);
+
+#define FETCH_IMAGE(px, py, pz) read_imagef(lut, lut_sampler, (int4)(px, py, pz, 0)).xyz
+        float3 color;
+        LUT_INTERPOLATE(FETCH_IMAGE, base, f, mode, color);
+#undef FETCH_IMAGE
+
+        uchar3 rgb = convert_uchar3_sat(color * 255.0f + 0.5f);
+        output[index] = (uchar4)(rgb, pixel.w);
+    }
+}
+#endif
+
+__kernel void apply_lut3d_buffer(__global const uchar4* input,
+                                 __global const float4* lut,
+                                 int size,
+                                 float4 domain_min,
+                                 float4 domain_scale,
+                                 int mode,
+                                 int width,
+                                 int height,
+                                 __global uchar4* output)
+{
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+
+    if (x < width && y < height)
+    {
+        int index = y * width + x;
+        uchar4 pixel = input[index];
+
+        int3 base;
+        float3 f = lut_coordinates(pixel, domain_min, domain_scale, size, &base);
+
+#define FETCH_BUFFER(px, py, pz) lut[((pz) * size + (py)) * size + (px)].xyz
+        float3 color;
+        LUT_INTERPOLATE(FETCH_BUFFER, base, f, mode, color);
+#undef FETCH_BUFFER
+
+        uchar3 rgb = convert_uchar3_sat(color * 255.0f + 0.5f);
+        output[index] = (uchar4)(rgb, pixel.w);
+    }
+}
@@ -0,0 +1,138 @@
+#include "CubeLUT.h"
+
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+
+bool CubeLUT::Load(const std::string& filename)
+{
+	std::ifstream file(filename);
+	if (!file.is_open())
+	{
+		perror("Couldn't open the LUT file");
+		return false;
+	}
+
+	mSize = 0;
+	mData.clear();
+	mDomainMin = { 0.0f, 0.0f, 0.0f };
+	mDomainMax = { 1.0f, 1.0f, 1.0f };
+
+	size_t numEntries = 0;
+
+	std::string line;
+	while (std::getline(file, line))
+	{
+		// Skip blank lines and comments
+		const size_t start = line.find_first_not_of(" \t\r");
+		if (start == std::string::npos || line[start] == '#')
+			continue;
+
+		std::istringstream stream(line.substr(start));
+		std::string keyword;
+
+		if (std::isalpha(static_cast<unsigned char>(line[start])))
+		{
+			stream >> keyword;
+			if (keyword == "LUT_3D_SIZE")
+			{
+				stream >> mSize;
+				if (mSize < 2 || mSize > 256)
+				{
+					printf("Unsupported LUT_3D_SIZE: %d\n", mSize);
+					return false;
+				}
+				mData.reserve(static_cast<size_t>(mSize) * mSize * mSize * 4);
+			}
+			else if (keyword == "DOMAIN_MIN")
+			{
+				stream >> mDomainMin[0] >> mDomainMin[1] >> mDomainMin[2];
+			}
+			else if (keyword == "DOMAIN_MAX")
+			{
+				stream >> mDomainMax[0] >> mDomainMax[1] >> mDomainMax[2];
+			}
+			else if (keyword == "LUT_1D_SIZE")
+			{
+				printf("1D LUTs are not supported!\n");
+				return false;
+			}
+			// TITLE and other keywords are ignored
+			continue;
+		}
+
+		if (mSize == 0)
+		{
+			printf("LUT data found before LUT_3D_SIZE!\n");
+			return false;
+		}
+
+		float r = 0.0f, g = 0.0f, b = 0.0f;
+		if (!(stream >> r >> g >> b))
+		{
+			printf("Malformed LUT entry: %s\n", line.c_str());
+			return false;
+		}
+
+		mData.push_back(r);
+		mData.push_back(g);
+		mData.push_back(b);
+		mData.push_back(1.0f);
+		++numEntries;
+	}
+
+	const size_t expectedEntries = static_cast<size_t>(mSize) * mSize * mSize;
+	if (mSize == 0 || numEntries != expectedEntries)
+	{
+		printf("Expected %zu LUT entries but read %zu!\n", expectedEntries, numEntries);
+		return false;
+	}
+	return true;
+}
+
+bool CubeLUT::Save(const std::string& filename) const
+{
+	std::ofstream file(filename);
+	if (!file.is_open())
+	{
+		perror("Couldn't create the LUT file");
+		return false;
+	}
+
+	file << "LUT_3D_SIZE " << mSize << "\n";
+	file << "DOMAIN_MIN " << mDomainMin[0] << " " << mDomainMin[1] << " " << mDomainMin[2] << "\n";
+	file << "DOMAIN_MAX " << mDomainMax[0] << " " << mDomainMax[1] << " " << mDomainMax[2] << "\n";
+
+	char entry[64];
+	for (size_t i = 0; i < mData.size(); i += 4)
+	{
+		snprintf(entry, sizeof(entry), "%.6f %.6f %.6f\n", mData[i], mData[i + 1], mData[i + 2]);
+		file << entry;
+	}
+	return true;
+}
+
+CubeLUT CubeLUT::FromFunction(int size, const std::function<std::array<float, 3>(float, float, float)>& transform)
+{
+	CubeLUT lut;
+	lut.mSize = size;
+	lut.mData.reserve(static_cast<size_t>(size) * size * size * 4);
+
+	const float step = 1.0f / (size - 1);
+	for (int b = 0; b < size; ++b)
+	{
+		for (int g = 0; g < size; ++g)
+		{
+			for (int r = 0; r < size; ++r)
+			{
+				const std::array<float, 3> color = transform(r * step, g * step, b * step);
+				lut.mData.push_back(color[0]);
+				lut.mData.push_back(color[1]);
+				lut.mData.push_back(color[2]);
+				lut.mData.push_back(1.0f);
+			}
+		}
+	}
+	return lut;
+}
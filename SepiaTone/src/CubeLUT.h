@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// A 3D color lookup table as described by the .cube format. Entries are
+/// stored as RGBA floats with red varying fastest, ready to be uploaded as
+/// an RGBA32F 3D image or a flat float4 buffer.
+/// </summary>
+class CubeLUT
+{
+public:
+	/// <summary>
+	/// Parses a .cube file.
+	/// </summary>
+	/// <param name="filename">The path to the .cube file</param>
+	/// <returns>True if a valid 3D LUT was read</returns>
+	bool Load(const std::string& filename);
+
+	/// <summary>
+	/// Writes the table as a .cube file.
+	/// </summary>
+	/// <param name="filename">The path to the .cube file</param>
+	/// <returns>True if the file was written</returns>
+	bool Save(const std::string& filename) const;
+
+	/// <summary>
+	/// Generates a table by sampling a color transform over the unit cube.
+	/// </summary>
+	/// <param name="size">The number of entries per axis</param>
+	/// <param name="transform">Maps a normalized RGB color to its output</param>
+	/// <returns>The sampled table</returns>
+	static CubeLUT FromFunction(int size, const std::function<std::array<float, 3>(float, float, float)>& transform);
+public:
+	/// <summary>
+	/// Retrieves the number of entries per axis.
+	/// </summary>
+	int GetSize() const { return mSize; }
+
+	/// <summary>
+	/// Retrieves the RGBA entries, size^3 * 4 floats.
+	/// </summary>
+	const std::vector<float>& GetData() const { return mData; }
+
+	const std::array<float, 3>& GetDomainMin() const { return mDomainMin; }
+	const std::array<float, 3>& GetDomainMax() const { return mDomainMax; }
+private:
+	int mSize = 0;
+	std::vector<float> mData;
+
+	std::array<float, 3> mDomainMin = { 0.0f, 0.0f, 0.0f };
+	std::array<float, 3> mDomainMax = { 1.0f, 1.0f, 1.0f };
+};
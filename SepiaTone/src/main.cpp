@@ -1,5 +1,8 @@
 #include "OpenCLUtils.h"
 #include "OpenCVUtils.h"
+#include "Timer.h"
+
+#include "CubeLUT.h"
 
 #include "opencv2/opencv.hpp"
 
@@ -7,14 +10,38 @@
 
 #include <vector>
 #include <string>
+#include <functional>
 
 cl_device_id device = nullptr;
 cl_context context = nullptr;
 cl_program program = nullptr;
 cl_kernel kernel = nullptr;
+cl_program lutProgram = nullptr;
+cl_kernel lutImageKernel = nullptr;
+cl_kernel lutBufferKernel = nullptr;
 cl_command_queue queue = nullptr;
 cl_int err = -1;
 
+enum class LUTInterpolation : int
+{
+	Trilinear	= 0,
+	Tetrahedral = 1
+};
+
+/// <summary>
+/// Device copy of a CubeLUT, either as a 3D image or a flat float4 buffer.
+/// </summary>
+struct DeviceLUT
+{
+public:
+	cl_mem memory = nullptr;
+	bool isImage = false;
+
+	int size = 0;
+	cl_float4 domainMin = {};
+	cl_float4 domainScale = {};
+};
+
 bool SepiaToneMapping(const cv::Mat& input,
 					  cv::Mat& output)
 {
@@ -72,12 +99,254 @@ bool SepiaToneMapping(const cv::Mat& input,
         return false;
     }
 
-	clReleaseKernel(kernel);
 	clReleaseMemObject(inputA);
 	clReleaseMemObject(output_buffer);
     return true;
 }
 
+bool SupportsImages()
+{
+	cl_bool imageSupport = CL_FALSE;
+	clGetDeviceInfo(device, CL_DEVICE_IMAGE_SUPPORT, sizeof(cl_bool), &imageSupport, NULL);
+	return imageSupport == CL_TRUE;
+}
+
+bool UploadLUT(const CubeLUT& lut,
+			   bool useImage,
+			   DeviceLUT& deviceLUT)
+{
+	const int size = lut.GetSize();
+	void* data = const_cast<float*>(lut.GetData().data());
+
+	if (useImage)
+	{
+		cl_image_format format = {};
+		format.image_channel_order = CL_RGBA;
+		format.image_channel_data_type = CL_FLOAT;
+
+		cl_image_desc desc = {};
+		desc.image_type = CL_MEM_OBJECT_IMAGE3D;
+		desc.image_width = size;
+		desc.image_height = size;
+		desc.image_depth = size;
+
+		deviceLUT.memory = clCreateImage(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &format, &desc, data, &err);
+	}
+	else
+	{
+		deviceLUT.memory = OpenCLUtils::create_input_buffer(context, data, lut.GetData().size() * sizeof(float));
+		err = deviceLUT.memory ? CL_SUCCESS : -1;
+	}
+
+	if (err < 0)
+	{
+		perror("Couldn't create the LUT memory object");
+		return false;
+	}
+
+	deviceLUT.isImage = useImage;
+	deviceLUT.size = size;
+	for (int i = 0; i < 3; ++i)
+	{
+		deviceLUT.domainMin.s[i] = lut.GetDomainMin()[i];
+		deviceLUT.domainScale.s[i] = (size - 1) / (lut.GetDomainMax()[i] - lut.GetDomainMin()[i]);
+	}
+	return true;
+}
+
+bool EnqueueLUT(cl_mem input,
+				int width,
+				int height,
+				const DeviceLUT& lut,
+				LUTInterpolation interpolation,
+				cl_mem output)
+{
+	cl_kernel lutKernel = lut.isImage ? lutImageKernel : lutBufferKernel;
+	const int mode = static_cast<int>(interpolation);
+
+	err = clSetKernelArg(lutKernel, 0, sizeof(cl_mem), &input);
+	err |= clSetKernelArg(lutKernel, 1, sizeof(cl_mem), &lut.memory);
+	err |= clSetKernelArg(lutKernel, 2, sizeof(int), &lut.size);
+	err |= clSetKernelArg(lutKernel, 3, sizeof(cl_float4), &lut.domainMin);
+	err |= clSetKernelArg(lutKernel, 4, sizeof(cl_float4), &lut.domainScale);
+	err |= clSetKernelArg(lutKernel, 5, sizeof(int), &mode);
+	err |= clSetKernelArg(lutKernel, 6, sizeof(int), &width);
+	err |= clSetKernelArg(lutKernel, 7, sizeof(int), &height);
+	err |= clSetKernelArg(lutKernel, 8, sizeof(cl_mem), &output);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
+
+	size_t global[2] = { static_cast<size_t>(width), static_cast<size_t>(height) };
+
+	err = clEnqueueNDRangeKernel(queue,
+								 lutKernel,
+								 2,
+								 NULL,
+								 (const size_t*)&global,
+								 NULL,
+								 0,
+								 NULL,
+								 NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the kernel");
+		return false;
+	}
+	return true;
+}
+
+bool EnqueueSepia(cl_mem input,
+				  int width,
+				  int height,
+				  cl_mem output)
+{
+	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
+	err |= clSetKernelArg(kernel, 1, sizeof(int), &width);
+	err |= clSetKernelArg(kernel, 2, sizeof(int), &height);
+	err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &output);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel argument");
+		return false;
+	}
+
+	size_t global[2] = { static_cast<size_t>(width), static_cast<size_t>(height) };
+
+	err = clEnqueueNDRangeKernel(queue,
+								 kernel,
+								 2,
+								 NULL,
+								 (const size_t*)&global,
+								 NULL,
+								 0,
+								 NULL,
+								 NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the kernel");
+		return false;
+	}
+	return true;
+}
+
+bool ApplyLUT(const cv::Mat& input,
+			  const CubeLUT& lut,
+			  LUTInterpolation interpolation,
+			  cv::Mat& output)
+{
+	const size_t dataSize = input.cols * input.rows * input.channels() * sizeof(unsigned char);
+	cl_mem inputA = OpenCLUtils::create_input_buffer(context, input.data, dataSize);
+	cl_mem output_buffer = OpenCLUtils::create_output_buffer(context, dataSize);
+
+	DeviceLUT deviceLUT;
+	if (!UploadLUT(lut, SupportsImages(), deviceLUT))
+		return false;
+
+	if (!EnqueueLUT(inputA, input.cols, input.rows, deviceLUT, interpolation, output_buffer))
+		return false;
+
+    /* Read the kernel's output    */
+    err = clEnqueueReadBuffer(queue,
+                              output_buffer,
+                              CL_TRUE,
+                              0,
+                              dataSize,
+                              output.data,
+                              0,
+                              NULL,
+                              NULL);
+    if (err < 0)
+    {
+        perror("Couldn't read the buffer");
+        return false;
+    }
+
+	clReleaseMemObject(deviceLUT.memory);
+	clReleaseMemObject(inputA);
+	clReleaseMemObject(output_buffer);
+	return true;
+}
+
+bool BenchmarkLUT(const cv::Mat& input)
+{
+	const size_t dataSize = input.cols * input.rows * input.channels() * sizeof(unsigned char);
+	cl_mem inputA = OpenCLUtils::create_input_buffer(context, input.data, dataSize);
+	cl_mem output_buffer = OpenCLUtils::create_output_buffer(context, dataSize);
+
+	const int width = input.cols;
+	const int height = input.rows;
+	const double megapixels = width * height / 1e6;
+	const int Iterations = 20;
+
+	std::vector<uint8_t> sepiaResult(dataSize);
+	std::vector<uint8_t> lutResult(dataSize);
+
+	const auto TimeRuns = [&](const std::function<bool()>& enqueue)
+	{
+		enqueue();
+		clFinish(queue);
+
+		Timer timer(true);
+		for (int i = 0; i < Iterations; ++i)
+			enqueue();
+		clFinish(queue);
+		return timer.Stop_ms() / Iterations;
+	};
+
+	// Fixed sepia matrix baseline
+	const double sepia_ms = TimeRuns([&]() { return EnqueueSepia(inputA, width, height, output_buffer); });
+	clEnqueueReadBuffer(queue, output_buffer, CL_TRUE, 0, dataSize, sepiaResult.data(), 0, NULL, NULL);
+	printf("%-28s %8.3f ms  %9.1f MPix/s\n", "Sepia Matrix", sepia_ms, megapixels / (sepia_ms / 1000.0));
+
+	// The sepia transform sampled into LUTs, so results are comparable
+	const auto SepiaTransform = [](float r, float g, float b)
+	{
+		return std::array<float, 3>
+		{
+			std::min(0.393f * r + 0.769f * g + 0.189f * b, 1.0f),
+			std::min(0.349f * r + 0.686f * g + 0.168f * b, 1.0f),
+			std::min(0.272f * r + 0.534f * g + 0.131f * b, 1.0f)
+		};
+	};
+
+	const bool imageSupport = SupportsImages();
+	for (int size : { 33, 65 })
+	{
+		const CubeLUT lut = CubeLUT::FromFunction(size, SepiaTransform);
+
+		for (int useImage = 0; useImage < (imageSupport ? 2 : 1); ++useImage)
+		{
+			DeviceLUT deviceLUT;
+			if (!UploadLUT(lut, useImage, deviceLUT))
+				return false;
+
+			for (LUTInterpolation interpolation : { LUTInterpolation::Trilinear, LUTInterpolation::Tetrahedral })
+			{
+				const double lut_ms = TimeRuns([&]() { return EnqueueLUT(inputA, width, height, deviceLUT, interpolation, output_buffer); });
+				clEnqueueReadBuffer(queue, output_buffer, CL_TRUE, 0, dataSize, lutResult.data(), 0, NULL, NULL);
+
+				int maxDifference = 0;
+				for (size_t i = 0; i < dataSize; ++i)
+					maxDifference = std::max(maxDifference, std::abs(sepiaResult[i] - lutResult[i]));
+
+				const std::string name = std::to_string(size) + "^3 " +
+										 (useImage ? "Image " : "Buffer ") +
+										 (interpolation == LUTInterpolation::Tetrahedral ? "Tetrahedral" : "Trilinear");
+				printf("%-28s %8.3f ms  %9.1f MPix/s  Max Difference: %d\n", name.c_str(), lut_ms, megapixels / (lut_ms / 1000.0), maxDifference);
+			}
+
+			clReleaseMemObject(deviceLUT.memory);
+		}
+	}
+
+	clReleaseMemObject(inputA);
+	clReleaseMemObject(output_buffer);
+	return true;
+}
+
 bool InitializeDeviceAndContext()
 {
 	device = OpenCLUtils::create_device();
@@ -115,6 +384,28 @@ bool InitializeProgram()
 		perror("Couldn't create a kernel");
 		return false;
 	};
+
+	lutProgram = OpenCLUtils::build_program(context, device, "shaders/lut3d_img.cl");
+	if (!lutProgram)
+		return false;
+
+	// The image kernel is only compiled on devices with image support, the others use the buffer path
+	if (SupportsImages())
+	{
+		lutImageKernel = clCreateKernel(lutProgram, "apply_lut3d_image", &err);
+		if (err < 0)
+		{
+			perror("Couldn't create a kernel");
+			return false;
+		};
+	}
+
+	lutBufferKernel = clCreateKernel(lutProgram, "apply_lut3d_buffer", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create a kernel");
+		return false;
+	};
     return true;
 }
 
@@ -135,10 +426,35 @@ int main()
 
 	cv::Mat outputImg(inputImg.rows, inputImg.cols, inputImg.type(), cv::Scalar(0, 0, 0));
 
+	// Data-driven grading with a .cube 3D LUT instead of the fixed sepia matrix
+	const bool UseLUT = true;
+	const std::string LUTFile = "content/sepia.cube";
+	const LUTInterpolation Interpolation = LUTInterpolation::Tetrahedral;
+	const bool RunBenchmark = false;
+
 	cv::Mat inputImgRGBA;
 	cv::cvtColor(inputImg, inputImgRGBA, cv::COLOR_BGRA2RGBA);
-    if (!SepiaToneMapping(inputImgRGBA, outputImg))
-        return -1;
+
+	if (RunBenchmark)
+	{
+		if (!BenchmarkLUT(inputImgRGBA))
+			return -1;
+	}
+
+	if (UseLUT)
+	{
+		CubeLUT lut;
+		if (!lut.Load(LUTFile))
+			return -1;
+
+		if (!ApplyLUT(inputImgRGBA, lut, Interpolation, outputImg))
+			return -1;
+	}
+	else
+	{
+		if (!SepiaToneMapping(inputImgRGBA, outputImg))
+			return -1;
+	}
 
     /// Check Results ---------------------------------------------------------
 
@@ -157,6 +473,11 @@ int main()
     
     ///* Deallocate resources */
     
+	clReleaseKernel(kernel);
+	if (lutImageKernel)
+		clReleaseKernel(lutImageKernel);
+	clReleaseKernel(lutBufferKernel);
+	clReleaseProgram(lutProgram);
     clReleaseCommandQueue(queue);
     clReleaseProgram(program);
     clReleaseContext(context);
@@ -14,7 +14,8 @@ project "Utils"
 	files
 	{
 		"src/**.h",
-		"src/**.cpp"
+		"src/**.cpp",
+		"shaders/*"
 	}
 
 	includedirs
@@ -0,0 +1,49 @@
+// Fused point operation: per-channel pre LUT -> 3x4 affine color matrix ->
+// per-channel post LUT. A chain of brightness, contrast, gamma, negative,
+// threshold, sepia and grayscale operations composes into one such stage per
+// color matrix, since the result saturates to bytes between matrices, so
+// the chain costs one read and write of the image per matrix.
+//
+// luts layout: [pre R | pre G | pre B | post R | post G | post B], 256 each.
+// matrix layout: three rows of (r, g, b, offset).
+
+#define POINT_OP_LUT_SIZE (6 * 256)
+
+__kernel void point_ops(__global const uchar4* input,
+                        __constant float* matrix,
+                        __global const uchar* luts,
+                        int num_pixels,
+                        __global uchar4* output)
+{
+    __local uchar local_luts[POINT_OP_LUT_SIZE];
+
+    // Cooperatively stage the tables, lookups are data dependent so local
+    // memory serves them better than the constant cache
+    for (int i = get_local_id(0); i < POINT_OP_LUT_SIZE; i += get_local_size(0))
+    {
+        local_luts[i] = luts[i];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    int index = get_global_id(0);
+    if (index >= num_pixels)
+        return;
+
+    uchar4 pixel = input[index];
+
+    // Pre LUT
+    float r = local_luts[pixel.x];
+    float g = local_luts[256 + pixel.y];
+    float b = local_luts[512 + pixel.z];
+
+    // Color matrix
+    uchar mr = convert_uchar_sat(matrix[0] * r + matrix[1] * g + matrix[2] * b + matrix[3]);
+    uchar mg = convert_uchar_sat(matrix[4] * r + matrix[5] * g + matrix[6] * b + matrix[7]);
+    uchar mb = convert_uchar_sat(matrix[8] * r + matrix[9] * g + matrix[10] * b + matrix[11]);
+
+    // Post LUT
+    output[index] = (uchar4)(local_luts[768 + mr],
+                             local_luts[1024 + mg],
+                             local_luts[1280 + mb],
+                             pixel.w);
+}
@@ -0,0 +1,154 @@
+// Stable LSD radix sort of 32-bit keys with optional 32-bit values,
+// RADIX_BITS per pass. Every pass runs three steps:
+//   1. radix_histogram counts the digits of every block of RADIX_BLOCK keys
+//      and stores the counts digit-major, histograms[digit * numGroups + group].
+//   2. An exclusive scan of the histograms (scan.cl) turns them into the
+//      first output position of every (digit, block).
+//   3. radix_scatter ranks the keys of every block locally and writes them
+//      to their output position, preserving the input order of equal digits.
+
+#ifndef RADIX_GROUP_SIZE
+#define RADIX_GROUP_SIZE 128
+#endif
+
+#ifndef RADIX_ITEMS
+#define RADIX_ITEMS 8
+#endif
+
+#define RADIX_BITS 4
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_BLOCK (RADIX_GROUP_SIZE * RADIX_ITEMS)
+
+inline uint radix_digit(uint key, int shift)
+{
+    return (key >> shift) & (RADIX_BUCKETS - 1);
+}
+
+__kernel __attribute__((reqd_work_group_size(RADIX_GROUP_SIZE, 1, 1)))
+void radix_histogram(__global const uint* keys,
+                     int n,
+                     int shift,
+                     __global uint* histograms)
+{
+    __local uint counts[RADIX_BUCKETS];
+
+    int lid = get_local_id(0);
+    int group = get_group_id(0);
+    int numGroups = get_num_groups(0);
+
+    if (lid < RADIX_BUCKETS)
+        counts[lid] = 0;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    int base = group * RADIX_BLOCK;
+    for (int k = 0; k < RADIX_ITEMS; ++k)
+    {
+        int i = base + k * RADIX_GROUP_SIZE + lid;
+        if (i < n)
+            atomic_inc(&counts[radix_digit(keys[i], shift)]);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    if (lid < RADIX_BUCKETS)
+        histograms[lid * numGroups + group] = counts[lid];
+}
+
+// Each work-item owns RADIX_ITEMS consecutive keys of the block. Their digit
+// counts are laid out digit-major in local memory, [digit][work-item], so an
+// exclusive scan of that array gives every work-item the number of keys of
+// the block that precede its own keys of each digit in a stable order.
+__kernel __attribute__((reqd_work_group_size(RADIX_GROUP_SIZE, 1, 1)))
+void radix_scatter(__global const uint* keysIn,
+                   __global const uint* valuesIn,
+                   int n,
+                   int shift,
+                   __global const uint* offsets,
+                   __global uint* keysOut,
+                   __global uint* valuesOut)
+{
+    __local uint localKeys[RADIX_BLOCK];
+    __local uint localValues[RADIX_BLOCK];
+    __local uint counts[RADIX_BUCKETS * RADIX_GROUP_SIZE];
+    __local uint partialSums[RADIX_GROUP_SIZE];
+    __local uint digitOffsets[RADIX_BUCKETS];
+
+    int lid = get_local_id(0);
+    int group = get_group_id(0);
+    int numGroups = get_num_groups(0);
+    int base = group * RADIX_BLOCK;
+
+    // Coalesced load of the block
+    for (int k = 0; k < RADIX_ITEMS; ++k)
+    {
+        int i = k * RADIX_GROUP_SIZE + lid;
+        if (base + i < n)
+        {
+            localKeys[i] = keysIn[base + i];
+            if (valuesIn)
+                localValues[i] = valuesIn[base + i];
+        }
+    }
+
+    if (lid < RADIX_BUCKETS)
+        digitOffsets[lid] = offsets[lid * numGroups + group];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    int first = lid * RADIX_ITEMS;
+
+    uint rank[RADIX_BUCKETS];
+    for (int d = 0; d < RADIX_BUCKETS; ++d)
+        rank[d] = 0;
+
+    for (int k = 0; k < RADIX_ITEMS; ++k)
+    {
+        if (base + first + k < n)
+            rank[radix_digit(localKeys[first + k], shift)]++;
+    }
+
+    for (int d = 0; d < RADIX_BUCKETS; ++d)
+        counts[d * RADIX_GROUP_SIZE + lid] = rank[d];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Exclusive scan of the counts, each work-item sums RADIX_BUCKETS
+    // consecutive entries and the partial sums are scanned across the group
+    uint sum = 0;
+    for (int j = 0; j < RADIX_BUCKETS; ++j)
+        sum += counts[lid * RADIX_BUCKETS + j];
+    partialSums[lid] = sum;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int offset = 1; offset < RADIX_GROUP_SIZE; offset <<= 1)
+    {
+        uint value = (lid >= offset) ? partialSums[lid - offset] : 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        partialSums[lid] += value;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    uint running = partialSums[lid] - sum;
+    for (int j = 0; j < RADIX_BUCKETS; ++j)
+    {
+        uint count = counts[lid * RADIX_BUCKETS + j];
+        counts[lid * RADIX_BUCKETS + j] = running;
+        running += count;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // counts[d * RADIX_GROUP_SIZE] is where digit d starts within the block
+    for (int d = 0; d < RADIX_BUCKETS; ++d)
+        rank[d] = digitOffsets[d] + counts[d * RADIX_GROUP_SIZE + lid] - counts[d * RADIX_GROUP_SIZE];
+
+    for (int k = 0; k < RADIX_ITEMS; ++k)
+    {
+        int i = first + k;
+        if (base + i < n)
+        {
+            uint key = localKeys[i];
+            uint position = rank[radix_digit(key, shift)]++;
+
+            keysOut[position] = key;
+            if (valuesOut)
+                valuesOut[position] = localValues[i];
+        }
+    }
+}
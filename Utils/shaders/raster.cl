@@ -0,0 +1,119 @@
+// Device rasterization of 2D entities (discs with optional velocity lines)
+// into a BGRA framebuffer. Every entity splats its shapes into an id buffer
+// with atomic_max, then every pixel resolves its id to a color:
+//   id 0        background
+//   id 2i + 1   disc of entity i
+//   id 2i + 2   velocity line of entity i
+// Larger ids win, so later entities cover earlier ones and each line covers
+// its own disc, the same order as drawing them one after another on the host.
+
+#define NO_ENTITY 0u
+
+__kernel void clear_ids(__global uint* ids, int numPixels)
+{
+    int i = get_global_id(0);
+    if (i < numPixels)
+        ids[i] = NO_ENTITY;
+}
+
+inline void splat(__global uint* ids, int x, int y, int width, int height, uint id)
+{
+    if (x >= 0 && x < width && y >= 0 && y < height)
+        atomic_max(&ids[y * width + x], id);
+}
+
+// Positions are read with a stride of positionStride floats so packed
+// layouts like float4(x, y, radius, mass) work directly. The radius comes
+// from radii, else from radiusOffset within the position entry when it is
+// not negative, else from defaultRadius. A negative discThickness fills the
+// disc, a positive one draws a ring. velocities may be NULL, entities are
+// moved back by velocity * rewind before drawing and lineThickness 0
+// disables the lines.
+__kernel void raster_entities(__global const float* positions,
+                              int positionStride,
+                              __global const float2* velocities,
+                              __global const float* radii,
+                              int radiusOffset,
+                              float defaultRadius,
+                              int count,
+                              float rewind,
+                              int discThickness,
+                              int lineThickness,
+                              int width,
+                              int height,
+                              __global uint* ids)
+{
+    int i = get_global_id(0);
+    if (i >= count)
+        return;
+
+    float2 p = (float2)(positions[i * positionStride], positions[i * positionStride + 1]);
+    float2 v = velocities ? velocities[i] : (float2)(0.0f, 0.0f);
+    p -= v * rewind;
+
+    float radius = radii ? radii[i]
+                 : (radiusOffset >= 0 ? positions[i * positionStride + radiusOffset] : defaultRadius);
+
+    // Disc or ring, clipped to the framebuffer
+    uint discId = 2u * i + 1u;
+    float outer = discThickness < 0 ? radius : radius + 0.5f * discThickness;
+    float inner = discThickness < 0 ? -1.0f : radius - 0.5f * discThickness;
+    int minX = max((int)floor(p.x - outer), 0);
+    int maxX = min((int)ceil(p.x + outer), width - 1);
+    int minY = max((int)floor(p.y - outer), 0);
+    int maxY = min((int)ceil(p.y + outer), height - 1);
+    for (int y = minY; y <= maxY; ++y)
+    {
+        for (int x = minX; x <= maxX; ++x)
+        {
+            float d = length((float2)((float)x, (float)y) - p);
+            if (d <= outer && d >= inner)
+                atomic_max(&ids[y * width + x], discId);
+        }
+    }
+
+    if (!velocities || lineThickness <= 0)
+        return;
+
+    // Velocity line with a square brush, one sample per pixel along the
+    // major axis and capped to the framebuffer size
+    uint lineId = 2u * i + 2u;
+    int steps = min((int)ceil(max(fabs(v.x), fabs(v.y))), width + height);
+    float2 delta = steps > 0 ? v / (float)steps : (float2)(0.0f, 0.0f);
+    int brushMin = -(lineThickness - 1) / 2;
+    int brushMax = brushMin + lineThickness - 1;
+    for (int s = 0; s <= steps; ++s)
+    {
+        float2 q = p + delta * (float)s;
+        int cx = (int)round(q.x);
+        int cy = (int)round(q.y);
+        for (int by = brushMin; by <= brushMax; ++by)
+            for (int bx = brushMin; bx <= brushMax; ++bx)
+                splat(ids, cx + bx, cy + by, width, height, lineId);
+    }
+}
+
+// Colors are BGRA in 0..255, lines are tinted by the entity's speed like
+// scaling a cv::Scalar, and saturate
+__kernel void resolve_frame(__global const uint* ids,
+                            int numPixels,
+                            __global const float2* velocities,
+                            float4 background,
+                            float4 discColor,
+                            float4 lineColor,
+                            __global uchar4* frame)
+{
+    int i = get_global_id(0);
+    if (i >= numPixels)
+        return;
+
+    uint id = ids[i];
+    float4 color = background;
+    if (id != NO_ENTITY)
+    {
+        uint entity = (id - 1u) >> 1;
+        bool isLine = ((id - 1u) & 1u) != 0;
+        color = isLine ? lineColor * length(velocities[entity]) : discColor;
+    }
+    frame[i] = convert_uchar4_sat_rte(color);
+}
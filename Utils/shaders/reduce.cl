@@ -0,0 +1,113 @@
+// Tree reductions of T values, built once per element type with -DT=<type>
+// and T_LOWEST / T_HIGHEST set to the type's limits. Every work-group
+// reduces a block of get_local_size(0) * REDUCE_ITEMS values to a single
+// partial result, the partials are reduced again by the same kernel until a
+// single value remains.
+
+#ifndef T
+#define T float
+#define T_LOWEST -INFINITY
+#define T_HIGHEST INFINITY
+#endif
+
+#ifndef REDUCE_ITEMS
+#define REDUCE_ITEMS 8
+#endif
+
+inline T combine_sum(T a, T b) { return a + b; }
+inline T combine_min(T a, T b) { return min(a, b); }
+inline T combine_max(T a, T b) { return max(a, b); }
+
+// Each work-item combines REDUCE_ITEMS values with coalesced loads, then the
+// group halves the local partials until scratch[0] holds the block's result.
+// The work-group size must be a power of two.
+#define DEFINE_REDUCE(name, identity, combine)                                \
+__kernel void name(__global const T* input,                                   \
+                   int n,                                                     \
+                   __global T* output,                                        \
+                   __local T* scratch)                                        \
+{                                                                             \
+    int lid = get_local_id(0);                                                \
+    int size = get_local_size(0);                                             \
+    int base = get_group_id(0) * size * REDUCE_ITEMS;                         \
+                                                                              \
+    T value = identity;                                                       \
+    for (int k = 0; k < REDUCE_ITEMS; ++k)                                    \
+    {                                                                         \
+        int i = base + k * size + lid;                                        \
+        if (i < n)                                                            \
+            value = combine(value, input[i]);                                 \
+    }                                                                         \
+    scratch[lid] = value;                                                     \
+                                                                              \
+    for (int stride = size >> 1; stride > 0; stride >>= 1)                    \
+    {                                                                         \
+        barrier(CLK_LOCAL_MEM_FENCE);                                         \
+        if (lid < stride)                                                     \
+            scratch[lid] = combine(scratch[lid], scratch[lid + stride]);      \
+    }                                                                         \
+                                                                              \
+    if (lid == 0)                                                             \
+        output[get_group_id(0)] = scratch[0];                                 \
+}
+
+DEFINE_REDUCE(reduce_sum, (T)0, combine_sum)
+DEFINE_REDUCE(reduce_min, T_HIGHEST, combine_min)
+DEFINE_REDUCE(reduce_max, T_LOWEST, combine_max)
+
+// Replaces the best value and index when the candidate is larger, or equal
+// with a smaller index, so ties resolve to the first occurrence
+inline void argmax_update(T* bestValue, int* bestIndex, T value, int index)
+{
+    if (value > *bestValue || (value == *bestValue && index < *bestIndex))
+    {
+        *bestValue = value;
+        *bestIndex = index;
+    }
+}
+
+// Same as the reductions above, carrying the index of the largest value.
+// inputIndices is NULL on the first level, where the index is the position.
+__kernel void reduce_argmax(__global const T* input,
+                            __global const int* inputIndices,
+                            int n,
+                            __global T* outputValues,
+                            __global int* outputIndices,
+                            __local T* values,
+                            __local int* indices)
+{
+    int lid = get_local_id(0);
+    int size = get_local_size(0);
+    int base = get_group_id(0) * size * REDUCE_ITEMS;
+
+    T bestValue = T_LOWEST;
+    int bestIndex = INT_MAX;
+    for (int k = 0; k < REDUCE_ITEMS; ++k)
+    {
+        int i = base + k * size + lid;
+        if (i < n)
+            argmax_update(&bestValue, &bestIndex, input[i], inputIndices ? inputIndices[i] : i);
+    }
+    values[lid] = bestValue;
+    indices[lid] = bestIndex;
+
+    for (int stride = size >> 1; stride > 0; stride >>= 1)
+    {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (lid < stride)
+        {
+            T value = values[lid];
+            int index = indices[lid];
+            argmax_update(&value, &index, values[lid + stride], indices[lid + stride]);
+            values[lid] = value;
+            indices[lid] = index;
+        }
+    }
+
+    if (lid == 0)
+    {
+        if (outputValues)
+            outputValues[get_group_id(0)] = values[0];
+        outputIndices[get_group_id(0)] = indices[0];
+    }
+}
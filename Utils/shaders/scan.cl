@@ -0,0 +1,131 @@
+// Work-efficient (Blelloch) prefix scan of T values, built once per element
+// type with -DT=<type>. Arrays of any length are scanned in blocks of
+// SCAN_ITEMS values per work-item:
+//   1. scan_blocks scans every block and writes its total to blockSums.
+//   2. The block totals are scanned the same way, recursively, until a
+//      single block remains.
+//   3. add_block_offsets adds the scanned totals back to every block.
+
+#ifndef T
+#define T uint
+#endif
+
+#ifndef SCAN_ITEMS
+#define SCAN_ITEMS 8
+#endif
+
+#ifndef LOG_NUM_BANKS
+#define LOG_NUM_BANKS 5
+#endif
+
+// Pads local indices by one every NUM_BANKS entries, and once more every
+// NUM_BANKS^2, so the strided per-work-item reads of the tile fall in
+// different banks. Must match the tile size of the host (Scan::GetTileSize).
+#define CONFLICT_FREE(i) ((i) + ((i) >> LOG_NUM_BANKS) + ((i) >> (2 * LOG_NUM_BANKS)))
+
+// Scans the blocks of get_local_size(0) * SCAN_ITEMS values, input and
+// output may be the same buffer. Each work-item sums SCAN_ITEMS consecutive
+// values of the tile, the per-work-item totals are scanned with an up-sweep
+// and down-sweep over the group, then every work-item rescans its values
+// from its offset. blockSums is NULL when there is a single block.
+__kernel void scan_blocks(__global const T* input,
+                          int n,
+                          int inclusive,
+                          __global T* output,
+                          __global T* blockSums,
+                          __local T* tile,
+                          __local T* sums)
+{
+    int lid = get_local_id(0);
+    int size = get_local_size(0);
+    int block = size * SCAN_ITEMS;
+    int base = get_group_id(0) * block;
+
+    // Coalesced load of the block
+    for (int k = 0; k < SCAN_ITEMS; ++k)
+    {
+        int i = k * size + lid;
+        tile[CONFLICT_FREE(i)] = (base + i < n) ? input[base + i] : (T)0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    int first = lid * SCAN_ITEMS;
+
+    T total = 0;
+    for (int k = 0; k < SCAN_ITEMS; ++k)
+        total += tile[CONFLICT_FREE(first + k)];
+    sums[lid] = total;
+
+    // Up-sweep (reduce) phase
+    int offset = 1;
+    for (int d = size >> 1; d > 0; d >>= 1)
+    {
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (lid < d)
+        {
+            int i = offset * (2 * lid + 1) - 1;
+            int j = offset * (2 * lid + 2) - 1;
+            sums[j] += sums[i];
+        }
+        offset <<= 1;
+    }
+
+    barrier(CLK_LOCAL_MEM_FENCE);
+    if (lid == 0)
+    {
+        if (blockSums)
+            blockSums[get_group_id(0)] = sums[size - 1];
+        sums[size - 1] = 0;
+    }
+
+    // Down-sweep phase
+    for (int d = 1; d < size; d <<= 1)
+    {
+        offset >>= 1;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (lid < d)
+        {
+            int i = offset * (2 * lid + 1) - 1;
+            int j = offset * (2 * lid + 2) - 1;
+            T t = sums[i];
+            sums[i] = sums[j];
+            sums[j] += t;
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    T running = sums[lid];
+    for (int k = 0; k < SCAN_ITEMS; ++k)
+    {
+        int i = CONFLICT_FREE(first + k);
+        T value = tile[i];
+        tile[i] = inclusive ? running + value : running;
+        running += value;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int k = 0; k < SCAN_ITEMS; ++k)
+    {
+        int i = k * size + lid;
+        if (base + i < n)
+            output[base + i] = tile[CONFLICT_FREE(i)];
+    }
+}
+
+// Adds the scanned block totals to the blocks of scan_blocks
+__kernel void add_block_offsets(__global T* data,
+                                int n,
+                                __global const T* blockOffsets)
+{
+    int lid = get_local_id(0);
+    int size = get_local_size(0);
+    int base = get_group_id(0) * size * SCAN_ITEMS;
+    T blockOffset = blockOffsets[get_group_id(0)];
+
+    for (int k = 0; k < SCAN_ITEMS; ++k)
+    {
+        int i = base + k * size + lid;
+        if (i < n)
+            data[i] += blockOffset;
+    }
+}
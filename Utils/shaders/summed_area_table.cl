@@ -0,0 +1,102 @@
+// Summed-area table (integral image) built as two passes: a work-efficient
+// (Blelloch) inclusive scan of every row, followed by an inclusive scan of
+// every column. Sums are kept as uint so window sums taken from the table
+// stay exact under modular arithmetic, even if the table itself wraps.
+
+__kernel void sat_row_scan(__global const uint* input,
+                           int width,
+                           int height,
+                           __global uint* output,
+                           __local uint* scratch)
+{
+    // One work-group per row, each chunk covers two elements per work-item.
+    int row = get_group_id(1);
+    int lid = get_local_id(0);
+    int half_size = get_local_size(0);
+    int chunk_size = half_size * 2;
+
+    if (row >= height)
+        return;
+
+    __global const uint* row_in = input + row * width;
+    __global uint* row_out = output + row * width;
+
+    uint carry = 0;
+    for (int base = 0; base < width; base += chunk_size)
+    {
+        int ai = base + lid;
+        int bi = base + lid + half_size;
+
+        uint a = (ai < width) ? row_in[ai] : 0;
+        uint b = (bi < width) ? row_in[bi] : 0;
+        scratch[lid] = a;
+        scratch[lid + half_size] = b;
+
+        // Up-sweep (reduce) phase
+        int offset = 1;
+        for (int d = half_size; d > 0; d >>= 1)
+        {
+            barrier(CLK_LOCAL_MEM_FENCE);
+            if (lid < d)
+            {
+                int i = offset * (2 * lid + 1) - 1;
+                int j = offset * (2 * lid + 2) - 1;
+                scratch[j] += scratch[i];
+            }
+            offset <<= 1;
+        }
+
+        barrier(CLK_LOCAL_MEM_FENCE);
+        uint total = scratch[chunk_size - 1];
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        if (lid == 0)
+            scratch[chunk_size - 1] = 0;
+
+        // Down-sweep phase
+        for (int d = 1; d < chunk_size; d <<= 1)
+        {
+            offset >>= 1;
+            barrier(CLK_LOCAL_MEM_FENCE);
+            if (lid < d)
+            {
+                int i = offset * (2 * lid + 1) - 1;
+                int j = offset * (2 * lid + 2) - 1;
+                uint t = scratch[i];
+                scratch[i] = scratch[j];
+                scratch[j] += t;
+            }
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Exclusive result plus own value gives the inclusive sum
+        if (ai < width)
+            row_out[ai] = carry + scratch[lid] + a;
+        if (bi < width)
+            row_out[bi] = carry + scratch[lid + half_size] + b;
+
+        carry += total;
+
+        // Ensure the chunk is consumed before the next one overwrites it
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+__kernel void sat_column_scan(__global uint* data,
+                              int width,
+                              int height)
+{
+    // One work-item per column, neighbouring work-items touch neighbouring
+    // addresses so each row step is a coalesced access.
+    int x = get_global_id(0);
+    if (x >= width)
+        return;
+
+    uint sum = 0;
+    for (int y = 0; y < height; ++y)
+    {
+        int index = y * width + x;
+        sum += data[index];
+        data[index] = sum;
+    }
+}
@@ -0,0 +1,36 @@
+// Cell tables of a uniform grid over items sorted by cell key. The keys are
+// computed and sorted by the host (UniformGrid), after which cellStart and
+// cellEnd hold the sorted range of every cell, empty cells have a start of
+// EMPTY_CELL.
+
+#define EMPTY_CELL 0xffffffffu
+
+__kernel void clear_cells(__global uint* cellStart, int numCells)
+{
+    int i = get_global_id(0);
+    if (i < numCells)
+    {
+        cellStart[i] = EMPTY_CELL;
+    }
+}
+
+// Every item that begins or ends a run of equal keys records the boundary
+__kernel void find_cell_bounds(__global const uint* cellKeys,
+                               int n,
+                               __global uint* cellStart,
+                               __global uint* cellEnd)
+{
+    int i = get_global_id(0);
+    if (i >= n)
+        return;
+
+    uint key = cellKeys[i];
+    if (i == 0 || cellKeys[i - 1] != key)
+    {
+        cellStart[key] = i;
+    }
+    if (i == n - 1 || cellKeys[i + 1] != key)
+    {
+        cellEnd[key] = i + 1;
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+/// <summary>
+/// Element types of the device scan and reduction primitives, all 32 bits wide.
+/// </summary>
+enum class ElementType
+{
+	Int,
+	UInt,
+	Float
+};
+
+constexpr int Num_Element_Types = 3;
+
+/// <summary>
+/// Retrieves the build options defining T, T_LOWEST and T_HIGHEST for the element type.
+/// </summary>
+inline const char* GetElementTypeOptions(ElementType type)
+{
+	switch (type)
+	{
+	case ElementType::Int:
+		return "-DT=int -DT_LOWEST=INT_MIN -DT_HIGHEST=INT_MAX";
+	case ElementType::UInt:
+		return "-DT=uint -DT_LOWEST=0 -DT_HIGHEST=UINT_MAX";
+	default:
+		return "-DT=float -DT_LOWEST=-INFINITY -DT_HIGHEST=INFINITY";
+	}
+}
@@ -0,0 +1,50 @@
+#include "FixedTimestep.h"
+
+#include <algorithm>
+#include <cmath>
+
+FixedTimestep::FixedTimestep(float step_s, int maxStepsPerFrame, double timeScale)
+	: mTimer(true)
+	, mStep_s(step_s)
+	, mMaxStepsPerFrame(maxStepsPerFrame)
+	, mTimeScale(timeScale)
+{
+}
+
+int FixedTimestep::Advance()
+{
+	const double elapsed_s = mTimer.Elapsed_s();
+	mTimer.Start();
+	return Advance(elapsed_s);
+}
+
+int FixedTimestep::Advance(double elapsed_s)
+{
+	if (mStepsPerFrame > 0)
+		return mStepsPerFrame;
+
+	mAccumulator += elapsed_s * mTimeScale;
+
+	long long numSteps = static_cast<long long>(mAccumulator / mStep_s);
+	mAccumulator -= numSteps * static_cast<double>(mStep_s);
+
+	// A frame that falls far behind (a stall, a debugger break) would
+	// otherwise spiral into ever longer catch-up frames
+	if (numSteps > mMaxStepsPerFrame)
+	{
+		mDroppedSteps += numSteps - mMaxStepsPerFrame;
+		numSteps = mMaxStepsPerFrame;
+	}
+
+	// Guard against rounding leaving a whole step behind
+	mAccumulator = std::fmin(std::fmax(mAccumulator, 0.0), std::nextafter(static_cast<double>(mStep_s), 0.0));
+	return static_cast<int>(numSteps);
+}
+
+void FixedTimestep::SetStepsPerFrame(int stepsPerFrame)
+{
+	mStepsPerFrame = std::max(stepsPerFrame, 0);
+
+	// Every frame ends on a whole step, nothing is left to interpolate
+	mAccumulator = 0.0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Timer.h"
+
+/// <summary>
+/// Fixed-timestep accumulator for simulation loops. Elapsed wall-clock time
+/// is scaled to simulated time and accumulated, and every frame runs as many
+/// whole steps of the fixed size as fit, so the simulation advances the same
+/// way regardless of draw time. The time left over is exposed as an
+/// interpolation factor for rendering between the last two steps.
+/// Alternatively every frame runs a fixed number of steps, uncapped and
+/// regardless of the clock, to measure the simulation throughput.
+/// </summary>
+class FixedTimestep
+{
+public:
+	/// <summary>
+	/// Constructor initializing a FixedTimestep and starting its clock.
+	/// </summary>
+	/// <param name="step_s">The simulated time per step</param>
+	/// <param name="maxStepsPerFrame">The catch-up cap, steps owed beyond it are dropped</param>
+	/// <param name="timeScale">The simulated seconds per wall-clock second</param>
+	FixedTimestep(float step_s, int maxStepsPerFrame, double timeScale = 1.0);
+
+	/// <summary>
+	/// Accumulates the wall-clock time since the previous call.
+	/// </summary>
+	/// <returns>The number of steps to run this frame</returns>
+	int Advance();
+
+	/// <summary>
+	/// Accumulates the given wall-clock time, for replaying a recorded or synthetic clock.
+	/// </summary>
+	/// <param name="elapsed_s">The wall-clock time since the previous frame</param>
+	/// <returns>The number of steps to run this frame</returns>
+	int Advance(double elapsed_s);
+
+	/// <summary>
+	/// Runs exactly the given number of steps every frame, ignoring the clock and the catch-up cap.
+	/// </summary>
+	/// <param name="stepsPerFrame">The steps per frame, or 0 to schedule the steps by the clock again</param>
+	void SetStepsPerFrame(int stepsPerFrame);
+
+	/// <summary>
+	/// Retrieves the simulated time per step.
+	/// </summary>
+	float GetStep_s() const { return mStep_s; }
+
+	/// <summary>
+	/// Retrieves the fraction of a step accumulated past the last step, in [0, 1).
+	/// Rendering the previous and the latest state blended by it hides the step rate.
+	/// </summary>
+	float GetAlpha() const { return static_cast<float>(mAccumulator / mStep_s); }
+
+	/// <summary>
+	/// Retrieves the total number of steps dropped by the catch-up cap.
+	/// </summary>
+	long long GetDroppedSteps() const { return mDroppedSteps; }
+private:
+	Timer mTimer;
+
+	float mStep_s;
+	int mMaxStepsPerFrame;
+	double mTimeScale;
+
+	// Fixed steps per frame, 0 when scheduled by the clock
+	int mStepsPerFrame = 0;
+
+	double mAccumulator = 0.0;
+	long long mDroppedSteps = 0;
+};
@@ -0,0 +1,87 @@
+#include "KernelProfiler.h"
+
+#include <stdio.h>
+
+cl_event* KernelProfiler::Record(const char* name)
+{
+	if (!mEnabled)
+		return nullptr;
+
+	mPending.push_back({ name, nullptr });
+	return &mPending.back().event;
+}
+
+bool KernelProfiler::Collect()
+{
+	bool success = true;
+	for (PendingEvent& pending : mPending)
+	{
+		// The enqueue failed and never created the event
+		if (!pending.event)
+			continue;
+
+		cl_ulong start_ns = 0;
+		cl_ulong end_ns = 0;
+		cl_int err = clGetEventProfilingInfo(pending.event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start_ns, NULL);
+		err |= clGetEventProfilingInfo(pending.event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end_ns, NULL);
+		clReleaseEvent(pending.event);
+		if (err < 0)
+		{
+			success = false;
+			continue;
+		}
+
+		KernelTime* time = nullptr;
+		for (KernelTime& kernelTime : mTimes)
+		{
+			if (kernelTime.name == pending.name)
+			{
+				time = &kernelTime;
+				break;
+			}
+		}
+
+		if (!time)
+		{
+			mTimes.push_back({ pending.name });
+			time = &mTimes.back();
+		}
+
+		time->total_ns += end_ns - start_ns;
+		++time->launches;
+	}
+	mPending.clear();
+
+	if (!success)
+		perror("Couldn't read the kernel profiling info");
+	return success;
+}
+
+void KernelProfiler::Print() const
+{
+	cl_ulong total_ns = 0;
+	for (const KernelTime& time : mTimes)
+		total_ns += time.total_ns;
+
+	printf("%-24s  %10s  %12s  %12s  %8s\n", "kernel", "launches", "total (ms)", "avg (us)", "share");
+	for (const KernelTime& time : mTimes)
+	{
+		printf("%-24s  %10d  %12.3f  %12.3f  %7.1f%%\n",
+			   time.name.c_str(),
+			   time.launches,
+			   time.total_ns * 1e-6,
+			   time.launches > 0 ? time.total_ns * 1e-3 / time.launches : 0.0,
+			   total_ns > 0 ? 100.0 * time.total_ns / total_ns : 0.0);
+	}
+}
+
+void KernelProfiler::Reset()
+{
+	for (PendingEvent& pending : mPending)
+	{
+		if (pending.event)
+			clReleaseEvent(pending.event);
+	}
+	mPending.clear();
+	mTimes.clear();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "Cl/cl.h"
+
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Accumulates the device execution time of named kernels from the
+/// profiling info of their events. Every enqueue passes the event of Record,
+/// the completed events are folded into the per-kernel totals by Collect.
+/// The queues must be created with CL_QUEUE_PROFILING_ENABLE.
+/// </summary>
+class KernelProfiler
+{
+public:
+	/// <summary>
+	/// Enables or disables recording, disabled profilers hand out no events.
+	/// </summary>
+	void SetEnabled(bool enabled) { mEnabled = enabled; }
+
+	bool IsEnabled() const { return mEnabled; }
+
+	/// <summary>
+	/// Retrieves the event argument for the next enqueue of the named kernel.
+	/// </summary>
+	/// <param name="name">The kernel or pass name the time is accumulated under</param>
+	/// <returns>The event to enqueue with, valid until the next call, or NULL when disabled</returns>
+	cl_event* Record(const char* name);
+
+	/// <summary>
+	/// Adds the execution time of every recorded command to its kernel and
+	/// releases the events. The commands must have completed, e.g. after clFinish.
+	/// </summary>
+	/// <returns>True if the profiling info of every event was available</returns>
+	bool Collect();
+
+	/// <summary>
+	/// Prints the launches, total and average time and share of the total of every kernel.
+	/// </summary>
+	void Print() const;
+
+	/// <summary>
+	/// Clears the accumulated times and releases the pending events.
+	/// </summary>
+	void Reset();
+private:
+	struct PendingEvent
+	{
+		std::string name;
+		cl_event event = nullptr;
+	};
+
+	struct KernelTime
+	{
+		std::string name;
+		cl_ulong total_ns = 0;
+		int launches = 0;
+	};
+private:
+	bool mEnabled = false;
+
+	std::vector<PendingEvent> mPending;
+
+	// In order of the first launch
+	std::vector<KernelTime> mTimes;
+};
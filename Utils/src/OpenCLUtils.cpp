@@ -36,7 +36,7 @@ cl_device_id OpenCLUtils::create_device()
 	return dev;
 }
 
-cl_program OpenCLUtils::build_program(cl_context ctx, cl_device_id dev, const char* filename)
+cl_program OpenCLUtils::build_program(cl_context ctx, cl_device_id dev, const char* filename, const char* options)
 {
     cl_program program;
     FILE* program_handle;
@@ -81,7 +81,7 @@ cl_program OpenCLUtils::build_program(cl_context ctx, cl_device_id dev, const ch
     define a macro with the option -DMACRO=VALUE and turn off optimization
     with -cl-opt-disable.
     */
-    err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
+    err = clBuildProgram(program, 0, NULL, options, NULL, NULL);
     if (err < 0) 
     {
         /* Find size of log and print to std output */
@@ -24,8 +24,9 @@ public:
     /// <param name="ctx"></param>
     /// <param name="dev"></param>
     /// <param name="filename"></param>
+    /// <param name="options">Optional build options, e.g. "-DTILE_SIZE=16"</param>
     /// <returns></returns>
-    static cl_program build_program(cl_context ctx, cl_device_id dev, const char* filename);
+    static cl_program build_program(cl_context ctx, cl_device_id dev, const char* filename, const char* options = nullptr);
 
     static cl_mem create_input_buffer(cl_context context, void* dataPtr, size_t dataSize);
 
@@ -0,0 +1,288 @@
+#include "PointOps.h"
+
+#include "OpenCLUtils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+
+namespace
+{
+	constexpr std::array<float, 12> Identity_Matrix =
+	{
+		1.0f, 0.0f, 0.0f, 0.0f,
+		0.0f, 1.0f, 0.0f, 0.0f,
+		0.0f, 0.0f, 1.0f, 0.0f
+	};
+
+	uint8_t SaturateToByte(float value)
+	{
+		// Truncates like the (uchar) conversions used by the single-op kernels
+		return static_cast<uint8_t>(std::clamp(value, 0.0f, 255.0f));
+	}
+}
+
+PointOpStage::PointOpStage()
+	: matrix(Identity_Matrix)
+{
+	for (size_t i = 0; i < luts.size(); ++i)
+		luts[i] = static_cast<uint8_t>(i % 256);
+}
+
+PointOpChain::PointOpChain()
+{
+	Reset();
+}
+
+PointOpChain& PointOpChain::Brightness(float factor)
+{
+	return ChannelFunction([factor](uint8_t value)
+	{
+		return SaturateToByte(value * factor);
+	});
+}
+
+PointOpChain& PointOpChain::Contrast(float factor)
+{
+	return ChannelFunction([factor](uint8_t value)
+	{
+		return SaturateToByte((value - 128.0f) * factor + 128.0f);
+	});
+}
+
+PointOpChain& PointOpChain::Gamma(float gamma)
+{
+	const float inverseGamma = 1.0f / gamma;
+	return ChannelFunction([inverseGamma](uint8_t value)
+	{
+		return SaturateToByte(255.0f * std::pow(value / 255.0f, inverseGamma) + 0.5f);
+	});
+}
+
+PointOpChain& PointOpChain::Negative()
+{
+	return ChannelFunction([](uint8_t value)
+	{
+		return static_cast<uint8_t>(255 - value);
+	});
+}
+
+PointOpChain& PointOpChain::Threshold(uint8_t threshold)
+{
+	return ChannelFunction([threshold](uint8_t value)
+	{
+		return static_cast<uint8_t>(value > threshold ? 255 : 0);
+	});
+}
+
+PointOpChain& PointOpChain::Sepia()
+{
+	return ColorMatrix(
+	{
+		0.393f, 0.769f, 0.189f, 0.0f,
+		0.349f, 0.686f, 0.168f, 0.0f,
+		0.272f, 0.534f, 0.131f, 0.0f
+	});
+}
+
+PointOpChain& PointOpChain::Grayscale(float weightR, float weightG, float weightB)
+{
+	return ColorMatrix(
+	{
+		weightR, weightG, weightB, 0.0f,
+		weightR, weightG, weightB, 0.0f,
+		weightR, weightG, weightB, 0.0f
+	});
+}
+
+PointOpChain& PointOpChain::ColorMatrix(const std::array<float, 12>& matrix)
+{
+	// The result of a matrix saturates to bytes before the next operation, so a
+	// second matrix cannot be composed into the first without losing that clamp
+	if (mStages.back().hasMatrix)
+		mStages.emplace_back();
+
+	PointOpStage& stage = mStages.back();
+	stage.matrix = matrix;
+	stage.hasMatrix = true;
+	return *this;
+}
+
+PointOpChain& PointOpChain::ChannelFunction(const std::function<uint8_t(uint8_t)>& function)
+{
+	std::array<uint8_t, 3 * 256> luts;
+	for (size_t i = 0; i < luts.size(); ++i)
+		luts[i] = function(static_cast<uint8_t>(i % 256));
+
+	ApplyChannelLUTs(luts.data());
+	return *this;
+}
+
+PointOpChain& PointOpChain::Append(const PointOpChain& other)
+{
+	for (const PointOpStage& stage : other.mStages)
+	{
+		ApplyChannelLUTs(stage.luts.data());
+		if (stage.hasMatrix)
+			ColorMatrix(stage.matrix);
+		if (stage.hasPostLUT)
+			ApplyChannelLUTs(stage.luts.data() + 3 * 256);
+	}
+	return *this;
+}
+
+void PointOpChain::ApplyChannelLUTs(const uint8_t* luts)
+{
+	PointOpStage& stage = mStages.back();
+
+	// Before any matrix the tables fold into the pre LUT, after it into the post LUT
+	const size_t offset = stage.hasMatrix ? 3 * 256 : 0;
+	for (size_t c = 0; c < 3; ++c)
+	{
+		uint8_t* table = stage.luts.data() + offset + c * 256;
+		for (size_t i = 0; i < 256; ++i)
+			table[i] = luts[c * 256 + table[i]];
+	}
+
+	stage.hasPostLUT |= stage.hasMatrix;
+}
+
+void PointOpChain::Reset()
+{
+	mStages.clear();
+	mStages.emplace_back();
+}
+
+void PointOpChain::ApplyReference(const uint8_t* input, size_t numPixels, uint8_t* output) const
+{
+	for (size_t i = 0; i < numPixels; ++i)
+	{
+		uint8_t pixel[4] = { input[i * 4], input[i * 4 + 1], input[i * 4 + 2], input[i * 4 + 3] };
+		for (const PointOpStage& stage : mStages)
+		{
+			const float r = stage.luts[pixel[0]];
+			const float g = stage.luts[256 + pixel[1]];
+			const float b = stage.luts[512 + pixel[2]];
+
+			for (int c = 0; c < 3; ++c)
+			{
+				const float* row = &stage.matrix[c * 4];
+				const uint8_t value = SaturateToByte(row[0] * r + row[1] * g + row[2] * b + row[3]);
+				pixel[c] = stage.luts[(3 + c) * 256 + value];
+			}
+		}
+		std::copy(pixel, pixel + 4, output + i * 4);
+	}
+}
+
+bool PointOpEngine::Initialize(cl_context context, cl_device_id device)
+{
+	cl_int err = -1;
+
+	mContext = context;
+	mProgram = OpenCLUtils::build_program(context, device, "../Utils/shaders/point_ops.cl");
+	if (!mProgram)
+		return false;
+
+	mKernel = clCreateKernel(mProgram, "point_ops", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the point ops kernel");
+		return false;
+	}
+	return true;
+}
+
+bool PointOpEngine::Apply(cl_command_queue queue,
+						  const PointOpChain& chain,
+						  cl_mem input,
+						  int numPixels,
+						  cl_mem output)
+{
+	const std::vector<PointOpStage>& stages = chain.GetStages();
+
+	cl_int err = -1;
+
+	// Parameter buffers are kept between calls, one pair per stage
+	while (mMatrixBuffers.size() < stages.size())
+	{
+		mMatrixBuffers.push_back(clCreateBuffer(mContext, CL_MEM_READ_ONLY, sizeof(PointOpStage::matrix), NULL, &err));
+		mLUTBuffers.push_back(clCreateBuffer(mContext, CL_MEM_READ_ONLY, sizeof(PointOpStage::luts), NULL, &err));
+		if (err < 0)
+		{
+			perror("Couldn't create the point ops parameter buffers");
+			return false;
+		}
+	}
+
+	const size_t localSize = 256;
+	const size_t global = (static_cast<size_t>(numPixels) + localSize - 1) / localSize * localSize;
+
+	for (size_t i = 0; i < stages.size(); ++i)
+	{
+		// The parameters are only uploaded when the stage changed since the previous call
+		if (i >= mUploadedStages.size() || mUploadedStages[i].matrix != stages[i].matrix || mUploadedStages[i].luts != stages[i].luts)
+		{
+			err = clEnqueueWriteBuffer(queue, mMatrixBuffers[i], CL_TRUE, 0, sizeof(PointOpStage::matrix), stages[i].matrix.data(), 0, NULL, NULL);
+			err |= clEnqueueWriteBuffer(queue, mLUTBuffers[i], CL_TRUE, 0, sizeof(PointOpStage::luts), stages[i].luts.data(), 0, NULL, NULL);
+			if (err < 0)
+			{
+				perror("Couldn't write the point ops parameters");
+				mUploadedStages.clear();
+				return false;
+			}
+
+			if (i >= mUploadedStages.size())
+				mUploadedStages.resize(i + 1);
+			mUploadedStages[i] = stages[i];
+		}
+
+		cl_mem stageInput = (i == 0) ? input : output;
+
+		err = clSetKernelArg(mKernel, 0, sizeof(cl_mem), &stageInput);
+		err |= clSetKernelArg(mKernel, 1, sizeof(cl_mem), &mMatrixBuffers[i]);
+		err |= clSetKernelArg(mKernel, 2, sizeof(cl_mem), &mLUTBuffers[i]);
+		err |= clSetKernelArg(mKernel, 3, sizeof(int), &numPixels);
+		err |= clSetKernelArg(mKernel, 4, sizeof(cl_mem), &output);
+		if (err < 0)
+		{
+			perror("Couldn't create a point ops kernel argument");
+			return false;
+		}
+
+		err = clEnqueueNDRangeKernel(queue,
+									 mKernel,
+									 1,
+									 NULL,
+									 &global,
+									 &localSize,
+									 0,
+									 NULL,
+									 NULL);
+		if (err < 0)
+		{
+			perror("Couldn't enqueue the point ops kernel");
+			return false;
+		}
+	}
+	return true;
+}
+
+void PointOpEngine::Release()
+{
+	for (cl_mem buffer : mMatrixBuffers)
+		clReleaseMemObject(buffer);
+	for (cl_mem buffer : mLUTBuffers)
+		clReleaseMemObject(buffer);
+	mMatrixBuffers.clear();
+	mLUTBuffers.clear();
+	mUploadedStages.clear();
+
+	if (mKernel)
+		clReleaseKernel(mKernel);
+	if (mProgram)
+		clReleaseProgram(mProgram);
+
+	mKernel = nullptr;
+	mProgram = nullptr;
+}
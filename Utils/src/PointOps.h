@@ -0,0 +1,170 @@
+#pragma once
+
+#include "Cl/cl.h"
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+/// <summary>
+/// One fused pass of a point operation chain: a per-channel pre LUT, a 3x4
+/// affine color matrix and a per-channel post LUT.
+/// </summary>
+struct PointOpStage
+{
+public:
+	PointOpStage();
+public:
+	/// <summary>
+	/// Three rows of (r, g, b, offset).
+	/// </summary>
+	std::array<float, 12> matrix;
+
+	/// <summary>
+	/// Pre R, G, B followed by post R, G, B tables of 256 entries each.
+	/// </summary>
+	std::array<uint8_t, 6 * 256> luts;
+
+	bool hasMatrix = false;
+	bool hasPostLUT = false;
+};
+
+/// <summary>
+/// Host-side builder composing a chain of point operations on RGBA pixels
+/// into as few fused stages as possible. Per-channel operations fold into a
+/// LUT and cross-channel operations into the color matrix. Every stage holds
+/// at most one matrix, since the operations saturate to bytes between steps
+/// and two composed matrices would skip that clamp, so the fused stages give
+/// the same result as applying the operations one at a time.
+/// </summary>
+class PointOpChain
+{
+public:
+	PointOpChain();
+public:
+	/// <summary>
+	/// Scales every channel by the factor.
+	/// </summary>
+	PointOpChain& Brightness(float factor);
+
+	/// <summary>
+	/// Scales every channel around mid-gray by the factor.
+	/// </summary>
+	PointOpChain& Contrast(float factor);
+
+	/// <summary>
+	/// Applies the gamma correction out = 255 * (in / 255)^(1 / gamma).
+	/// </summary>
+	PointOpChain& Gamma(float gamma);
+
+	/// <summary>
+	/// Inverts every channel.
+	/// </summary>
+	PointOpChain& Negative();
+
+	/// <summary>
+	/// Sets every channel to 255 when above the value, 0 otherwise.
+	/// </summary>
+	PointOpChain& Threshold(uint8_t value);
+
+	/// <summary>
+	/// Applies the classic sepia tone matrix.
+	/// </summary>
+	PointOpChain& Sepia();
+
+	/// <summary>
+	/// Replaces every channel by the luminance using the given weights
+	/// (defaults to BT.601).
+	/// </summary>
+	PointOpChain& Grayscale(float weightR = 0.299f, float weightG = 0.587f, float weightB = 0.114f);
+
+	/// <summary>
+	/// Applies an arbitrary 3x4 affine color matrix given as three rows of (r, g, b, offset).
+	/// </summary>
+	PointOpChain& ColorMatrix(const std::array<float, 12>& matrix);
+
+	/// <summary>
+	/// Applies an arbitrary function to every channel value.
+	/// </summary>
+	PointOpChain& ChannelFunction(const std::function<uint8_t(uint8_t)>& function);
+
+	/// <summary>
+	/// Appends every operation of another chain to this one.
+	/// </summary>
+	PointOpChain& Append(const PointOpChain& other);
+
+	/// <summary>
+	/// Clears the chain back to the identity.
+	/// </summary>
+	void Reset();
+
+	/// <summary>
+	/// Retrieves the fused stages, each costing a single pass over the image.
+	/// </summary>
+	/// <returns>The fused stages</returns>
+	const std::vector<PointOpStage>& GetStages() const { return mStages; }
+
+	/// <summary>
+	/// Applies the chain on the host, mirroring the device kernel (up to
+	/// floating point contraction in the color matrix).
+	/// </summary>
+	/// <param name="input">RGBA pixels</param>
+	/// <param name="numPixels">The number of pixels</param>
+	/// <param name="output">RGBA pixels receiving the result</param>
+	void ApplyReference(const uint8_t* input, size_t numPixels, uint8_t* output) const;
+private:
+	/// <summary>
+	/// Folds per-channel tables (R, G, B, 256 entries each) into the chain.
+	/// </summary>
+	void ApplyChannelLUTs(const uint8_t* luts);
+private:
+	std::vector<PointOpStage> mStages;
+};
+
+/// <summary>
+/// Device-side executor of a PointOpChain.
+/// </summary>
+class PointOpEngine
+{
+public:
+	/// <summary>
+	/// Builds the point operation program and creates its kernel.
+	/// </summary>
+	/// <param name="context">The OpenCL context</param>
+	/// <param name="device">The device to build the program for</param>
+	/// <returns>True if the kernel was created successfully</returns>
+	bool Initialize(cl_context context, cl_device_id device);
+
+	/// <summary>
+	/// Enqueues the fused stages of the chain. The first stage reads the
+	/// input and writes the output, further stages run in place on the output.
+	/// The stage parameters are only uploaded when they changed since the last call.
+	/// </summary>
+	/// <param name="queue">The command queue to enqueue the passes on</param>
+	/// <param name="chain">The chain to apply</param>
+	/// <param name="input">Buffer of RGBA pixels</param>
+	/// <param name="numPixels">The number of pixels</param>
+	/// <param name="output">Buffer of RGBA pixels receiving the result</param>
+	/// <returns>True if every stage was enqueued successfully</returns>
+	bool Apply(cl_command_queue queue,
+			   const PointOpChain& chain,
+			   cl_mem input,
+			   int numPixels,
+			   cl_mem output);
+
+	/// <summary>
+	/// Releases the kernel, program and parameter buffers.
+	/// </summary>
+	void Release();
+private:
+	cl_context mContext = nullptr;
+	cl_program mProgram = nullptr;
+	cl_kernel mKernel = nullptr;
+
+	std::vector<cl_mem> mMatrixBuffers;
+	std::vector<cl_mem> mLUTBuffers;
+
+	// Host copy of the parameters in the buffers, to skip the upload of unchanged stages
+	std::vector<PointOpStage> mUploadedStages;
+};
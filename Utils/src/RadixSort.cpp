@@ -0,0 +1,187 @@
+#include "RadixSort.h"
+
+#include "OpenCLUtils.h"
+
+#include <string>
+#include <utility>
+#include <stdio.h>
+
+bool RadixSort::Initialize(cl_context context, cl_device_id device)
+{
+	cl_int err = -1;
+
+	mContext = context;
+
+	const std::string options = "-DRADIX_GROUP_SIZE=" + std::to_string(Group_Size) +
+								" -DRADIX_ITEMS=" + std::to_string(Items_Per_Work_Item);
+	mProgram = OpenCLUtils::build_program(context, device, "../Utils/shaders/radix_sort.cl", options.c_str());
+	if (!mProgram)
+		return false;
+
+	const std::pair<cl_kernel*, const char*> kernels[] =
+	{
+		{ &mHistogramKernel, "radix_histogram" },
+		{ &mScatterKernel, "radix_scatter" }
+	};
+
+	for (const auto& [kernel, name] : kernels)
+	{
+		*kernel = clCreateKernel(mProgram, name, &err);
+		if (err < 0)
+		{
+			printf("Couldn't create the %s kernel\n", name);
+			return false;
+		}
+	}
+	return mScan.Initialize(context, device);
+}
+
+int RadixSort::GetKeyBits(cl_uint maxKey)
+{
+	int bits = 0;
+	while (bits < 32 && (maxKey >> bits) != 0)
+		++bits;
+	return bits;
+}
+
+bool RadixSort::Reserve(int n, bool withValues)
+{
+	cl_int err = CL_SUCCESS;
+
+	const size_t count = n;
+	if (count > mKeyCapacity)
+	{
+		if (mTempKeys)
+			clReleaseMemObject(mTempKeys);
+		if (mHistograms)
+			clReleaseMemObject(mHistograms);
+
+		const size_t numGroups = (count + Block_Size - 1) / Block_Size;
+		const size_t histogramSize = Radix_Buckets * numGroups;
+
+		cl_int bufferErr = -1;
+		mTempKeys = clCreateBuffer(mContext, CL_MEM_READ_WRITE, count * sizeof(cl_uint), NULL, &bufferErr);
+		err |= bufferErr;
+		mHistograms = clCreateBuffer(mContext, CL_MEM_READ_WRITE, histogramSize * sizeof(cl_uint), NULL, &bufferErr);
+		err |= bufferErr;
+		mKeyCapacity = count;
+	}
+
+	if (withValues && count > mValueCapacity)
+	{
+		if (mTempValues)
+			clReleaseMemObject(mTempValues);
+
+		cl_int bufferErr = -1;
+		mTempValues = clCreateBuffer(mContext, CL_MEM_READ_WRITE, count * sizeof(cl_uint), NULL, &bufferErr);
+		err |= bufferErr;
+		mValueCapacity = count;
+	}
+
+	if (err < 0)
+	{
+		perror("Couldn't create the radix sort buffers");
+		return false;
+	}
+	return true;
+}
+
+bool RadixSort::Sort(cl_command_queue queue, cl_mem keys, cl_mem values, int n, int keyBits)
+{
+	if (n <= 1 || keyBits <= 0)
+		return true;
+
+	if (!Reserve(n, values != nullptr))
+		return false;
+
+	const size_t numGroups = (static_cast<size_t>(n) + Block_Size - 1) / Block_Size;
+	const size_t global = numGroups * Group_Size;
+	const size_t local = Group_Size;
+	const int histogramSize = static_cast<int>(Radix_Buckets * numGroups);
+	const int numPasses = (keyBits + Radix_Bits - 1) / Radix_Bits;
+
+	cl_mem sourceKeys = keys;
+	cl_mem sourceValues = values;
+	cl_mem targetKeys = mTempKeys;
+	cl_mem targetValues = values ? mTempValues : nullptr;
+
+	for (int pass = 0; pass < numPasses; ++pass)
+	{
+		const int shift = pass * Radix_Bits;
+
+		cl_int err = clSetKernelArg(mHistogramKernel, 0, sizeof(cl_mem), &sourceKeys);
+		err |= clSetKernelArg(mHistogramKernel, 1, sizeof(int), &n);
+		err |= clSetKernelArg(mHistogramKernel, 2, sizeof(int), &shift);
+		err |= clSetKernelArg(mHistogramKernel, 3, sizeof(cl_mem), &mHistograms);
+
+		err |= clSetKernelArg(mScatterKernel, 0, sizeof(cl_mem), &sourceKeys);
+		err |= clSetKernelArg(mScatterKernel, 1, sizeof(cl_mem), &sourceValues);
+		err |= clSetKernelArg(mScatterKernel, 2, sizeof(int), &n);
+		err |= clSetKernelArg(mScatterKernel, 3, sizeof(int), &shift);
+		err |= clSetKernelArg(mScatterKernel, 4, sizeof(cl_mem), &mHistograms);
+		err |= clSetKernelArg(mScatterKernel, 5, sizeof(cl_mem), &targetKeys);
+		err |= clSetKernelArg(mScatterKernel, 6, sizeof(cl_mem), &targetValues);
+		if (err < 0)
+		{
+			perror("Couldn't create a radix sort kernel argument");
+			return false;
+		}
+
+		err = clEnqueueNDRangeKernel(queue, mHistogramKernel, 1, NULL, &global, &local, 0, NULL, NULL);
+		if (err < 0 || !mScan.Exclusive(queue, ElementType::UInt, mHistograms, histogramSize, mHistograms))
+		{
+			perror("Couldn't enqueue the radix histogram");
+			return false;
+		}
+
+		err = clEnqueueNDRangeKernel(queue, mScatterKernel, 1, NULL, &global, &local, 0, NULL, NULL);
+		if (err < 0)
+		{
+			perror("Couldn't enqueue the radix scatter kernel");
+			return false;
+		}
+
+		std::swap(sourceKeys, targetKeys);
+		std::swap(sourceValues, targetValues);
+	}
+
+	// After an odd number of passes the result is in the scratch buffers
+	if (sourceKeys != keys)
+	{
+		const size_t bytes = static_cast<size_t>(n) * sizeof(cl_uint);
+		cl_int err = clEnqueueCopyBuffer(queue, sourceKeys, keys, 0, 0, bytes, 0, NULL, NULL);
+		if (values)
+			err |= clEnqueueCopyBuffer(queue, sourceValues, values, 0, 0, bytes, 0, NULL, NULL);
+		if (err < 0)
+		{
+			perror("Couldn't copy the sorted keys");
+			return false;
+		}
+	}
+	return true;
+}
+
+void RadixSort::Release()
+{
+	for (cl_mem* buffer : { &mTempKeys, &mTempValues, &mHistograms })
+	{
+		if (*buffer)
+			clReleaseMemObject(*buffer);
+		*buffer = nullptr;
+	}
+	mKeyCapacity = 0;
+	mValueCapacity = 0;
+
+	for (cl_kernel* kernel : { &mHistogramKernel, &mScatterKernel })
+	{
+		if (*kernel)
+			clReleaseKernel(*kernel);
+		*kernel = nullptr;
+	}
+
+	if (mProgram)
+		clReleaseProgram(mProgram);
+	mProgram = nullptr;
+
+	mScan.Release();
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Cl/cl.h"
+
+#include "Scan.h"
+
+/// <summary>
+/// Stable device LSD radix sort of 32-bit unsigned keys with optional 32-bit
+/// values, 4 bits per pass. Each pass builds per-block digit histograms in
+/// local memory, scans them with a multi-level global prefix scan and
+/// scatters every block with a local ranking that preserves the input order
+/// of equal keys. Scratch buffers are kept between calls.
+/// </summary>
+class RadixSort
+{
+public:
+	/// <summary>
+	/// Builds the sort and scan programs and creates the kernels.
+	/// </summary>
+	/// <param name="context">The OpenCL context</param>
+	/// <param name="device">The device to build the program for</param>
+	/// <returns>True if the kernels were created successfully</returns>
+	bool Initialize(cl_context context, cl_device_id device);
+
+	/// <summary>
+	/// Enqueues the sort of the keys, and the values along with them, in place.
+	/// </summary>
+	/// <param name="queue">The command queue to enqueue the passes on</param>
+	/// <param name="keys">Buffer of n uint keys</param>
+	/// <param name="values">Buffer of n uint values, or nullptr to sort the keys only</param>
+	/// <param name="n">The number of keys</param>
+	/// <param name="keyBits">Only the lowest keyBits bits are sorted on, the higher bits must be zero</param>
+	/// <returns>True if every pass was enqueued successfully</returns>
+	bool Sort(cl_command_queue queue, cl_mem keys, cl_mem values, int n, int keyBits = 32);
+
+	/// <summary>
+	/// Releases the scratch buffers, kernels and programs.
+	/// </summary>
+	void Release();
+public:
+	/// <summary>
+	/// Retrieves the number of bits needed to represent keys up to maxKey,
+	/// so that sorts of small keys can skip the passes over the zero bits.
+	/// </summary>
+	static int GetKeyBits(cl_uint maxKey);
+private:
+	/// <summary>
+	/// Ensures the scratch buffers hold n keys, and values if requested.
+	/// </summary>
+	bool Reserve(int n, bool withValues);
+private:
+	static constexpr int Group_Size = 128;
+	static constexpr int Items_Per_Work_Item = 8;
+	static constexpr int Radix_Bits = 4;
+	static constexpr int Radix_Buckets = 1 << Radix_Bits;
+	static constexpr int Block_Size = Group_Size * Items_Per_Work_Item;
+
+	cl_context mContext = nullptr;
+	cl_program mProgram = nullptr;
+	cl_kernel mHistogramKernel = nullptr;
+	cl_kernel mScatterKernel = nullptr;
+
+	cl_mem mTempKeys = nullptr;
+	cl_mem mTempValues = nullptr;
+	cl_mem mHistograms = nullptr;
+	size_t mKeyCapacity = 0;
+	size_t mValueCapacity = 0;
+
+	Scan mScan;
+};
@@ -0,0 +1,169 @@
+#include "Rasterizer.h"
+
+#include "OpenCLUtils.h"
+
+#include <stdio.h>
+
+namespace
+{
+	cl_float4 ToColor(const cv::Scalar& color)
+	{
+		return { { static_cast<float>(color[0]), static_cast<float>(color[1]), static_cast<float>(color[2]), static_cast<float>(color[3]) } };
+	}
+}
+
+bool Rasterizer::Initialize(cl_context context, cl_device_id device)
+{
+	cl_int err = -1;
+
+	mContext = context;
+
+	mProgram = OpenCLUtils::build_program(context, device, "../Utils/shaders/raster.cl");
+	if (!mProgram)
+		return false;
+
+	mClearKernel = clCreateKernel(mProgram, "clear_ids", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the raster clear kernel");
+		return false;
+	}
+
+	mRasterKernel = clCreateKernel(mProgram, "raster_entities", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the raster kernel");
+		return false;
+	}
+
+	mResolveKernel = clCreateKernel(mProgram, "resolve_frame", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the raster resolve kernel");
+		return false;
+	}
+	return true;
+}
+
+bool Rasterizer::Reserve(int numPixels)
+{
+	if (numPixels <= mCapacity)
+		return true;
+
+	if (mIds)
+		clReleaseMemObject(mIds);
+	if (mFrame)
+		clReleaseMemObject(mFrame);
+	mCapacity = 0;
+
+	cl_int err = -1;
+	cl_int frameErr = -1;
+	mIds = clCreateBuffer(mContext, CL_MEM_READ_WRITE, numPixels * sizeof(cl_uint), NULL, &err);
+	mFrame = clCreateBuffer(mContext, CL_MEM_WRITE_ONLY, numPixels * sizeof(cl_uchar4), NULL, &frameErr);
+	if (err < 0 || frameErr < 0)
+	{
+		perror("Couldn't create the raster buffers");
+		return false;
+	}
+
+	mCapacity = numPixels;
+	return true;
+}
+
+bool Rasterizer::Draw(cl_command_queue queue, const Entities& entities, const Style& style, int width, int height, float rewind)
+{
+	const int numPixels = width * height;
+	if (!Reserve(numPixels))
+		return false;
+	mWidth = width;
+	mHeight = height;
+
+	const size_t pixelsGlobal = numPixels;
+
+	cl_int err = clSetKernelArg(mClearKernel, 0, sizeof(cl_mem), &mIds);
+	err |= clSetKernelArg(mClearKernel, 1, sizeof(int), &numPixels);
+	err |= clEnqueueNDRangeKernel(queue, mClearKernel, 1, NULL, &pixelsGlobal, NULL, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the raster clear kernel");
+		return false;
+	}
+
+	if (entities.count > 0)
+	{
+		const size_t entitiesGlobal = entities.count;
+		err = clSetKernelArg(mRasterKernel, 0, sizeof(cl_mem), &entities.positions);
+		err |= clSetKernelArg(mRasterKernel, 1, sizeof(int), &entities.positionStride);
+		err |= clSetKernelArg(mRasterKernel, 2, sizeof(cl_mem), &entities.velocities);
+		err |= clSetKernelArg(mRasterKernel, 3, sizeof(cl_mem), &entities.radii);
+		err |= clSetKernelArg(mRasterKernel, 4, sizeof(int), &entities.radiusOffset);
+		err |= clSetKernelArg(mRasterKernel, 5, sizeof(float), &entities.radius);
+		err |= clSetKernelArg(mRasterKernel, 6, sizeof(int), &entities.count);
+		err |= clSetKernelArg(mRasterKernel, 7, sizeof(float), &rewind);
+		err |= clSetKernelArg(mRasterKernel, 8, sizeof(int), &style.discThickness);
+		err |= clSetKernelArg(mRasterKernel, 9, sizeof(int), &style.lineThickness);
+		err |= clSetKernelArg(mRasterKernel, 10, sizeof(int), &width);
+		err |= clSetKernelArg(mRasterKernel, 11, sizeof(int), &height);
+		err |= clSetKernelArg(mRasterKernel, 12, sizeof(cl_mem), &mIds);
+		err |= clEnqueueNDRangeKernel(queue, mRasterKernel, 1, NULL, &entitiesGlobal, NULL, 0, NULL, NULL);
+		if (err < 0)
+		{
+			perror("Couldn't enqueue the raster kernel");
+			return false;
+		}
+	}
+
+	const cl_float4 background = ToColor(style.background);
+	const cl_float4 discColor = ToColor(style.discColor);
+	const cl_float4 lineColor = ToColor(style.lineColor);
+
+	err = clSetKernelArg(mResolveKernel, 0, sizeof(cl_mem), &mIds);
+	err |= clSetKernelArg(mResolveKernel, 1, sizeof(int), &numPixels);
+	err |= clSetKernelArg(mResolveKernel, 2, sizeof(cl_mem), &entities.velocities);
+	err |= clSetKernelArg(mResolveKernel, 3, sizeof(cl_float4), &background);
+	err |= clSetKernelArg(mResolveKernel, 4, sizeof(cl_float4), &discColor);
+	err |= clSetKernelArg(mResolveKernel, 5, sizeof(cl_float4), &lineColor);
+	err |= clSetKernelArg(mResolveKernel, 6, sizeof(cl_mem), &mFrame);
+	err |= clEnqueueNDRangeKernel(queue, mResolveKernel, 1, NULL, &pixelsGlobal, NULL, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the raster resolve kernel");
+		return false;
+	}
+	return true;
+}
+
+bool Rasterizer::Read(cl_command_queue queue, cv::Mat& image)
+{
+	image.create(mHeight, mWidth, CV_8UC4);
+
+	cl_int err = clEnqueueReadBuffer(queue, mFrame, CL_TRUE, 0, static_cast<size_t>(mWidth) * mHeight * sizeof(cl_uchar4), image.data, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't read the raster frame");
+		return false;
+	}
+	return true;
+}
+
+void Rasterizer::Release()
+{
+	if (mIds)
+		clReleaseMemObject(mIds);
+	if (mFrame)
+		clReleaseMemObject(mFrame);
+	mIds = nullptr;
+	mFrame = nullptr;
+	mCapacity = 0;
+
+	for (cl_kernel* kernel : { &mClearKernel, &mRasterKernel, &mResolveKernel })
+	{
+		if (*kernel)
+			clReleaseKernel(*kernel);
+		*kernel = nullptr;
+	}
+
+	if (mProgram)
+		clReleaseProgram(mProgram);
+	mProgram = nullptr;
+}
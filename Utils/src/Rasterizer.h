@@ -0,0 +1,106 @@
+#pragma once
+
+#include "Cl/cl.h"
+
+#include <opencv2/opencv.hpp>
+
+/// <summary>
+/// Draws 2D entities as discs with optional velocity lines into a device
+/// BGRA framebuffer, so simulations only read back the finished image
+/// instead of every position and velocity. Entities splat their ids into
+/// a per-pixel buffer with atomics and a resolve pass turns the ids into
+/// colors, keeping the host drawing order of one entity after another.
+/// </summary>
+class Rasterizer
+{
+public:
+	/// <summary>
+	/// The device buffers of the entities to draw.
+	/// </summary>
+	struct Entities
+	{
+		// Floats per entity, the first two are x and y
+		cl_mem positions = nullptr;
+		int positionStride = 2;
+
+		// Optional float2 per entity, needed for lines and rewinding
+		cl_mem velocities = nullptr;
+
+		// Optional float per entity, else the float at radiusOffset within each
+		// position entry when it is not negative, else the constant radius
+		cl_mem radii = nullptr;
+		int radiusOffset = -1;
+		float radius = 1.0f;
+
+		int count = 0;
+	};
+
+	/// <summary>
+	/// The colors and thicknesses to draw with, following the cv::circle and cv::line conventions.
+	/// </summary>
+	struct Style
+	{
+		cv::Scalar background;
+		cv::Scalar discColor;
+		// Tinted by the entity's speed
+		cv::Scalar lineColor;
+
+		// Negative for filled discs
+		int discThickness = -1;
+		// 0 for no velocity lines
+		int lineThickness = 0;
+	};
+public:
+	/// <summary>
+	/// Builds the raster program and creates the kernels.
+	/// </summary>
+	/// <param name="context">The OpenCL context</param>
+	/// <param name="device">The device to build the program for</param>
+	/// <returns>True if the kernels were created successfully</returns>
+	bool Initialize(cl_context context, cl_device_id device);
+
+	/// <summary>
+	/// Enqueues the clear, raster and resolve passes of a frame.
+	/// </summary>
+	/// <param name="queue">The command queue to enqueue the passes on</param>
+	/// <param name="entities">The entities to draw</param>
+	/// <param name="style">The colors and thicknesses</param>
+	/// <param name="width">The framebuffer width</param>
+	/// <param name="height">The framebuffer height</param>
+	/// <param name="rewind">Time to move every entity back along its velocity, for interpolated rendering</param>
+	/// <returns>True if every pass was enqueued successfully</returns>
+	bool Draw(cl_command_queue queue, const Entities& entities, const Style& style, int width, int height, float rewind = 0.0f);
+
+	/// <summary>
+	/// Reads the framebuffer of the last Draw into the image and waits for it.
+	/// </summary>
+	/// <param name="queue">The command queue Draw was enqueued on</param>
+	/// <param name="image">Receives the frame, reallocated as CV_8UC4 if needed</param>
+	/// <returns>True if the frame was read successfully</returns>
+	bool Read(cl_command_queue queue, cv::Mat& image);
+
+	/// <summary>
+	/// Releases the framebuffers, kernels and program.
+	/// </summary>
+	void Release();
+private:
+	/// <summary>
+	/// Ensures the framebuffers hold the given number of pixels.
+	/// </summary>
+	bool Reserve(int numPixels);
+private:
+	cl_context mContext = nullptr;
+	cl_program mProgram = nullptr;
+
+	cl_kernel mClearKernel = nullptr;
+	cl_kernel mRasterKernel = nullptr;
+	cl_kernel mResolveKernel = nullptr;
+
+	int mWidth = 0;
+	int mHeight = 0;
+	int mCapacity = 0;
+
+	// Winning entity id per pixel and the resolved BGRA frame
+	cl_mem mIds = nullptr;
+	cl_mem mFrame = nullptr;
+};
@@ -0,0 +1,25 @@
+#include "RateCounter.h"
+
+RateCounter::RateCounter(double window_s)
+	: mTimer(true)
+	, mWindow_s(window_s)
+{
+}
+
+bool RateCounter::AddFrame(int numSteps)
+{
+	++mFrames;
+	mSteps += numSteps;
+
+	const double elapsed_s = mTimer.Elapsed_s();
+	if (elapsed_s < mWindow_s)
+		return false;
+
+	mStepsPerSecond = mSteps / elapsed_s;
+	mFramesPerSecond = mFrames / elapsed_s;
+
+	mFrames = 0;
+	mSteps = 0;
+	mTimer.Start();
+	return true;
+}
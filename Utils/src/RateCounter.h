@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Timer.h"
+
+/// <summary>
+/// Measures the rendered frames and simulated steps per second of a
+/// simulation loop, averaged over a fixed wall-clock window so the two rates
+/// can be reported separately when several steps run per frame.
+/// </summary>
+class RateCounter
+{
+public:
+	/// <summary>
+	/// Constructor initializing a RateCounter.
+	/// </summary>
+	/// <param name="window_s">The averaging window in seconds</param>
+	RateCounter(double window_s = 1.0);
+
+	/// <summary>
+	/// Records a rendered frame and the simulation steps run for it.
+	/// </summary>
+	/// <param name="numSteps">The number of steps simulated since the last frame</param>
+	/// <returns>True if the window elapsed and the rates were updated</returns>
+	bool AddFrame(int numSteps);
+
+	/// <summary>
+	/// Retrieves the simulated steps per second over the last complete window.
+	/// </summary>
+	double GetStepsPerSecond() const { return mStepsPerSecond; }
+
+	/// <summary>
+	/// Retrieves the rendered frames per second over the last complete window.
+	/// </summary>
+	double GetFramesPerSecond() const { return mFramesPerSecond; }
+private:
+	Timer mTimer;
+	double mWindow_s;
+
+	int mFrames = 0;
+	long long mSteps = 0;
+
+	double mStepsPerSecond = 0.0;
+	double mFramesPerSecond = 0.0;
+};
@@ -0,0 +1,205 @@
+#include "Reduce.h"
+
+#include "OpenCLUtils.h"
+
+#include <algorithm>
+#include <string>
+#include <stdio.h>
+
+bool Reduce::Initialize(cl_context context, cl_device_id device)
+{
+	cl_int err = -1;
+
+	mContext = context;
+
+	const char* kernelNames[Num_Ops] = { "reduce_sum", "reduce_min", "reduce_max", "reduce_argmax" };
+
+	// The tree reductions require a power of two work-group size that every kernel supports
+	size_t maxGroupSize = Max_Group_Size;
+	for (int type = 0; type < Num_Element_Types; ++type)
+	{
+		const std::string options = std::string(GetElementTypeOptions(static_cast<ElementType>(type))) +
+									" -DREDUCE_ITEMS=" + std::to_string(Items_Per_Work_Item);
+		mPrograms[type] = OpenCLUtils::build_program(context, device, "../Utils/shaders/reduce.cl", options.c_str());
+		if (!mPrograms[type])
+			return false;
+
+		for (int op = 0; op < Num_Ops; ++op)
+		{
+			mKernels[type][op] = clCreateKernel(mPrograms[type], kernelNames[op], &err);
+			if (err < 0)
+			{
+				printf("Couldn't create the %s kernel\n", kernelNames[op]);
+				return false;
+			}
+
+			size_t kernelGroupSize = 0;
+			clGetKernelWorkGroupInfo(mKernels[type][op], device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernelGroupSize, NULL);
+			maxGroupSize = std::min(maxGroupSize, kernelGroupSize);
+		}
+	}
+
+	mGroupSize = 1;
+	while (mGroupSize * 2 <= maxGroupSize)
+		mGroupSize *= 2;
+
+	mResult = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint), NULL, &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the reduction result buffer");
+		return false;
+	}
+	return true;
+}
+
+int Reduce::GetNumGroups(int n) const
+{
+	const size_t blockSize = mGroupSize * Items_Per_Work_Item;
+	return static_cast<int>((static_cast<size_t>(n) + blockSize - 1) / blockSize);
+}
+
+bool Reduce::Reserve(int n)
+{
+	if (n <= mCapacity)
+		return true;
+
+	for (std::vector<cl_mem>* buffers : { &mPartialValues, &mPartialIndices })
+	{
+		for (cl_mem buffer : *buffers)
+			clReleaseMemObject(buffer);
+		buffers->clear();
+	}
+	mCapacity = 0;
+
+	cl_int err = CL_SUCCESS;
+
+	// One level of partials per pass until a single group remains, the last pass writes the result
+	for (int levelSize = GetNumGroups(n); levelSize > 1; levelSize = GetNumGroups(levelSize))
+	{
+		cl_int bufferErr = -1;
+		mPartialValues.push_back(clCreateBuffer(mContext, CL_MEM_READ_WRITE, levelSize * sizeof(cl_uint), NULL, &bufferErr));
+		err |= bufferErr;
+		mPartialIndices.push_back(clCreateBuffer(mContext, CL_MEM_READ_WRITE, levelSize * sizeof(cl_int), NULL, &bufferErr));
+		err |= bufferErr;
+	}
+
+	if (err < 0)
+	{
+		perror("Couldn't create the reduction buffers");
+		return false;
+	}
+
+	mCapacity = n;
+	return true;
+}
+
+bool Reduce::Enqueue(cl_command_queue queue, ReduceOp op, ElementType type, cl_mem input, int n, cl_mem result)
+{
+	if (n <= 0)
+	{
+		printf("Can't reduce an empty array\n");
+		return false;
+	}
+
+	if (!Reserve(n))
+		return false;
+
+	const bool argMax = (op == ReduceOp::ArgMax);
+	cl_kernel kernel = mKernels[static_cast<int>(type)][static_cast<int>(op)];
+
+	cl_mem levelValues = input;
+	cl_mem levelIndices = nullptr;
+	int count = n;
+
+	for (size_t level = 0; ; ++level)
+	{
+		const int numGroups = GetNumGroups(count);
+		const bool last = (numGroups == 1);
+		const size_t global = numGroups * mGroupSize;
+
+		cl_mem outputValues = last ? (argMax ? nullptr : result) : mPartialValues[level];
+		cl_mem outputIndices = last ? result : mPartialIndices[level];
+
+		cl_int err = CL_SUCCESS;
+		if (argMax)
+		{
+			err |= clSetKernelArg(kernel, 0, sizeof(cl_mem), &levelValues);
+			err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &levelIndices);
+			err |= clSetKernelArg(kernel, 2, sizeof(int), &count);
+			err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &outputValues);
+			err |= clSetKernelArg(kernel, 4, sizeof(cl_mem), &outputIndices);
+			err |= clSetKernelArg(kernel, 5, mGroupSize * sizeof(cl_uint), NULL);
+			err |= clSetKernelArg(kernel, 6, mGroupSize * sizeof(cl_int), NULL);
+		}
+		else
+		{
+			err |= clSetKernelArg(kernel, 0, sizeof(cl_mem), &levelValues);
+			err |= clSetKernelArg(kernel, 1, sizeof(int), &count);
+			err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &outputValues);
+			err |= clSetKernelArg(kernel, 3, mGroupSize * sizeof(cl_uint), NULL);
+		}
+		if (err < 0)
+		{
+			perror("Couldn't create a reduction kernel argument");
+			return false;
+		}
+
+		err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global, &mGroupSize, 0, NULL, NULL);
+		if (err < 0)
+		{
+			perror("Couldn't enqueue the reduction kernel");
+			return false;
+		}
+
+		if (last)
+			return true;
+
+		levelValues = outputValues;
+		levelIndices = outputIndices;
+		count = numGroups;
+	}
+}
+
+bool Reduce::Run(cl_command_queue queue, ReduceOp op, ElementType type, cl_mem input, int n, void* result)
+{
+	if (!Enqueue(queue, op, type, input, n, mResult))
+		return false;
+
+	// Every element type and the argmax index are 32 bits wide
+	cl_int err = clEnqueueReadBuffer(queue, mResult, CL_TRUE, 0, sizeof(cl_uint), result, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't read the reduction result");
+		return false;
+	}
+	return true;
+}
+
+void Reduce::Release()
+{
+	for (std::vector<cl_mem>* buffers : { &mPartialValues, &mPartialIndices })
+	{
+		for (cl_mem buffer : *buffers)
+			clReleaseMemObject(buffer);
+		buffers->clear();
+	}
+	mCapacity = 0;
+
+	if (mResult)
+		clReleaseMemObject(mResult);
+	mResult = nullptr;
+
+	for (int type = 0; type < Num_Element_Types; ++type)
+	{
+		for (cl_kernel& kernel : mKernels[type])
+		{
+			if (kernel)
+				clReleaseKernel(kernel);
+			kernel = nullptr;
+		}
+
+		if (mPrograms[type])
+			clReleaseProgram(mPrograms[type]);
+		mPrograms[type] = nullptr;
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Cl/cl.h"
+
+#include "ElementType.h"
+
+#include <vector>
+
+/// <summary>
+/// The reductions supported by Reduce.
+/// </summary>
+enum class ReduceOp
+{
+	Sum,
+	Min,
+	Max,
+	ArgMax
+};
+
+/// <summary>
+/// Device tree reductions of int, uint or float arrays of any length.
+/// Every work-group reduces a block of values to one partial result in
+/// local memory, and the partials are reduced again level by level until a
+/// single value remains. Scratch buffers are kept between calls.
+/// </summary>
+class Reduce
+{
+public:
+	/// <summary>
+	/// Builds the reduction program for every element type and creates the kernels.
+	/// </summary>
+	/// <param name="context">The OpenCL context</param>
+	/// <param name="device">The device to build the programs for</param>
+	/// <returns>True if the kernels were created successfully</returns>
+	bool Initialize(cl_context context, cl_device_id device);
+
+	/// <summary>
+	/// Enqueues the reduction of the input into a device buffer, without waiting for it.
+	/// </summary>
+	/// <param name="queue">The command queue to enqueue the passes on</param>
+	/// <param name="op">The reduction</param>
+	/// <param name="type">The element type of the input</param>
+	/// <param name="input">Buffer of n values</param>
+	/// <param name="n">The number of values, at least 1</param>
+	/// <param name="result">Buffer receiving one value, or the int index of the first largest value for ArgMax</param>
+	/// <returns>True if every pass was enqueued successfully</returns>
+	bool Enqueue(cl_command_queue queue, ReduceOp op, ElementType type, cl_mem input, int n, cl_mem result);
+
+	/// <summary>
+	/// Reduces the input and reads the result back.
+	/// </summary>
+	/// <param name="result">Receives one value of the element type, or a cl_int index for ArgMax</param>
+	/// <returns>True if the reduction succeeded</returns>
+	bool Run(cl_command_queue queue, ReduceOp op, ElementType type, cl_mem input, int n, void* result);
+
+	/// <summary>
+	/// Releases the scratch buffers, kernels and programs.
+	/// </summary>
+	void Release();
+private:
+	/// <summary>
+	/// Ensures the partial results of every level hold the partials of n values.
+	/// </summary>
+	bool Reserve(int n);
+
+	/// <summary>
+	/// Retrieves the number of partial results when reducing n values.
+	/// </summary>
+	int GetNumGroups(int n) const;
+private:
+	static constexpr size_t Max_Group_Size = 256;
+	static constexpr int Items_Per_Work_Item = 8;
+	static constexpr int Num_Ops = 4;
+
+	cl_context mContext = nullptr;
+	cl_program mPrograms[Num_Element_Types] = {};
+	cl_kernel mKernels[Num_Element_Types][Num_Ops] = {};
+
+	size_t mGroupSize = 0;
+	int mCapacity = 0;
+
+	// Partial values and argmax indices of every level, every element type is 32 bits wide
+	std::vector<cl_mem> mPartialValues;
+	std::vector<cl_mem> mPartialIndices;
+	cl_mem mResult = nullptr;
+};
@@ -0,0 +1,185 @@
+#include "Scan.h"
+
+#include "OpenCLUtils.h"
+
+#include <algorithm>
+#include <string>
+#include <stdio.h>
+
+bool Scan::Initialize(cl_context context, cl_device_id device)
+{
+	cl_int err = -1;
+
+	mContext = context;
+
+	// The up-sweep and down-sweep require a power of two work-group size that every kernel supports
+	size_t maxGroupSize = Max_Group_Size;
+	for (int type = 0; type < Num_Element_Types; ++type)
+	{
+		const std::string options = std::string(GetElementTypeOptions(static_cast<ElementType>(type))) +
+									" -DSCAN_ITEMS=" + std::to_string(Items_Per_Work_Item) +
+									" -DLOG_NUM_BANKS=" + std::to_string(Log_Num_Banks);
+		mPrograms[type] = OpenCLUtils::build_program(context, device, "../Utils/shaders/scan.cl", options.c_str());
+		if (!mPrograms[type])
+			return false;
+
+		mScanKernels[type] = clCreateKernel(mPrograms[type], "scan_blocks", &err);
+		if (err < 0)
+		{
+			perror("Couldn't create the scan kernel");
+			return false;
+		}
+
+		mAddOffsetsKernels[type] = clCreateKernel(mPrograms[type], "add_block_offsets", &err);
+		if (err < 0)
+		{
+			perror("Couldn't create the scan offsets kernel");
+			return false;
+		}
+
+		for (cl_kernel kernel : { mScanKernels[type], mAddOffsetsKernels[type] })
+		{
+			size_t kernelGroupSize = 0;
+			clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernelGroupSize, NULL);
+			maxGroupSize = std::min(maxGroupSize, kernelGroupSize);
+		}
+	}
+
+	mGroupSize = 1;
+	while (mGroupSize * 2 <= maxGroupSize)
+		mGroupSize *= 2;
+	mBlockSize = mGroupSize * Items_Per_Work_Item;
+	return true;
+}
+
+bool Scan::Reserve(int n)
+{
+	if (n <= mCapacity)
+		return true;
+
+	for (cl_mem sums : mBlockSums)
+		clReleaseMemObject(sums);
+	mBlockSums.clear();
+	mCapacity = 0;
+
+	cl_int err = CL_SUCCESS;
+
+	// One level of block sums per scan level until a single block remains
+	for (size_t levelSize = n; levelSize > mBlockSize; )
+	{
+		levelSize = (levelSize + mBlockSize - 1) / mBlockSize;
+
+		cl_int bufferErr = -1;
+		mBlockSums.push_back(clCreateBuffer(mContext, CL_MEM_READ_WRITE, levelSize * sizeof(cl_uint), NULL, &bufferErr));
+		err |= bufferErr;
+	}
+
+	if (err < 0)
+	{
+		perror("Couldn't create the scan buffers");
+		return false;
+	}
+
+	mCapacity = n;
+	return true;
+}
+
+size_t Scan::GetTileSize(size_t blockSize)
+{
+	// One past the padded index of the last value, matching CONFLICT_FREE in scan.cl
+	const size_t last = blockSize - 1;
+	return last + (last >> Log_Num_Banks) + (last >> (2 * Log_Num_Banks)) + 1;
+}
+
+bool Scan::EnqueueScan(cl_command_queue queue, int typeIndex, cl_mem input, int n, bool inclusive, cl_mem output, size_t level)
+{
+	cl_kernel scanKernel = mScanKernels[typeIndex];
+	cl_kernel addOffsetsKernel = mAddOffsetsKernels[typeIndex];
+
+	const size_t numBlocks = (static_cast<size_t>(n) + mBlockSize - 1) / mBlockSize;
+	const size_t global = numBlocks * mGroupSize;
+	const size_t tileSize = GetTileSize(mBlockSize);
+	const int inclusiveArg = inclusive ? 1 : 0;
+
+	cl_mem blockSums = (numBlocks > 1) ? mBlockSums[level] : nullptr;
+
+	cl_int err = clSetKernelArg(scanKernel, 0, sizeof(cl_mem), &input);
+	err |= clSetKernelArg(scanKernel, 1, sizeof(int), &n);
+	err |= clSetKernelArg(scanKernel, 2, sizeof(int), &inclusiveArg);
+	err |= clSetKernelArg(scanKernel, 3, sizeof(cl_mem), &output);
+	err |= clSetKernelArg(scanKernel, 4, sizeof(cl_mem), &blockSums);
+	err |= clSetKernelArg(scanKernel, 5, tileSize * sizeof(cl_uint), NULL);
+	err |= clSetKernelArg(scanKernel, 6, mGroupSize * sizeof(cl_uint), NULL);
+	if (err < 0)
+	{
+		perror("Couldn't create a scan kernel argument");
+		return false;
+	}
+
+	err = clEnqueueNDRangeKernel(queue, scanKernel, 1, NULL, &global, &mGroupSize, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the scan kernel");
+		return false;
+	}
+
+	if (numBlocks == 1)
+		return true;
+
+	// Scan the block totals in place, then add them back to every block
+	if (!EnqueueScan(queue, typeIndex, blockSums, static_cast<int>(numBlocks), false, blockSums, level + 1))
+		return false;
+
+	err = clSetKernelArg(addOffsetsKernel, 0, sizeof(cl_mem), &output);
+	err |= clSetKernelArg(addOffsetsKernel, 1, sizeof(int), &n);
+	err |= clSetKernelArg(addOffsetsKernel, 2, sizeof(cl_mem), &blockSums);
+	err |= clEnqueueNDRangeKernel(queue, addOffsetsKernel, 1, NULL, &global, &mGroupSize, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the scan offsets kernel");
+		return false;
+	}
+	return true;
+}
+
+bool Scan::Exclusive(cl_command_queue queue, ElementType type, cl_mem input, int n, cl_mem output)
+{
+	if (n <= 0)
+		return true;
+
+	if (!Reserve(n))
+		return false;
+	return EnqueueScan(queue, static_cast<int>(type), input, n, false, output, 0);
+}
+
+bool Scan::Inclusive(cl_command_queue queue, ElementType type, cl_mem input, int n, cl_mem output)
+{
+	if (n <= 0)
+		return true;
+
+	if (!Reserve(n))
+		return false;
+	return EnqueueScan(queue, static_cast<int>(type), input, n, true, output, 0);
+}
+
+void Scan::Release()
+{
+	for (cl_mem sums : mBlockSums)
+		clReleaseMemObject(sums);
+	mBlockSums.clear();
+	mCapacity = 0;
+
+	for (int type = 0; type < Num_Element_Types; ++type)
+	{
+		for (cl_kernel* kernel : { &mScanKernels[type], &mAddOffsetsKernels[type] })
+		{
+			if (*kernel)
+				clReleaseKernel(*kernel);
+			*kernel = nullptr;
+		}
+
+		if (mPrograms[type])
+			clReleaseProgram(mPrograms[type]);
+		mPrograms[type] = nullptr;
+	}
+}
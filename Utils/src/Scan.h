@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Cl/cl.h"
+
+#include "ElementType.h"
+
+#include <vector>
+
+/// <summary>
+/// Device work-efficient (Blelloch) prefix scan of int, uint or float
+/// arrays of any length. Every work-group scans a block of values in local
+/// memory and writes the block total, the totals are scanned recursively
+/// and added back, so each level shrinks the problem by the block size.
+/// Scratch buffers are kept between calls.
+/// </summary>
+class Scan
+{
+public:
+	/// <summary>
+	/// Builds the scan program for every element type and creates the kernels.
+	/// </summary>
+	/// <param name="context">The OpenCL context</param>
+	/// <param name="device">The device to build the programs for</param>
+	/// <returns>True if the kernels were created successfully</returns>
+	bool Initialize(cl_context context, cl_device_id device);
+
+	/// <summary>
+	/// Enqueues the exclusive scan of the input, output[i] = input[0] + ... + input[i - 1].
+	/// </summary>
+	/// <param name="queue">The command queue to enqueue the passes on</param>
+	/// <param name="type">The element type of both buffers</param>
+	/// <param name="input">Buffer of n values</param>
+	/// <param name="n">The number of values</param>
+	/// <param name="output">Buffer of n values receiving the scan, may be the input</param>
+	/// <returns>True if every pass was enqueued successfully</returns>
+	bool Exclusive(cl_command_queue queue, ElementType type, cl_mem input, int n, cl_mem output);
+
+	/// <summary>
+	/// Enqueues the inclusive scan of the input, output[i] = input[0] + ... + input[i].
+	/// </summary>
+	bool Inclusive(cl_command_queue queue, ElementType type, cl_mem input, int n, cl_mem output);
+
+	/// <summary>
+	/// Releases the scratch buffers, kernels and programs.
+	/// </summary>
+	void Release();
+private:
+	/// <summary>
+	/// Ensures the block sums of every level hold the totals of n values.
+	/// </summary>
+	bool Reserve(int n);
+
+	/// <summary>
+	/// Enqueues the scan of the given level, recursing over its block sums.
+	/// </summary>
+	bool EnqueueScan(cl_command_queue queue, int typeIndex, cl_mem input, int n, bool inclusive, cl_mem output, size_t level);
+
+	/// <summary>
+	/// Retrieves the number of values of the local tile holding a block, including the bank conflict padding.
+	/// </summary>
+	static size_t GetTileSize(size_t blockSize);
+private:
+	static constexpr size_t Max_Group_Size = 256;
+	static constexpr int Items_Per_Work_Item = 8;
+
+	// Local memory banks of 32-bit words, the tile is padded to avoid conflicts between them
+	static constexpr int Log_Num_Banks = 5;
+
+	cl_context mContext = nullptr;
+	cl_program mPrograms[Num_Element_Types] = {};
+	cl_kernel mScanKernels[Num_Element_Types] = {};
+	cl_kernel mAddOffsetsKernels[Num_Element_Types] = {};
+
+	size_t mGroupSize = 0;
+	size_t mBlockSize = 0;
+	int mCapacity = 0;
+
+	// Block sums of every level, every element type is 32 bits wide
+	std::vector<cl_mem> mBlockSums;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Memory layouts of per-entity simulation state with several float
+/// components, such as float2 velocities or float4(x, y, radius, mass) bodies.
+/// AoS interleaves the components of every entity, SoA stores one plane per
+/// component and AoSoA stores blocks of State_Block_Width entities with one
+/// float vector per component. The kernels access one entity per work-item,
+/// which is a vector load only for AoS, for SoA and AoSoA every component is
+/// a scalar load, contiguous with the same component of the neighbouring
+/// work-items. Loops over all entities instead load the same component of 4
+/// consecutive entities as one vector in SoA and AoSoA.
+/// </summary>
+enum class StateLayout
+{
+	AoS,
+	SoA,
+	AoSoA
+};
+
+constexpr int Num_State_Layouts = 3;
+
+// Entities per AoSoA block, the width of the float4 component vectors
+constexpr int State_Block_Width = 4;
+
+/// <summary>
+/// Retrieves the display name of the layout.
+/// </summary>
+inline const char* GetStateLayoutName(StateLayout layout)
+{
+	switch (layout)
+	{
+	case StateLayout::SoA:
+		return "SoA";
+	case StateLayout::AoSoA:
+		return "AoSoA";
+	default:
+		return "AoS";
+	}
+}
+
+/// <summary>
+/// Retrieves the build options selecting the layout in the simulation kernels.
+/// </summary>
+inline std::string GetStateLayoutOptions(StateLayout layout)
+{
+	const std::string width = " -DAOSOA_WIDTH=" + std::to_string(State_Block_Width);
+	switch (layout)
+	{
+	case StateLayout::SoA:
+		return "-DLAYOUT_SOA" + width;
+	case StateLayout::AoSoA:
+		return "-DLAYOUT_AOSOA" + width;
+	default:
+		return "-DLAYOUT_AOS" + width;
+	}
+}
+
+/// <summary>
+/// Retrieves the number of entities to allocate for n, whole AoSoA blocks for every layout.
+/// </summary>
+inline int GetStateCapacity(int n)
+{
+	return (n + State_Block_Width - 1) / State_Block_Width * State_Block_Width;
+}
+
+/// <summary>
+/// Retrieves the float index of component c of entity i, matching element_index in the kernels.
+/// </summary>
+inline size_t GetStateIndex(StateLayout layout, int i, int c, int n, int components)
+{
+	switch (layout)
+	{
+	case StateLayout::SoA:
+		return static_cast<size_t>(c) * n + i;
+	case StateLayout::AoSoA:
+		return (static_cast<size_t>(i) / State_Block_Width) * components * State_Block_Width + c * State_Block_Width + i % State_Block_Width;
+	default:
+		return static_cast<size_t>(i) * components + c;
+	}
+}
+
+/// <summary>
+/// Rearranges n interleaved entities of the given number of float components
+/// into the layout, padded to GetStateCapacity(n) entities with zeros.
+/// </summary>
+inline std::vector<float> ToStateLayout(StateLayout layout, const float* data, int n, int components)
+{
+	std::vector<float> result(static_cast<size_t>(GetStateCapacity(n)) * components, 0.0f);
+	for (int i = 0; i < n; ++i)
+	{
+		for (int c = 0; c < components; ++c)
+			result[GetStateIndex(layout, i, c, n, components)] = data[static_cast<size_t>(i) * components + c];
+	}
+	return result;
+}
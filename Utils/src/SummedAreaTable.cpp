@@ -0,0 +1,114 @@
+#include "SummedAreaTable.h"
+
+#include "OpenCLUtils.h"
+
+#include <stdio.h>
+
+bool SummedAreaTable::Initialize(cl_context context, cl_device_id device)
+{
+	cl_int err = -1;
+
+	mProgram = OpenCLUtils::build_program(context, device, "../Utils/shaders/summed_area_table.cl");
+	if (!mProgram)
+		return false;
+
+	mRowScanKernel = clCreateKernel(mProgram, "sat_row_scan", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the row scan kernel");
+		return false;
+	}
+
+	mColumnScanKernel = clCreateKernel(mProgram, "sat_column_scan", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the column scan kernel");
+		return false;
+	}
+
+	// The row scan requires a power of two work-group size
+	size_t maxGroupSize = 0;
+	clGetKernelWorkGroupInfo(mRowScanKernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxGroupSize, NULL);
+
+	mRowGroupSize = 1;
+	while (mRowGroupSize * 2 <= maxGroupSize && mRowGroupSize < 256)
+		mRowGroupSize *= 2;
+	return true;
+}
+
+bool SummedAreaTable::Compute(cl_command_queue queue,
+							  cl_mem input,
+							  int width,
+							  int height,
+							  cl_mem output)
+{
+	cl_int err = clSetKernelArg(mRowScanKernel, 0, sizeof(cl_mem), &input);
+	err |= clSetKernelArg(mRowScanKernel, 1, sizeof(int), &width);
+	err |= clSetKernelArg(mRowScanKernel, 2, sizeof(int), &height);
+	err |= clSetKernelArg(mRowScanKernel, 3, sizeof(cl_mem), &output);
+	err |= clSetKernelArg(mRowScanKernel, 4, mRowGroupSize * 2 * sizeof(cl_uint), NULL);
+	if (err < 0)
+	{
+		perror("Couldn't create a row scan kernel argument");
+		return false;
+	}
+
+	size_t rowGlobal[2] = { mRowGroupSize, static_cast<size_t>(height) };
+	size_t rowLocal[2] = { mRowGroupSize, 1 };
+
+	err = clEnqueueNDRangeKernel(queue,
+								 mRowScanKernel,
+								 2,
+								 NULL,
+								 (const size_t*)&rowGlobal,
+								 (const size_t*)&rowLocal,
+								 0,
+								 NULL,
+								 NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the row scan kernel");
+		return false;
+	}
+
+	err = clSetKernelArg(mColumnScanKernel, 0, sizeof(cl_mem), &output);
+	err |= clSetKernelArg(mColumnScanKernel, 1, sizeof(int), &width);
+	err |= clSetKernelArg(mColumnScanKernel, 2, sizeof(int), &height);
+	if (err < 0)
+	{
+		perror("Couldn't create a column scan kernel argument");
+		return false;
+	}
+
+	size_t columnGlobal = static_cast<size_t>(width);
+
+	err = clEnqueueNDRangeKernel(queue,
+								 mColumnScanKernel,
+								 1,
+								 NULL,
+								 &columnGlobal,
+								 NULL,
+								 0,
+								 NULL,
+								 NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the column scan kernel");
+		return false;
+	}
+	return true;
+}
+
+void SummedAreaTable::Release()
+{
+	if (mRowScanKernel)
+		clReleaseKernel(mRowScanKernel);
+	if (mColumnScanKernel)
+		clReleaseKernel(mColumnScanKernel);
+	if (mProgram)
+		clReleaseProgram(mProgram);
+
+	mRowScanKernel = nullptr;
+	mColumnScanKernel = nullptr;
+	mProgram = nullptr;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "Cl/cl.h"
+
+/// <summary>
+/// Device-side summed-area table (integral image) builder.
+/// The table is built with a parallel scan of every row followed by a scan
+/// of every column, allowing any rectangular window sum to be read back in
+/// O(1) with four lookups.
+/// </summary>
+class SummedAreaTable
+{
+public:
+	/// <summary>
+	/// Builds the scan program and creates the row and column kernels.
+	/// </summary>
+	/// <param name="context">The OpenCL context</param>
+	/// <param name="device">The device to build the program for</param>
+	/// <returns>True if the kernels were created successfully</returns>
+	bool Initialize(cl_context context, cl_device_id device);
+
+	/// <summary>
+	/// Enqueues the construction of the summed-area table.
+	/// </summary>
+	/// <param name="queue">The command queue to enqueue the passes on</param>
+	/// <param name="input">Buffer of width * height uint values</param>
+	/// <param name="width">The width of the input</param>
+	/// <param name="height">The height of the input</param>
+	/// <param name="output">Buffer of width * height uint values receiving the table</param>
+	/// <returns>True if both passes were enqueued successfully</returns>
+	bool Compute(cl_command_queue queue,
+				 cl_mem input,
+				 int width,
+				 int height,
+				 cl_mem output);
+
+	/// <summary>
+	/// Releases the kernels and program.
+	/// </summary>
+	void Release();
+private:
+	cl_program mProgram = nullptr;
+	cl_kernel mRowScanKernel = nullptr;
+	cl_kernel mColumnScanKernel = nullptr;
+
+	size_t mRowGroupSize = 0;
+};
@@ -0,0 +1,236 @@
+#include "UniformGrid.h"
+
+#include "OpenCLUtils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <stdio.h>
+
+bool UniformGrid::Initialize(cl_context context, cl_device_id device, cl_program program, const char* hashKernel, const char* reorderKernel)
+{
+	cl_int err = -1;
+
+	mContext = context;
+
+	mProgram = OpenCLUtils::build_program(context, device, "../Utils/shaders/uniform_grid.cl");
+	if (!mProgram)
+		return false;
+
+	const std::pair<cl_kernel*, std::pair<cl_program, const char*>> kernels[] =
+	{
+		{ &mHashKernel, { program, hashKernel } },
+		{ &mReorderKernel, { program, reorderKernel } },
+		{ &mClearCellsKernel, { mProgram, "clear_cells" } },
+		{ &mCellBoundsKernel, { mProgram, "find_cell_bounds" } }
+	};
+
+	for (const auto& [kernel, source] : kernels)
+	{
+		*kernel = clCreateKernel(source.first, source.second, &err);
+		if (err < 0)
+		{
+			printf("Couldn't create the %s kernel\n", source.second);
+			return false;
+		}
+	}
+	return mSort.Initialize(context, device);
+}
+
+bool UniformGrid::Reserve(int n, std::initializer_list<State> states, int numCells)
+{
+	cl_int err = CL_SUCCESS;
+
+	if (n > mItemCapacity)
+	{
+		for (cl_mem* buffer : { &mCellKeys, &mIndices })
+		{
+			if (*buffer)
+				clReleaseMemObject(*buffer);
+			*buffer = nullptr;
+		}
+
+		cl_int bufferErr = -1;
+		mCellKeys = clCreateBuffer(mContext, CL_MEM_READ_WRITE, n * sizeof(cl_uint), NULL, &bufferErr);
+		err |= bufferErr;
+		mIndices = clCreateBuffer(mContext, CL_MEM_READ_WRITE, n * sizeof(cl_uint), NULL, &bufferErr);
+		err |= bufferErr;
+		mItemCapacity = n;
+	}
+
+	mSorted.resize(states.size());
+	size_t i = 0;
+	for (const State& state : states)
+	{
+		SortedState& sorted = mSorted[i++];
+		if (state.size <= sorted.capacity)
+			continue;
+
+		if (sorted.buffer)
+			clReleaseMemObject(sorted.buffer);
+
+		cl_int bufferErr = -1;
+		sorted.buffer = clCreateBuffer(mContext, CL_MEM_READ_WRITE, state.size, NULL, &bufferErr);
+		err |= bufferErr;
+		sorted.capacity = state.size;
+	}
+
+	if (numCells > mCellCapacity)
+	{
+		for (cl_mem* buffer : { &mCellStart, &mCellEnd })
+		{
+			if (*buffer)
+				clReleaseMemObject(*buffer);
+			*buffer = nullptr;
+		}
+
+		cl_int bufferErr = -1;
+		mCellStart = clCreateBuffer(mContext, CL_MEM_READ_WRITE, numCells * sizeof(cl_uint), NULL, &bufferErr);
+		err |= bufferErr;
+		mCellEnd = clCreateBuffer(mContext, CL_MEM_READ_WRITE, numCells * sizeof(cl_uint), NULL, &bufferErr);
+		err |= bufferErr;
+		mCellCapacity = numCells;
+	}
+
+	if (err < 0)
+	{
+		perror("Couldn't create the grid buffers");
+		ReleaseBuffers();
+		return false;
+	}
+	return true;
+}
+
+bool UniformGrid::Build(cl_command_queue queue,
+						cl_mem positions,
+						std::initializer_list<State> states,
+						int n,
+						const cl_float4& bounds,
+						float cellSize)
+{
+	mCellSize = cellSize;
+	mOrigin = { { bounds.s[0], bounds.s[2] } };
+	mGridSize = { { std::max(1, static_cast<int>(std::ceil((bounds.s[1] - bounds.s[0]) / cellSize))),
+					std::max(1, static_cast<int>(std::ceil((bounds.s[3] - bounds.s[2]) / cellSize))) } };
+	const int numCells = mGridSize.s[0] * mGridSize.s[1];
+
+	if (!Reserve(n, states, numCells))
+		return false;
+
+	const size_t itemCount = n;
+	const size_t cellCount = numCells;
+
+	cl_int err = clSetKernelArg(mHashKernel, 0, sizeof(cl_mem), &positions);
+	err |= clSetKernelArg(mHashKernel, 1, sizeof(int), &n);
+	err |= clSetKernelArg(mHashKernel, 2, sizeof(cl_float2), &mOrigin);
+	err |= clSetKernelArg(mHashKernel, 3, sizeof(cl_int2), &mGridSize);
+	err |= clSetKernelArg(mHashKernel, 4, sizeof(float), &mCellSize);
+	err |= clSetKernelArg(mHashKernel, 5, sizeof(cl_mem), &mCellKeys);
+	err |= clSetKernelArg(mHashKernel, 6, sizeof(cl_mem), &mIndices);
+
+	const cl_uint numStates = static_cast<cl_uint>(states.size());
+	err |= clSetKernelArg(mReorderKernel, 0, sizeof(cl_mem), &mIndices);
+	err |= clSetKernelArg(mReorderKernel, 1, sizeof(int), &n);
+	cl_uint i = 0;
+	for (const State& state : states)
+	{
+		err |= clSetKernelArg(mReorderKernel, 2 + i, sizeof(cl_mem), state.buffer);
+		err |= clSetKernelArg(mReorderKernel, 2 + numStates + i, sizeof(cl_mem), &mSorted[i].buffer);
+		++i;
+	}
+
+	err |= clSetKernelArg(mClearCellsKernel, 0, sizeof(cl_mem), &mCellStart);
+	err |= clSetKernelArg(mClearCellsKernel, 1, sizeof(int), &numCells);
+
+	err |= clSetKernelArg(mCellBoundsKernel, 0, sizeof(cl_mem), &mCellKeys);
+	err |= clSetKernelArg(mCellBoundsKernel, 1, sizeof(int), &n);
+	err |= clSetKernelArg(mCellBoundsKernel, 2, sizeof(cl_mem), &mCellStart);
+	err |= clSetKernelArg(mCellBoundsKernel, 3, sizeof(cl_mem), &mCellEnd);
+	if (err < 0)
+	{
+		perror("Couldn't create a grid kernel argument");
+		return false;
+	}
+
+	// Only the bits of the largest cell index are sorted on
+	const int keyBits = RadixSort::GetKeyBits(static_cast<cl_uint>(numCells - 1));
+
+	err = clEnqueueNDRangeKernel(queue, mHashKernel, 1, NULL, &itemCount, NULL, 0, NULL, NULL);
+	if (err < 0 || !mSort.Sort(queue, mCellKeys, mIndices, n, keyBits))
+	{
+		perror("Couldn't enqueue the cell sort");
+		return false;
+	}
+
+	err = clEnqueueNDRangeKernel(queue, mReorderKernel, 1, NULL, &itemCount, NULL, 0, NULL, NULL);
+	err |= clEnqueueNDRangeKernel(queue, mClearCellsKernel, 1, NULL, &cellCount, NULL, 0, NULL, NULL);
+	err |= clEnqueueNDRangeKernel(queue, mCellBoundsKernel, 1, NULL, &itemCount, NULL, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the grid kernels");
+		return false;
+	}
+
+	// The sorted state becomes the caller's, the previous buffers are the scratch of the next build
+	// and only known to hold the size they were given with, a larger build must not reuse them
+	i = 0;
+	for (const State& state : states)
+	{
+		SortedState& sorted = mSorted[i++];
+		std::swap(*state.buffer, sorted.buffer);
+		sorted.capacity = state.size;
+	}
+	return true;
+}
+
+bool UniformGrid::SetGridArgs(cl_kernel kernel, cl_uint firstArg) const
+{
+	cl_int err = clSetKernelArg(kernel, firstArg, sizeof(cl_mem), &mCellStart);
+	err |= clSetKernelArg(kernel, firstArg + 1, sizeof(cl_mem), &mCellEnd);
+	err |= clSetKernelArg(kernel, firstArg + 2, sizeof(cl_float2), &mOrigin);
+	err |= clSetKernelArg(kernel, firstArg + 3, sizeof(cl_int2), &mGridSize);
+	err |= clSetKernelArg(kernel, firstArg + 4, sizeof(float), &mCellSize);
+	if (err < 0)
+	{
+		perror("Couldn't create a grid kernel argument");
+		return false;
+	}
+	return true;
+}
+
+void UniformGrid::ReleaseBuffers()
+{
+	for (cl_mem* buffer : { &mCellKeys, &mIndices, &mCellStart, &mCellEnd })
+	{
+		if (*buffer)
+			clReleaseMemObject(*buffer);
+		*buffer = nullptr;
+	}
+
+	for (SortedState& sorted : mSorted)
+	{
+		if (sorted.buffer)
+			clReleaseMemObject(sorted.buffer);
+	}
+	mSorted.clear();
+
+	mItemCapacity = 0;
+	mCellCapacity = 0;
+}
+
+void UniformGrid::Release()
+{
+	ReleaseBuffers();
+	mSort.Release();
+
+	for (cl_kernel* kernel : { &mHashKernel, &mReorderKernel, &mClearCellsKernel, &mCellBoundsKernel })
+	{
+		if (*kernel)
+			clReleaseKernel(*kernel);
+		*kernel = nullptr;
+	}
+
+	if (mProgram)
+		clReleaseProgram(mProgram);
+	mProgram = nullptr;
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include "Cl/cl.h"
+
+#include "RadixSort.h"
+
+#include <initializer_list>
+#include <vector>
+
+/// <summary>
+/// Uniform grid broadphase over 2D items. Building the grid hashes every
+/// item to a cell, sorts the items by cell on the device, reorders their
+/// state to match and records the range of every cell, so neighbour queries
+/// only visit the 3x3 cells around an item. The hash and reorder kernels
+/// come from the caller's program, since they read its state:
+///   hash(positions, int n, float2 gridOrigin, int2 gridSize, float cellSize, uint* cellKeys, uint* indices)
+///   writes the cell key and index of every item, and
+///   reorder(const uint* indices, int n, state 0 .. k-1, sorted 0 .. k-1)
+///   gathers item indices[i] of every state buffer to i of its sorted buffer.
+/// </summary>
+class UniformGrid
+{
+public:
+	/// <summary>
+	/// A state buffer reordered by the build, and the size its handles are known to hold.
+	/// </summary>
+	struct State
+	{
+		cl_mem* buffer;
+		size_t size;
+	};
+
+	/// <summary>
+	/// Creates the hash and reorder kernels from the caller's program, and the cell table kernels and sort.
+	/// </summary>
+	/// <param name="context">The OpenCL context</param>
+	/// <param name="device">The device the program was built for</param>
+	/// <param name="program">The built program with the hash and reorder kernels</param>
+	/// <param name="hashKernel">The name of the hash kernel</param>
+	/// <param name="reorderKernel">The name of the reorder kernel</param>
+	/// <returns>True if the kernels were created successfully</returns>
+	bool Initialize(cl_context context, cl_device_id device, cl_program program, const char* hashKernel, const char* reorderKernel);
+
+	/// <summary>
+	/// Enqueues the sort of the state by cell and the cell table build. The
+	/// sorted state is gathered into scratch buffers whose handles are then
+	/// swapped with the given ones, so every state buffer must hold its size,
+	/// and the scratch buffers are sized to match.
+	/// </summary>
+	/// <param name="queue">The command queue to enqueue the kernels on</param>
+	/// <param name="positions">The positions the hash kernel reads, before the reorder</param>
+	/// <param name="states">The state buffers, replaced by the sorted ones, in the reorder kernel's order</param>
+	/// <param name="n">The number of items</param>
+	/// <param name="bounds">The simulation area as (minX, maxX, minY, maxY)</param>
+	/// <param name="cellSize">The cell edge, at least the largest query radius</param>
+	/// <returns>True if the kernels were enqueued successfully</returns>
+	bool Build(cl_command_queue queue,
+			   cl_mem positions,
+			   std::initializer_list<State> states,
+			   int n,
+			   const cl_float4& bounds,
+			   float cellSize);
+
+	/// <summary>
+	/// Sets the cell start and end tables, grid origin, grid size and cell
+	/// size as the five kernel arguments starting at firstArg.
+	/// </summary>
+	bool SetGridArgs(cl_kernel kernel, cl_uint firstArg) const;
+
+	/// <summary>
+	/// Releases the scratch buffers, tables and kernels.
+	/// </summary>
+	void Release();
+private:
+	/// <summary>
+	/// Ensures the keys, scratch state buffers and tables hold the given items, state sizes and cells.
+	/// </summary>
+	bool Reserve(int n, std::initializer_list<State> states, int numCells);
+
+	void ReleaseBuffers();
+private:
+	struct SortedState
+	{
+		cl_mem buffer = nullptr;
+		size_t capacity = 0;
+	};
+private:
+	cl_context mContext = nullptr;
+	cl_program mProgram = nullptr;
+
+	cl_kernel mHashKernel = nullptr;
+	cl_kernel mReorderKernel = nullptr;
+	cl_kernel mClearCellsKernel = nullptr;
+	cl_kernel mCellBoundsKernel = nullptr;
+
+	RadixSort mSort;
+
+	int mItemCapacity = 0;
+	int mCellCapacity = 0;
+
+	cl_mem mCellKeys = nullptr;
+	cl_mem mIndices = nullptr;
+
+	// One per state buffer, after a build these are the caller's previous
+	// state buffers and only known to hold the size they were given with
+	std::vector<SortedState> mSorted;
+
+	cl_mem mCellStart = nullptr;
+	cl_mem mCellEnd = nullptr;
+
+	cl_float2 mOrigin = {};
+	cl_int2 mGridSize = {};
+	float mCellSize = 0.0f;
+};
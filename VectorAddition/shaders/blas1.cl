@@ -0,0 +1,313 @@
+// Single precision BLAS level 1 kernels.
+//
+// Every kernel walks the vectors with a grid-stride loop over VEC_WIDTH
+// wide chunks (float4 or float8, chosen at build time), followed by a
+// scalar loop over the n % VEC_WIDTH tail. Reductions run in two stages:
+// each work-group reduces its grid-stride sums in local memory and writes a
+// partial, then a single work-group reduces the partials. The work-group
+// size must be a power of two.
+
+#ifndef VEC_WIDTH
+#define VEC_WIDTH 4
+#endif
+
+#if VEC_WIDTH == 8
+    #define floatv float8
+    #define VLOAD vload8
+    #define VSTORE vstore8
+    #define HSUM(v) (hsum4((v).lo) + hsum4((v).hi))
+#elif VEC_WIDTH == 4
+    #define floatv float4
+    #define VLOAD vload4
+    #define VSTORE vstore4
+    #define HSUM(v) hsum4(v)
+#else
+    #error VEC_WIDTH must be 4 or 8
+#endif
+
+inline float hsum4(float4 v)
+{
+    return (v.x + v.y) + (v.z + v.w);
+}
+
+// Tree reduction of one value per work-item, the result is valid in every work-item
+inline float group_reduce_sum(float value, __local float* scratch)
+{
+    int lid = get_local_id(0);
+    scratch[lid] = value;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int offset = get_local_size(0) / 2; offset > 0; offset >>= 1)
+    {
+        if (lid < offset)
+        {
+            scratch[lid] += scratch[lid + offset];
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    float result = scratch[0];
+    barrier(CLK_LOCAL_MEM_FENCE);
+    return result;
+}
+
+// Keeps the larger magnitude, preferring the lower index on ties like i_amax
+inline void amax_merge(float* value, int* index, float other_value, int other_index)
+{
+    if (other_value > *value || (other_value == *value && other_index < *index))
+    {
+        *value = other_value;
+        *index = other_index;
+    }
+}
+
+inline void group_reduce_amax(float* value, int* index, __local float* values, __local int* indices)
+{
+    int lid = get_local_id(0);
+    values[lid] = *value;
+    indices[lid] = *index;
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for (int offset = get_local_size(0) / 2; offset > 0; offset >>= 1)
+    {
+        if (lid < offset)
+        {
+            float v = values[lid];
+            int i = indices[lid];
+            amax_merge(&v, &i, values[lid + offset], indices[lid + offset]);
+            values[lid] = v;
+            indices[lid] = i;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    *value = values[0];
+    *index = indices[0];
+}
+
+// y = alpha * x + y
+__kernel void axpy(const int n,
+                   const float alpha,
+                   __global const float* x,
+                   __global float* y)
+{
+    const int gid = get_global_id(0);
+    const int stride = get_global_size(0);
+    const int chunks = n / VEC_WIDTH;
+
+    for (int i = gid; i < chunks; i += stride)
+    {
+        VSTORE(mad((floatv)(alpha), VLOAD(i, x), VLOAD(i, y)), i, y);
+    }
+
+    for (int i = chunks * VEC_WIDTH + gid; i < n; i += stride)
+    {
+        y[i] = mad(alpha, x[i], y[i]);
+    }
+}
+
+// x = alpha * x
+__kernel void scal(const int n,
+                   const float alpha,
+                   __global float* x)
+{
+    const int gid = get_global_id(0);
+    const int stride = get_global_size(0);
+    const int chunks = n / VEC_WIDTH;
+
+    for (int i = gid; i < chunks; i += stride)
+    {
+        VSTORE(alpha * VLOAD(i, x), i, x);
+    }
+
+    for (int i = chunks * VEC_WIDTH + gid; i < n; i += stride)
+    {
+        x[i] *= alpha;
+    }
+}
+
+// Per work-group partial sums of x . y
+__kernel void dot_partial(const int n,
+                          __global const float* x,
+                          __global const float* y,
+                          __global float* partial,
+                          __local float* scratch)
+{
+    const int gid = get_global_id(0);
+    const int stride = get_global_size(0);
+    const int chunks = n / VEC_WIDTH;
+
+    floatv acc = (floatv)(0.0f);
+    for (int i = gid; i < chunks; i += stride)
+    {
+        acc = mad(VLOAD(i, x), VLOAD(i, y), acc);
+    }
+
+    float sum = HSUM(acc);
+    for (int i = chunks * VEC_WIDTH + gid; i < n; i += stride)
+    {
+        sum = mad(x[i], y[i], sum);
+    }
+
+    sum = group_reduce_sum(sum, scratch);
+    if (get_local_id(0) == 0)
+    {
+        partial[get_group_id(0)] = sum;
+    }
+}
+
+// Per work-group partial sums of (x / amax) . (x / amax). Scaling by the
+// largest |x| keeps the squares from overflowing or underflowing, the host
+// multiplies the square root of the final stage back by amax.
+__kernel void nrm2_partial(const int n,
+                           __global const float* x,
+                           const float inv_amax,
+                           __global float* partial,
+                           __local float* scratch)
+{
+    const int gid = get_global_id(0);
+    const int stride = get_global_size(0);
+    const int chunks = n / VEC_WIDTH;
+
+    floatv acc = (floatv)(0.0f);
+    for (int i = gid; i < chunks; i += stride)
+    {
+        floatv v = VLOAD(i, x) * inv_amax;
+        acc = mad(v, v, acc);
+    }
+
+    float sum = HSUM(acc);
+    for (int i = chunks * VEC_WIDTH + gid; i < n; i += stride)
+    {
+        float v = x[i] * inv_amax;
+        sum = mad(v, v, sum);
+    }
+
+    sum = group_reduce_sum(sum, scratch);
+    if (get_local_id(0) == 0)
+    {
+        partial[get_group_id(0)] = sum;
+    }
+}
+
+// Per work-group partial sums of |x|
+__kernel void asum_partial(const int n,
+                           __global const float* x,
+                           __global float* partial,
+                           __local float* scratch)
+{
+    const int gid = get_global_id(0);
+    const int stride = get_global_size(0);
+    const int chunks = n / VEC_WIDTH;
+
+    floatv acc = (floatv)(0.0f);
+    for (int i = gid; i < chunks; i += stride)
+    {
+        acc += fabs(VLOAD(i, x));
+    }
+
+    float sum = HSUM(acc);
+    for (int i = chunks * VEC_WIDTH + gid; i < n; i += stride)
+    {
+        sum += fabs(x[i]);
+    }
+
+    sum = group_reduce_sum(sum, scratch);
+    if (get_local_id(0) == 0)
+    {
+        partial[get_group_id(0)] = sum;
+    }
+}
+
+// Per work-group largest |x| and its index
+__kernel void iamax_partial(const int n,
+                            __global const float* x,
+                            __global float* partial_values,
+                            __global int* partial_indices,
+                            __local float* scratch_values,
+                            __local int* scratch_indices)
+{
+    const int gid = get_global_id(0);
+    const int stride = get_global_size(0);
+    const int chunks = n / VEC_WIDTH;
+
+    float best = -1.0f;
+    int best_index = n;
+
+    for (int i = gid; i < chunks; i += stride)
+    {
+        floatv v = fabs(VLOAD(i, x));
+        float lanes[VEC_WIDTH];
+        VSTORE(v, 0, lanes);
+
+        // Chunks are visited in increasing order, so a strict compare keeps the first maximum
+        for (int lane = 0; lane < VEC_WIDTH; ++lane)
+        {
+            if (lanes[lane] > best)
+            {
+                best = lanes[lane];
+                best_index = i * VEC_WIDTH + lane;
+            }
+        }
+    }
+
+    for (int i = chunks * VEC_WIDTH + gid; i < n; i += stride)
+    {
+        float v = fabs(x[i]);
+        if (v > best)
+        {
+            best = v;
+            best_index = i;
+        }
+    }
+
+    group_reduce_amax(&best, &best_index, scratch_values, scratch_indices);
+    if (get_local_id(0) == 0)
+    {
+        partial_values[get_group_id(0)] = best;
+        partial_indices[get_group_id(0)] = best_index;
+    }
+}
+
+// Final stage: a single work-group sums the partials
+__kernel void reduce_sum(const int n,
+                         __global const float* partial,
+                         __global float* result,
+                         __local float* scratch)
+{
+    float sum = 0.0f;
+    for (int i = get_local_id(0); i < n; i += get_local_size(0))
+    {
+        sum += partial[i];
+    }
+
+    sum = group_reduce_sum(sum, scratch);
+    if (get_local_id(0) == 0)
+    {
+        result[0] = sum;
+    }
+}
+
+// Final stage: a single work-group merges the (value, index) partials
+__kernel void reduce_amax(const int n,
+                          __global const float* partial_values,
+                          __global const int* partial_indices,
+                          __global float* result_value,
+                          __global int* result_index,
+                          __local float* scratch_values,
+                          __local int* scratch_indices)
+{
+    float best = -1.0f;
+    int best_index = INT_MAX;
+    for (int i = get_local_id(0); i < n; i += get_local_size(0))
+    {
+        amax_merge(&best, &best_index, partial_values[i], partial_indices[i]);
+    }
+
+    group_reduce_amax(&best, &best_index, scratch_values, scratch_indices);
+    if (get_local_id(0) == 0)
+    {
+        result_value[0] = best;
+        result_index[0] = best_index;
+    }
+}
@@ -0,0 +1,303 @@
+#include "Blas1.h"
+
+#include "OpenCLUtils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <stdio.h>
+
+bool Blas1::Initialize(cl_context context, cl_device_id device, int vectorWidth)
+{
+	cl_int err = -1;
+
+	if (vectorWidth != 4 && vectorWidth != 8)
+	{
+		printf("Unsupported BLAS-1 vector width: %d\n", vectorWidth);
+		return false;
+	}
+	mVectorWidth = vectorWidth;
+
+	const std::string options = "-DVEC_WIDTH=" + std::to_string(mVectorWidth);
+	mProgram = OpenCLUtils::build_program(context, device, "shaders/blas1.cl", options.c_str());
+	if (!mProgram)
+		return false;
+
+	const std::pair<cl_kernel*, const char*> kernels[] =
+	{
+		{ &mAxpyKernel, "axpy" },
+		{ &mScalKernel, "scal" },
+		{ &mDotKernel, "dot_partial" },
+		{ &mNrm2Kernel, "nrm2_partial" },
+		{ &mAsumKernel, "asum_partial" },
+		{ &mIamaxKernel, "iamax_partial" },
+		{ &mReduceSumKernel, "reduce_sum" },
+		{ &mReduceAmaxKernel, "reduce_amax" }
+	};
+
+	// The reductions require a power of two work-group size that every kernel supports
+	size_t maxGroupSize = Max_Group_Size;
+	for (const auto& [kernel, name] : kernels)
+	{
+		*kernel = clCreateKernel(mProgram, name, &err);
+		if (err < 0)
+		{
+			printf("Couldn't create the %s kernel\n", name);
+			return false;
+		}
+
+		size_t kernelGroupSize = 0;
+		clGetKernelWorkGroupInfo(*kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernelGroupSize, NULL);
+		maxGroupSize = std::min(maxGroupSize, kernelGroupSize);
+	}
+
+	mGroupSize = 1;
+	while (mGroupSize * 2 <= maxGroupSize)
+		mGroupSize *= 2;
+
+	// Enough groups to keep every compute unit busy, each then strides over the vectors
+	cl_uint computeUnits = 1;
+	clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+	mMaxGroups = std::min<size_t>(static_cast<size_t>(computeUnits) * 8, 1024);
+
+	err = CL_SUCCESS;
+	cl_int bufferErr = -1;
+	mPartialValues = clCreateBuffer(context, CL_MEM_READ_WRITE, mMaxGroups * sizeof(float), NULL, &bufferErr);
+	err |= bufferErr;
+	mPartialIndices = clCreateBuffer(context, CL_MEM_READ_WRITE, mMaxGroups * sizeof(int), NULL, &bufferErr);
+	err |= bufferErr;
+	mResultValue = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(float), NULL, &bufferErr);
+	err |= bufferErr;
+	mResultIndex = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(int), NULL, &bufferErr);
+	err |= bufferErr;
+	if (err < 0)
+	{
+		perror("Couldn't create the BLAS-1 scratch buffers");
+		ReleaseBuffers();
+		return false;
+	}
+	return true;
+}
+
+size_t Blas1::GetGlobalSize(int n) const
+{
+	const size_t chunks = (static_cast<size_t>(n) + mVectorWidth - 1) / mVectorWidth;
+	const size_t groups = std::clamp<size_t>((chunks + mGroupSize - 1) / mGroupSize, 1, mMaxGroups);
+	return groups * mGroupSize;
+}
+
+bool Blas1::Axpy(cl_command_queue queue, int n, float alpha, cl_mem x, cl_mem y)
+{
+	cl_int err = clSetKernelArg(mAxpyKernel, 0, sizeof(int), &n);
+	err |= clSetKernelArg(mAxpyKernel, 1, sizeof(float), &alpha);
+	err |= clSetKernelArg(mAxpyKernel, 2, sizeof(cl_mem), &x);
+	err |= clSetKernelArg(mAxpyKernel, 3, sizeof(cl_mem), &y);
+	if (err < 0)
+	{
+		perror("Couldn't create an axpy kernel argument");
+		return false;
+	}
+
+	const size_t global = GetGlobalSize(n);
+	err = clEnqueueNDRangeKernel(queue, mAxpyKernel, 1, NULL, &global, &mGroupSize, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the axpy kernel");
+		return false;
+	}
+	return true;
+}
+
+bool Blas1::Scal(cl_command_queue queue, int n, float alpha, cl_mem x)
+{
+	cl_int err = clSetKernelArg(mScalKernel, 0, sizeof(int), &n);
+	err |= clSetKernelArg(mScalKernel, 1, sizeof(float), &alpha);
+	err |= clSetKernelArg(mScalKernel, 2, sizeof(cl_mem), &x);
+	if (err < 0)
+	{
+		perror("Couldn't create a scal kernel argument");
+		return false;
+	}
+
+	const size_t global = GetGlobalSize(n);
+	err = clEnqueueNDRangeKernel(queue, mScalKernel, 1, NULL, &global, &mGroupSize, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the scal kernel");
+		return false;
+	}
+	return true;
+}
+
+bool Blas1::Dot(cl_command_queue queue, int n, cl_mem x, cl_mem y, float& result)
+{
+	cl_int err = clSetKernelArg(mDotKernel, 0, sizeof(int), &n);
+	err |= clSetKernelArg(mDotKernel, 1, sizeof(cl_mem), &x);
+	err |= clSetKernelArg(mDotKernel, 2, sizeof(cl_mem), &y);
+	if (err < 0)
+	{
+		perror("Couldn't create a dot kernel argument");
+		return false;
+	}
+	return ReduceSum(queue, mDotKernel, 3, n, result);
+}
+
+bool Blas1::Nrm2(cl_command_queue queue, int n, cl_mem x, float& result)
+{
+	// Scale by the largest |x| first, so the sum of squares neither overflows
+	// nor underflows for any finite input, like the reference BLAS nrm2
+	if (!EnqueueAmax(queue, n, x))
+		return false;
+
+	float amax = 0.0f;
+	cl_int err = clEnqueueReadBuffer(queue, mResultValue, CL_TRUE, 0, sizeof(float), &amax, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't read the nrm2 scale");
+		return false;
+	}
+
+	// A zero vector has no scale, and an infinite or NaN entry is the norm itself
+	if (amax == 0.0f || !std::isfinite(amax))
+	{
+		result = amax;
+		return true;
+	}
+
+	const float invAmax = 1.0f / amax;
+	err = clSetKernelArg(mNrm2Kernel, 0, sizeof(int), &n);
+	err |= clSetKernelArg(mNrm2Kernel, 1, sizeof(cl_mem), &x);
+	err |= clSetKernelArg(mNrm2Kernel, 2, sizeof(float), &invAmax);
+	if (err < 0)
+	{
+		perror("Couldn't create a nrm2 kernel argument");
+		return false;
+	}
+
+	float scaledSumOfSquares = 0.0f;
+	if (!ReduceSum(queue, mNrm2Kernel, 3, n, scaledSumOfSquares))
+		return false;
+
+	result = amax * std::sqrt(scaledSumOfSquares);
+	return true;
+}
+
+bool Blas1::Asum(cl_command_queue queue, int n, cl_mem x, float& result)
+{
+	cl_int err = clSetKernelArg(mAsumKernel, 0, sizeof(int), &n);
+	err |= clSetKernelArg(mAsumKernel, 1, sizeof(cl_mem), &x);
+	if (err < 0)
+	{
+		perror("Couldn't create an asum kernel argument");
+		return false;
+	}
+	return ReduceSum(queue, mAsumKernel, 2, n, result);
+}
+
+bool Blas1::ReduceSum(cl_command_queue queue, cl_kernel partialKernel, cl_uint partialArg, int n, float& result)
+{
+	const size_t global = GetGlobalSize(n);
+	const int numGroups = static_cast<int>(global / mGroupSize);
+
+	cl_int err = clSetKernelArg(partialKernel, partialArg, sizeof(cl_mem), &mPartialValues);
+	err |= clSetKernelArg(partialKernel, partialArg + 1, mGroupSize * sizeof(float), NULL);
+	err |= clSetKernelArg(mReduceSumKernel, 0, sizeof(int), &numGroups);
+	err |= clSetKernelArg(mReduceSumKernel, 1, sizeof(cl_mem), &mPartialValues);
+	err |= clSetKernelArg(mReduceSumKernel, 2, sizeof(cl_mem), &mResultValue);
+	err |= clSetKernelArg(mReduceSumKernel, 3, mGroupSize * sizeof(float), NULL);
+	if (err < 0)
+	{
+		perror("Couldn't create a reduction kernel argument");
+		return false;
+	}
+
+	err = clEnqueueNDRangeKernel(queue, partialKernel, 1, NULL, &global, &mGroupSize, 0, NULL, NULL);
+	err |= clEnqueueNDRangeKernel(queue, mReduceSumKernel, 1, NULL, &mGroupSize, &mGroupSize, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the reduction kernels");
+		return false;
+	}
+
+	err = clEnqueueReadBuffer(queue, mResultValue, CL_TRUE, 0, sizeof(float), &result, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't read the reduction result");
+		return false;
+	}
+	return true;
+}
+
+bool Blas1::EnqueueAmax(cl_command_queue queue, int n, cl_mem x)
+{
+	const size_t global = GetGlobalSize(n);
+	const int numGroups = static_cast<int>(global / mGroupSize);
+
+	cl_int err = clSetKernelArg(mIamaxKernel, 0, sizeof(int), &n);
+	err |= clSetKernelArg(mIamaxKernel, 1, sizeof(cl_mem), &x);
+	err |= clSetKernelArg(mIamaxKernel, 2, sizeof(cl_mem), &mPartialValues);
+	err |= clSetKernelArg(mIamaxKernel, 3, sizeof(cl_mem), &mPartialIndices);
+	err |= clSetKernelArg(mIamaxKernel, 4, mGroupSize * sizeof(float), NULL);
+	err |= clSetKernelArg(mIamaxKernel, 5, mGroupSize * sizeof(int), NULL);
+	err |= clSetKernelArg(mReduceAmaxKernel, 0, sizeof(int), &numGroups);
+	err |= clSetKernelArg(mReduceAmaxKernel, 1, sizeof(cl_mem), &mPartialValues);
+	err |= clSetKernelArg(mReduceAmaxKernel, 2, sizeof(cl_mem), &mPartialIndices);
+	err |= clSetKernelArg(mReduceAmaxKernel, 3, sizeof(cl_mem), &mResultValue);
+	err |= clSetKernelArg(mReduceAmaxKernel, 4, sizeof(cl_mem), &mResultIndex);
+	err |= clSetKernelArg(mReduceAmaxKernel, 5, mGroupSize * sizeof(float), NULL);
+	err |= clSetKernelArg(mReduceAmaxKernel, 6, mGroupSize * sizeof(int), NULL);
+	if (err < 0)
+	{
+		perror("Couldn't create an iamax kernel argument");
+		return false;
+	}
+
+	err = clEnqueueNDRangeKernel(queue, mIamaxKernel, 1, NULL, &global, &mGroupSize, 0, NULL, NULL);
+	err |= clEnqueueNDRangeKernel(queue, mReduceAmaxKernel, 1, NULL, &mGroupSize, &mGroupSize, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the iamax kernels");
+		return false;
+	}
+	return true;
+}
+
+bool Blas1::Iamax(cl_command_queue queue, int n, cl_mem x, int& result)
+{
+	if (!EnqueueAmax(queue, n, x))
+		return false;
+
+	cl_int err = clEnqueueReadBuffer(queue, mResultIndex, CL_TRUE, 0, sizeof(int), &result, 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't read the iamax result");
+		return false;
+	}
+	return true;
+}
+
+void Blas1::ReleaseBuffers()
+{
+	for (cl_mem* buffer : { &mPartialValues, &mPartialIndices, &mResultValue, &mResultIndex })
+	{
+		if (*buffer)
+			clReleaseMemObject(*buffer);
+		*buffer = nullptr;
+	}
+}
+
+void Blas1::Release()
+{
+	ReleaseBuffers();
+
+	for (cl_kernel* kernel : { &mAxpyKernel, &mScalKernel, &mDotKernel, &mNrm2Kernel, &mAsumKernel, &mIamaxKernel, &mReduceSumKernel, &mReduceAmaxKernel })
+	{
+		if (*kernel)
+			clReleaseKernel(*kernel);
+		*kernel = nullptr;
+	}
+
+	if (mProgram)
+		clReleaseProgram(mProgram);
+	mProgram = nullptr;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Cl/cl.h"
+
+/// <summary>
+/// Single precision BLAS level 1 routines on device buffers. The kernels
+/// use float4 or float8 loads with grid-stride loops, and reductions run
+/// as per work-group partials followed by a single work-group final pass.
+/// Reductions read their scalar result back, blocking until it is ready.
+/// </summary>
+class Blas1
+{
+public:
+	/// <summary>
+	/// Builds the BLAS-1 program for the given vector width.
+	/// </summary>
+	/// <param name="context">The OpenCL context</param>
+	/// <param name="device">The device to build the program for</param>
+	/// <param name="vectorWidth">The number of floats per load, 4 or 8</param>
+	/// <returns>True if the kernels and scratch buffers were created successfully</returns>
+	bool Initialize(cl_context context, cl_device_id device, int vectorWidth = 4);
+
+	/// <summary>
+	/// Enqueues y = alpha * x + y.
+	/// </summary>
+	bool Axpy(cl_command_queue queue, int n, float alpha, cl_mem x, cl_mem y);
+
+	/// <summary>
+	/// Enqueues x = alpha * x.
+	/// </summary>
+	bool Scal(cl_command_queue queue, int n, float alpha, cl_mem x);
+
+	/// <summary>
+	/// Computes the dot product of x and y.
+	/// </summary>
+	bool Dot(cl_command_queue queue, int n, cl_mem x, cl_mem y, float& result);
+
+	/// <summary>
+	/// Computes the euclidean norm of x. The squares are scaled by the
+	/// largest |x| found in a first pass, so they neither overflow nor
+	/// underflow for finite vectors, at the cost of a second pass and readback.
+	/// </summary>
+	bool Nrm2(cl_command_queue queue, int n, cl_mem x, float& result);
+
+	/// <summary>
+	/// Computes the sum of the absolute values of x.
+	/// </summary>
+	bool Asum(cl_command_queue queue, int n, cl_mem x, float& result);
+
+	/// <summary>
+	/// Finds the first index of the largest absolute value of x.
+	/// Unlike the Fortran BLAS the index is 0-based.
+	/// </summary>
+	bool Iamax(cl_command_queue queue, int n, cl_mem x, int& result);
+
+	/// <summary>
+	/// Releases the scratch buffers, kernels and program.
+	/// </summary>
+	void Release();
+public:
+	int GetVectorWidth() const { return mVectorWidth; }
+private:
+	/// <summary>
+	/// Retrieves the grid-stride launch size for n elements.
+	/// </summary>
+	size_t GetGlobalSize(int n) const;
+
+	/// <summary>
+	/// Enqueues a partial sum kernel whose arguments up to the partials are
+	/// already set, followed by the final reduction, and reads the sum back.
+	/// </summary>
+	bool ReduceSum(cl_command_queue queue, cl_kernel partialKernel, cl_uint partialArg, int n, float& result);
+
+	/// <summary>
+	/// Enqueues the search of the largest |x| into the result value and its index into the result index.
+	/// </summary>
+	bool EnqueueAmax(cl_command_queue queue, int n, cl_mem x);
+
+	void ReleaseBuffers();
+private:
+	static constexpr size_t Max_Group_Size = 256;
+
+	cl_program mProgram = nullptr;
+	cl_kernel mAxpyKernel = nullptr;
+	cl_kernel mScalKernel = nullptr;
+	cl_kernel mDotKernel = nullptr;
+	cl_kernel mNrm2Kernel = nullptr;
+	cl_kernel mAsumKernel = nullptr;
+	cl_kernel mIamaxKernel = nullptr;
+	cl_kernel mReduceSumKernel = nullptr;
+	cl_kernel mReduceAmaxKernel = nullptr;
+
+	int mVectorWidth = 4;
+	size_t mGroupSize = 0;
+	size_t mMaxGroups = 0;
+
+	cl_mem mPartialValues = nullptr;
+	cl_mem mPartialIndices = nullptr;
+	cl_mem mResultValue = nullptr;
+	cl_mem mResultIndex = nullptr;
+};
@@ -0,0 +1,187 @@
+#include "Blas1Reference.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#include <immintrin.h>
+#endif
+
+namespace
+{
+	/// <summary>
+	/// Minimal wrapper over the widest available float SIMD register.
+	/// </summary>
+#if defined(__AVX__)
+	struct SimdFloat
+	{
+		static constexpr size_t Width = 8;
+		__m256 v;
+
+		static SimdFloat Load(const float* p) { return { _mm256_loadu_ps(p) }; }
+		static SimdFloat Set(float value) { return { _mm256_set1_ps(value) }; }
+		void Store(float* p) const { _mm256_storeu_ps(p, v); }
+
+		SimdFloat operator+(SimdFloat other) const { return { _mm256_add_ps(v, other.v) }; }
+		SimdFloat operator*(SimdFloat other) const { return { _mm256_mul_ps(v, other.v) }; }
+		SimdFloat Abs() const { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v) }; }
+		SimdFloat Max(SimdFloat other) const { return { _mm256_max_ps(v, other.v) }; }
+	};
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	struct SimdFloat
+	{
+		static constexpr size_t Width = 4;
+		__m128 v;
+
+		static SimdFloat Load(const float* p) { return { _mm_loadu_ps(p) }; }
+		static SimdFloat Set(float value) { return { _mm_set1_ps(value) }; }
+		void Store(float* p) const { _mm_storeu_ps(p, v); }
+
+		SimdFloat operator+(SimdFloat other) const { return { _mm_add_ps(v, other.v) }; }
+		SimdFloat operator*(SimdFloat other) const { return { _mm_mul_ps(v, other.v) }; }
+		SimdFloat Abs() const { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), v) }; }
+		SimdFloat Max(SimdFloat other) const { return { _mm_max_ps(v, other.v) }; }
+	};
+#else
+	struct SimdFloat
+	{
+		static constexpr size_t Width = 1;
+		float v;
+
+		static SimdFloat Load(const float* p) { return { *p }; }
+		static SimdFloat Set(float value) { return { value }; }
+		void Store(float* p) const { *p = v; }
+
+		SimdFloat operator+(SimdFloat other) const { return { v + other.v }; }
+		SimdFloat operator*(SimdFloat other) const { return { v * other.v }; }
+		SimdFloat Abs() const { return { std::fabs(v) }; }
+		SimdFloat Max(SimdFloat other) const { return { std::max(v, other.v) }; }
+	};
+#endif
+
+	// Elements accumulated in float lanes before being added to the double total
+	constexpr size_t Block_Size = 4096;
+
+	double HorizontalSum(SimdFloat value)
+	{
+		float lanes[SimdFloat::Width];
+		value.Store(lanes);
+
+		double sum = 0.0;
+		for (float lane : lanes)
+			sum += lane;
+		return sum;
+	}
+
+	/// <summary>
+	/// Sums transform(i) over the vector, where transform maps a SIMD chunk
+	/// at index i to its terms and scalarTransform handles the tail.
+	/// </summary>
+	template<typename Transform, typename ScalarTransform>
+	double BlockedSum(size_t n, Transform transform, ScalarTransform scalarTransform)
+	{
+		const size_t vectorEnd = n - n % SimdFloat::Width;
+
+		double total = 0.0;
+		for (size_t block = 0; block < vectorEnd; block += Block_Size)
+		{
+			const size_t blockEnd = std::min(block + Block_Size, vectorEnd);
+
+			SimdFloat acc = SimdFloat::Set(0.0f);
+			for (size_t i = block; i < blockEnd; i += SimdFloat::Width)
+				acc = acc + transform(i);
+			total += HorizontalSum(acc);
+		}
+
+		for (size_t i = vectorEnd; i < n; ++i)
+			total += scalarTransform(i);
+		return total;
+	}
+}
+
+void Blas1Reference::Axpy(size_t n, float alpha, const float* x, float* y)
+{
+	const size_t vectorEnd = n - n % SimdFloat::Width;
+	const SimdFloat a = SimdFloat::Set(alpha);
+
+	for (size_t i = 0; i < vectorEnd; i += SimdFloat::Width)
+		(a * SimdFloat::Load(x + i) + SimdFloat::Load(y + i)).Store(y + i);
+
+	for (size_t i = vectorEnd; i < n; ++i)
+		y[i] = alpha * x[i] + y[i];
+}
+
+void Blas1Reference::Scal(size_t n, float alpha, float* x)
+{
+	const size_t vectorEnd = n - n % SimdFloat::Width;
+	const SimdFloat a = SimdFloat::Set(alpha);
+
+	for (size_t i = 0; i < vectorEnd; i += SimdFloat::Width)
+		(a * SimdFloat::Load(x + i)).Store(x + i);
+
+	for (size_t i = vectorEnd; i < n; ++i)
+		x[i] *= alpha;
+}
+
+double Blas1Reference::Dot(size_t n, const float* x, const float* y)
+{
+	return BlockedSum(n,
+					  [&](size_t i) { return SimdFloat::Load(x + i) * SimdFloat::Load(y + i); },
+					  [&](size_t i) { return static_cast<double>(x[i]) * y[i]; });
+}
+
+double Blas1Reference::Nrm2(size_t n, const float* x)
+{
+	const double sumOfSquares = BlockedSum(n,
+										   [&](size_t i) { const SimdFloat v = SimdFloat::Load(x + i); return v * v; },
+										   [&](size_t i) { return static_cast<double>(x[i]) * x[i]; });
+	return std::sqrt(sumOfSquares);
+}
+
+double Blas1Reference::Asum(size_t n, const float* x)
+{
+	return BlockedSum(n,
+					  [&](size_t i) { return SimdFloat::Load(x + i).Abs(); },
+					  [&](size_t i) { return static_cast<double>(std::fabs(x[i])); });
+}
+
+size_t Blas1Reference::Iamax(size_t n, const float* x)
+{
+	const size_t vectorEnd = n - n % SimdFloat::Width;
+
+	size_t bestIndex = 0;
+	float best = -1.0f;
+
+	// Find each block's maximum with SIMD and only locate it when it beats the best so far
+	for (size_t block = 0; block < vectorEnd; block += Block_Size)
+	{
+		const size_t blockEnd = std::min(block + Block_Size, vectorEnd);
+
+		SimdFloat blockMax = SimdFloat::Set(-1.0f);
+		for (size_t i = block; i < blockEnd; i += SimdFloat::Width)
+			blockMax = blockMax.Max(SimdFloat::Load(x + i).Abs());
+
+		float lanes[SimdFloat::Width];
+		blockMax.Store(lanes);
+		const float value = *std::max_element(lanes, lanes + SimdFloat::Width);
+
+		if (value > best)
+		{
+			best = value;
+			bestIndex = block;
+			while (std::fabs(x[bestIndex]) != value)
+				++bestIndex;
+		}
+	}
+
+	for (size_t i = vectorEnd; i < n; ++i)
+	{
+		const float value = std::fabs(x[i]);
+		if (value > best)
+		{
+			best = value;
+			bestIndex = i;
+		}
+	}
+	return bestIndex;
+}
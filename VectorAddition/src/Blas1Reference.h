@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+
+/// <summary>
+/// Host BLAS level 1 routines used to verify the device results.
+/// The loops are vectorized with AVX or SSE when available, and the
+/// reductions accumulate fixed-size blocks in float lanes before adding
+/// them in double precision, keeping the reference accurate on large vectors.
+/// </summary>
+class Blas1Reference
+{
+public:
+	static void Axpy(size_t n, float alpha, const float* x, float* y);
+
+	static void Scal(size_t n, float alpha, float* x);
+
+	static double Dot(size_t n, const float* x, const float* y);
+
+	static double Nrm2(size_t n, const float* x);
+
+	static double Asum(size_t n, const float* x);
+
+	/// <summary>
+	/// Finds the first index of the largest absolute value, 0-based.
+	/// </summary>
+	static size_t Iamax(size_t n, const float* x);
+};
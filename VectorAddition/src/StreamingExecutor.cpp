@@ -0,0 +1,197 @@
+#include "StreamingExecutor.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdio.h>
+
+bool StreamingExecutor::Initialize(cl_context context, cl_device_id device, size_t maxChunkBytes)
+{
+	cl_int err = -1;
+
+	mContext = context;
+	mMaxChunkBytes = maxChunkBytes;
+
+	clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &mMaxAllocSize, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &mGlobalMemSize, NULL);
+
+	for (cl_command_queue& queue : mQueues)
+	{
+		queue = clCreateCommandQueue(context, device, 0, &err);
+		if (err < 0)
+		{
+			perror("Couldn't create a streaming command queue");
+			return false;
+		}
+	}
+	return true;
+}
+
+size_t StreamingExecutor::GetChunkElements(const std::vector<size_t>& elementSizes) const
+{
+	if (elementSizes.empty())
+		return 0;
+
+	const size_t largestElement = *std::max_element(elementSizes.begin(), elementSizes.end());
+	const size_t bytesPerElement = std::accumulate(elementSizes.begin(), elementSizes.end(), size_t(0));
+
+	// Every buffer must fit in a single allocation, and both buffer sets in
+	// half of the device memory, leaving room for everything else
+	size_t chunkElements = static_cast<size_t>(mMaxAllocSize) / largestElement;
+	chunkElements = std::min<size_t>(chunkElements, static_cast<size_t>(mGlobalMemSize / 2) / (Num_Slots * bytesPerElement));
+
+	if (mMaxChunkBytes > 0)
+		chunkElements = std::min(chunkElements, mMaxChunkBytes / largestElement);
+
+	// Keep chunk boundaries aligned for vectorized kernels
+	const size_t alignment = 1024;
+	if (chunkElements > alignment)
+		chunkElements -= chunkElements % alignment;
+	return std::max<size_t>(chunkElements, 1);
+}
+
+bool StreamingExecutor::ReserveBuffers(const std::vector<size_t>& bufferBytes)
+{
+	cl_int err = -1;
+
+	if (mBufferBytes.size() != bufferBytes.size())
+	{
+		for (std::vector<cl_mem>& buffers : mBuffers)
+		{
+			for (cl_mem buffer : buffers)
+			{
+				if (buffer)
+					clReleaseMemObject(buffer);
+			}
+			buffers.assign(bufferBytes.size(), nullptr);
+		}
+		mBufferBytes.assign(bufferBytes.size(), 0);
+	}
+
+	for (size_t i = 0; i < bufferBytes.size(); ++i)
+	{
+		if (mBufferBytes[i] >= bufferBytes[i])
+			continue;
+
+		for (std::vector<cl_mem>& buffers : mBuffers)
+		{
+			if (buffers[i])
+				clReleaseMemObject(buffers[i]);
+
+			buffers[i] = clCreateBuffer(mContext, CL_MEM_READ_WRITE, bufferBytes[i], NULL, &err);
+			if (err < 0)
+			{
+				perror("Couldn't create a streaming chunk buffer");
+				buffers[i] = nullptr;
+				mBufferBytes[i] = 0;
+				return false;
+			}
+		}
+		mBufferBytes[i] = bufferBytes[i];
+	}
+	return true;
+}
+
+bool StreamingExecutor::Run(cl_kernel kernel,
+							size_t numElements,
+							const std::vector<Input>& inputs,
+							const std::vector<Output>& outputs,
+							const ArgumentSetter& setExtraArgs,
+							bool doubleBuffered)
+{
+	cl_int err = -1;
+
+	std::vector<size_t> elementSizes;
+	for (const Input& input : inputs)
+		elementSizes.push_back(input.elementSize);
+	for (const Output& output : outputs)
+		elementSizes.push_back(output.elementSize);
+
+	const size_t chunkElements = GetChunkElements(elementSizes);
+	if (chunkElements == 0 || numElements == 0)
+		return true;
+
+	std::vector<size_t> bufferBytes;
+	for (size_t elementSize : elementSizes)
+		bufferBytes.push_back(std::min(chunkElements, numElements) * elementSize);
+	if (!ReserveBuffers(bufferBytes))
+		return false;
+
+	const cl_uint numStreams = static_cast<cl_uint>(elementSizes.size());
+	const int numSlots = doubleBuffered ? Num_Slots : 1;
+
+	// Transfers are non-blocking, each in-order queue serializes the reuse of its own buffer set
+	size_t chunkIndex = 0;
+	for (size_t offset = 0; offset < numElements; offset += chunkElements, ++chunkIndex)
+	{
+		const size_t count = std::min(chunkElements, numElements - offset);
+		const int slot = static_cast<int>(chunkIndex % numSlots);
+		cl_command_queue queue = mQueues[slot];
+		const std::vector<cl_mem>& buffers = mBuffers[slot];
+
+		for (size_t i = 0; i < inputs.size(); ++i)
+		{
+			const char* source = static_cast<const char*>(inputs[i].data) + offset * inputs[i].elementSize;
+			err = clEnqueueWriteBuffer(queue, buffers[i], CL_FALSE, 0, count * inputs[i].elementSize, source, 0, NULL, NULL);
+			if (err < 0)
+			{
+				perror("Couldn't write a streaming chunk");
+				return false;
+			}
+		}
+
+		err = CL_SUCCESS;
+		for (cl_uint arg = 0; arg < numStreams; ++arg)
+			err |= clSetKernelArg(kernel, arg, sizeof(cl_mem), &buffers[arg]);
+		if (err < 0 || (setExtraArgs && !setExtraArgs(kernel, numStreams, offset, count)))
+		{
+			perror("Couldn't create a streaming kernel argument");
+			return false;
+		}
+
+		err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &count, NULL, 0, NULL, NULL);
+		if (err < 0)
+		{
+			perror("Couldn't enqueue the streaming kernel");
+			return false;
+		}
+
+		for (size_t i = 0; i < outputs.size(); ++i)
+		{
+			char* destination = static_cast<char*>(outputs[i].data) + offset * outputs[i].elementSize;
+			err = clEnqueueReadBuffer(queue, buffers[inputs.size() + i], CL_FALSE, 0, count * outputs[i].elementSize, destination, 0, NULL, NULL);
+			if (err < 0)
+			{
+				perror("Couldn't read a streaming chunk");
+				return false;
+			}
+		}
+
+		// Submit now so the other queue's chunk can run alongside
+		clFlush(queue);
+	}
+
+	for (cl_command_queue queue : mQueues)
+		clFinish(queue);
+	return true;
+}
+
+void StreamingExecutor::Release()
+{
+	for (std::vector<cl_mem>& buffers : mBuffers)
+	{
+		for (cl_mem buffer : buffers)
+		{
+			if (buffer)
+				clReleaseMemObject(buffer);
+		}
+		buffers.clear();
+	}
+	mBufferBytes.clear();
+
+	for (cl_command_queue& queue : mQueues)
+	{
+		if (queue)
+			clReleaseCommandQueue(queue);
+		queue = nullptr;
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Cl/cl.h"
+
+#include <functional>
+#include <vector>
+
+/// <summary>
+/// Runs elementwise kernels over host arrays of any size by streaming them
+/// through the device in chunks. Chunk sizes are derived from the device
+/// allocation and memory limits, and consecutive chunks alternate between
+/// two buffer sets on two in-order queues so the transfers of one chunk
+/// overlap the kernel of the other.
+/// </summary>
+class StreamingExecutor
+{
+public:
+	/// <summary>
+	/// A host array read by the kernel.
+	/// </summary>
+	struct Input
+	{
+		const void* data;
+		size_t elementSize;
+	};
+
+	/// <summary>
+	/// A host array written by the kernel.
+	/// </summary>
+	struct Output
+	{
+		void* data;
+		size_t elementSize;
+	};
+
+	/// <summary>
+	/// Sets any kernel arguments after the streamed buffers.
+	/// Receives the kernel, the index of the first free argument, the offset
+	/// of the chunk's first element and the number of elements in the chunk.
+	/// </summary>
+	using ArgumentSetter = std::function<bool(cl_kernel, cl_uint, size_t, size_t)>;
+public:
+	/// <summary>
+	/// Queries the device limits and creates the command queues.
+	/// </summary>
+	/// <param name="context">The OpenCL context</param>
+	/// <param name="device">The device to stream to</param>
+	/// <param name="maxChunkBytes">Optional cap on the bytes per buffer per chunk, 0 for the device limit</param>
+	/// <returns>True if the queues were created successfully</returns>
+	bool Initialize(cl_context context, cl_device_id device, size_t maxChunkBytes = 0);
+
+	/// <summary>
+	/// Streams the inputs through the kernel into the outputs and waits for completion.
+	/// The kernel takes the input buffers, then the output buffers, then the
+	/// arguments set by setExtraArgs, and is launched with one work-item per element.
+	/// </summary>
+	/// <param name="kernel">The elementwise kernel</param>
+	/// <param name="numElements">The number of elements in every array</param>
+	/// <param name="inputs">The host arrays read by the kernel</param>
+	/// <param name="outputs">The host arrays written by the kernel</param>
+	/// <param name="setExtraArgs">Optional setter for the remaining kernel arguments</param>
+	/// <param name="doubleBuffered">False to process chunks one after another, for comparison</param>
+	/// <returns>True if every chunk was processed successfully</returns>
+	bool Run(cl_kernel kernel,
+			 size_t numElements,
+			 const std::vector<Input>& inputs,
+			 const std::vector<Output>& outputs,
+			 const ArgumentSetter& setExtraArgs = nullptr,
+			 bool doubleBuffered = true);
+
+	/// <summary>
+	/// Releases the chunk buffers and command queues.
+	/// </summary>
+	void Release();
+public:
+	/// <summary>
+	/// Retrieves the number of elements per chunk for arrays of the given element sizes.
+	/// </summary>
+	size_t GetChunkElements(const std::vector<size_t>& elementSizes) const;
+private:
+	/// <summary>
+	/// Ensures every buffer of both sets holds at least the given number of bytes.
+	/// </summary>
+	bool ReserveBuffers(const std::vector<size_t>& bufferBytes);
+private:
+	static constexpr int Num_Slots = 2;
+
+	cl_context mContext = nullptr;
+	cl_command_queue mQueues[Num_Slots] = {};
+
+	cl_ulong mMaxAllocSize = 0;
+	cl_ulong mGlobalMemSize = 0;
+	size_t mMaxChunkBytes = 0;
+
+	// One set of device buffers per slot, inputs followed by outputs
+	std::vector<cl_mem> mBuffers[Num_Slots];
+	std::vector<size_t> mBufferBytes;
+};
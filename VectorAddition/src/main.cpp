@@ -1,9 +1,23 @@
 #include "OpenCLUtils.h"
+#include "Timer.h"
+
+#include "Blas1.h"
+#include "Blas1Reference.h"
+#include "StreamingExecutor.h"
+#include "RadixSort.h"
+#include "Scan.h"
+#include "Reduce.h"
 
 #include "Cl/cl.h"
 
 #include <vector>
 #include <string>
+#include <random>
+#include <cmath>
+#include <functional>
+#include <algorithm>
+#include <numeric>
+#include <type_traits>
 
 cl_device_id device = nullptr;
 cl_context context = nullptr;
@@ -12,6 +26,16 @@ cl_kernel kernel = nullptr;
 cl_command_queue queue = nullptr;
 cl_int err = -1;
 
+// float4 and float8 builds of the BLAS-1 kernels
+Blas1 blas1Vec4;
+Blas1 blas1Vec8;
+
+StreamingExecutor streamer;
+
+RadixSort radixSort;
+Scan scan;
+Reduce reduce;
+
 bool VectorAdd(size_t local_size,
                std::vector<float>& vectorA,
                std::vector<float>& vectorB,
@@ -32,7 +56,7 @@ bool VectorAdd(size_t local_size,
 
     /* Create kernel arguments */
     err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &inputA); // <=====INPUT
-    err = clSetKernelArg(kernel, 1, sizeof(cl_mem), &inputB); // <=====INPUT
+    err |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &inputB); // <=====INPUT
     err |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &output_buffer); // <=====OUTPUT
     if (err < 0)
     {
@@ -72,13 +96,483 @@ bool VectorAdd(size_t local_size,
         return false;
     }
 
-	clReleaseKernel(kernel);
 	clReleaseMemObject(inputA);
 	clReleaseMemObject(inputB);
 	clReleaseMemObject(output_buffer);
     return true;
 }
 
+bool StreamVectorAdd(const std::vector<float>& vectorA,
+                     const std::vector<float>& vectorB,
+                     std::vector<float>& output,
+                     StreamingExecutor& executor,
+                     bool doubleBuffered = true)
+{
+    if (vectorA.size() != vectorB.size() || output.size() != vectorA.size())
+    {
+        printf("Invalid Input Sizes!");
+        return false;
+    }
+
+    // vectors_add takes (a, b, result), which matches the executor's inputs-then-outputs layout
+    return executor.Run(kernel,
+                        vectorA.size(),
+                        { { vectorA.data(), sizeof(float) }, { vectorB.data(), sizeof(float) } },
+                        { { output.data(), sizeof(float) } },
+                        nullptr,
+                        doubleBuffered);
+}
+
+bool BenchmarkStreaming(size_t numValues)
+{
+	const size_t Chunk_Caps[] = { 16 << 20, 64 << 20, 0 };
+
+	std::vector<float> vectorA(numValues);
+	std::vector<float> vectorB(numValues);
+	std::vector<float> output(numValues);
+	for (size_t i = 0; i < numValues; ++i)
+	{
+		vectorA[i] = static_cast<float>(i % 1000);
+		vectorB[i] = static_cast<float>(i % 7);
+	}
+
+	// Two reads and one write per element, all crossing the bus
+	const double gigabytes = 3.0 * numValues * sizeof(float) / 1e9;
+
+	for (size_t chunkCap : Chunk_Caps)
+	{
+		StreamingExecutor executor;
+		if (!executor.Initialize(context, device, chunkCap))
+			return false;
+
+		const size_t chunkElements = executor.GetChunkElements({ sizeof(float), sizeof(float), sizeof(float) });
+
+		for (bool doubleBuffered : { false, true })
+		{
+			std::fill(output.begin(), output.end(), 0.0f);
+
+			Timer timer(true);
+			if (!StreamVectorAdd(vectorA, vectorB, output, executor, doubleBuffered))
+				return false;
+			const double elapsed_ms = timer.Stop_ms();
+
+			bool correct = true;
+			for (size_t i = 0; i < numValues && correct; ++i)
+				correct = (output[i] == vectorA[i] + vectorB[i]);
+
+			printf("chunk %10zu elements  %-15s %10.3f ms  %7.2f GB/s  %s\n",
+				   std::min(chunkElements, numValues),
+				   doubleBuffered ? "double buffered" : "serial",
+				   elapsed_ms,
+				   gigabytes / (elapsed_ms / 1000.0),
+				   correct ? "Correct" : "Mismatch!");
+		}
+
+		executor.Release();
+	}
+	return true;
+}
+
+bool BenchmarkBlas1()
+{
+	const int Iterations = 10;
+	const size_t Sizes[] = { 1 << 20, 1 << 22, 1 << 24, 1 << 26, 1 << 28 };
+
+	cl_ulong maxAllocSize = 0;
+	cl_ulong globalMemSize = 0;
+	clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &maxAllocSize, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &globalMemSize, NULL);
+
+	std::mt19937 generator(1);
+	std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+
+	const auto RelativeError = [](double value, double expected)
+	{
+		return std::abs(value - expected) / std::max(1e-30, std::abs(expected));
+	};
+
+	printf("%-6s %6s %12s  %10s %10s  %s\n", "op", "width", "n", "ms", "GB/s", "error");
+
+	for (size_t n : Sizes)
+	{
+		const size_t dataSize = n * sizeof(float);
+		if (dataSize > maxAllocSize || 2 * dataSize > globalMemSize)
+		{
+			printf("Skipping %zu elements, the vectors don't fit in device memory\n", n);
+			continue;
+		}
+
+		std::vector<float> x(n);
+		std::vector<float> y(n);
+		for (float& value : x)
+			value = distribution(generator);
+		for (float& value : y)
+			value = distribution(generator);
+
+		const float alpha = 0.5f;
+
+		// Host references
+		std::vector<float> axpyExpected = y;
+		Blas1Reference::Axpy(n, alpha, x.data(), axpyExpected.data());
+		std::vector<float> scalExpected = y;
+		Blas1Reference::Scal(n, alpha, scalExpected.data());
+		const double dotExpected = Blas1Reference::Dot(n, x.data(), y.data());
+		const double nrm2Expected = Blas1Reference::Nrm2(n, x.data());
+		const double asumExpected = Blas1Reference::Asum(n, x.data());
+		const size_t iamaxExpected = Blas1Reference::Iamax(n, x.data());
+
+		cl_mem x_buffer = OpenCLUtils::create_input_buffer(context, x.data(), dataSize);
+		cl_mem y_buffer = clCreateBuffer(context, CL_MEM_READ_WRITE, dataSize, NULL, &err);
+		if (!x_buffer || err < 0)
+		{
+			perror("Couldn't create the benchmark buffers");
+			return false;
+		}
+
+		std::vector<float> result(n);
+
+		const auto ResetY = [&]()
+		{
+			return clEnqueueWriteBuffer(queue, y_buffer, CL_TRUE, 0, dataSize, y.data(), 0, NULL, NULL) == CL_SUCCESS;
+		};
+
+		const auto MaxElementError = [&](const std::vector<float>& expected)
+		{
+			clEnqueueReadBuffer(queue, y_buffer, CL_TRUE, 0, dataSize, result.data(), 0, NULL, NULL);
+
+			double maxError = 0.0;
+			for (size_t i = 0; i < n; ++i)
+				maxError = std::max(maxError, static_cast<double>(std::abs(result[i] - expected[i])));
+			return maxError;
+		};
+
+		const auto TimeRuns = [&](const std::function<bool()>& run)
+		{
+			Timer timer(true);
+			for (int i = 0; i < Iterations; ++i)
+			{
+				if (!run())
+					return -1.0;
+			}
+			clFinish(queue);
+			return timer.Stop_ms() / Iterations;
+		};
+
+		const auto Report = [&](const char* op, int width, double elapsed_ms, double bytes, double error)
+		{
+			printf("%-6s %6d %12zu  %10.3f %10.2f  %.2e\n", op, width, n, elapsed_ms, bytes / 1e9 / (elapsed_ms / 1000.0), error);
+		};
+
+		for (Blas1* blas : { &blas1Vec4, &blas1Vec8 })
+		{
+			const int width = blas->GetVectorWidth();
+			const int count = static_cast<int>(n);
+
+			// axpy: read x and y, write y
+			if (!ResetY() || !blas->Axpy(queue, count, alpha, x_buffer, y_buffer))
+				return false;
+			const double axpyError = MaxElementError(axpyExpected);
+			const double axpy_ms = TimeRuns([&]() { return blas->Axpy(queue, count, alpha, x_buffer, y_buffer); });
+			Report("axpy", width, axpy_ms, 3.0 * dataSize, axpyError);
+
+			// scal: read and write y
+			if (!ResetY() || !blas->Scal(queue, count, alpha, y_buffer))
+				return false;
+			const double scalError = MaxElementError(scalExpected);
+			const double scal_ms = TimeRuns([&]() { return blas->Scal(queue, count, 1.0f, y_buffer); });
+			Report("scal", width, scal_ms, 2.0 * dataSize, scalError);
+
+			if (!ResetY())
+				return false;
+
+			float dot = 0.0f, nrm2 = 0.0f, asum = 0.0f;
+			int iamax = -1;
+
+			const double dot_ms = TimeRuns([&]() { return blas->Dot(queue, count, x_buffer, y_buffer, dot); });
+			Report("dot", width, dot_ms, 2.0 * dataSize, RelativeError(dot, dotExpected));
+
+			const double nrm2_ms = TimeRuns([&]() { return blas->Nrm2(queue, count, x_buffer, nrm2); });
+			// The scaled norm reads x twice, once for the scale and once for the squares
+			Report("nrm2", width, nrm2_ms, 2.0 * dataSize, RelativeError(nrm2, nrm2Expected));
+
+			const double asum_ms = TimeRuns([&]() { return blas->Asum(queue, count, x_buffer, asum); });
+			Report("asum", width, asum_ms, static_cast<double>(dataSize), RelativeError(asum, asumExpected));
+
+			const double iamax_ms = TimeRuns([&]() { return blas->Iamax(queue, count, x_buffer, iamax); });
+			Report("iamax", width, iamax_ms, static_cast<double>(dataSize), static_cast<size_t>(iamax) == iamaxExpected ? 0.0 : 1.0);
+
+			if (axpy_ms < 0.0 || scal_ms < 0.0 || dot_ms < 0.0 || nrm2_ms < 0.0 || asum_ms < 0.0 || iamax_ms < 0.0)
+				return false;
+		}
+
+		clReleaseMemObject(x_buffer);
+		clReleaseMemObject(y_buffer);
+	}
+	return true;
+}
+
+bool BenchmarkRadixSort()
+{
+	const int Iterations = 5;
+
+	cl_ulong maxAllocSize = 0;
+	cl_ulong globalMemSize = 0;
+	clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &maxAllocSize, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &globalMemSize, NULL);
+
+	std::mt19937 generator(1);
+
+	printf("%12s  %10s %12s  %10s %12s  %s\n", "n", "radix ms", "Mkeys/s", "std ms", "Mkeys/s", "result");
+
+	for (size_t n = 1 << 10; n <= (size_t(1) << 26); n *= 4)
+	{
+		// Keys and values, their originals and the sort's scratch copies
+		const size_t dataSize = n * sizeof(cl_uint);
+		if (dataSize > maxAllocSize || 6 * dataSize > globalMemSize)
+		{
+			printf("Skipping %zu keys, the buffers don't fit in device memory\n", n);
+			continue;
+		}
+
+		std::vector<cl_uint> keys(n);
+		std::vector<cl_uint> values(n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			keys[i] = static_cast<cl_uint>(generator());
+			values[i] = static_cast<cl_uint>(i);
+		}
+
+		cl_mem originalKeys = OpenCLUtils::create_input_buffer(context, keys.data(), dataSize);
+		cl_mem originalValues = OpenCLUtils::create_input_buffer(context, values.data(), dataSize);
+		cl_mem keysBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, dataSize, NULL, &err);
+		cl_mem valuesBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, dataSize, NULL, &err);
+		if (!originalKeys || !originalValues || err < 0)
+		{
+			perror("Couldn't create the sort buffers");
+			return false;
+		}
+
+		const int count = static_cast<int>(n);
+
+		// Every run sorts a fresh copy, only the sort itself is timed
+		double radix_ms = 0.0;
+		for (int i = -1; i < Iterations; ++i)
+		{
+			err = clEnqueueCopyBuffer(queue, originalKeys, keysBuffer, 0, 0, dataSize, 0, NULL, NULL);
+			err |= clEnqueueCopyBuffer(queue, originalValues, valuesBuffer, 0, 0, dataSize, 0, NULL, NULL);
+			clFinish(queue);
+			if (err < 0)
+			{
+				perror("Couldn't reset the sort buffers");
+				return false;
+			}
+
+			Timer timer(true);
+			if (!radixSort.Sort(queue, keysBuffer, valuesBuffer, count))
+				return false;
+			clFinish(queue);
+
+			// The first run is a warm-up
+			if (i >= 0)
+				radix_ms += timer.Stop_ms();
+		}
+		radix_ms /= Iterations;
+
+		std::vector<cl_uint> sortedKeys(n);
+		std::vector<cl_uint> sortedValues(n);
+		clEnqueueReadBuffer(queue, keysBuffer, CL_TRUE, 0, dataSize, sortedKeys.data(), 0, NULL, NULL);
+		clEnqueueReadBuffer(queue, valuesBuffer, CL_TRUE, 0, dataSize, sortedValues.data(), 0, NULL, NULL);
+
+		std::vector<cl_uint> expected = keys;
+		Timer timer(true);
+		std::sort(expected.begin(), expected.end());
+		const double std_ms = timer.Stop_ms();
+
+		// The keys must match std::sort, every value must still belong to its key
+		// and equal keys must keep their input order
+		bool correct = (sortedKeys == expected);
+		for (size_t i = 0; i < n && correct; ++i)
+		{
+			correct = (keys[sortedValues[i]] == sortedKeys[i]);
+			if (i > 0 && sortedKeys[i] == sortedKeys[i - 1])
+				correct &= (sortedValues[i] > sortedValues[i - 1]);
+		}
+
+		printf("%12zu  %10.3f %12.1f  %10.3f %12.1f  %s\n",
+			   n,
+			   radix_ms,
+			   n / 1e3 / radix_ms,
+			   std_ms,
+			   n / 1e3 / std_ms,
+			   correct ? "Correct" : "Mismatch!");
+
+		for (cl_mem buffer : { originalKeys, originalValues, keysBuffer, valuesBuffer })
+			clReleaseMemObject(buffer);
+	}
+	return true;
+}
+
+/// <summary>
+/// Times the exclusive and inclusive scans and every reduction of one element type,
+/// comparing each result with a host reference computed in double precision.
+/// </summary>
+template<typename T>
+bool BenchmarkScanReduceType(ElementType type, const char* typeName, size_t n, std::mt19937& generator)
+{
+	const int Iterations = 10;
+
+	// Small values keep the int and uint sums clear of overflow
+	std::vector<T> values(n);
+	for (T& value : values)
+	{
+		if constexpr (std::is_floating_point_v<T>)
+			value = std::uniform_real_distribution<T>(0.0f, 1.0f)(generator);
+		else
+			value = static_cast<T>(std::uniform_int_distribution<int>(std::is_signed_v<T> ? -100 : 0, 100)(generator));
+	}
+
+	const size_t dataSize = n * sizeof(T);
+	const int count = static_cast<int>(n);
+
+	cl_mem inputBuffer = OpenCLUtils::create_input_buffer(context, values.data(), dataSize);
+	cl_mem outputBuffer = clCreateBuffer(context, CL_MEM_READ_WRITE, dataSize, NULL, &err);
+	if (!inputBuffer || err < 0)
+	{
+		perror("Couldn't create the scan buffers");
+		return false;
+	}
+
+	const auto TimeRuns = [&](const std::function<bool()>& run)
+	{
+		// Warm-up
+		if (!run())
+			return -1.0;
+		clFinish(queue);
+
+		Timer timer(true);
+		for (int i = 0; i < Iterations; ++i)
+		{
+			if (!run())
+				return -1.0;
+		}
+		clFinish(queue);
+		return timer.Stop_ms() / Iterations;
+	};
+
+	const auto Report = [&](const char* op, double elapsed_ms, double bytes, double error)
+	{
+		printf("%-10s %-6s %12zu  %10.3f %10.2f  %.2e\n", op, typeName, n, elapsed_ms, bytes / 1e9 / (elapsed_ms / 1000.0), error);
+	};
+
+	const auto RelativeError = [](double value, double expected)
+	{
+		return std::abs(value - expected) / std::max(1.0, std::abs(expected));
+	};
+
+	// Scans, read the input and write the output
+	std::vector<T> result(n);
+	for (bool inclusive : { false, true })
+	{
+		const double elapsed_ms = TimeRuns([&]()
+		{
+			return inclusive ? scan.Inclusive(queue, type, inputBuffer, count, outputBuffer)
+							 : scan.Exclusive(queue, type, inputBuffer, count, outputBuffer);
+		});
+		if (elapsed_ms < 0.0)
+			return false;
+
+		clEnqueueReadBuffer(queue, outputBuffer, CL_TRUE, 0, dataSize, result.data(), 0, NULL, NULL);
+
+		double expected = 0.0;
+		double maxError = 0.0;
+		for (size_t i = 0; i < n; ++i)
+		{
+			if (inclusive)
+				expected += values[i];
+			maxError = std::max(maxError, RelativeError(result[i], expected));
+			if (!inclusive)
+				expected += values[i];
+		}
+		Report(inclusive ? "inclusive" : "exclusive", elapsed_ms, 2.0 * dataSize, maxError);
+	}
+
+	// Reductions, read the input once
+	const double sumExpected = std::accumulate(values.begin(), values.end(), 0.0);
+	const T minExpected = *std::min_element(values.begin(), values.end());
+	const T maxExpected = *std::max_element(values.begin(), values.end());
+	const size_t argMaxExpected = std::max_element(values.begin(), values.end()) - values.begin();
+
+	const std::pair<ReduceOp, const char*> ops[] =
+	{
+		{ ReduceOp::Sum, "sum" },
+		{ ReduceOp::Min, "min" },
+		{ ReduceOp::Max, "max" },
+		{ ReduceOp::ArgMax, "argmax" }
+	};
+
+	for (const auto& [op, name] : ops)
+	{
+		// T for the values, cl_int for the argmax index
+		union { T value; cl_int index; } reduced = {};
+
+		const double elapsed_ms = TimeRuns([&]() { return reduce.Run(queue, op, type, inputBuffer, count, &reduced); });
+		if (elapsed_ms < 0.0)
+			return false;
+
+		double error = 0.0;
+		switch (op)
+		{
+		case ReduceOp::Sum:
+			error = RelativeError(reduced.value, sumExpected);
+			break;
+		case ReduceOp::Min:
+			error = (reduced.value == minExpected) ? 0.0 : 1.0;
+			break;
+		case ReduceOp::Max:
+			error = (reduced.value == maxExpected) ? 0.0 : 1.0;
+			break;
+		case ReduceOp::ArgMax:
+			error = (static_cast<size_t>(reduced.index) == argMaxExpected) ? 0.0 : 1.0;
+			break;
+		}
+		Report(name, elapsed_ms, static_cast<double>(dataSize), error);
+	}
+
+	clReleaseMemObject(inputBuffer);
+	clReleaseMemObject(outputBuffer);
+	return true;
+}
+
+bool BenchmarkScanReduce()
+{
+	const size_t Sizes[] = { 1 << 16, 1 << 20, 1 << 24, 1 << 26 };
+
+	cl_ulong maxAllocSize = 0;
+	cl_ulong globalMemSize = 0;
+	clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &maxAllocSize, NULL);
+	clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &globalMemSize, NULL);
+
+	std::mt19937 generator(1);
+
+	printf("%-10s %-6s %12s  %10s %10s  %s\n", "op", "type", "n", "ms", "GB/s", "error");
+
+	for (size_t n : Sizes)
+	{
+		const size_t dataSize = n * sizeof(cl_uint);
+		if (dataSize > maxAllocSize || 2 * dataSize > globalMemSize)
+		{
+			printf("Skipping %zu elements, the arrays don't fit in device memory\n", n);
+			continue;
+		}
+
+		if (!BenchmarkScanReduceType<cl_int>(ElementType::Int, "int", n, generator) ||
+			!BenchmarkScanReduceType<cl_uint>(ElementType::UInt, "uint", n, generator) ||
+			!BenchmarkScanReduceType<cl_float>(ElementType::Float, "float", n, generator))
+			return false;
+	}
+	return true;
+}
+
 bool InitializeDeviceAndContext()
 {
 	device = OpenCLUtils::create_device();
@@ -116,6 +610,18 @@ bool InitializeProgram()
 		perror("Couldn't create a kernel");
 		return false;
 	};
+
+	if (!blas1Vec4.Initialize(context, device, 4) || !blas1Vec8.Initialize(context, device, 8))
+		return false;
+
+	if (!streamer.Initialize(context, device))
+		return false;
+
+	if (!radixSort.Initialize(context, device))
+		return false;
+
+	if (!scan.Initialize(context, device) || !reduce.Initialize(context, device))
+		return false;
     return true;
 }
 
@@ -130,13 +636,52 @@ int main()
     if (!InitializeProgram())
         return -1;
 
+	const bool RunBenchmark = false;
+	const bool RunStreamingBenchmark = false;
+	const bool RunSortBenchmark = false;
+	const bool RunScanBenchmark = false;
+	const bool UseStreaming = false;
+
+	if (RunBenchmark)
+	{
+		if (!BenchmarkBlas1())
+			return -1;
+	}
+
+	if (RunStreamingBenchmark)
+	{
+		// 1 GiB per vector, raise past CL_DEVICE_MAX_MEM_ALLOC_SIZE to exercise true out-of-core streaming
+		if (!BenchmarkStreaming(size_t(1) << 28))
+			return -1;
+	}
+
+	if (RunSortBenchmark)
+	{
+		if (!BenchmarkRadixSort())
+			return -1;
+	}
+
+	if (RunScanBenchmark)
+	{
+		if (!BenchmarkScanReduce())
+			return -1;
+	}
+
     std::vector<float> vectorA(numValues, 1.0f);
     std::vector<float> vectorB(numValues, 2.0f);
 
     std::vector<float> output(numValues, 0.0f);
 
-    if (!VectorAdd(local_size, vectorA, vectorB, output))
-        return -1;
+    if (UseStreaming)
+    {
+        if (!StreamVectorAdd(vectorA, vectorB, output, streamer))
+            return -1;
+    }
+    else
+    {
+        if (!VectorAdd(local_size, vectorA, vectorB, output))
+            return -1;
+    }
 
     /// Check Results ---------------------------------------------------------
 
@@ -169,6 +714,13 @@ int main()
     
     ///* Deallocate resources */
     
+	blas1Vec4.Release();
+	blas1Vec8.Release();
+	streamer.Release();
+	radixSort.Release();
+	scan.Release();
+	reduce.Release();
+	clReleaseKernel(kernel);
     clReleaseCommandQueue(queue);
     clReleaseProgram(program);
     clReleaseContext(context);